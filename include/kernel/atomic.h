@@ -43,6 +43,57 @@ static inline uint32_t atomic_load(volatile uint32_t *ptr) {
     return value;
 }
 
+static inline uint64_t atomic_compare_and_swap64(volatile uint64_t *ptr, uint64_t expected, uint64_t desired) {
+    uint64_t prev;
+    __asm__ volatile(
+        "lock cmpxchgq %2, %1"
+        : "=a"(prev), "+m"(*ptr)
+        : "r"(desired), "0"(expected)
+        : "memory"
+    );
+    return prev;
+}
+
+static inline uint64_t atomic_exchange64(volatile uint64_t *ptr, uint64_t value) {
+    __asm__ volatile(
+        "xchgq %0, %1"
+        : "+r"(value), "+m"(*ptr)
+        :
+        : "memory"
+    );
+    return value;
+}
+
+static inline uint64_t atomic_load64(volatile uint64_t *ptr) {
+    uint64_t value;
+    __asm__ volatile(
+        "movq %1, %0"
+        : "=r"(value)
+        : "m"(*ptr)
+        : "memory"
+    );
+    return value;
+}
+
+// 128-bit compare-and-swap on a 16-byte aligned {low, high} pair. Returns 1
+// if the swap happened; otherwise loads the current pair into expected[].
+static inline int atomic_compare_and_swap128(volatile uint64_t *ptr, uint64_t expected[2],
+                                             uint64_t desired_lo, uint64_t desired_hi) {
+    uint64_t lo = expected[0];
+    uint64_t hi = expected[1];
+    uint8_t swapped;
+    __asm__ volatile(
+        "lock cmpxchg16b %1\n\t"
+        "setz %0"
+        : "=q"(swapped), "+m"(*ptr), "+a"(lo), "+d"(hi)
+        : "b"(desired_lo), "c"(desired_hi)
+        : "memory", "cc"
+    );
+    expected[0] = lo;
+    expected[1] = hi;
+    return swapped;
+}
+
 static inline void memory_barrier(void) {
     __asm__ volatile("mfence" ::: "memory");
 }
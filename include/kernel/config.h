@@ -81,6 +81,58 @@
  */
 #define DEBUG_PAGE_CACHE 1
 
+/**
+ * DEBUG_VMALLOC - vmalloc debug logging
+ * 
+ * Logs:
+ * - Area allocation and free operations
+ * - Lazy TLB purges
+ */
+#define DEBUG_VMALLOC 1
+
+/**
+ * DEBUG_KSM - Same-page merging debug logging
+ * 
+ * Logs:
+ * - Range registration
+ * - Merges into shared frames and the zero page
+ */
+#define DEBUG_KSM 1
+
+/**
+ * DEBUG_RMAP - Reverse mapping debug logging
+ * 
+ * Logs:
+ * - Allocation failures while tracking frames or linking clones
+ */
+#define DEBUG_RMAP 1
+
+// ============================================================================
+// Feature Switches
+// ============================================================================
+
+/**
+ * ALLOC_PROFILE - Allocation-site profiler (see mm/alloc_profile.h)
+ * 
+ * Off by default: the hooks compile out entirely. Build with
+ * `make ALLOC_PROFILE=1` to compile them into kmalloc, slab and buddy and
+ * keep frame pointers for the stack walk. The profiler still starts
+ * disabled; until alloc_profile_enable() is called each hook costs one
+ * predicted-not-taken branch.
+ */
+#ifndef ALLOC_PROFILE
+#define ALLOC_PROFILE 0
+#endif
+
+/**
+ * KMALLOC_BOOT_CLASSES - Extra kmalloc size classes created at boot
+ * 
+ * Zero-terminated list of object sizes (multiples of 8, at most 2048)
+ * that get their own slab cache next to the static classes. Paste the
+ * output of kmalloc_print_profile() from a profiled run here.
+ */
+#define KMALLOC_BOOT_CLASSES { 0 }
+
 // ============================================================================
 // Debug Print Macro
 // ============================================================================
@@ -95,7 +147,7 @@
  * 
  * This will only print if DEBUG_BUDDY is enabled.
  * 
- * @param module Module name (BUDDY, SLAB, COW, DEMAND_PAGING, PAGE_CACHE)
+ * @param module Module name (BUDDY, SLAB, COW, DEMAND_PAGING, PAGE_CACHE, VMALLOC, KSM, RMAP)
  * @param ... Printf-style format string and arguments
  */
 #define DEBUG_PRINT(module, ...) \
@@ -0,0 +1,32 @@
+#pragma once
+#include "types.h"
+
+/**
+ * Per-CPU Data
+ *
+ * Each CPU owns a cpu_local_t whose address is loaded into the GS_BASE MSR
+ * by cpu_local_init(), so the current CPU's id is a single %gs-relative
+ * load with no locking or APIC access. cpu_local_init() must run on every
+ * CPU after its GDT has been loaded (reloading %gs clears GS_BASE).
+ *
+ * Only the boot CPU is brought up today; it runs as CPU 0.
+ */
+#define MAX_CPUS 8
+
+#define MSR_GS_BASE 0xC0000101
+
+typedef struct cpu_local {
+    struct cpu_local *self;      // Must stay first: %gs:0
+    uint32_t id;                 // Must stay at %gs:8
+    uint32_t online;
+} cpu_local_t;
+
+void cpu_local_init(uint32_t cpu_id);
+cpu_local_t *cpu_local(uint32_t cpu_id);
+uint32_t cpu_online_count(void);
+
+static inline uint32_t cpu_current_id(void) {
+    uint32_t id;
+    __asm__ volatile("movl %%gs:8, %0" : "=r"(id));
+    return id;
+}
@@ -1,55 +1,159 @@
 #pragma once
 #include "types.h"
+#include "cpu.h"
 
 /**
- * Allocation Header Structure
- * 
- * This header is prepended to every allocation made by kmalloc/kcalloc.
- * It enables:
- * - Corruption detection via magic number validation
- * - Accurate size tracking for debugging and statistics
- * - Fast determination of allocation source (slab vs heap)
- * - O(1) slab cache lookup for frees
- * 
- * Memory layout:
- *   [alloc_header_t][user data...]
- *                   ^
- *                   returned pointer
+ * kmalloc Size Classes
+ *
+ * Small allocations are served headerless from dedicated slab caches. The
+ * owning cache is found through the page descriptor of the object's slab
+ * page, so a 64-byte request occupies exactly one 64-byte slot.
+ *
+ * Classes are powers of two plus the 1.5x midpoints between them:
+ *   8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+ *
+ * Sizes up to 192 bytes are mapped through a lookup table indexed by
+ * (size - 1) / 8; larger sizes are mapped with __builtin_clzll().
+ *
+ * Whole-page requests up to the largest buddy block are taken straight
+ * from the buddy allocator, with the order kept in the page descriptor.
+ *
+ * Everything else (or slab/buddy failures) falls back to the heap, a TLSF
+ * allocator (see mm/tlsf.h) with O(1) malloc/free and immediate
+ * coalescing. Its boundary tags catch double frees and header corruption.
  */
-typedef struct alloc_header {
-    uint32_t magic;              // Magic number for validation (0xDEADBEEF)
-    uint32_t size;               // Requested size (before alignment)
-    uint16_t flags;              // Allocation source flags
-    uint8_t slab_cache_index;    // Index into slab cache array (0-7)
-    uint8_t padding;             // Padding for alignment
-} alloc_header_t;
-
-// Magic number for allocation header validation
-#define ALLOC_MAGIC 0xDEADBEEF
-
-// Allocation source flags
-#define ALLOC_FROM_SLAB 0x01    // Allocated from slab cache
-#define ALLOC_FROM_HEAP 0x02    // Allocated from heap
-
-// Slab cache index values (for ALLOC_FROM_SLAB allocations)
-#define SLAB_CACHE_16    0
-#define SLAB_CACHE_32    1
-#define SLAB_CACHE_64    2
-#define SLAB_CACHE_128   3
-#define SLAB_CACHE_256   4
-#define SLAB_CACHE_512   5
-#define SLAB_CACHE_1024  6
-#define SLAB_CACHE_2048  7
-#define SLAB_CACHE_NONE  0xFF   // Not from slab cache
+#define KMALLOC_MIN_SIZE        8
+#define KMALLOC_MAX_CACHE_SIZE  2048
+#define KMALLOC_NUM_CACHES      16
+
+/**
+ * Adaptive Size Classes
+ *
+ * Every slab-sized request is counted in a per-CPU histogram with 8-byte
+ * buckets. kmalloc_adapt_classes() uses it to add up to KMALLOC_MAX_ADAPTIVE
+ * extra caches at the sizes that remove the most rounding slack, e.g. a
+ * kmalloc-1104 cache when most requests are 1100 bytes instead of sending
+ * them to kmalloc-1536. A candidate is only created if it saves at least
+ * KMALLOC_ADAPT_MIN_SAVED bytes over the recorded requests, since a cache
+ * costs at least a page of its own.
+ *
+ * Classes can be added three ways:
+ *   - at boot from KMALLOC_BOOT_CLASSES in config.h (heap_enable_slab)
+ *   - from a saved profile with kmalloc_load_profile()
+ *   - at runtime: with heap_set_adaptive_classes(1), each CPU runs one
+ *     adaptation step every KMALLOC_ADAPT_INTERVAL slab requests
+ *
+ * kmalloc_print_profile() prints the current adaptive classes in the
+ * KMALLOC_BOOT_CLASSES format so a profiled run can seed the next boot.
+ *
+ * Adaptive classes only ever redirect new requests; objects already handed
+ * out stay in their original cache. They are destroyed only by
+ * kmalloc_reset_classes(), once all of them are empty.
+ * Once any adaptive class exists, kfree_sized() looks up the owning cache
+ * like kfree() because a size no longer identifies it.
+ */
+#define KMALLOC_MAX_ADAPTIVE      8
+#define KMALLOC_ADAPT_INTERVAL    65536      // Slab requests per CPU between steps
+#define KMALLOC_ADAPT_MIN_SAVED   4096       // Bytes
+
+typedef struct kmalloc_class_stats {
+  uint32_t adaptive_classes;   // Extra caches created so far
+  uint64_t requests;           // Slab-sized requests recorded
+  uint64_t requested_bytes;    // Bytes asked for by those requests
+  uint64_t static_waste;       // Rounding slack with the static classes only
+  uint64_t current_waste;      // Rounding slack with the current classes
+  uint64_t bytes_saved;        // static_waste - current_waste
+} kmalloc_class_stats_t;
+
+/**
+ * Heap Window
+ *
+ * The heap owns a reserved kernel virtual window. Only its first
+ * HEAP_INITIAL_SIZE bytes are backed at boot; when TLSF runs out, the heap
+ * maps another run of buddy pages at the end of the backed region and adds
+ * it as a new TLSF pool (at least grow_min bytes at a time).
+ *
+ * When the most recently added pool is entirely free, it stays mapped for
+ * shrink_delay PIT ticks and is then unmapped and its pages returned to the
+ * buddy allocator, provided at least shrink_threshold free bytes remain in
+ * the arena afterwards. The first pool of each arena is never released.
+ * A buddy shrinker releases free tail pools at once, like heap_trim(),
+ * when the buddy allocator runs out of memory.
+ *
+ * The window is split into one HEAP_ARENA_SIZE arena per CPU, each with its
+ * own TLSF instance and lock, so CPUs allocating from the heap never
+ * contend. A block freed on a CPU other than its owner is pushed onto the
+ * owner's lock-free remote list and merged back the next time the owner
+ * allocates, frees or trims. An arena that runs dry borrows from an arena
+ * holding more than shrink_threshold spare bytes before growing, and from
+ * any arena once growth fails.
+ */
+#define HEAP_VIRT_START         0xFFFFC80000000000ULL
+#define HEAP_MAX_SIZE           (8ULL << 30)         // 8 GiB window
+#define HEAP_INITIAL_SIZE       (4ULL << 20)         // 4 MiB backed at boot
+#define HEAP_ARENA_SIZE         (HEAP_MAX_SIZE / MAX_CPUS)
+#define HEAP_MAX_POOLS          32                   // Per arena
+
+#define HEAP_DEFAULT_GROW_MIN          (1ULL << 20)  // 1 MiB
+#define HEAP_DEFAULT_SHRINK_THRESHOLD  (1ULL << 20)  // 1 MiB
+#define HEAP_DEFAULT_SHRINK_DELAY      1000          // PIT ticks
+
+typedef struct heap_stats {
+  uint64_t mapped_bytes;       // Bytes currently backed by buddy pages
+  uint64_t free_bytes;         // Free bytes inside the TLSF pools
+  uint32_t pools;              // Pools currently in the heap
+  uint32_t arenas;             // Arenas with at least one pool
+  uint64_t grows;
+  uint64_t shrinks;
+  uint64_t steals;             // Blocks served from another CPU's arena
+  uint64_t remote_frees;       // Cross-CPU frees merged back by the owner
+} heap_stats_t;
 
 // Public heap interface
 void heap_init(uint64_t start, uint64_t size);
 void heap_enable_slab(void);
+
+// Growth tuning; shrink_delay is in PIT ticks
+void heap_set_growth_params(size_t grow_min, size_t shrink_threshold,
+                            uint64_t shrink_delay);
+
+// Release every fully free tail pool now, ignoring the hysteresis;
+// returns the number of bytes given back to the buddy allocator
+size_t heap_trim(void);
+void heap_get_stats(heap_stats_t *stats);
 void *kmalloc(size_t size);
 void *kcalloc(size_t num, size_t size);
 void *krealloc(void *ptr, size_t size);
 void kfree(void *ptr);
 
-// Allocation with GFP flags
+// Free when the caller knows the allocation size (skips the owner lookup)
+void kfree_sized(void *ptr, size_t size);
+
+// Adaptive size classes. kmalloc_adapt_classes() adds at most max_new
+// classes from the histogram and returns how many were created;
+// kmalloc_load_profile() creates classes for the listed sizes (zeros and
+// sizes that are already classes are skipped) and returns the count.
+void heap_set_adaptive_classes(int enable);
+uint32_t kmalloc_adapt_classes(uint32_t max_new);
+uint32_t kmalloc_load_profile(const uint16_t *sizes, uint32_t count);
+uint32_t kmalloc_export_profile(uint16_t *sizes, uint32_t max);
+void kmalloc_print_profile(void);
+void kmalloc_get_class_stats(kmalloc_class_stats_t *stats);
+void kmalloc_reset_histogram(void);
+// Drop every adaptive class and return how many there were, or -1 (and
+// change nothing) while one still has live objects. Callers must keep
+// other CPUs from allocating meanwhile.
+//
+// kfree_sized() reads the class count (acquire), the size's bucket, then
+// the count again, and only uses the bucket if both reads saw zero. Adding
+// a class stores its entry, then the count (release), then moves buckets;
+// a reset restores every bucket before storing a zero count (release).
+int kmalloc_reset_classes(void);
+
+// Usable size of an allocation (slot size for slab objects)
+size_t ksize(const void *ptr);
+
+// Allocation with GFP flags. GFP_DMA requests get whole buddy pages below
+// GFP_DMA_LIMIT whatever their size; krealloc() may move them above it.
 void *kmalloc_flags(size_t size, uint32_t flags);
 void *kcalloc_flags(size_t num, size_t size, uint32_t flags);
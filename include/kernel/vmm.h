@@ -1,14 +1,46 @@
 #pragma once
 #include "types.h"
+#include "spinlock.h"
 #define VMM_FLAG_PRESENT 0x001
 #define VMM_FLAG_WRITABLE 0x002
 #define VMM_FLAG_USER 0x004
+#define VMM_FLAG_ACCESSED 0x020
+#define VMM_FLAG_DIRTY 0x040
+#define VMM_FLAG_HUGE 0x080
 #define VMM_FLAG_NO_EXECUTE (1ULL << 63)
 typedef uint64_t page_table_t;
+struct tlb_gather;
 void vmm_init(void);
+page_table_t *vmm_get_kernel_address_space(void);
+void vmm_flush_tlb_all(void);
 page_table_t *vmm_create_address_space(void);
 void vmm_switch_address_space(page_table_t *pml4);
+// Address space loaded in CR3 on this CPU
+page_table_t *vmm_get_current_address_space(void);
 void vmm_map_page(page_table_t *pml4, uint64_t virt, uint64_t phys,
                   uint32_t flags);
 void vmm_unmap_page(page_table_t *pml4, uint64_t virt);
+// Clear the entry and queue its invalidation on tlb (see mm/tlb.h);
+// returns the frame it mapped, or 0 if nothing was mapped. With tlb NULL
+// nothing is invalidated and the caller must flush before the range is
+// reused (vmalloc's lazy purge).
+uint64_t vmm_unmap_page_deferred(page_table_t *pml4, uint64_t virt,
+                                 struct tlb_gather *tlb);
 uint64_t vmm_get_physical_address(page_table_t *pml4, uint64_t virt);
+// Pointer to the 4 KB entry for virt, or NULL if a table above it is
+// missing or virt lies in a huge page
+uint64_t *vmm_get_pte(page_table_t *pml4, uint64_t virt);
+// The PDPT or PD entry mapping virt with a 1 GiB or 2 MiB page, or 0
+uint64_t vmm_get_huge_entry(page_table_t *pml4, uint64_t virt);
+// Like vmm_get_pte(), but allocates missing tables; NULL if out of memory
+// or virt lies in a huge page.
+// Racing callers may allocate the same table, one of them wins.
+uint64_t *vmm_alloc_pte(page_table_t *pml4, uint64_t virt);
+// Lock for the entries of the page table holding pte: one per table, kept
+// in the table frame's page descriptor, so each 2 MiB span has its own
+spinlock_t *vmm_pte_lock(uint64_t *pte);
+// Call visit for every present 4 KB entry in the user half (PML4 entries
+// 0-255) in address order; stops at the first nonzero return and passes it
+// back. visit may change the entry but not the tables above it.
+typedef int (*vmm_pte_visit_t)(uint64_t virt, uint64_t *pte, void *arg);
+int vmm_walk_user_ptes(page_table_t *pml4, vmm_pte_visit_t visit, void *arg);
@@ -0,0 +1,155 @@
+#pragma once
+#include "../kernel/types.h"
+#include "../kernel/config.h"
+#include "../kernel/cpu.h"
+
+/**
+ * Allocation-Site Profiler
+ *
+ * Attributes kmalloc, slab_alloc and buddy_alloc_pages calls to the code
+ * that made them. A site is keyed on the allocator type plus the first
+ * ALLOC_PROFILE_DEPTH return addresses of a frame-pointer walk starting at
+ * the caller, so two callers of a shared helper show up separately.
+ *
+ * Per site the profiler counts allocations, frees, total bytes, live
+ * objects and live bytes, plus a histogram of alloc-to-free lifetimes.
+ * Live objects are tracked in a fixed-size table so frees can be charged
+ * back to their site; allocations that do not fit are counted as dropped.
+ *
+ * Only the outermost allocator call is recorded: a kmalloc served from a
+ * slab cache counts once, as kmalloc, and the slab or buddy calls it makes
+ * internally are not charged to kmalloc.c.
+ *
+ * Leaks and hot sites are found by comparing two snapshots:
+ *
+ *   alloc_profile_snapshot_t *a = alloc_profile_snapshot();
+ *   ... run the workload ...
+ *   alloc_profile_snapshot_t *b = alloc_profile_snapshot();
+ *   alloc_profile_print_diff(a, b, 10);
+ *
+ * The profiler starts disabled. Its tables (~0.75 MiB) are allocated with
+ * vzalloc on the first alloc_profile_enable(). While disabled, every hook
+ * is a single predicted-not-taken branch. Unless the kernel is built with
+ * `make ALLOC_PROFILE=1` the hooks compile out completely.
+ *
+ * Lifetime bucket 0 holds lifetimes below 2^10 TSC cycles; bucket i holds
+ * [2^(2i+8), 2^(2i+10)) cycles, and the last bucket is open-ended.
+ */
+#define ALLOC_PROFILE_DEPTH        4       // Return addresses per site
+#define ALLOC_PROFILE_MAX_SITES    1024
+#define ALLOC_PROFILE_MAX_LIVE     16384   // Tracked live objects
+#define ALLOC_PROFILE_HIST_BUCKETS 16
+#define ALLOC_PROFILE_MAX_FRAME    (64 * 1024)  // Largest plausible stack frame
+
+typedef enum {
+    ALLOC_PROFILE_KMALLOC = 0,
+    ALLOC_PROFILE_SLAB,
+    ALLOC_PROFILE_BUDDY,
+    ALLOC_PROFILE_TYPES
+} alloc_profile_type_t;
+
+// Sort key for alloc_profile_diff()
+typedef enum {
+    ALLOC_PROFILE_BY_LIVE_BYTES = 0,   // Leak candidates
+    ALLOC_PROFILE_BY_ALLOCS            // Hot sites
+} alloc_profile_key_t;
+
+typedef struct alloc_site {
+    uint64_t stack[ALLOC_PROFILE_DEPTH];   // Return addresses, caller first
+    uint32_t type;                         // alloc_profile_type_t
+    uint32_t id;                           // Stable until alloc_profile_reset()
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t bytes;                        // Total bytes ever requested
+    int64_t live_objects;
+    int64_t live_bytes;
+    uint64_t lifetime[ALLOC_PROFILE_HIST_BUCKETS];
+} alloc_site_t;
+
+typedef struct alloc_profile_snapshot {
+    uint32_t count;                        // Sites in use when taken
+    uint64_t taken_at;                     // TSC
+    alloc_site_t sites[ALLOC_PROFILE_MAX_SITES];
+} alloc_profile_snapshot_t;
+
+typedef struct alloc_profile_stats {
+    uint32_t sites;
+    uint32_t live_tracked;                 // Entries in the live-object table
+    uint64_t dropped;                      // Events lost to full tables
+} alloc_profile_stats_t;
+
+// Returns -1 if the tables cannot be allocated or profiling is compiled out
+int alloc_profile_enable(void);
+void alloc_profile_disable(void);
+int alloc_profile_is_enabled(void);
+
+// Forget every site and live object
+void alloc_profile_reset(void);
+void alloc_profile_get_stats(alloc_profile_stats_t *stats);
+
+alloc_profile_snapshot_t *alloc_profile_snapshot(void);
+void alloc_profile_snapshot_free(alloc_profile_snapshot_t *snap);
+
+// Fill out[] with per-site deltas (after - before) for sites whose key
+// grew, largest growth first; before may be NULL to rank absolute values.
+// Returns the number of entries written.
+uint32_t alloc_profile_diff(const alloc_profile_snapshot_t *before,
+                            const alloc_profile_snapshot_t *after,
+                            alloc_profile_key_t key, alloc_site_t *out, uint32_t max);
+
+// Print the top_n leak candidates and hottest sites between two snapshots
+void alloc_profile_print_diff(const alloc_profile_snapshot_t *before,
+                              const alloc_profile_snapshot_t *after, uint32_t top_n);
+
+// Print the top_n sites by live bytes and by allocations since the reset
+void alloc_profile_dump(uint32_t top_n);
+
+// Allocator hooks. An entry point brackets its work with enter/exit and
+// reports its result in between, passing its own frame address:
+//
+//   int prof = alloc_profile_enter();
+//   void *ptr = ...;
+//   if (prof)
+//       alloc_profile_alloc(ALLOC_PROFILE_KMALLOC, ptr, size, __builtin_frame_address(0));
+//   alloc_profile_exit(prof);
+#if ALLOC_PROFILE
+
+extern volatile uint32_t g_alloc_profile_enabled;
+extern uint32_t g_alloc_profile_depth[MAX_CPUS];
+
+static inline int alloc_profile_enter(void) {
+    if (__builtin_expect(!g_alloc_profile_enabled, 1)) {
+        return 0;
+    }
+    g_alloc_profile_depth[cpu_current_id()]++;
+    return 1;
+}
+
+static inline void alloc_profile_exit(int entered) {
+    if (entered) {
+        g_alloc_profile_depth[cpu_current_id()]--;
+    }
+}
+
+void alloc_profile_alloc(uint32_t type, uint64_t addr, size_t size, void *frame);
+void alloc_profile_free(uint64_t addr);
+
+#else
+
+static inline int alloc_profile_enter(void) {
+    return 0;
+}
+
+static inline void alloc_profile_exit(int entered) {
+    (void)entered;
+}
+
+static inline void alloc_profile_alloc(uint32_t type, uint64_t addr, size_t size, void *frame) {
+    (void)type; (void)addr; (void)size; (void)frame;
+}
+
+static inline void alloc_profile_free(uint64_t addr) {
+    (void)addr;
+}
+
+#endif
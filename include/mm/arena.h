@@ -0,0 +1,74 @@
+#pragma once
+#include "../kernel/types.h"
+
+/**
+ * Scoped Arena (Bump) Allocator
+ *
+ * For groups of short-lived objects that all die together, such as
+ * per-request scratch space or test fixtures. Memory comes from buddy
+ * chunks of 2^chunk_order pages; an allocation just bumps a pointer
+ * inside the current chunk, so objects carry no header and there is no
+ * per-object free. Everything is released at once:
+ *
+ *   mem_arena_t scratch;
+ *   arena_init(&scratch, "scratch", 0);
+ *   ... arena_alloc(&scratch, ...) as often as needed ...
+ *   arena_destroy(&scratch);
+ *
+ * arena_mark()/arena_rewind() free everything allocated after the mark,
+ * so a nested phase can give back its memory and keep the rest.
+ *
+ * A request that does not fit the current chunk starts a new chunk (a
+ * larger one if needed); the rest of the old chunk is not reused until the
+ * arena is rewound past it. One emptied chunk of the default order is kept
+ * as a spare so repeated mark/rewind cycles do not go back to buddy.
+ *
+ * An arena has no lock: it belongs to one thread of execution at a time.
+ */
+#define ARENA_NAME_MAX        32
+#define ARENA_DEFAULT_ALIGN   16
+#define ARENA_MAX_ALIGN       4096
+
+// Header at the start of every chunk
+typedef struct arena_chunk {
+    struct arena_chunk *prev;   // Chunk filled before this one
+    uint32_t order;
+    uint32_t reserved;
+} arena_chunk_t;
+
+typedef struct mem_arena {
+    char name[ARENA_NAME_MAX];
+    arena_chunk_t *current;     // Chunk being bumped (NULL until first use)
+    arena_chunk_t *spare;       // Emptied default-order chunk kept for reuse
+    uint8_t *ptr;               // Next free byte in current
+    uint8_t *end;               // End of current
+    uint32_t chunk_order;       // Default buddy order of new chunks
+    uint32_t chunks;            // Chunks in use (excluding the spare)
+    size_t allocated;           // Bytes handed out, including alignment padding
+    size_t reserved_bytes;      // Bytes in chunks in use
+    size_t peak_bytes;          // High-water mark of reserved_bytes
+} mem_arena_t;
+
+// Position returned by arena_mark()
+typedef struct arena_mark {
+    arena_chunk_t *chunk;
+    uint8_t *ptr;
+    size_t allocated;
+} arena_mark_t;
+
+// chunk_order 0 means single pages; no memory is taken until the first allocation
+void arena_init(mem_arena_t *arena, const char *name, uint32_t chunk_order);
+
+// Return every chunk to buddy; the arena can be used again afterwards
+void arena_destroy(mem_arena_t *arena);
+
+// align must be a power of two no larger than ARENA_MAX_ALIGN
+void *arena_alloc(mem_arena_t *arena, size_t size);
+void *arena_alloc_aligned(mem_arena_t *arena, size_t size, size_t align);
+void *arena_zalloc(mem_arena_t *arena, size_t size);
+
+arena_mark_t arena_mark(const mem_arena_t *arena);
+void arena_rewind(mem_arena_t *arena, arena_mark_t mark);
+
+// Rewind to empty; one default-order chunk stays behind as the spare
+void arena_reset(mem_arena_t *arena);
@@ -31,12 +31,46 @@ typedef struct buddy_zone {
 
 void buddy_init(uint64_t memory_start, uint64_t memory_size);
 uint64_t buddy_alloc_pages(uint32_t order, buddy_zone_type_t zone_type);
+
+// Allocate a block that ends at or below the physical address limit (zone
+// fallback and shrinkers as for buddy_alloc_pages). The free lists are
+// searched linearly, so this is meant for rare constrained requests.
+#define BUDDY_NO_LIMIT (~0ULL)
+uint64_t buddy_alloc_pages_below(uint32_t order, buddy_zone_type_t zone_type, uint64_t limit);
 void buddy_free_pages(uint64_t address, uint32_t order);
+
+// Allocate up to count single pages, taking each zone's lock once. Returns
+// how many were stored in pages[]; shrinkers are not run, so callers use
+// it for pages they can do without.
+uint32_t buddy_alloc_pages_bulk(uint32_t count, buddy_zone_type_t zone_type, uint64_t *pages);
+
+// Shrink an allocated block in place to new_order, freeing its upper part
+void buddy_shrink_pages(uint64_t address, uint32_t order, uint32_t new_order);
 uint64_t buddy_get_free_pages(void);
 uint64_t buddy_get_total_pages(void);
 void buddy_get_order_stats(uint32_t order, uint64_t *free_count);
 void buddy_dump_stats(void);
 void buddy_dump_zone(buddy_zone_type_t zone_type);
 
+/**
+ * Memory-Pressure Shrinkers
+ *
+ * Caches that hold free memory they could give back (pools, heaps) register
+ * a shrinker. When an allocation finds every fallback zone empty, the buddy
+ * allocator runs all shrinkers once and retries before failing.
+ *
+ * A shrinker may run inside any allocation, including one its own
+ * subsystem made while holding its locks, so it must only try-lock and
+ * skip anything busy. It returns the number of pages it released.
+ */
+#define BUDDY_MAX_SHRINKERS 8
+
+typedef uint64_t (*buddy_shrinker_t)(void);
+
+int buddy_register_shrinker(buddy_shrinker_t shrinker);
+
+// Run every shrinker now; returns the number of pages released
+uint64_t buddy_reclaim(void);
+
 // Allocation with GFP flags
 uint64_t buddy_alloc_pages_flags(uint32_t order, uint32_t flags);
@@ -2,30 +2,50 @@
 #include "../kernel/types.h"
 #include "../kernel/spinlock.h"
 #include "../kernel/vmm.h"
+#include "page.h"
 
 // COW flag bit in page table entry (using available bit 9)
 #define COW_FLAG_MASK 0x200
 
-// Hash table size for page reference tracking
-// IMPORTANT: Must be a power of 2 for efficient bitwise AND hashing
-#define COW_HASH_SIZE 1024
-#define COW_HASH_MASK (COW_HASH_SIZE - 1)  // For bitwise AND (faster than modulo)
-
-// Page reference structure for tracking shared physical pages
-typedef struct page_ref {
-    uint64_t physical_address;
-    uint32_t ref_count;
-    spinlock_t lock;
-    struct page_ref *next;  // For hash table chaining
-} page_ref_t;
+/**
+ * Reference counts for shared frames live in the page descriptor
+ * (page_t.refcount), indexed by frame number, and are only changed with
+ * atomic operations: no allocation or lock is needed to share a page.
+ * Frames outside buddy-managed memory have no descriptor and cannot be
+ * shared.
+ */
 
 // COW subsystem functions
 void cow_init(void);
+
+// Shared all-zero frame (0 before cow_init()). Zero-fill read faults map it
+// read-only with the COW bit; cow_handle_fault() replaces it with a cleared
+// private frame on the first write. It has no reference count.
+uint64_t cow_zero_page(void);
 int cow_mark_page(page_table_t *pml4, uint64_t virt_addr);
+// Break COW on a write fault; takes the entry's page-table lock. Succeeds
+// without doing anything if the entry is already writable.
 int cow_handle_fault(page_table_t *pml4, uint64_t virt_addr);
+// The same, for callers already holding vmm_pte_lock(pte)
+int cow_handle_fault_locked(page_table_t *pml4, uint64_t virt_addr, uint64_t *pte);
 void cow_increment_ref(uint64_t phys_addr);
 void cow_decrement_ref(uint64_t phys_addr);
 
+// Drop a mapping's reference without freeing the frame. Returns 1 when no
+// other mapping is left and the caller now owns the frame (to free it after
+// its TLB flush), 0 otherwise.
+int cow_release_ref(uint64_t phys_addr);
+
+// Fork: copy the parent's user-half page tables into a new address space in
+// one walk, making every writable frame read-only + COW in both trees, and
+// flush the TLB once. The kernel half (PML4 entries 256-511) is shared.
+// Returns NULL on failure, leaving the parent valid.
+page_table_t *cow_clone_address_space(page_table_t *parent);
+
+// Drop the reference of every COW mapping and free the user-half page
+// tables and the PML4. Frames mapped writable belong to whoever mapped them.
+void cow_release_address_space(page_table_t *pml4);
+
 // Helper functions
-page_ref_t *cow_get_ref(uint64_t phys_addr);
+page_t *cow_get_ref(uint64_t phys_addr);  // NULL outside buddy memory and for the zero page
 uint32_t cow_get_ref_count(uint64_t phys_addr);
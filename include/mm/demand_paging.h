@@ -11,38 +11,97 @@
  * - Safety margin for burst scenarios
  * - Memory overhead: 256 * sizeof(vm_address_space_t) ≈ 8KB
  * 
- * Can be increased if needed, but consider:
- * - Memory overhead grows linearly with this value
- * - Linear search performance in demand_paging_get_address_space()
- * - For >256 processes, consider hash table instead of array
+ * Can be increased if needed; memory overhead grows linearly with this
+ * value. Lookups hash the PML4 address (AS_HASH_SIZE buckets), so their
+ * cost does not depend on it.
  */
 #define MAX_ADDRESS_SPACES 256
+#define AS_HASH_SIZE 512
+#define AS_HASH_MASK (AS_HASH_SIZE - 1)
 
 // VM region flags
 #define VM_FLAG_DEMAND_PAGED 0x01
 #define VM_FLAG_ZERO_FILL 0x02
 #define VM_FLAG_FILE_BACKED 0x04
+#define VM_FLAG_MERGEABLE 0x08    // Scanned for duplicate pages (see mm/ksm.h)
 
-// VM region structure for tracking virtual memory regions
+// Fault flags for demand_paging_handle_fault_flags(), laid out like the
+// x86 page-fault error code so it can be passed straight through
+#define VM_FAULT_PRESENT 0x01   // Protection fault on a present page
+#define VM_FAULT_WRITE   0x02   // Write access
+#define VM_FAULT_USER    0x04   // Fault from user mode
+
+// Faults are serialized per page table (vmm_pte_lock()), not per region:
+// two faults in the same 2 MiB span still double-check under one lock,
+// while faults in different spans of a large region run in parallel.
+
+/**
+ * Fault-around
+ *
+ * A fault on an unmapped page also maps the unmapped pages after it in
+ * the same region and page table, up to the region's window, under the
+ * one page-table lock.
+ * Private frames for the window come from buddy_alloc_pages_bulk(); read
+ * faults in zero-fill regions map the zero page instead.
+ *
+ * Each region's window starts at one page (no fault-around). At the next
+ * fault the previous window is judged: it was a hit if the fault landed
+ * right after it (sequential access) or at least half its pages have the
+ * accessed bit. Hits double the window up to the global maximum, misses
+ * halve it, so random access goes back to one page per fault.
+ */
+#define FAULT_AROUND_DEFAULT_PAGES 16
+#define FAULT_AROUND_MAX_PAGES 64
+
+// VM region structure for tracking virtual memory regions. Regions of an
+// address space never overlap, so an AVL tree keyed by start finds the
+// region containing an address, or any overlapping one, in O(log n).
 typedef struct vm_region {
     uint64_t start;              // Region start address (page-aligned)
     uint64_t end;                // Region end address (page-aligned)
     uint32_t flags;              // VM_FLAG_* flags
-    spinlock_t page_fault_lock;  // Synchronizes concurrent page fault handling
-    struct vm_region *next;      // Next region in linked list
+    int32_t height;              // Height of the subtree rooted here
+    uint32_t around_window;      // Fault-around window in pages, faulting page included
+    uint32_t around_pages;       // Pages pre-mapped by the last fault
+    uint64_t around_start;       // First page pre-mapped by the last fault
+    uint64_t around_next;        // Page right after the last window
+    struct vm_region *left;      // Regions below start
+    struct vm_region *right;     // Regions at or above end
 } vm_region_t;
 
-// Address space structure containing region list
+// Address space structure containing the region tree
 typedef struct vm_address_space {
     page_table_t *pml4;
-    vm_region_t *regions;
+    vm_region_t *regions;        // Root of the region tree
+    vm_region_t *last_hit;       // Region found by the last lookup
+    uint32_t region_count;
     spinlock_t lock;
+    struct vm_address_space *hash_next;
 } vm_address_space_t;
 
+typedef struct demand_paging_stats {
+    uint64_t faults;             // Faults handled (including already-mapped pages)
+    uint64_t pages_allocated;    // Private frames allocated on fault
+    uint64_t zero_page_hits;     // Read faults served by the shared zero page
+    uint64_t zero_page_breaks;   // Writes that replaced the zero page
+    uint64_t around_mapped;      // Pages pre-mapped by fault-around
+    uint64_t around_hits;        // Pre-mapped pages found accessed
+} demand_paging_stats_t;
+
 // Demand paging subsystem functions
 void demand_paging_init(void);
 int demand_paging_register_region(page_table_t *pml4, uint64_t start, uint64_t size, uint32_t flags);
-int demand_paging_handle_fault(page_table_t *pml4, uint64_t virt_addr);
+int demand_paging_handle_fault(page_table_t *pml4, uint64_t virt_addr);  // Treated as a write
+
+// Read faults in VM_FLAG_ZERO_FILL regions map the shared zero page; a
+// later write fault on it goes through cow_handle_fault()
+int demand_paging_handle_fault_flags(page_table_t *pml4, uint64_t virt_addr, uint32_t fault_flags);
+void demand_paging_get_stats(demand_paging_stats_t *stats);
+
+// Largest fault-around window in pages (capped at FAULT_AROUND_MAX_PAGES);
+// 0 or 1 turns fault-around off
+void demand_paging_set_fault_around(uint32_t pages);
+uint32_t demand_paging_get_fault_around(void);
 void demand_paging_unregister_region(page_table_t *pml4, uint64_t start);
 
 // Helper functions
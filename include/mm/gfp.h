@@ -11,6 +11,9 @@
 #define GFP_ZERO        0x04    // Zero the allocated memory
 #define GFP_DMA         0x08    // Allocate from DMA-capable memory
 
+// GFP_DMA memory lies entirely below the 16 MiB reach of ISA DMA
+#define GFP_DMA_LIMIT   0x1000000ULL
+
 // Zone modifiers
 // Zone priority: MOVABLE > RECLAIMABLE > UNMOVABLE
 // - MOVABLE: Pages that can be relocated (user allocations, page cache)
@@ -0,0 +1,66 @@
+#pragma once
+#include "../kernel/types.h"
+#include "../kernel/vmm.h"
+
+/**
+ * Kernel Same-page Merging (KSM)
+ *
+ * Scans registered ranges of anonymous memory for pages with identical
+ * contents and maps them to a single frame shared copy-on-write, freeing
+ * the duplicates. Demand-paging regions registered with VM_FLAG_MERGEABLE
+ * are added automatically.
+ *
+ * Each scanned page (present, writable, privately owned) is checksummed:
+ *   - all-zero pages are replaced by the shared zero page
+ *   - a match in the stable table (frames KSM already shares) maps the page
+ *     to that frame and bumps its COW reference count
+ *   - a match in the unstable table (candidates seen earlier in this pass)
+ *     turns both pages into one shared frame, which moves to the stable
+ *     table
+ *   - otherwise the page becomes a candidate
+ * Checksums only select candidates: pages are write-protected and compared
+ * in full before they are merged. A write to a merged page is an ordinary
+ * COW fault. The unstable table is rebuilt every full pass, and stable
+ * frames nobody shares any more are dropped at the same time.
+ *
+ * The scanner runs from the idle loop: every sleep_ms it scans
+ * pages_to_scan pages (ksm_set_scan_rate()). ksm_scan() runs it directly.
+ * Each entry is re-checked and changed under its page-table lock
+ * (vmm_pte_lock()), as in the fault path; a merge whose entries changed
+ * meanwhile is abandoned.
+ */
+// Software PTE bit on an entry KSM has write-protected while it compares
+// the frame; a write fault on it is retried until KSM is done
+#define KSM_PTE_COMPARING            0x400
+
+#define KSM_MAX_RANGES               64
+#define KSM_HASH_SIZE                1024
+#define KSM_HASH_MASK                (KSM_HASH_SIZE - 1)
+#define KSM_DEFAULT_PAGES_TO_SCAN    100
+#define KSM_DEFAULT_SLEEP_MS         20
+
+typedef struct ksm_stats {
+    uint64_t pages_scanned;
+    uint64_t full_scans;
+    uint64_t pages_shared;       // Frames KSM currently shares
+    uint64_t pages_sharing;      // Extra mappings of those frames (frames saved)
+    uint64_t zero_pages_merged;  // Pages replaced by the zero page (cumulative)
+    uint64_t pages_merged;       // Pages merged into a shared frame (cumulative)
+} ksm_stats_t;
+
+void ksm_init(void);
+
+// Add/remove a range of anonymous memory to scan; returns 0 or -1
+int ksm_register(page_table_t *pml4, uint64_t start, uint64_t end);
+void ksm_unregister(page_table_t *pml4, uint64_t start);
+
+// Scan up to pages pages from the cursor; returns the number merged
+uint32_t ksm_scan(uint32_t pages);
+
+// Called from the idle loop; scans when the interval has elapsed
+void ksm_idle(void);
+
+void ksm_set_enabled(int enabled);
+void ksm_set_scan_rate(uint32_t pages_to_scan, uint32_t sleep_ms);
+void ksm_get_stats(ksm_stats_t *stats);
+void ksm_print_stats(void);
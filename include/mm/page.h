@@ -0,0 +1,36 @@
+#pragma once
+#include "../kernel/types.h"
+#include "../kernel/spinlock.h"
+
+/**
+ * Page Descriptor
+ *
+ * The buddy allocator keeps one descriptor per physical page frame in a
+ * flat array carved from the start of managed memory. Allocators that need
+ * per-page metadata (which slab owns a page, the order of a multi-page
+ * allocation, ...) store it here instead of in-band headers.
+ *
+ * Only the head page of a buddy block carries the block's metadata, except
+ * for pool regions, which tag every page so any object maps to its region.
+ */
+typedef struct page {
+    uint32_t flags;              // PAGE_FLAG_* bits
+    uint16_t order;              // Buddy order of the block headed by this page
+    uint16_t zone;               // Zone the block was taken from (buddy_zone_type_t)
+    void *owner;                 // Owning object (slab cache for PAGE_FLAG_SLAB)
+    volatile uint32_t refcount;  // COW mappings sharing the frame (cow.c)
+    spinlock_t ptl;              // Lock of the entries while this frame is a page table (vmm.c)
+    uint64_t index;              // Virtual page number for PAGE_FLAG_ANON (rmap.c)
+} page_t;
+
+// Page descriptor flags
+#define PAGE_FLAG_RESERVED 0x01  // Holds the descriptor array, never allocated
+#define PAGE_FLAG_SLAB     0x02  // Slab page, owner is the slab_cache_t
+#define PAGE_FLAG_KMALLOC_LARGE 0x04  // Page-granular kmalloc block of 2^order pages
+#define PAGE_FLAG_POOL     0x08  // Memory pool region page, owner is the pool_region_t
+#define PAGE_FLAG_ANON     0x10  // Mapped anonymous frame, owner is the rmap_anon_t
+#define PAGE_FLAG_ZERO     0x20  // The shared zero page (cow.c), never in an rmap group
+
+// Descriptor lookup (NULL for addresses outside buddy-managed memory)
+page_t *buddy_phys_to_page(uint64_t phys_addr);
+uint64_t buddy_page_to_phys(page_t *page);
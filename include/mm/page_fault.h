@@ -0,0 +1,72 @@
+#pragma once
+#include "../kernel/types.h"
+#include "../kernel/vmm.h"
+#include "../kernel/interrupts.h"
+
+/**
+ * Page-Fault Dispatch
+ *
+ * Vector 14 bypasses the generic exception path: interrupt_handler() hands
+ * the frame to page_fault_handler(), which reads CR2 and the current CR3
+ * and calls page_fault_dispatch(). The error code pushed by the CPU is
+ * decoded as:
+ *
+ *   bit 0 P     protection fault on a present page (else not present)
+ *   bit 1 W     write access
+ *   bit 2 U     access from user mode
+ *   bit 3 RSVD  reserved bit set in a paging entry (always fatal)
+ *   bit 4 I/D   instruction fetch
+ *
+ * and routed to one of:
+ *
+ *   not present            demand paging (demand_paging_handle_fault_flags())
+ *   present write, COW     demand paging inside a region, else cow_handle_fault()
+ *   present, now allowed   a stale TLB entry: invlpg and retry
+ *   write, read-only       retried if KSM has the entry write-protected
+ *                          (KSM_PTE_COMPARING) or it changed meanwhile
+ *
+ * Faults inside a huge page (a PS=1 PDPT or PD entry, as in the boot
+ * identity map) are checked against that entry: spurious if it allows the
+ * access, fatal otherwise.
+ *
+ * Anything else, or a handler failure, is fatal: the fault is reported
+ * and the CPU halts, as for other exceptions.
+ *
+ * Every dispatch is counted per outcome with its latency in cycles, in a
+ * histogram of power-of-two buckets: bucket 0 holds faults under
+ * 2^PAGE_FAULT_HIST_SHIFT cycles, bucket i those under 2^(SHIFT + i), and
+ * the last bucket everything slower.
+ */
+#define PAGE_FAULT_ERR_PRESENT  0x01
+#define PAGE_FAULT_ERR_WRITE    0x02
+#define PAGE_FAULT_ERR_USER     0x04
+#define PAGE_FAULT_ERR_RESERVED 0x08
+#define PAGE_FAULT_ERR_FETCH    0x10
+
+#define PAGE_FAULT_HIST_BUCKETS 16
+#define PAGE_FAULT_HIST_SHIFT   8
+
+typedef enum {
+    PAGE_FAULT_DEMAND,      // Not-present page filled by demand paging
+    PAGE_FAULT_COW,         // Write to a COW page
+    PAGE_FAULT_SPURIOUS,    // Access already allowed by the page tables
+    PAGE_FAULT_FATAL,       // Not resolvable
+    PAGE_FAULT_TYPES
+} page_fault_type_t;
+
+typedef struct page_fault_stats {
+    uint64_t count[PAGE_FAULT_TYPES];
+    uint64_t cycles[PAGE_FAULT_TYPES];
+    uint64_t histogram[PAGE_FAULT_TYPES][PAGE_FAULT_HIST_BUCKETS];
+} page_fault_stats_t;
+
+// Entry point from interrupt_handler() for vector 14
+void page_fault_handler(interrupt_frame_t *frame);
+
+// Resolve a fault at addr in pml4 with the CPU's error code; returns the
+// outcome (PAGE_FAULT_FATAL if it could not be resolved)
+page_fault_type_t page_fault_dispatch(page_table_t *pml4, uint64_t addr, uint64_t err_code);
+
+void page_fault_get_stats(page_fault_stats_t *stats);
+void page_fault_reset_stats(void);
+void page_fault_dump_stats(void);
@@ -1,32 +1,133 @@
 #pragma once
 #include "../kernel/types.h"
 #include "../kernel/spinlock.h"
+#include "../kernel/cpu.h"
+#include "../kernel/atomic.h"
 
-#define POOL_NAME_MAX 32
+/**
+ * Fixed-Size Memory Pool
+ *
+ * Free objects are kept in two tiers:
+ *   - a per-CPU front cache (a short singly-linked list) that pool_alloc()
+ *     and pool_free() use without any atomic operation on the list itself
+ *   - a shared lock-free stack of batches of up to POOL_BATCH objects,
+ *     which front caches refill from and spill to one batch at a time
+ *
+ * The shared stack head is a {top, tag} pair swapped with cmpxchg16b; every
+ * pop bumps the tag, so a pop that read a stale top/next pair cannot
+ * succeed after other CPUs popped and pushed the same batch back (ABA).
+ * Pool memory stays mapped while the pool exists, so a racing pop may
+ * read a stale next_batch from a reused object but never faults.
+ *
+ * pool->lock is only taken to grow, shrink or destroy the pool, so refills
+ * that find the stack empty do not all grow the pool at once.
+ *
+ * Free objects are counted where they sit: stack_objects for the shared
+ * stack, updated once per batch moved, and each front cache's own count.
+ * pool_free_count() adds them up, so the fast paths touch no shared
+ * counter; the sum is a snapshot while other CPUs keep allocating.
+ * Objects are at least sizeof(pool_chunk_t) (16 bytes) and 8-byte aligned;
+ * pool_create_aligned() raises the alignment up to POOL_CACHE_LINE, and
+ * POOL_PAD_CACHELINE gives every object whole cache lines of its own so
+ * objects written by different CPUs never share a line.
+ *
+ * pool_alloc_inline()/pool_free_inline() are the front-cache fast paths,
+ * falling back to pool_alloc()/pool_free() for refills and spills. See
+ * mm/typed_pool.h for per-type wrappers built on them.
+ *
+ * pool_shrink() returns regions whose objects are all on the shared stack
+ * (after parking the calling CPU's front cache there) to the buddy
+ * allocator. The oldest region is kept so the pool never starts from zero.
+ * Every pool is also shrunk by a buddy shrinker when memory runs out.
+ * Objects parked in other CPUs' front caches pin their region until those
+ * CPUs use or spill them.
+ */
+#define POOL_NAME_MAX       32
+#define POOL_BATCH          8     // Objects moved per stack push/pop
+#define POOL_CPU_CACHE_MAX  16    // Front cache spills one batch above this
+#define POOL_CACHE_LINE     64    // Largest supported object alignment
+
+// pool_create_aligned() flags
+#define POOL_PAD_CACHELINE  0x01  // Round objects up to whole cache lines
 
 typedef struct pool_chunk {
-    struct pool_chunk *next;
+    struct pool_chunk *next;          // Next object in this batch / front cache
+    struct pool_chunk *next_batch;    // Next batch on the shared stack (batch head only)
 } pool_chunk_t;
 
+// Shared stack head, swapped as one 16-byte unit
+typedef struct pool_stack {
+    pool_chunk_t *top;
+    uint64_t tag;                     // Bumped by every pop
+} __attribute__((aligned(16))) pool_stack_t;
+
+typedef struct pool_cpu_cache {
+    pool_chunk_t *head;
+    uint32_t count;
+} __attribute__((aligned(64))) pool_cpu_cache_t;
+
+// Header at the start of every buddy block the pool grows by. Every page
+// of the block is tagged PAGE_FLAG_POOL with this header as its owner.
 typedef struct pool_region {
     void *base;
-    struct pool_region *next;
+    struct pool_region *next;        // Newer regions first
+    uint32_t order;                  // Buddy order of the block
+    uint32_t objects;                // Objects carved from it
+    uint32_t live;                   // Objects off the shared stack at the last shrink
+    uint32_t free_seen;              // Scratch count for pool_shrink()
 } pool_region_t;
 
 typedef struct memory_pool {
     char name[POOL_NAME_MAX];
-    size_t object_size;
+    size_t object_size;               // Slot size, a multiple of align
+    size_t align;
     uint32_t initial_count;
     uint32_t grow_count;
     uint32_t total_objects;
-    uint32_t free_objects;
-    pool_chunk_t *free_list;
+    volatile uint32_t stack_objects;  // Objects on the shared stack
+    pool_stack_t free_stack;
     pool_region_t *regions;
-    spinlock_t lock;
+    spinlock_t lock;                  // Serializes pool_grow()
+    struct memory_pool *next_pool;   // Global pool list (shrinker)
+    pool_cpu_cache_t cpu_caches[MAX_CPUS];
 } memory_pool_t;
 
 memory_pool_t *pool_create(const char *name, size_t object_size, uint32_t initial_count);
+
+// align must be a power of two no larger than POOL_CACHE_LINE
+memory_pool_t *pool_create_aligned(const char *name, size_t object_size, size_t align,
+                                   uint32_t flags, uint32_t initial_count);
 void pool_destroy(memory_pool_t *pool);
 void *pool_alloc(memory_pool_t *pool);
 void pool_free(memory_pool_t *pool, void *object);
+
+// Release fully free regions; returns the number of bytes given back
+size_t pool_shrink(memory_pool_t *pool);
 uint32_t pool_get_utilization(memory_pool_t *pool);
+
+// Objects not handed out: the shared stack plus every front cache
+uint32_t pool_free_count(memory_pool_t *pool);
+
+// Front-cache fast paths: a per-CPU list pop/push, no shared writes
+static inline void *pool_alloc_inline(memory_pool_t *pool) {
+    pool_cpu_cache_t *cache = &pool->cpu_caches[cpu_current_id()];
+    pool_chunk_t *chunk = cache->head;
+    if (__builtin_expect(chunk == NULL, 0)) {
+        return pool_alloc(pool);
+    }
+    cache->head = chunk->next;
+    cache->count--;
+    return chunk;
+}
+
+static inline void pool_free_inline(memory_pool_t *pool, void *object) {
+    pool_cpu_cache_t *cache = &pool->cpu_caches[cpu_current_id()];
+    if (__builtin_expect(cache->count >= POOL_CPU_CACHE_MAX, 0)) {
+        pool_free(pool, object);
+        return;
+    }
+    pool_chunk_t *chunk = (pool_chunk_t *)object;
+    chunk->next = cache->head;
+    cache->head = chunk;
+    cache->count++;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "../kernel/types.h"
+#include "../kernel/vmm.h"
+#include "page.h"
+
+/**
+ * Reverse Mapping (rmap)
+ *
+ * Finds the page-table entries that map an anonymous frame, for code that
+ * has to move, merge or evict a frame it did not map itself.
+ *
+ * Mappings are grouped rather than recorded per PTE. Every address space
+ * has an anon group; a frame first mapped in the user half by
+ * vmm_map_page() (demand paging, tests) or by a COW fault is tagged
+ * PAGE_FLAG_ANON with the group in page_t.owner and its virtual page
+ * number in page_t.index. Fork keeps frames at the same address, so
+ * cow_clone_address_space() only links the child into every group the
+ * parent belongs to:
+ *
+ *   group(P) <- P, C1, C2     frames P faulted in before the forks
+ *   group(C1) <- C1           frames C1 faulted in (or COW-copied) itself
+ *
+ * rmap_walk() visits each address space linked to the frame's group and
+ * checks the entry at index; entries mapping other frames are skipped.
+ * Tracking costs 8 bytes per frame (page_t.index) plus one link per
+ * (address space, group) pair, however many pages are mapped.
+ *
+ * A frame mapped again at another address while unshared (refcount 0)
+ * moves to the new mapping. Frames merged by KSM are shared across
+ * addresses and are only found at the address of the kept frame.
+ * Kernel-half mappings, slab/pool pages and the zero page are not tracked.
+ *
+ * Everything is serialized by one spinlock; walk callbacks run with it
+ * held and must not map or unmap pages.
+ */
+#define RMAP_MM_HASH_SIZE 256
+#define RMAP_MM_HASH_MASK (RMAP_MM_HASH_SIZE - 1)
+#define RMAP_USER_END     0x0000800000000000ULL
+
+struct rmap_link;
+
+// A group of anonymous frames and the address spaces that may map them
+typedef struct rmap_anon {
+    struct rmap_link *links;     // Address spaces linked to the group
+    uint32_t refs;               // Links plus frames tagged with the group
+} rmap_anon_t;
+
+// Per-address-space state: its own group and every group it is linked to
+typedef struct rmap_mm {
+    page_table_t *pml4;
+    rmap_anon_t *anon;           // Group for frames first mapped here
+    struct rmap_link *links;
+    struct rmap_mm *hash_next;
+} rmap_mm_t;
+
+// One (address space, group) pair, on both the group's and the space's list
+typedef struct rmap_link {
+    rmap_mm_t *mm;
+    rmap_anon_t *anon;
+    struct rmap_link *anon_next;
+    struct rmap_link *mm_next;
+} rmap_link_t;
+
+typedef struct rmap_stats {
+    uint64_t pages_tracked;      // Frames tagged since boot
+    uint64_t groups;             // Live anon groups
+    uint64_t links;              // Live links
+    uint64_t walks;
+} rmap_stats_t;
+
+// Visitor for rmap_walk(); return nonzero to stop the walk
+typedef int (*rmap_visit_t)(page_table_t *pml4, uint64_t virt, uint64_t *pte, void *arg);
+
+void rmap_init(void);
+
+// Record that pml4 maps phys at virt (called by vmm_map_page() and COW)
+void rmap_add(page_table_t *pml4, uint64_t virt, uint64_t phys);
+
+// Fork: link child into every group of parent; returns 0 or -1
+int rmap_clone(page_table_t *parent, page_table_t *child);
+
+// Address space teardown: unlink it from every group
+void rmap_release(page_table_t *pml4);
+
+// Called by the buddy allocator when a PAGE_FLAG_ANON frame is freed
+void rmap_page_freed(page_t *page);
+
+// Visit every entry mapping phys; returns the number of entries visited
+uint32_t rmap_walk(uint64_t phys, rmap_visit_t visit, void *arg);
+
+void rmap_get_stats(rmap_stats_t *stats);
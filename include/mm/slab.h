@@ -1,6 +1,7 @@
 #pragma once
 #include "../kernel/types.h"
 #include "../kernel/spinlock.h"
+#include "../kernel/cpu.h"
 
 #define SLAB_CACHE_NAME_MAX 32
 #define SLAB_CPU_CACHE_SIZE 16
@@ -32,7 +33,7 @@ typedef struct slab_cache {
     uint64_t total_frees;
     uint64_t cache_hits;
     spinlock_t lock;
-    slab_cpu_cache_t cpu_caches[8];
+    slab_cpu_cache_t cpu_caches[MAX_CPUS];
     struct slab_cache *next;
 } slab_cache_t;
 
@@ -0,0 +1,94 @@
+#pragma once
+#include "../kernel/types.h"
+
+/**
+ * Slot Map
+ *
+ * A container of fixed-size objects addressed by 32-bit generational
+ * handles, for subsystems that look objects up by id and also sweep over
+ * all of them. Live objects are stored densely in one array, so a full
+ * scan is a linear walk over count * object_size bytes instead of a chase
+ * through pointers scattered across pool regions:
+ *
+ *   task_t *tasks = slotmap_data(&map);
+ *   for (uint32_t i = 0; i < slotmap_count(&map); i++) {
+ *       ... tasks[i] ...
+ *   }
+ *
+ * A handle is a 20-bit slot index plus a 12-bit generation. Every slot
+ * records where its object sits in the dense array; removing an object
+ * moves the last object into the hole (so the array stays packed), bumps
+ * the slot's generation and puts the slot on a free list. Insert, remove
+ * and lookup are O(1), and a handle to a removed object is detected as
+ * stale until its slot has been reused 4095 times.
+ *
+ * Pointers returned by slotmap_insert()/slotmap_get() are only valid until
+ * the next insert (the arrays may move when they grow) or remove (the last
+ * object moves into the removed one's place). Hold handles, not pointers.
+ * Sweeps that remove objects should walk the dense array backwards.
+ *
+ * The arrays come from kmalloc()/krealloc() and double when full. A slot
+ * map has no lock: callers serialize access, usually with the lock of the
+ * structure that owns it.
+ */
+#define SLOTMAP_NAME_MAX      32
+#define SLOTMAP_INDEX_BITS    20
+#define SLOTMAP_GEN_BITS      12
+#define SLOTMAP_MAX_OBJECTS   (1U << SLOTMAP_INDEX_BITS)
+#define SLOTMAP_INDEX_MASK    (SLOTMAP_MAX_OBJECTS - 1)
+#define SLOTMAP_GEN_MASK      ((1U << SLOTMAP_GEN_BITS) - 1)
+
+// Generations start at 1, so no valid handle is ever 0
+#define SLOTMAP_INVALID_HANDLE 0
+
+typedef uint32_t slot_handle_t;
+
+typedef struct slotmap_slot {
+    uint32_t dense;     // Index in the dense array, or next free slot
+    uint16_t gen;       // Generation of the current (or next) occupant
+    uint16_t used;
+} slotmap_slot_t;
+
+typedef struct slotmap {
+    char name[SLOTMAP_NAME_MAX];
+    size_t object_size;
+    uint8_t *objects;           // Dense array of count objects
+    uint32_t *dense_slot;       // Slot index of each dense object
+    slotmap_slot_t *slots;
+    uint32_t count;             // Live objects
+    uint32_t capacity;          // Objects the arrays can hold
+    uint32_t slot_count;        // Slots handed out so far (used or free)
+    uint32_t free_head;         // First free slot, SLOTMAP_MAX_OBJECTS if none
+} slotmap_t;
+
+// Returns 0 on success, -1 on bad arguments or out of memory
+int slotmap_init(slotmap_t *map, const char *name, size_t object_size, uint32_t initial_capacity);
+void slotmap_destroy(slotmap_t *map);
+
+// Adds a zeroed object; *object (if given) points at it. Returns
+// SLOTMAP_INVALID_HANDLE when the map is full or out of memory.
+slot_handle_t slotmap_insert(slotmap_t *map, void **object);
+
+// Returns 0, or -1 if the handle is stale or invalid
+int slotmap_remove(slotmap_t *map, slot_handle_t handle);
+
+// NULL if the handle is stale or invalid
+void *slotmap_get(const slotmap_t *map, slot_handle_t handle);
+
+static inline uint32_t slotmap_count(const slotmap_t *map) {
+    return map->count;
+}
+
+static inline void *slotmap_data(const slotmap_t *map) {
+    return map->objects;
+}
+
+// Object and handle at a dense index (i < slotmap_count())
+static inline void *slotmap_at(const slotmap_t *map, uint32_t i) {
+    return map->objects + (size_t)i * map->object_size;
+}
+
+static inline slot_handle_t slotmap_handle_at(const slotmap_t *map, uint32_t i) {
+    uint32_t slot = map->dense_slot[i];
+    return ((slot_handle_t)map->slots[slot].gen << SLOTMAP_INDEX_BITS) | slot;
+}
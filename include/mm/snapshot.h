@@ -0,0 +1,52 @@
+#pragma once
+#include "../kernel/types.h"
+#include "../kernel/vmm.h"
+
+/**
+ * Address-Space Snapshots
+ *
+ * A snapshot freezes an address space without copying it. The frozen view
+ * is a COW clone (cow_clone_address_space()) that never runs. Every page
+ * the live space shares with it becomes read-only + COW, so the first
+ * write to a page copies it and leaves the view's frame untouched.
+ *
+ * Dirty bits are cleared when a snapshot is taken. A page counts as dirty
+ * since then if its entry has the dirty bit, maps a different frame than
+ * the view (a COW copy), or is new; pages unmapped since are reported
+ * with phys 0. That supports incremental pre-copy:
+ *
+ *   snap = snapshot_create(pml4);         // round 0: copy out the view
+ *   while (...) {
+ *       snapshot_for_each_dirty(snap, copy_page, ctx);
+ *       snapshot_refresh(snap);           // next round starts here
+ *   }
+ *   snapshot_discard(snap);
+ *
+ * snapshot_refresh() takes a new view before dropping the old one.
+ * snapshot_discard() only drops the view's references, after which the
+ * live space's writes take the no-copy COW path again.
+ * snapshot_rollback() puts the view's frames back into the live space and
+ * frees the private frames it replaces, so use it on anonymous memory
+ * only.
+ *
+ * The caller keeps the live space from changing during these calls.
+ */
+typedef struct snapshot {
+    page_table_t *source;        // Live address space
+    page_table_t *view;          // Frozen COW clone, never run
+    uint64_t generation;         // Views taken (1 after snapshot_create())
+} snapshot_t;
+
+// Visitor for dirty pages: phys is the live frame, 0 if unmapped since.
+// Return nonzero to stop.
+typedef int (*snapshot_visit_t)(uint64_t virt, uint64_t phys, void *arg);
+
+snapshot_t *snapshot_create(page_table_t *pml4);
+int snapshot_refresh(snapshot_t *snap);
+void snapshot_discard(snapshot_t *snap);
+
+// Returns the number of dirty pages visited
+uint32_t snapshot_for_each_dirty(snapshot_t *snap, snapshot_visit_t visit, void *arg);
+
+// Make the live space match the view again; returns pages restored
+uint32_t snapshot_rollback(snapshot_t *snap);
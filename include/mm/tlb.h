@@ -0,0 +1,64 @@
+#pragma once
+#include "../kernel/types.h"
+
+/**
+ * TLB Invalidation Batching
+ *
+ * Page-table operations that change many entries collect the affected
+ * pages in a tlb_gather_t and flush once at the end:
+ *
+ *   tlb_gather_t tlb;
+ *   tlb_gather_init(&tlb);
+ *   for (...) {
+ *       phys = vmm_unmap_page_deferred(pml4, virt, &tlb);
+ *       tlb_gather_free_frame(&tlb, phys);
+ *   }
+ *   tlb_gather_finish(&tlb);
+ *
+ * Up to the flush threshold each page is invalidated with invlpg; beyond
+ * it one CR3 reload drops every non-global entry, which is cheaper than
+ * hundreds of invlpg and avoids tracking the pages. The threshold is
+ * tunable with tlb_set_flush_threshold() (1..TLB_GATHER_MAX pages).
+ *
+ * Frames unmapped during the operation are handed to the gather rather
+ * than freed directly, so they go back to the buddy allocator only after
+ * the stale translations are gone. A full frame batch forces an early
+ * flush.
+ *
+ * Only the local TLB is flushed; there are no other CPUs running to shoot
+ * down yet. A gather lives on the caller's stack and is not shared.
+ */
+#define TLB_GATHER_MAX                 64
+#define TLB_DEFAULT_FLUSH_THRESHOLD    32
+
+typedef struct tlb_gather {
+    uint64_t pages[TLB_GATHER_MAX];     // Pages to invlpg (first page_count)
+    uint64_t frames[TLB_GATHER_MAX];    // Order-0 frames to free after the flush
+    uint32_t page_count;                // Pages invalidated so far in this batch
+    uint32_t frame_count;
+    uint32_t full;                      // Threshold exceeded: reload CR3 instead
+} tlb_gather_t;
+
+typedef struct tlb_stats {
+    uint64_t page_flushes;              // invlpg issued
+    uint64_t full_flushes;              // CR3 reloads
+    uint64_t gathers;                   // Batches flushed
+} tlb_stats_t;
+
+void tlb_gather_init(tlb_gather_t *tlb);
+void tlb_gather_page(tlb_gather_t *tlb, uint64_t virt);
+void tlb_gather_range(tlb_gather_t *tlb, uint64_t start, uint64_t end);
+
+// Free phys (order 0) once the TLB no longer maps it; 0 is ignored
+void tlb_gather_free_frame(tlb_gather_t *tlb, uint64_t phys);
+
+// Flush what has been gathered and free the deferred frames; the gather
+// can be reused afterwards
+void tlb_gather_finish(tlb_gather_t *tlb);
+
+// Invalidate a single page right away
+void tlb_flush_page(uint64_t virt);
+
+void tlb_set_flush_threshold(uint32_t pages);
+uint32_t tlb_get_flush_threshold(void);
+void tlb_get_stats(tlb_stats_t *stats);
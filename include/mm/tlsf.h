@@ -0,0 +1,65 @@
+#pragma once
+#include "../kernel/types.h"
+
+/**
+ * Two-Level Segregated Fit (TLSF) Allocator
+ *
+ * Free blocks are kept in segregated lists indexed by a first level
+ * (power-of-two range) and a second level (TLSF_SL_COUNT linear subdivisions
+ * of that range). Two bitmaps record which lists are non-empty, so finding
+ * a suitable block is a pair of bit scans and malloc/free are O(1)
+ * regardless of how many blocks the heap holds. Adjacent free blocks are
+ * coalesced immediately on free through boundary tags.
+ *
+ * Block layout (16-byte aligned):
+ *   [size | flags][prev_phys][payload...]
+ *                            ^
+ *                            returned pointer
+ * Free blocks store their list links in the first 16 payload bytes.
+ * The low bits of the size word hold flags (free, claimed).
+ */
+#define TLSF_ALIGN_LOG2   4
+#define TLSF_ALIGN        (1 << TLSF_ALIGN_LOG2)
+#define TLSF_SL_LOG2      4
+#define TLSF_SL_COUNT     (1 << TLSF_SL_LOG2)
+#define TLSF_FL_SHIFT     (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_BLOCK  (1 << TLSF_FL_SHIFT)
+#define TLSF_FL_COUNT     26   // Supports blocks up to 8 GiB
+
+#define TLSF_BLOCK_HEADER 16   // size + prev_phys
+#define TLSF_MIN_PAYLOAD  16   // room for the free-list links
+
+typedef struct tlsf_block {
+    size_t size;                    // Payload size | TLSF_BLOCK_FREE
+    struct tlsf_block *prev_phys;   // Previous block in address order
+    struct tlsf_block *next_free;   // Free-list links (free blocks only)
+    struct tlsf_block *prev_free;
+} tlsf_block_t;
+
+typedef struct tlsf {
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[TLSF_FL_COUNT];
+    tlsf_block_t *blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    size_t free_bytes;
+    size_t pool_bytes;
+} tlsf_t;
+
+void tlsf_init(tlsf_t *tlsf);
+int tlsf_add_pool(tlsf_t *tlsf, void *mem, size_t bytes);
+
+// Pools can be removed again once every block in them has been freed
+int tlsf_remove_pool(tlsf_t *tlsf, void *mem, size_t bytes);
+int tlsf_pool_is_free(const void *mem, size_t bytes);
+void *tlsf_malloc(tlsf_t *tlsf, size_t size);
+int tlsf_free(tlsf_t *tlsf, void *ptr);
+
+// Resize a used block without moving it: grow into a free successor or
+// return the tail to the free lists. Returns -1 (block untouched) if the
+// successor cannot cover the new size.
+int tlsf_resize(tlsf_t *tlsf, void *ptr, size_t size);
+
+// Atomically mark a used block as being freed, without the pool's lock.
+// Fails (and reports a double free) if the block is free or already
+// claimed. Lets a block be queued for a deferred tlsf_free() safely.
+int tlsf_block_claim(void *ptr);
+size_t tlsf_block_size(const void *ptr);
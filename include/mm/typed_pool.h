@@ -0,0 +1,52 @@
+#pragma once
+#include "pool.h"
+
+/**
+ * Typed Pools
+ *
+ * DEFINE_TYPED_POOL(name, type, align, flags) defines a file-local pool of
+ * `type` objects and inline helpers around it:
+ *
+ *   int   name_pool_init(uint32_t initial_count);   // 0 or -1
+ *   void  name_pool_destroy(void);
+ *   type *name_alloc(void);
+ *   void  name_free(type *obj);
+ *
+ * name_alloc()/name_free() are pool_alloc_inline()/pool_free_inline() with
+ * the pool pointer and object type fixed at compile time: a %gs load and a
+ * list pop or push on this CPU's front cache, with the refill/spill paths
+ * out of line.
+ *
+ * align (a power of two up to POOL_CACHE_LINE, and no less than the type's
+ * own alignment) is checked at compile time.
+ * Pass POOL_PAD_CACHELINE in flags for objects that different CPUs write,
+ * so no two objects share a cache line:
+ *
+ *   DEFINE_TYPED_POOL(task_stats, task_stats_t, 8, POOL_PAD_CACHELINE)
+ */
+#define DEFINE_TYPED_POOL(name, type, align, flags)                                     \
+    _Static_assert((align) > 0 && ((align) & ((align) - 1)) == 0 &&                     \
+                   (align) <= POOL_CACHE_LINE, #name ": invalid pool alignment");       \
+    _Static_assert(_Alignof(type) <= (align),                                           \
+                   #name ": pool alignment below the type's alignment");                \
+                                                                                        \
+    static memory_pool_t *name##_pool;                                                  \
+                                                                                        \
+    static inline int name##_pool_init(uint32_t initial_count) {                        \
+        name##_pool = pool_create_aligned(#name, sizeof(type), (align), (flags),        \
+                                          initial_count);                               \
+        return name##_pool ? 0 : -1;                                                    \
+    }                                                                                   \
+                                                                                        \
+    static inline void name##_pool_destroy(void) {                                      \
+        pool_destroy(name##_pool);                                                      \
+        name##_pool = NULL;                                                             \
+    }                                                                                   \
+                                                                                        \
+    static inline type *name##_alloc(void) {                                            \
+        return (type *)pool_alloc_inline(name##_pool);                                  \
+    }                                                                                   \
+                                                                                        \
+    static inline void name##_free(type *obj) {                                         \
+        pool_free_inline(name##_pool, obj);                                             \
+    }
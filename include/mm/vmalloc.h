@@ -0,0 +1,52 @@
+#pragma once
+#include "../kernel/types.h"
+
+/**
+ * vmalloc - Virtually Contiguous Kernel Allocations
+ *
+ * vmalloc() reserves a range of kernel virtual address space and backs it
+ * with individual order-0 buddy pages mapped through vmm_map_page(), so a
+ * large buffer never needs a physically contiguous high-order block.
+ *
+ * The range lives in its own PML4 slot, away from the identity map and the
+ * kernel image. Every area is followed by an unmapped guard page so an
+ * overrun faults instead of corrupting the next area.
+ *
+ * vfree() unmaps and releases the pages immediately but does not flush the
+ * TLB. The virtual range is parked on a lazy list and only becomes reusable
+ * after a purge, which flushes the TLB once for every range collected so
+ * far. A purge runs when VMALLOC_LAZY_MAX_PAGES pages are pending or when
+ * an allocation cannot find free address space.
+ */
+#define VMALLOC_START          0xFFFFC90000000000ULL
+#define VMALLOC_SIZE           (1ULL << 39)   // One PML4 slot (512 GiB)
+#define VMALLOC_END            (VMALLOC_START + VMALLOC_SIZE)
+#define VMALLOC_LAZY_MAX_PAGES 8192           // Purge threshold (32 MiB)
+
+// A reserved, free or lazily freed range of vmalloc address space
+typedef struct vmap_area {
+    uint64_t start;              // Page-aligned start address
+    uint64_t size;               // Bytes, including the trailing guard page
+    struct vmap_area *next;
+} vmap_area_t;
+
+typedef struct vmalloc_stats {
+    uint64_t total_allocs;
+    uint64_t total_frees;
+    uint64_t mapped_pages;       // Pages currently backing live areas
+    uint64_t lazy_pages;         // Pages of address space awaiting a purge
+    uint64_t purges;             // TLB flushes performed by purges
+} vmalloc_stats_t;
+
+void vmalloc_init(void);
+void *vmalloc(size_t size);
+void *vzalloc(size_t size);
+void vfree(void *addr);
+
+// Usable size of a vmalloc allocation (0 if addr is not one)
+size_t vmalloc_size(const void *addr);
+int is_vmalloc_addr(const void *addr);
+
+// Flush the TLB and recycle all lazily freed ranges now
+void vmalloc_purge(void);
+void vmalloc_get_stats(vmalloc_stats_t *stats);
@@ -53,63 +53,63 @@ SECTION .text
 idt_load:
     lidt [rdi]
     ret
-%macro ISR_NOERR 1
+%macro ISR_NOERR 2
 %1:
     push qword 0
-    push qword %0
+    push qword %2
     jmp interrupt_common_stub
 %endmacro
-%macro ISR_ERR 1
+%macro ISR_ERR 2
 %1:
-    push qword %0
+    push qword %2
     jmp interrupt_common_stub
 %endmacro
-ISR_NOERR isr0
-ISR_NOERR isr1
-ISR_NOERR isr2
-ISR_NOERR isr3
-ISR_NOERR isr4
-ISR_NOERR isr5
-ISR_NOERR isr6
-ISR_NOERR isr7
-ISR_ERR   isr8
-ISR_NOERR isr9
-ISR_ERR   isr10
-ISR_ERR   isr11
-ISR_ERR   isr12
-ISR_ERR   isr13
-ISR_ERR   isr14
-ISR_NOERR isr15
-ISR_NOERR isr16
-ISR_NOERR isr17
-ISR_NOERR isr18
-ISR_NOERR isr19
-ISR_NOERR isr20
-ISR_NOERR isr21
-ISR_NOERR isr22
-ISR_NOERR isr23
-ISR_NOERR isr24
-ISR_NOERR isr25
-ISR_NOERR isr26
-ISR_NOERR isr27
-ISR_NOERR isr28
-ISR_NOERR isr29
-ISR_NOERR isr30
-ISR_NOERR isr31
-ISR_NOERR irq0
-ISR_NOERR irq1
-ISR_NOERR irq2
-ISR_NOERR irq3
-ISR_NOERR irq4
-ISR_NOERR irq5
-ISR_NOERR irq6
-ISR_NOERR irq7
-ISR_NOERR irq8
-ISR_NOERR irq9
-ISR_NOERR irq10
-ISR_NOERR irq11
-ISR_NOERR irq12
-ISR_NOERR irq13
-ISR_NOERR irq14
-ISR_NOERR irq15
+ISR_NOERR isr0, 0
+ISR_NOERR isr1, 1
+ISR_NOERR isr2, 2
+ISR_NOERR isr3, 3
+ISR_NOERR isr4, 4
+ISR_NOERR isr5, 5
+ISR_NOERR isr6, 6
+ISR_NOERR isr7, 7
+ISR_ERR   isr8, 8
+ISR_NOERR isr9, 9
+ISR_ERR   isr10, 10
+ISR_ERR   isr11, 11
+ISR_ERR   isr12, 12
+ISR_ERR   isr13, 13
+ISR_ERR   isr14, 14
+ISR_NOERR isr15, 15
+ISR_NOERR isr16, 16
+ISR_NOERR isr17, 17
+ISR_NOERR isr18, 18
+ISR_NOERR isr19, 19
+ISR_NOERR isr20, 20
+ISR_NOERR isr21, 21
+ISR_NOERR isr22, 22
+ISR_NOERR isr23, 23
+ISR_NOERR isr24, 24
+ISR_NOERR isr25, 25
+ISR_NOERR isr26, 26
+ISR_NOERR isr27, 27
+ISR_NOERR isr28, 28
+ISR_NOERR isr29, 29
+ISR_NOERR isr30, 30
+ISR_NOERR isr31, 31
+ISR_NOERR irq0, 32
+ISR_NOERR irq1, 33
+ISR_NOERR irq2, 34
+ISR_NOERR irq3, 35
+ISR_NOERR irq4, 36
+ISR_NOERR irq5, 37
+ISR_NOERR irq6, 38
+ISR_NOERR irq7, 39
+ISR_NOERR irq8, 40
+ISR_NOERR irq9, 41
+ISR_NOERR irq10, 42
+ISR_NOERR irq11, 43
+ISR_NOERR irq12, 44
+ISR_NOERR irq13, 45
+ISR_NOERR irq14, 46
+ISR_NOERR irq15, 47
 
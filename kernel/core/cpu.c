@@ -0,0 +1,42 @@
+#include "../../include/kernel/cpu.h"
+#include "../../include/kernel/stdio.h"
+
+static cpu_local_t g_cpu_locals[MAX_CPUS];
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr"
+                     :
+                     : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32))
+                     : "memory");
+}
+
+void cpu_local_init(uint32_t cpu_id) {
+    if (cpu_id >= MAX_CPUS) {
+        kprintf("[CPU] ERROR: CPU id %u exceeds MAX_CPUS (%u)\n", cpu_id, MAX_CPUS);
+        return;
+    }
+
+    cpu_local_t *local = &g_cpu_locals[cpu_id];
+    local->self = local;
+    local->id = cpu_id;
+    local->online = 1;
+
+    wrmsr(MSR_GS_BASE, (uint64_t)(uintptr_t)local);
+}
+
+cpu_local_t *cpu_local(uint32_t cpu_id) {
+    if (cpu_id >= MAX_CPUS) {
+        return NULL;
+    }
+    return &g_cpu_locals[cpu_id];
+}
+
+uint32_t cpu_online_count(void) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (g_cpu_locals[i].online) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -3,8 +3,14 @@
 #include "../../include/drivers/pic.h"
 #include "../../include/drivers/pit.h"
 #include "../../include/kernel/stdio.h"
+#include "../../include/mm/page_fault.h"
 
 void interrupt_handler(interrupt_frame_t *frame) {
+  // Page faults are the hot exception: COW and demand paging resolve them
+  if (frame->int_no == 14) {
+    page_fault_handler(frame);
+    return;
+  }
   if (frame->int_no < 32) {
     kprintf("Exception %u err=%u\n", (unsigned)frame->int_no,
             (unsigned)frame->err_code);
@@ -3,6 +3,7 @@
 #include "../../include/drivers/pic.h"
 #include "../../include/drivers/pit.h"
 #include "../../include/drivers/keyboard.h"
+#include "../../include/kernel/cpu.h"
 #include "../../include/kernel/gdt.h"
 #include "../../include/kernel/heap.h"
 #include "../../include/kernel/idt.h"
@@ -16,8 +17,11 @@
 #include "../../include/mm/buddy.h"
 #include "../../include/mm/slab.h"
 #include "../../include/mm/cow.h"
+#include "../../include/mm/rmap.h"
 #include "../../include/mm/demand_paging.h"
+#include "../../include/mm/ksm.h"
 #include "../../include/mm/page_cache.h"
+#include "../../include/mm/vmalloc.h"
 #include "../../include/kernel/test_runner.h"
 
 void kernel_main(uint32_t multiboot_magic, void *multiboot_info) {
@@ -27,6 +31,7 @@ void kernel_main(uint32_t multiboot_magic, void *multiboot_info) {
   kprintf("[PROMETHEUS] Initializing GDT... OK\n");
   gdt_init();
   gdt_load(0);
+  cpu_local_init(0);
   kprintf("[PROMETHEUS] Initializing IDT... OK\n");
   interrupts_init();
   kprintf("[PROMETHEUS] Initializing PIC... OK\n");
@@ -68,11 +73,19 @@ void kernel_main(uint32_t multiboot_magic, void *multiboot_info) {
   vmm_init();
   kprintf("[PROMETHEUS] Initializing VMM... OK\n");
   
-  // Initialize heap and enable slab integration
-  heap_init(0x0000000080000000ULL, 16 * 1024 * 1024ULL);
+  // Initialize heap (grows on demand) and enable slab integration
+  heap_init(HEAP_VIRT_START, HEAP_INITIAL_SIZE);
   heap_enable_slab();
   kprintf("[PROMETHEUS] Initializing Heap... OK\n");
   
+  // Initialize vmalloc (depends on VMM and slab)
+  vmalloc_init();
+  kprintf("[PROMETHEUS] Initializing vmalloc... OK\n");
+  
+  // Initialize reverse mapping (depends on slab)
+  rmap_init();
+  kprintf("[PROMETHEUS] Initializing Reverse Mapping... OK\n");
+  
   // Initialize advanced memory features
   cow_init();
   kprintf("[PROMETHEUS] Initializing COW... OK\n");
@@ -80,6 +93,9 @@ void kernel_main(uint32_t multiboot_magic, void *multiboot_info) {
   demand_paging_init();
   kprintf("[PROMETHEUS] Initializing Demand Paging... OK\n");
   
+  ksm_init();
+  kprintf("[PROMETHEUS] Initializing Same-Page Merging... OK\n");
+  
   // Initialize page cache with 1024 pages (4 MB)
   page_cache_init(1024);
   kprintf("[PROMETHEUS] Initializing Page Cache... OK\n");
@@ -98,6 +114,8 @@ void kernel_main(uint32_t multiboot_magic, void *multiboot_info) {
   
   kprintf("\n[PROMETHEUS] Tests complete. Awaiting input...\n");
   for (;;) {
+    // Merge duplicate pages while idle; the timer IRQ wakes us every tick
+    ksm_idle();
     __asm__ volatile("hlt");
   }
 }
@@ -6,10 +6,16 @@ void *memset(void *dest, int c, size_t n) {
   return dest;
 }
 void *memcpy(void *dest, const void *src, size_t n) {
-  unsigned char *d = dest;
-  const unsigned char *s = src;
-  for (size_t i = 0; i < n; i++)
-    d[i] = s[i];
+  // Bulk of the copy eight bytes at a time, then the remaining tail bytes
+  void *d = dest;
+  size_t qwords = n >> 3;
+  size_t bytes = n & 7;
+  __asm__ volatile("rep movsq\n\t"
+                   "movq %3, %%rcx\n\t"
+                   "rep movsb"
+                   : "+D"(d), "+S"(src), "+c"(qwords)
+                   : "r"(bytes)
+                   : "memory");
   return dest;
 }
 void *memmove(void *dest, const void *src, size_t n) {
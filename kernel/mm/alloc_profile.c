@@ -0,0 +1,513 @@
+#include "../../include/mm/alloc_profile.h"
+#include "../../include/mm/vmalloc.h"
+#include "../../include/kernel/spinlock.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+
+#if ALLOC_PROFILE
+
+#define KERNEL_TEXT_START   0xFFFFFFFF80000000ULL
+#define SITE_HASH_SIZE      (2 * ALLOC_PROFILE_MAX_SITES)
+#define LIVE_HASH_SIZE      8192
+#define PRINT_MAX           16
+
+extern char kernel_end[];
+
+// A tracked live object, chained in g_live_hash or on the free list
+typedef struct live_obj {
+    uint64_t addr;
+    uint64_t born;               // TSC at allocation
+    uint64_t size;
+    uint32_t site;
+    int32_t next;
+} live_obj_t;
+
+volatile uint32_t g_alloc_profile_enabled = 0;
+uint32_t g_alloc_profile_depth[MAX_CPUS];
+
+static spinlock_t g_profile_lock;
+static int g_profile_lock_ready = 0;
+
+static alloc_site_t *g_sites = NULL;
+static uint32_t g_site_count = 0;
+static uint16_t *g_site_hash = NULL;     // Site index + 1, 0 = empty
+static live_obj_t *g_live = NULL;
+static int32_t *g_live_hash = NULL;      // Chain heads, -1 = empty
+static int32_t g_live_free = -1;
+static uint32_t g_live_count = 0;
+static uint64_t g_dropped = 0;
+
+static spinlock_t g_report_lock;
+static alloc_site_t g_report[PRINT_MAX];
+
+static const char *g_type_names[ALLOC_PROFILE_TYPES] = {
+    "kmalloc", "slab", "buddy"
+};
+
+static inline uint64_t read_tsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t hash64(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// Keep the profiler's own allocations out of the profile
+static inline void profile_suspend(void) {
+    g_alloc_profile_depth[cpu_current_id()]++;
+}
+
+static inline void profile_resume(void) {
+    g_alloc_profile_depth[cpu_current_id()]--;
+}
+
+// Walk the frame-pointer chain from an allocator entry point's frame.
+// Stops at the first frame that does not look like a kernel stack frame.
+static void capture_stack(void *frame, uint64_t *stack) {
+    uint64_t *fp = (uint64_t *)frame;
+    for (uint32_t i = 0; i < ALLOC_PROFILE_DEPTH; i++) {
+        if (!fp || ((uintptr_t)fp & 7)) {
+            return;
+        }
+        uint64_t ret = fp[1];
+        if (ret < KERNEL_TEXT_START || ret >= (uint64_t)(uintptr_t)kernel_end) {
+            return;
+        }
+        stack[i] = ret;
+
+        uint64_t *next = (uint64_t *)(uintptr_t)fp[0];
+        if (next <= fp || (uintptr_t)next - (uintptr_t)fp > ALLOC_PROFILE_MAX_FRAME) {
+            return;
+        }
+        fp = next;
+    }
+}
+
+static uint32_t lifetime_bucket(uint64_t cycles) {
+    if (cycles < (1ULL << 10)) {
+        return 0;
+    }
+    uint32_t top = 63 - (uint32_t)__builtin_clzll(cycles);
+    uint32_t bucket = (top - 10) / 2 + 1;
+    return bucket < ALLOC_PROFILE_HIST_BUCKETS ? bucket : ALLOC_PROFILE_HIST_BUCKETS - 1;
+}
+
+// Clear every site and live object
+// Caller must hold g_profile_lock
+static void reset_locked(void) {
+    memset(g_sites, 0, ALLOC_PROFILE_MAX_SITES * sizeof(alloc_site_t));
+    memset(g_site_hash, 0, SITE_HASH_SIZE * sizeof(uint16_t));
+    for (uint32_t i = 0; i < LIVE_HASH_SIZE; i++) {
+        g_live_hash[i] = -1;
+    }
+    for (uint32_t i = 0; i < ALLOC_PROFILE_MAX_LIVE; i++) {
+        g_live[i].next = (i + 1 < ALLOC_PROFILE_MAX_LIVE) ? (int32_t)(i + 1) : -1;
+    }
+    g_live_free = 0;
+    g_live_count = 0;
+    g_site_count = 0;
+    g_dropped = 0;
+}
+
+// Find or create the site for a type and stack; -1 if the table is full
+// Caller must hold g_profile_lock
+static int32_t site_lookup(uint32_t type, const uint64_t *stack) {
+    uint64_t key = type;
+    for (uint32_t i = 0; i < ALLOC_PROFILE_DEPTH; i++) {
+        key = hash64(key ^ stack[i]);
+    }
+
+    uint32_t slot = (uint32_t)key & (SITE_HASH_SIZE - 1);
+    for (uint32_t probe = 0; probe < SITE_HASH_SIZE; probe++) {
+        uint16_t entry = g_site_hash[slot];
+        if (entry == 0) {
+            break;
+        }
+        alloc_site_t *site = &g_sites[entry - 1];
+        if (site->type == type && memcmp(site->stack, stack, sizeof(site->stack)) == 0) {
+            return (int32_t)(entry - 1);
+        }
+        slot = (slot + 1) & (SITE_HASH_SIZE - 1);
+    }
+
+    if (g_site_count >= ALLOC_PROFILE_MAX_SITES) {
+        return -1;
+    }
+
+    uint32_t id = g_site_count++;
+    alloc_site_t *site = &g_sites[id];
+    memcpy(site->stack, stack, sizeof(site->stack));
+    site->type = type;
+    site->id = id;
+    g_site_hash[slot] = (uint16_t)(id + 1);
+    return (int32_t)id;
+}
+
+// Unlink and return the live entry for addr, or -1
+// Caller must hold g_profile_lock
+static int32_t live_remove(uint64_t addr) {
+    uint32_t bucket = (uint32_t)hash64(addr) & (LIVE_HASH_SIZE - 1);
+    int32_t prev = -1;
+    int32_t curr = g_live_hash[bucket];
+    while (curr >= 0 && g_live[curr].addr != addr) {
+        prev = curr;
+        curr = g_live[curr].next;
+    }
+    if (curr < 0) {
+        return -1;
+    }
+    if (prev >= 0) {
+        g_live[prev].next = g_live[curr].next;
+    } else {
+        g_live_hash[bucket] = g_live[curr].next;
+    }
+    g_live_count--;
+    return curr;
+}
+
+static void live_release(int32_t index) {
+    g_live[index].next = g_live_free;
+    g_live_free = index;
+}
+
+void alloc_profile_alloc(uint32_t type, uint64_t addr, size_t size, void *frame) {
+    if (!addr || type >= ALLOC_PROFILE_TYPES ||
+        g_alloc_profile_depth[cpu_current_id()] != 1) {
+        return;
+    }
+
+    uint64_t stack[ALLOC_PROFILE_DEPTH];
+    memset(stack, 0, sizeof(stack));
+    capture_stack(frame, stack);
+    uint64_t now = read_tsc();
+
+    spinlock_acquire(&g_profile_lock);
+
+    // A stale entry means the old owner was freed while profiling was off
+    int32_t stale = live_remove(addr);
+    if (stale >= 0) {
+        alloc_site_t *old = &g_sites[g_live[stale].site];
+        old->live_objects--;
+        old->live_bytes -= (int64_t)g_live[stale].size;
+        live_release(stale);
+    }
+
+    int32_t id = site_lookup(type, stack);
+    if (id < 0) {
+        g_dropped++;
+        spinlock_release(&g_profile_lock);
+        return;
+    }
+
+    alloc_site_t *site = &g_sites[id];
+    site->allocs++;
+    site->bytes += size;
+
+    // Without a live entry the free cannot be matched, so only count the
+    // object as live if it is tracked
+    if (g_live_free >= 0) {
+        int32_t index = g_live_free;
+        g_live_free = g_live[index].next;
+
+        uint32_t bucket = (uint32_t)hash64(addr) & (LIVE_HASH_SIZE - 1);
+        g_live[index].addr = addr;
+        g_live[index].born = now;
+        g_live[index].size = size;
+        g_live[index].site = (uint32_t)id;
+        g_live[index].next = g_live_hash[bucket];
+        g_live_hash[bucket] = index;
+        g_live_count++;
+
+        site->live_objects++;
+        site->live_bytes += (int64_t)size;
+    } else {
+        g_dropped++;
+    }
+
+    spinlock_release(&g_profile_lock);
+}
+
+void alloc_profile_free(uint64_t addr) {
+    if (!addr || g_alloc_profile_depth[cpu_current_id()] != 1) {
+        return;
+    }
+
+    uint64_t now = read_tsc();
+    spinlock_acquire(&g_profile_lock);
+
+    int32_t index = live_remove(addr);
+    if (index >= 0) {
+        live_obj_t *obj = &g_live[index];
+        alloc_site_t *site = &g_sites[obj->site];
+        site->frees++;
+        site->live_objects--;
+        site->live_bytes -= (int64_t)obj->size;
+        site->lifetime[lifetime_bucket(now - obj->born)]++;
+        live_release(index);
+    }
+
+    spinlock_release(&g_profile_lock);
+}
+
+int alloc_profile_enable(void) {
+    if (!g_profile_lock_ready) {
+        spinlock_init(&g_profile_lock);
+        spinlock_init(&g_report_lock);
+        g_profile_lock_ready = 1;
+    }
+
+    if (!g_sites) {
+        profile_suspend();
+        g_sites = (alloc_site_t *)vzalloc(ALLOC_PROFILE_MAX_SITES * sizeof(alloc_site_t));
+        g_site_hash = (uint16_t *)vzalloc(SITE_HASH_SIZE * sizeof(uint16_t));
+        g_live = (live_obj_t *)vzalloc(ALLOC_PROFILE_MAX_LIVE * sizeof(live_obj_t));
+        g_live_hash = (int32_t *)vzalloc(LIVE_HASH_SIZE * sizeof(int32_t));
+        profile_resume();
+
+        if (!g_sites || !g_site_hash || !g_live || !g_live_hash) {
+            kprintf("[PROFILE] ERROR: Failed to allocate profiler tables\n");
+            profile_suspend();
+            vfree(g_sites);
+            vfree(g_site_hash);
+            vfree(g_live);
+            vfree(g_live_hash);
+            profile_resume();
+            g_sites = NULL;
+            g_site_hash = NULL;
+            g_live = NULL;
+            g_live_hash = NULL;
+            return -1;
+        }
+
+        spinlock_acquire(&g_profile_lock);
+        reset_locked();
+        spinlock_release(&g_profile_lock);
+    }
+
+    g_alloc_profile_enabled = 1;
+    return 0;
+}
+
+void alloc_profile_disable(void) {
+    g_alloc_profile_enabled = 0;
+}
+
+int alloc_profile_is_enabled(void) {
+    return g_alloc_profile_enabled != 0;
+}
+
+void alloc_profile_reset(void) {
+    if (!g_sites) {
+        return;
+    }
+    spinlock_acquire(&g_profile_lock);
+    reset_locked();
+    spinlock_release(&g_profile_lock);
+}
+
+void alloc_profile_get_stats(alloc_profile_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+    memset(stats, 0, sizeof(alloc_profile_stats_t));
+    if (!g_sites) {
+        return;
+    }
+    spinlock_acquire(&g_profile_lock);
+    stats->sites = g_site_count;
+    stats->live_tracked = g_live_count;
+    stats->dropped = g_dropped;
+    spinlock_release(&g_profile_lock);
+}
+
+alloc_profile_snapshot_t *alloc_profile_snapshot(void) {
+    if (!g_sites) {
+        kprintf("[PROFILE] ERROR: Snapshot requested before alloc_profile_enable()\n");
+        return NULL;
+    }
+
+    profile_suspend();
+    alloc_profile_snapshot_t *snap =
+        (alloc_profile_snapshot_t *)vmalloc(sizeof(alloc_profile_snapshot_t));
+    profile_resume();
+    if (!snap) {
+        kprintf("[PROFILE] ERROR: Failed to allocate snapshot\n");
+        return NULL;
+    }
+
+    spinlock_acquire(&g_profile_lock);
+    snap->count = g_site_count;
+    snap->taken_at = read_tsc();
+    memcpy(snap->sites, g_sites, g_site_count * sizeof(alloc_site_t));
+    spinlock_release(&g_profile_lock);
+    return snap;
+}
+
+void alloc_profile_snapshot_free(alloc_profile_snapshot_t *snap) {
+    profile_suspend();
+    vfree(snap);
+    profile_resume();
+}
+
+static int64_t site_key(const alloc_site_t *site, alloc_profile_key_t key) {
+    return key == ALLOC_PROFILE_BY_ALLOCS ? (int64_t)site->allocs : site->live_bytes;
+}
+
+uint32_t alloc_profile_diff(const alloc_profile_snapshot_t *before,
+                            const alloc_profile_snapshot_t *after,
+                            alloc_profile_key_t key, alloc_site_t *out, uint32_t max) {
+    if (!after || !out || max == 0) {
+        return 0;
+    }
+
+    uint32_t found = 0;
+    for (uint32_t id = 0; id < after->count; id++) {
+        alloc_site_t delta = after->sites[id];
+        if (before && id < before->count) {
+            const alloc_site_t *old = &before->sites[id];
+            delta.allocs -= old->allocs;
+            delta.frees -= old->frees;
+            delta.bytes -= old->bytes;
+            delta.live_objects -= old->live_objects;
+            delta.live_bytes -= old->live_bytes;
+            for (uint32_t b = 0; b < ALLOC_PROFILE_HIST_BUCKETS; b++) {
+                delta.lifetime[b] -= old->lifetime[b];
+            }
+        }
+
+        int64_t value = site_key(&delta, key);
+        if (value <= 0) {
+            continue;
+        }
+
+        // Insertion into the top-max list, largest first
+        uint32_t pos = found < max ? found : max;
+        while (pos > 0 && site_key(&out[pos - 1], key) < value) {
+            if (pos < max) {
+                out[pos] = out[pos - 1];
+            }
+            pos--;
+        }
+        if (pos < max) {
+            out[pos] = delta;
+            if (found < max) {
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+static void print_site(const alloc_site_t *site, int show_lifetimes) {
+    kprintf("  #%u %s: live %lld B / %lld objs, %llu allocs, %llu frees, %llu B total\n",
+            site->id, g_type_names[site->type], site->live_bytes, site->live_objects,
+            site->allocs, site->frees, site->bytes);
+    kprintf("    at");
+    for (uint32_t i = 0; i < ALLOC_PROFILE_DEPTH && site->stack[i]; i++) {
+        kprintf(" 0x%llx", site->stack[i]);
+    }
+    kprintf("\n");
+
+    if (show_lifetimes && site->frees) {
+        kprintf("    lifetimes:");
+        for (uint32_t b = 0; b < ALLOC_PROFILE_HIST_BUCKETS; b++) {
+            kprintf(" %llu", site->lifetime[b]);
+        }
+        kprintf("\n");
+    }
+}
+
+void alloc_profile_print_diff(const alloc_profile_snapshot_t *before,
+                              const alloc_profile_snapshot_t *after, uint32_t top_n) {
+    if (!after) {
+        return;
+    }
+    if (top_n > PRINT_MAX) {
+        top_n = PRINT_MAX;
+    }
+
+    spinlock_acquire(&g_report_lock);
+
+    uint32_t n = alloc_profile_diff(before, after, ALLOC_PROFILE_BY_LIVE_BYTES, g_report, top_n);
+    kprintf("[PROFILE] Top %u sites by live bytes growth:\n", n);
+    for (uint32_t i = 0; i < n; i++) {
+        print_site(&g_report[i], 0);
+    }
+
+    n = alloc_profile_diff(before, after, ALLOC_PROFILE_BY_ALLOCS, g_report, top_n);
+    kprintf("[PROFILE] Top %u sites by allocations:\n", n);
+    for (uint32_t i = 0; i < n; i++) {
+        print_site(&g_report[i], 1);
+    }
+
+    spinlock_release(&g_report_lock);
+}
+
+void alloc_profile_dump(uint32_t top_n) {
+    alloc_profile_snapshot_t *snap = alloc_profile_snapshot();
+    if (!snap) {
+        return;
+    }
+
+    alloc_profile_stats_t stats;
+    alloc_profile_get_stats(&stats);
+    kprintf("[PROFILE] %u sites, %u live objects tracked, %llu events dropped\n",
+            stats.sites, stats.live_tracked, stats.dropped);
+
+    alloc_profile_print_diff(NULL, snap, top_n);
+    alloc_profile_snapshot_free(snap);
+}
+
+#else
+
+int alloc_profile_enable(void) {
+    kprintf("[PROFILE] ERROR: Kernel built without ALLOC_PROFILE\n");
+    return -1;
+}
+
+void alloc_profile_disable(void) {
+}
+
+int alloc_profile_is_enabled(void) {
+    return 0;
+}
+
+void alloc_profile_reset(void) {
+}
+
+void alloc_profile_get_stats(alloc_profile_stats_t *stats) {
+    if (stats) {
+        memset(stats, 0, sizeof(alloc_profile_stats_t));
+    }
+}
+
+alloc_profile_snapshot_t *alloc_profile_snapshot(void) {
+    return NULL;
+}
+
+void alloc_profile_snapshot_free(alloc_profile_snapshot_t *snap) {
+    (void)snap;
+}
+
+uint32_t alloc_profile_diff(const alloc_profile_snapshot_t *before,
+                            const alloc_profile_snapshot_t *after,
+                            alloc_profile_key_t key, alloc_site_t *out, uint32_t max) {
+    (void)before; (void)after; (void)key; (void)out; (void)max;
+    return 0;
+}
+
+void alloc_profile_print_diff(const alloc_profile_snapshot_t *before,
+                              const alloc_profile_snapshot_t *after, uint32_t top_n) {
+    (void)before; (void)after; (void)top_n;
+}
+
+void alloc_profile_dump(uint32_t top_n) {
+    (void)top_n;
+}
+
+#endif
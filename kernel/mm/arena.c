@@ -0,0 +1,174 @@
+#include "../../include/mm/arena.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+
+#define ARENA_MAX_REQUEST ((size_t)BUDDY_PAGE_SIZE << BUDDY_MAX_ORDER)
+
+static inline size_t chunk_bytes(const arena_chunk_t *chunk) {
+    return (size_t)BUDDY_PAGE_SIZE << chunk->order;
+}
+
+static inline uint8_t *chunk_end(arena_chunk_t *chunk) {
+    return (uint8_t *)chunk + chunk_bytes(chunk);
+}
+
+void arena_init(mem_arena_t *arena, const char *name, uint32_t chunk_order) {
+    if (!arena) {
+        return;
+    }
+
+    memset(arena, 0, sizeof(mem_arena_t));
+    if (name) {
+        strncpy(arena->name, name, ARENA_NAME_MAX - 1);
+        arena->name[ARENA_NAME_MAX - 1] = '\0';
+    }
+    arena->chunk_order = chunk_order > BUDDY_MAX_ORDER ? BUDDY_MAX_ORDER : chunk_order;
+}
+
+// Give back a chunk popped off the arena, keeping one default-order chunk
+// so a rewind followed by new allocations stays off the buddy allocator
+static void arena_release_chunk(mem_arena_t *arena, arena_chunk_t *chunk) {
+    arena->chunks--;
+    arena->reserved_bytes -= chunk_bytes(chunk);
+
+    if (!arena->spare && chunk->order == arena->chunk_order) {
+        arena->spare = chunk;
+        return;
+    }
+    buddy_free_pages((uint64_t)(uintptr_t)chunk, chunk->order);
+}
+
+// Start a new chunk large enough for size bytes at align and carve them
+// out of it
+static void *arena_alloc_slow(mem_arena_t *arena, size_t size, size_t align) {
+    size_t need = sizeof(arena_chunk_t) + (align - 1) + size;
+    uint32_t order = arena->chunk_order;
+    while (order < BUDDY_MAX_ORDER && ((size_t)BUDDY_PAGE_SIZE << order) < need) {
+        order++;
+    }
+    if (((size_t)BUDDY_PAGE_SIZE << order) < need) {
+        kprintf("[ARENA] ERROR: %s: %zu-byte request exceeds the largest chunk\n",
+                arena->name, size);
+        return NULL;
+    }
+
+    arena_chunk_t *chunk;
+    if (arena->spare && order == arena->chunk_order) {
+        chunk = arena->spare;
+        arena->spare = NULL;
+    } else {
+        uint64_t phys = buddy_alloc_pages(order, BUDDY_ZONE_UNMOVABLE);
+        if (phys == 0) {
+            kprintf("[ARENA] ERROR: %s: out of memory for an order-%u chunk\n",
+                    arena->name, order);
+            return NULL;
+        }
+        chunk = (arena_chunk_t *)(uintptr_t)phys;
+    }
+
+    chunk->prev = arena->current;
+    chunk->order = order;
+    chunk->reserved = 0;
+
+    arena->current = chunk;
+    arena->end = chunk_end(chunk);
+    arena->chunks++;
+    arena->reserved_bytes += chunk_bytes(chunk);
+    if (arena->reserved_bytes > arena->peak_bytes) {
+        arena->peak_bytes = arena->reserved_bytes;
+    }
+
+    uint8_t *base = (uint8_t *)(chunk + 1);
+    uint8_t *obj = (uint8_t *)(((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1));
+    arena->ptr = obj + size;
+    arena->allocated += (size_t)(arena->ptr - base);
+    return obj;
+}
+
+void *arena_alloc_aligned(mem_arena_t *arena, size_t size, size_t align) {
+    if (!arena || size == 0 || size > ARENA_MAX_REQUEST) {
+        return NULL;
+    }
+    if (align == 0 || (align & (align - 1)) || align > ARENA_MAX_ALIGN) {
+        kprintf("[ARENA] ERROR: %s: invalid alignment %zu\n", arena->name, align);
+        return NULL;
+    }
+
+    // Chunk ends are page aligned, so aligning up never passes end
+    uint8_t *obj = (uint8_t *)(((uintptr_t)arena->ptr + align - 1) & ~(uintptr_t)(align - 1));
+    if (arena->current && size <= (size_t)(arena->end - obj)) {
+        arena->allocated += (size_t)(obj + size - arena->ptr);
+        arena->ptr = obj + size;
+        return obj;
+    }
+
+    return arena_alloc_slow(arena, size, align);
+}
+
+void *arena_alloc(mem_arena_t *arena, size_t size) {
+    return arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGN);
+}
+
+void *arena_zalloc(mem_arena_t *arena, size_t size) {
+    void *obj = arena_alloc_aligned(arena, size, ARENA_DEFAULT_ALIGN);
+    if (obj) {
+        memset(obj, 0, size);
+    }
+    return obj;
+}
+
+arena_mark_t arena_mark(const mem_arena_t *arena) {
+    arena_mark_t mark = { NULL, NULL, 0 };
+    if (arena) {
+        mark.chunk = arena->current;
+        mark.ptr = arena->ptr;
+        mark.allocated = arena->allocated;
+    }
+    return mark;
+}
+
+void arena_rewind(mem_arena_t *arena, arena_mark_t mark) {
+    if (!arena) {
+        return;
+    }
+
+    // Chunks started after the mark go back whole
+    while (arena->current && arena->current != mark.chunk) {
+        arena_chunk_t *chunk = arena->current;
+        arena->current = chunk->prev;
+        arena_release_chunk(arena, chunk);
+    }
+
+    if (!arena->current) {
+        arena->ptr = NULL;
+        arena->end = NULL;
+        arena->allocated = 0;
+        if (mark.chunk) {
+            kprintf("[ARENA] ERROR: %s: rewind to a mark from another arena\n", arena->name);
+        }
+        return;
+    }
+
+    arena->ptr = mark.ptr;
+    arena->end = chunk_end(arena->current);
+    arena->allocated = mark.allocated;
+}
+
+void arena_reset(mem_arena_t *arena) {
+    arena_mark_t empty = { NULL, NULL, 0 };
+    arena_rewind(arena, empty);
+}
+
+void arena_destroy(mem_arena_t *arena) {
+    if (!arena) {
+        return;
+    }
+
+    arena_reset(arena);
+    if (arena->spare) {
+        buddy_free_pages((uint64_t)(uintptr_t)arena->spare, arena->spare->order);
+        arena->spare = NULL;
+    }
+    arena->peak_bytes = 0;
+}
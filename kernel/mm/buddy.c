@@ -1,13 +1,31 @@
 #include "../../include/mm/buddy.h"
 #include "../../include/mm/gfp.h"
+#include "../../include/mm/page.h"
+#include "../../include/mm/alloc_profile.h"
+#include "../../include/mm/rmap.h"
 #include "../../include/kernel/config.h"
 #include "../../include/kernel/string.h"
 #include "../../include/kernel/stdio.h"
+#include "../../include/kernel/cpu.h"
 
 static buddy_zone_t g_zones[BUDDY_ZONE_COUNT];
 static uint64_t g_memory_start;
 static uint64_t g_memory_size;
 static uint8_t g_allocation_bitmap[1024 * 1024];
+static page_t *g_page_map;
+static uint64_t g_page_map_count;
+
+static buddy_shrinker_t g_shrinkers[BUDDY_MAX_SHRINKERS];
+static volatile uint32_t g_shrinker_count;
+static spinlock_t g_shrinker_lock;
+static uint32_t g_reclaiming[MAX_CPUS];   // Per-CPU recursion guard
+
+// Zones tried, in order, when the requested zone has no suitable block
+static const buddy_zone_type_t g_zone_fallback[BUDDY_ZONE_COUNT][BUDDY_ZONE_COUNT] = {
+    [BUDDY_ZONE_UNMOVABLE]   = { BUDDY_ZONE_UNMOVABLE, BUDDY_ZONE_RECLAIMABLE, BUDDY_ZONE_MOVABLE },
+    [BUDDY_ZONE_RECLAIMABLE] = { BUDDY_ZONE_RECLAIMABLE, BUDDY_ZONE_UNMOVABLE, BUDDY_ZONE_MOVABLE },
+    [BUDDY_ZONE_MOVABLE]     = { BUDDY_ZONE_MOVABLE, BUDDY_ZONE_RECLAIMABLE, BUDDY_ZONE_UNMOVABLE },
+};
 
 static inline uint64_t pages_to_bytes(uint64_t pages) {
     return pages * BUDDY_PAGE_SIZE;
@@ -56,6 +74,23 @@ static inline uint64_t get_buddy_address(uint64_t addr, uint32_t order) {
     return page_index_to_addr(buddy_index);
 }
 
+page_t *buddy_phys_to_page(uint64_t phys_addr) {
+    if (!g_page_map || phys_addr < g_memory_start) {
+        return NULL;
+    }
+    
+    uint64_t index = addr_to_page_index(phys_addr);
+    if (index >= g_page_map_count) {
+        return NULL;
+    }
+    
+    return &g_page_map[index];
+}
+
+uint64_t buddy_page_to_phys(page_t *page) {
+    return page_index_to_addr((uint64_t)(page - g_page_map));
+}
+
 static void list_add(buddy_block_t **head, buddy_block_t *block) {
     block->next = *head;
     block->prev = NULL;
@@ -86,6 +121,8 @@ void buddy_init(uint64_t memory_start, uint64_t memory_size) {
         g_allocation_bitmap[i] = 0;
     }
     
+    spinlock_init(&g_shrinker_lock);
+    
     for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
         buddy_zone_t *zone = &g_zones[z];
         spinlock_init(&zone->lock);
@@ -102,13 +139,32 @@ void buddy_init(uint64_t memory_start, uint64_t memory_size) {
         zone->map_size = sizeof(g_allocation_bitmap);
     }
     
-    buddy_zone_t *zone = &g_zones[BUDDY_ZONE_UNMOVABLE];
+    // Carve the page descriptor array from the start of managed memory
     uint64_t total_pages = bytes_to_pages(memory_size);
-    zone->total_pages = total_pages;
-    zone->free_pages = total_pages;
+    uint64_t map_pages = bytes_to_pages(total_pages * sizeof(page_t));
+    if (map_pages >= total_pages) {
+        kprintf("[BUDDY] ERROR: Region too small for page descriptors (%llu pages)\n", total_pages);
+        g_page_map = NULL;
+        g_page_map_count = 0;
+        g_memory_size = 0;
+        return;
+    }
+    
+    g_page_map = (page_t *)(uintptr_t)memory_start;
+    g_page_map_count = total_pages;
+    memset(g_page_map, 0, total_pages * sizeof(page_t));
+    
+    for (uint64_t i = 0; i < map_pages; i++) {
+        g_page_map[i].flags = PAGE_FLAG_RESERVED;
+        set_allocation_bit(i, 0);
+    }
+    
+    buddy_zone_t *zone = &g_zones[BUDDY_ZONE_UNMOVABLE];
+    zone->total_pages = total_pages - map_pages;
+    zone->free_pages = total_pages - map_pages;
     
-    uint64_t current_addr = memory_start;
-    uint64_t remaining_pages = total_pages;
+    uint64_t current_addr = memory_start + pages_to_bytes(map_pages);
+    uint64_t remaining_pages = total_pages - map_pages;
     
     while (remaining_pages > 0) {
         uint32_t order = BUDDY_MAX_ORDER;
@@ -129,43 +185,31 @@ void buddy_init(uint64_t memory_start, uint64_t memory_size) {
     }
 }
 
-uint64_t buddy_alloc_pages(uint32_t order, buddy_zone_type_t zone_type) {
-    // Validate order parameter
-    if (order > BUDDY_MAX_ORDER) {
-        kprintf("[BUDDY] ERROR: Invalid order %u (max %u)\n", order, BUDDY_MAX_ORDER);
-        return 0;
-    }
-    
-    // Validate and sanitize zone type
-    if (zone_type >= BUDDY_ZONE_COUNT) {
-        kprintf("[BUDDY] WARNING: Invalid zone type %u, using UNMOVABLE\n", zone_type);
-        zone_type = BUDDY_ZONE_UNMOVABLE;
-    }
-    
+// Take a block of the given order that ends at or below limit from a zone
+// whose lock is held, or return 0 if it has none
+static uint64_t alloc_from_zone_locked(uint32_t order, buddy_zone_type_t zone_type, uint64_t limit) {
     buddy_zone_t *zone = &g_zones[zone_type];
     
-    // Check for NULL zone (shouldn't happen, but defensive)
-    if (!zone) {
-        kprintf("[BUDDY] ERROR: NULL zone pointer\n");
-        return 0;
-    }
-    
-    spinlock_acquire(&zone->lock);
-    
-    // Find a free block of sufficient size
+    // Find a free block of sufficient size. Splitting keeps the low half,
+    // so a larger block qualifies if its first 2^order pages do; without a
+    // limit the list head always does.
     uint32_t current_order = order;
-    while (current_order <= BUDDY_MAX_ORDER && zone->free_lists[current_order] == NULL) {
-        current_order++;
+    buddy_block_t *block = NULL;
+    for (; current_order <= BUDDY_MAX_ORDER; current_order++) {
+        block = zone->free_lists[current_order];
+        while (block && (uint64_t)(uintptr_t)block + pages_to_bytes(1ULL << order) > limit) {
+            block = block->next;
+        }
+        if (block) {
+            break;
+        }
     }
     
     // No free blocks available
-    if (current_order > BUDDY_MAX_ORDER) {
-        spinlock_release(&zone->lock);
-        kprintf("[BUDDY] ERROR: Out of memory (order %u, zone %u)\n", order, zone_type);
+    if (!block) {
         return 0;
     }
     
-    buddy_block_t *block = zone->free_lists[current_order];
     list_remove(&zone->free_lists[current_order], block);
     zone->free_counts[current_order]--;
     
@@ -183,14 +227,72 @@ uint64_t buddy_alloc_pages(uint32_t order, buddy_zone_type_t zone_type) {
     uint64_t page_index = addr_to_page_index(allocated_addr);
     set_allocation_bit(page_index, order);
     
+    page_t *page = &g_page_map[page_index];
+    page->flags = 0;
+    page->order = (uint16_t)order;
+    page->zone = (uint16_t)zone_type;
+    page->owner = NULL;
+    page->refcount = 0;
+    
     uint64_t allocated_pages = 1ULL << order;
     zone->free_pages -= allocated_pages;
     
-    spinlock_release(&zone->lock);
     return allocated_addr;
 }
 
-void buddy_free_pages(uint64_t address, uint32_t order) {
+// Take a block of the given order from one zone, or return 0 if it has none
+static uint64_t alloc_from_zone(uint32_t order, buddy_zone_type_t zone_type, uint64_t limit) {
+    buddy_zone_t *zone = &g_zones[zone_type];
+    
+    spinlock_acquire(&zone->lock);
+    uint64_t addr = alloc_from_zone_locked(order, zone_type, limit);
+    spinlock_release(&zone->lock);
+    return addr;
+}
+
+static uint64_t alloc_pages(uint32_t order, buddy_zone_type_t zone_type, uint64_t limit) {
+    // Validate order parameter
+    if (order > BUDDY_MAX_ORDER) {
+        kprintf("[BUDDY] ERROR: Invalid order %u (max %u)\n", order, BUDDY_MAX_ORDER);
+        return 0;
+    }
+    
+    // Validate and sanitize zone type
+    if (zone_type >= BUDDY_ZONE_COUNT) {
+        kprintf("[BUDDY] WARNING: Invalid zone type %u, using UNMOVABLE\n", zone_type);
+        zone_type = BUDDY_ZONE_UNMOVABLE;
+    }
+    
+    // Try the requested zone first, then fall back; the page descriptor
+    // records the zone actually used so the block is freed back there.
+    // If everything is empty, ask the shrinkers for memory and retry once.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        for (int i = 0; i < BUDDY_ZONE_COUNT; i++) {
+            buddy_zone_type_t candidate = g_zone_fallback[zone_type][i];
+            uint64_t addr = alloc_from_zone(order, candidate, limit);
+            if (addr) {
+                if (candidate != zone_type) {
+                    DEBUG_PRINT(BUDDY, "Zone %u empty for order %u, fell back to zone %u\n",
+                                zone_type, order, candidate);
+                }
+                return addr;
+            }
+        }
+        if (attempt == 0 && buddy_reclaim() == 0) {
+            break;
+        }
+    }
+    
+    if (limit != BUDDY_NO_LIMIT) {
+        kprintf("[BUDDY] ERROR: Out of memory below 0x%llx (order %u, zone %u)\n",
+                limit, order, zone_type);
+        return 0;
+    }
+    kprintf("[BUDDY] ERROR: Out of memory (order %u, zone %u)\n", order, zone_type);
+    return 0;
+}
+
+static void free_pages(uint64_t address, uint32_t order) {
     // Validate parameters
     if (order > BUDDY_MAX_ORDER) {
         kprintf("[BUDDY] ERROR: Invalid order %u in free (max %u)\n", order, BUDDY_MAX_ORDER);
@@ -214,14 +316,34 @@ void buddy_free_pages(uint64_t address, uint32_t order) {
         return;
     }
     
-    buddy_zone_type_t zone_type = BUDDY_ZONE_UNMOVABLE;
+    if (g_page_map[addr_to_page_index(address)].flags & PAGE_FLAG_RESERVED) {
+        kprintf("[BUDDY] ERROR: Attempt to free reserved page 0x%llx\n", address);
+        return;
+    }
+    
+    // Return the block to the zone it was allocated from
+    uint64_t page_index = addr_to_page_index(address);
+    page_t *page = &g_page_map[page_index];
+    buddy_zone_type_t zone_type = (buddy_zone_type_t)page->zone;
+    
+    // Leave the frame's rmap group before the descriptor is reset
+    if (page->flags & PAGE_FLAG_ANON) {
+        rmap_page_freed(page);
+    }
+    if (zone_type >= BUDDY_ZONE_COUNT) {
+        zone_type = BUDDY_ZONE_UNMOVABLE;
+    }
     buddy_zone_t *zone = &g_zones[zone_type];
     
     spinlock_acquire(&zone->lock);
     
-    uint64_t page_index = addr_to_page_index(address);
     clear_allocation_bit(page_index, order);
     
+    // Drop owner metadata so stale lookups cannot match a freed page
+    page->flags = 0;
+    page->owner = NULL;
+    page->refcount = 0;
+    
     uint64_t current_addr = address;
     uint32_t current_order = order;
     
@@ -271,6 +393,135 @@ void buddy_free_pages(uint64_t address, uint32_t order) {
     spinlock_release(&zone->lock);
 }
 
+uint64_t buddy_alloc_pages(uint32_t order, buddy_zone_type_t zone_type) {
+    int prof = alloc_profile_enter();
+    uint64_t addr = alloc_pages(order, zone_type, BUDDY_NO_LIMIT);
+    if (prof) {
+        alloc_profile_alloc(ALLOC_PROFILE_BUDDY, addr, pages_to_bytes(1ULL << order),
+                            __builtin_frame_address(0));
+    }
+    alloc_profile_exit(prof);
+    return addr;
+}
+
+uint64_t buddy_alloc_pages_below(uint32_t order, buddy_zone_type_t zone_type, uint64_t limit) {
+    int prof = alloc_profile_enter();
+    uint64_t addr = alloc_pages(order, zone_type, limit);
+    if (prof) {
+        alloc_profile_alloc(ALLOC_PROFILE_BUDDY, addr, pages_to_bytes(1ULL << order),
+                            __builtin_frame_address(0));
+    }
+    alloc_profile_exit(prof);
+    return addr;
+}
+
+uint32_t buddy_alloc_pages_bulk(uint32_t count, buddy_zone_type_t zone_type, uint64_t *pages) {
+    if (!pages || count == 0) {
+        return 0;
+    }
+    if (zone_type >= BUDDY_ZONE_COUNT) {
+        zone_type = BUDDY_ZONE_UNMOVABLE;
+    }
+    
+    // One lock round-trip per zone instead of one per page
+    uint32_t allocated = 0;
+    for (int i = 0; i < BUDDY_ZONE_COUNT && allocated < count; i++) {
+        buddy_zone_type_t candidate = g_zone_fallback[zone_type][i];
+        buddy_zone_t *zone = &g_zones[candidate];
+        spinlock_acquire(&zone->lock);
+        while (allocated < count) {
+            uint64_t addr = alloc_from_zone_locked(0, candidate, BUDDY_NO_LIMIT);
+            if (!addr) {
+                break;
+            }
+            pages[allocated++] = addr;
+        }
+        spinlock_release(&zone->lock);
+    }
+    
+    int prof = alloc_profile_enter();
+    if (prof) {
+        for (uint32_t i = 0; i < allocated; i++) {
+            alloc_profile_alloc(ALLOC_PROFILE_BUDDY, pages[i], BUDDY_PAGE_SIZE, __builtin_frame_address(0));
+        }
+    }
+    alloc_profile_exit(prof);
+    return allocated;
+}
+
+void buddy_free_pages(uint64_t address, uint32_t order) {
+    int prof = alloc_profile_enter();
+    if (prof) {
+        alloc_profile_free(address);
+    }
+    free_pages(address, order);
+    alloc_profile_exit(prof);
+}
+
+void buddy_shrink_pages(uint64_t address, uint32_t order, uint32_t new_order) {
+    if (order > BUDDY_MAX_ORDER || new_order >= order) {
+        return;
+    }
+    if (address < g_memory_start || address >= g_memory_start + g_memory_size ||
+        address % BUDDY_PAGE_SIZE != 0) {
+        kprintf("[BUDDY] ERROR: Cannot shrink block at 0x%llx\n", address);
+        return;
+    }
+    
+    page_t *head = &g_page_map[addr_to_page_index(address)];
+    head->order = (uint16_t)new_order;
+    
+    // Free the upper halves, largest first; each one's buddy is the still
+    // allocated lower half, so none of them merges back into the block
+    for (uint32_t o = order; o > new_order; o--) {
+        uint64_t tail = address + pages_to_bytes(1ULL << (o - 1));
+        page_t *page = &g_page_map[addr_to_page_index(tail)];
+        page->zone = head->zone;
+        page->order = (uint16_t)(o - 1);
+        free_pages(tail, o - 1);
+    }
+}
+
+int buddy_register_shrinker(buddy_shrinker_t shrinker) {
+    if (!shrinker) {
+        return -1;
+    }
+    
+    spinlock_acquire(&g_shrinker_lock);
+    if (g_shrinker_count >= BUDDY_MAX_SHRINKERS) {
+        spinlock_release(&g_shrinker_lock);
+        kprintf("[BUDDY] ERROR: Shrinker table full\n");
+        return -1;
+    }
+    g_shrinkers[g_shrinker_count] = shrinker;
+    g_shrinker_count++;
+    spinlock_release(&g_shrinker_lock);
+    return 0;
+}
+
+uint64_t buddy_reclaim(void) {
+    // Shrinkers free pages and must not re-enter reclaim through a nested
+    // allocation on this CPU. Entries are never removed, so the table can
+    // be walked without the lock.
+    uint32_t cpu = cpu_current_id();
+    if (g_reclaiming[cpu]) {
+        return 0;
+    }
+    g_reclaiming[cpu] = 1;
+    
+    uint64_t released = 0;
+    uint32_t count = g_shrinker_count;
+    for (uint32_t i = 0; i < count; i++) {
+        released += g_shrinkers[i]();
+    }
+    
+    g_reclaiming[cpu] = 0;
+    if (released) {
+        DEBUG_PRINT(BUDDY, "Shrinkers released %llu pages\n", released);
+    }
+    return released;
+}
+
 uint64_t buddy_get_free_pages(void) {
     uint64_t total_free = 0;
     for (int z = 0; z < BUDDY_ZONE_COUNT; z++) {
@@ -387,7 +638,7 @@ void buddy_dump_zone(buddy_zone_type_t zone_type) {
 }
 
 // Allocation with GFP flags support
-uint64_t buddy_alloc_pages_flags(uint32_t order, uint32_t flags) {
+static uint64_t alloc_pages_flags(uint32_t order, uint32_t flags) {
     // Validate flags - check for unknown/unsupported flags
     uint32_t valid_flags = GFP_ZONE_MASK | GFP_ZERO | GFP_ATOMIC | GFP_NOWAIT | GFP_DMA | GFP_KERNEL;
     if ((flags & ~valid_flags) != 0) {
@@ -411,8 +662,9 @@ uint64_t buddy_alloc_pages_flags(uint32_t order, uint32_t flags) {
         DEBUG_PRINT(BUDDY, "Selected UNMOVABLE zone for allocation (order %u)\n", order);
     }
     
-    // Allocate pages from selected zone
-    uint64_t addr = buddy_alloc_pages(order, zone_type);
+    // Allocate pages from selected zone; GFP_DMA limits where they may lie
+    uint64_t limit = (flags & GFP_DMA) ? GFP_DMA_LIMIT : BUDDY_NO_LIMIT;
+    uint64_t addr = alloc_pages(order, zone_type, limit);
     
     if (addr == 0) {
         DEBUG_PRINT(BUDDY, "Allocation failed for order %u from zone %u\n", order, zone_type);
@@ -434,3 +686,14 @@ uint64_t buddy_alloc_pages_flags(uint32_t order, uint32_t flags) {
     
     return addr;
 }
+
+uint64_t buddy_alloc_pages_flags(uint32_t order, uint32_t flags) {
+    int prof = alloc_profile_enter();
+    uint64_t addr = alloc_pages_flags(order, flags);
+    if (prof) {
+        alloc_profile_alloc(ALLOC_PROFILE_BUDDY, addr, pages_to_bytes(1ULL << order),
+                            __builtin_frame_address(0));
+    }
+    alloc_profile_exit(prof);
+    return addr;
+}
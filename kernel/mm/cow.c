@@ -3,98 +3,60 @@
 #include "../../include/kernel/config.h"
 #include "../../include/kernel/string.h"
 #include "../../include/kernel/stdio.h"
+#include "../../include/kernel/atomic.h"
+#include "../../include/kernel/pmm.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/rmap.h"
 
-// Global hash table for page reference tracking
-static page_ref_t *cow_hash_table[COW_HASH_SIZE];
-static spinlock_t cow_global_lock;
-
-// Hash function for physical addresses
-static uint32_t cow_hash(uint64_t phys_addr) {
-    // Align to page boundary and hash
-    phys_addr &= ~0xFFFULL;
-    // Use bitwise AND instead of modulo for performance (20-40x faster)
-    // This works because COW_HASH_SIZE is a power of 2
-    return (uint32_t)((phys_addr >> 12) & COW_HASH_MASK);
-}
+// Frame mapped read-only by every zero-fill read fault
+static uint64_t g_zero_page = 0;
 
 // Initialize COW subsystem
 void cow_init(void) {
-    // Initialize hash table to NULL
-    for (uint32_t i = 0; i < COW_HASH_SIZE; i++) {
-        cow_hash_table[i] = 0;
+    // Reference counts live in the page descriptors, which buddy_init()
+    // zeroes and every allocation resets; only the zero page is set up here
+    if (g_zero_page) {
+        return;
     }
     
-    // Initialize global lock
-    spinlock_init(&cow_global_lock);
+    g_zero_page = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (!g_zero_page) {
+        kprintf("[COW] ERROR: Failed to allocate the shared zero page\n");
+        return;
+    }
+    memset((void *)(uintptr_t)g_zero_page, 0, BUDDY_PAGE_SIZE);
+    buddy_phys_to_page(g_zero_page)->flags |= PAGE_FLAG_ZERO;
+}
+
+uint64_t cow_zero_page(void) {
+    return g_zero_page;
 }
 
-// Helper function to get page table entry pointer
-static uint64_t *cow_get_pte(page_table_t *pml4, uint64_t virt_addr) {
-    uint64_t *pml4t = (uint64_t *)(uintptr_t)pml4;
-    
-    // PML4 index
-    uint64_t pml4_idx = (virt_addr >> 39) & 0x1FF;
-    uint64_t pml4_entry = pml4t[pml4_idx];
-    if (!(pml4_entry & VMM_FLAG_PRESENT)) {
+// Get the descriptor holding a frame's reference count
+page_t *cow_get_ref(uint64_t phys_addr) {
+    // The zero page is shared by everyone and never counted or freed
+    if (g_zero_page && (phys_addr & ~0xFFFULL) == g_zero_page) {
         return 0;
     }
     
-    // PDPT index
-    uint64_t *pdpt = (uint64_t *)(uintptr_t)(pml4_entry & 0x000FFFFFFFFFF000ULL);
-    uint64_t pdpt_idx = (virt_addr >> 30) & 0x1FF;
-    uint64_t pdpt_entry = pdpt[pdpt_idx];
-    if (!(pdpt_entry & VMM_FLAG_PRESENT)) {
-        return 0;
+    page_t *page = buddy_phys_to_page(phys_addr & ~0xFFFULL);
+    if (!page) {
+        DEBUG_PRINT(COW, "No page descriptor for phys 0x%llx\n", phys_addr);
     }
-    
-    // PD index
-    uint64_t *pd = (uint64_t *)(uintptr_t)(pdpt_entry & 0x000FFFFFFFFFF000ULL);
-    uint64_t pd_idx = (virt_addr >> 21) & 0x1FF;
-    uint64_t pd_entry = pd[pd_idx];
-    if (!(pd_entry & VMM_FLAG_PRESENT)) {
-        return 0;
-    }
-    
-    // PT index
-    uint64_t *pt = (uint64_t *)(uintptr_t)(pd_entry & 0x000FFFFFFFFFF000ULL);
-    uint64_t pt_idx = (virt_addr >> 12) & 0x1FF;
-    
-    return &pt[pt_idx];
+    return page;
 }
 
-// Get or create page reference entry
-page_ref_t *cow_get_ref(uint64_t phys_addr) {
-    phys_addr &= ~0xFFFULL;  // Align to page boundary
-    uint32_t hash = cow_hash(phys_addr);
-    
-    spinlock_acquire(&cow_global_lock);
-    
-    // Search for existing entry
-    page_ref_t *ref = cow_hash_table[hash];
-    while (ref) {
-        if (ref->physical_address == phys_addr) {
-            spinlock_release(&cow_global_lock);
-            return ref;
+// Drop one reference unless the count is already zero; returns the old count
+static uint32_t cow_put_ref(page_t *page) {
+    uint32_t count = atomic_load(&page->refcount);
+    while (count != 0) {
+        uint32_t seen = atomic_compare_and_swap(&page->refcount, count, count - 1);
+        if (seen == count) {
+            break;
         }
-        ref = ref->next;
+        count = seen;
     }
-    
-    // Create new entry
-    ref = (page_ref_t *)buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
-    if (!ref) {
-        spinlock_release(&cow_global_lock);
-        DEBUG_PRINT(COW, "Failed to allocate reference entry for phys 0x%llx\n", phys_addr);
-        return 0;
-    }
-    
-    ref->physical_address = phys_addr;
-    ref->ref_count = 0;
-    spinlock_init(&ref->lock);
-    ref->next = cow_hash_table[hash];
-    cow_hash_table[hash] = ref;
-    
-    spinlock_release(&cow_global_lock);
-    return ref;
+    return count;
 }
 
 // Mark a page as copy-on-write
@@ -106,7 +68,7 @@ int cow_mark_page(page_table_t *pml4, uint64_t virt_addr) {
     }
     
     // Get page table entry
-    uint64_t *pte = cow_get_pte(pml4, virt_addr);
+    uint64_t *pte = vmm_get_pte(pml4, virt_addr);
     if (!pte) {
         DEBUG_PRINT(COW, "Page not mapped at 0x%llx\n", virt_addr);
         return -1;
@@ -121,18 +83,14 @@ int cow_mark_page(page_table_t *pml4, uint64_t virt_addr) {
     // Get physical address
     uint64_t phys_addr = entry & 0x000FFFFFFFFFF000ULL;
     
-    // Get or create reference entry
-    page_ref_t *ref = cow_get_ref(phys_addr);
-    if (!ref) {
-        DEBUG_PRINT(COW, "Failed to allocate reference entry for phys 0x%llx (virt 0x%llx)\n", 
+    // Count the new sharer in the frame's descriptor
+    page_t *page = cow_get_ref(phys_addr);
+    if (!page) {
+        DEBUG_PRINT(COW, "Cannot share phys 0x%llx (virt 0x%llx): not buddy memory\n", 
                     phys_addr, virt_addr);
         return -1;
     }
-    
-    // Increment reference count
-    spinlock_acquire(&ref->lock);
-    ref->ref_count++;
-    spinlock_release(&ref->lock);
+    atomic_fetch_and_add(&page->refcount, 1);
     
     // Set page read-only and set COW bit
     entry &= ~VMM_FLAG_WRITABLE;  // Clear writable flag
@@ -140,20 +98,35 @@ int cow_mark_page(page_table_t *pml4, uint64_t virt_addr) {
     *pte = entry;
     
     // Flush TLB for this address
-    __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+    tlb_flush_page(virt_addr);
     
     return 0;
 }
 
 // Handle copy-on-write page fault
 int cow_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
+    if (!pml4) {
+        DEBUG_PRINT(COW, "NULL pml4 in cow_handle_fault\n");
+        return -1;
+    }
+    
     // Get page table entry
-    uint64_t *pte = cow_get_pte(pml4, virt_addr);
+    uint64_t *pte = vmm_get_pte(pml4, virt_addr);
     if (!pte) {
         DEBUG_PRINT(COW, "Page not mapped at 0x%llx in cow_handle_fault\n", virt_addr);
         return -1;  // Page not mapped
     }
     
+    // Writers of the same entry in one address space serialize here; the
+    // reference count orders sharers in different address spaces
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    spinlock_acquire(ptl);
+    int result = cow_handle_fault_locked(pml4, virt_addr, pte);
+    spinlock_release(ptl);
+    return result;
+}
+
+int cow_handle_fault_locked(page_table_t *pml4, uint64_t virt_addr, uint64_t *pte) {
     uint64_t entry = *pte;
     if (!(entry & VMM_FLAG_PRESENT)) {
         DEBUG_PRINT(COW, "Page not present at 0x%llx in cow_handle_fault\n", virt_addr);
@@ -162,6 +135,9 @@ int cow_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
     
     // Check if this is a COW page
     if (!(entry & COW_FLAG_MASK)) {
+        if (entry & VMM_FLAG_WRITABLE) {
+            return 0;  // Another CPU broke it while we waited for the lock
+        }
         DEBUG_PRINT(COW, "Not a COW page at 0x%llx\n", virt_addr);
         return -1;  // Not a COW page
     }
@@ -169,26 +145,44 @@ int cow_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
     // Get old physical address
     uint64_t old_phys = entry & 0x000FFFFFFFFFF000ULL;
     
-    // Get reference entry
-    page_ref_t *ref = cow_get_ref(old_phys);
-    if (!ref) {
-        DEBUG_PRINT(COW, "Reference entry not found for phys 0x%llx (virt 0x%llx)\n", 
+    // First write to a zero-fill page: a cleared frame replaces the zero
+    // page, nothing to copy
+    if (old_phys == g_zero_page) {
+        uint64_t new_phys = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+        if (!new_phys) {
+            DEBUG_PRINT(COW, "Failed to allocate page replacing the zero page at 0x%llx\n", virt_addr);
+            return -1;
+        }
+        memset((void *)(uintptr_t)new_phys, 0, BUDDY_PAGE_SIZE);
+        
+        // Keep every flag, NX (bit 63) included
+        entry = new_phys | (entry & ~0x000FFFFFFFFFF000ULL);
+        entry |= VMM_FLAG_WRITABLE;
+        entry &= ~COW_FLAG_MASK;
+        *pte = entry;
+        tlb_flush_page(virt_addr);
+        rmap_add(pml4, virt_addr, new_phys);
+        
+        DEBUG_PRINT(COW, "Replaced zero page at virt 0x%llx with phys 0x%llx\n", virt_addr, new_phys);
+        return 0;
+    }
+    
+    page_t *page = cow_get_ref(old_phys);
+    if (!page) {
+        DEBUG_PRINT(COW, "No page descriptor for phys 0x%llx (virt 0x%llx)\n", 
                     old_phys, virt_addr);
-        return -1;  // Reference entry not found
+        return -1;
     }
     
-    // Check reference count
-    spinlock_acquire(&ref->lock);
-    uint32_t ref_count = ref->ref_count;
+    uint32_t ref_count = atomic_load(&page->refcount);
     
     DEBUG_PRINT(COW, "Handling COW fault at virt 0x%llx, phys 0x%llx, refcount %u\n",
                 virt_addr, old_phys, ref_count);
     
-    // If we're the only reference, just make it writable
-    if (ref_count == 1) {
-        ref->ref_count--;
-        spinlock_release(&ref->lock);
-        
+    // If we're the only reference, just make it writable. The CAS fails if
+    // another mapping shared the page meanwhile; the copy path handles that.
+    if (ref_count <= 1 &&
+        (ref_count == 0 || atomic_compare_and_swap(&page->refcount, 1, 0) == 1)) {
         DEBUG_PRINT(COW, "Single reference, making page writable at 0x%llx\n", virt_addr);
         
         // Make page writable and clear COW flag
@@ -197,25 +191,18 @@ int cow_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
         *pte = entry;
         
         // Flush TLB
-        __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+        tlb_flush_page(virt_addr);
         
         return 0;
     }
     
-    // Multiple references - need to copy
-    ref->ref_count--;
-    spinlock_release(&ref->lock);
-    
     DEBUG_PRINT(COW, "Multiple references (%u), copying page from 0x%llx\n", 
                 ref_count, old_phys);
     
-    // Allocate new physical page
+    // Copy before dropping our reference, so a failed allocation leaves the
+    // count untouched
     uint64_t new_phys = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
     if (!new_phys) {
-        // Restore reference count on failure
-        spinlock_acquire(&ref->lock);
-        ref->ref_count++;
-        spinlock_release(&ref->lock);
         DEBUG_PRINT(COW, "Failed to allocate new page for COW at 0x%llx\n", virt_addr);
         return -1;  // Out of memory
     }
@@ -229,105 +216,229 @@ int cow_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
         new_page[i] = old_page[i];
     }
     
+    // Every other sharer may have copied or unmapped while we did; then the
+    // frame is ours alone and the copy is not needed
+    if (cow_put_ref(page) <= 1) {
+        buddy_free_pages(new_phys, 0);
+        DEBUG_PRINT(COW, "Last reference after copy, keeping phys 0x%llx at 0x%llx\n",
+                    old_phys, virt_addr);
+        entry |= VMM_FLAG_WRITABLE;
+        entry &= ~COW_FLAG_MASK;
+        *pte = entry;
+        tlb_flush_page(virt_addr);
+        return 0;
+    }
+    
     DEBUG_PRINT(COW, "Copy completed, updating PTE for virt 0x%llx\n", virt_addr);
     
     // Update page table entry
-    entry = (new_phys & 0x000FFFFFFFFFF000ULL) | (entry & 0xFFF);
+    entry = (new_phys & 0x000FFFFFFFFFF000ULL) | (entry & ~0x000FFFFFFFFFF000ULL);
     entry |= VMM_FLAG_WRITABLE;  // Make writable
     entry &= ~COW_FLAG_MASK;      // Clear COW flag
     *pte = entry;
     
     // Flush TLB
-    __asm__ volatile("invlpg (%0)" : : "r"(virt_addr) : "memory");
+    tlb_flush_page(virt_addr);
+    rmap_add(pml4, virt_addr, new_phys);
     
     DEBUG_PRINT(COW, "COW fault handled successfully for virt 0x%llx\n", virt_addr);
     
     return 0;
 }
 
-// Increment reference count for a physical page
-void cow_increment_ref(uint64_t phys_addr) {
-    page_ref_t *ref = cow_get_ref(phys_addr);
-    if (!ref) {
-        return;  // Failed to get/create reference entry
+// Entries 256-511 map the kernel half, which every address space shares
+#define COW_USER_PML4_ENTRIES 256
+#define COW_ADDR_MASK 0x000FFFFFFFFFF000ULL
+#define COW_PTE_HUGE 0x080
+
+// Share one leaf entry with the child: writable frames become read-only
+// and COW in the parent, and the frame's count takes both mappings in one
+// atomic add. Returns the entry for the child.
+static uint64_t cow_share_pte(uint64_t *parent_pte, uint64_t virt, uint64_t *shared,
+                              tlb_gather_t *tlb) {
+    uint64_t entry = *parent_pte;
+    if (!(entry & VMM_FLAG_PRESENT)) {
+        return 0;
     }
     
-    spinlock_acquire(&ref->lock);
-    ref->ref_count++;
-    spinlock_release(&ref->lock);
+    // Frames without a descriptor (device memory), the zero page and
+    // read-only frames are mapped as they are
+    page_t *page = cow_get_ref(entry & COW_ADDR_MASK);
+    if (!page) {
+        return entry;
+    }
+    if (entry & COW_FLAG_MASK) {
+        atomic_fetch_and_add(&page->refcount, 1);
+        (*shared)++;
+        return entry;
+    }
+    if (!(entry & VMM_FLAG_WRITABLE)) {
+        return entry;
+    }
+    
+    entry = (entry & ~(uint64_t)VMM_FLAG_WRITABLE) | COW_FLAG_MASK;
+    *parent_pte = entry;
+    tlb_gather_page(tlb, virt);
+    atomic_fetch_and_add(&page->refcount, 2);
+    (*shared)++;
+    return entry;
 }
 
-// Decrement reference count and free page if count reaches zero
-void cow_decrement_ref(uint64_t phys_addr) {
-    phys_addr &= ~0xFFFULL;  // Align to page boundary
-    uint32_t hash = cow_hash(phys_addr);
+// Copy one table level (4 = PML4 ... 1 = PT) into dst. On failure the rest
+// of dst is cleared so cow_release_address_space() can undo the copy.
+static int cow_clone_table(uint64_t *src, uint64_t *dst, int level, uint32_t entries,
+                           uint64_t base, uint64_t *shared, tlb_gather_t *tlb) {
+    for (uint32_t i = 0; i < entries; i++) {
+        uint64_t entry = src[i];
+        uint64_t virt = base + ((uint64_t)i << (12 + 9 * (level - 1)));
+        
+        if (level == 1) {
+            dst[i] = cow_share_pte(&src[i], virt, shared, tlb);
+            continue;
+        }
+        if (!(entry & VMM_FLAG_PRESENT) || (entry & COW_PTE_HUGE)) {
+            dst[i] = entry;  // Large pages stay shared as they are
+            continue;
+        }
+        
+        uint64_t frame = pmm_alloc_frame();
+        if (frame == 0) {
+            DEBUG_PRINT(COW, "Out of memory for a level-%d table during clone\n", level - 1);
+            for (uint32_t j = i; j < entries; j++) {
+                dst[j] = 0;
+            }
+            return -1;
+        }
+        dst[i] = frame | (entry & ~COW_ADDR_MASK);
+        
+        if (cow_clone_table((uint64_t *)(uintptr_t)(entry & COW_ADDR_MASK),
+                            (uint64_t *)(uintptr_t)frame, level - 1, 512, virt, shared, tlb) != 0) {
+            for (uint32_t j = i + 1; j < entries; j++) {
+                dst[j] = 0;
+            }
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Fork an address space: one pass over the parent's tables
+page_table_t *cow_clone_address_space(page_table_t *parent) {
+    if (!parent) {
+        DEBUG_PRINT(COW, "NULL pml4 in cow_clone_address_space\n");
+        return 0;
+    }
     
-    spinlock_acquire(&cow_global_lock);
+    page_table_t *child = vmm_create_address_space();
+    if (!child) {
+        DEBUG_PRINT(COW, "Failed to allocate PML4 for clone\n");
+        return 0;
+    }
     
-    // Find reference entry
-    page_ref_t *ref = cow_hash_table[hash];
-    page_ref_t *prev = 0;
+    uint64_t *src = (uint64_t *)(uintptr_t)parent;
+    uint64_t *dst = (uint64_t *)(uintptr_t)child;
+    uint64_t shared = 0;
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb);
     
-    while (ref) {
-        if (ref->physical_address == phys_addr) {
-            break;
-        }
-        prev = ref;
-        ref = ref->next;
+    int result = cow_clone_table(src, dst, 4, COW_USER_PML4_ENTRIES, 0, &shared, &tlb);
+    for (uint32_t i = COW_USER_PML4_ENTRIES; i < 512; i++) {
+        dst[i] = src[i];
     }
     
-    if (!ref) {
-        spinlock_release(&cow_global_lock);
-        return;  // Reference entry not found
-    }
+    // Parent entries lost their write bit: a few invlpg or one CR3 reload.
+    // The parent stays consistent if the clone failed: every entry marked
+    // so far holds its own reference.
+    tlb_gather_finish(&tlb);
     
-    // Decrement reference count
-    spinlock_acquire(&ref->lock);
-    ref->ref_count--;
-    uint32_t count = ref->ref_count;
-    spinlock_release(&ref->lock);
+    // The child maps the parent's frames at the same addresses
+    if (result == 0) {
+        result = rmap_clone(parent, child);
+    }
+    if (result != 0) {
+        cow_release_address_space(child);
+        return 0;
+    }
     
-    // If count reaches zero, free the physical page and reference entry
-    if (count == 0) {
-        // Remove from hash table
-        if (prev) {
-            prev->next = ref->next;
-        } else {
-            cow_hash_table[hash] = ref->next;
+    DEBUG_PRINT(COW, "Cloned address space %p -> %p, %llu pages shared\n",
+                parent, child, shared);
+    return child;
+}
+
+static void cow_release_table(uint64_t *table, int level, uint32_t entries) {
+    for (uint32_t i = 0; i < entries; i++) {
+        uint64_t entry = table[i];
+        if (!(entry & VMM_FLAG_PRESENT)) {
+            continue;
         }
         
-        spinlock_release(&cow_global_lock);
-        
-        // Free physical page
-        buddy_free_pages(phys_addr, 0);
+        if (level == 1) {
+            if ((entry & COW_FLAG_MASK) && (entry & COW_ADDR_MASK) != g_zero_page) {
+                cow_decrement_ref(entry & COW_ADDR_MASK);
+            }
+            continue;
+        }
+        if (entry & COW_PTE_HUGE) {
+            continue;
+        }
         
-        // Free reference entry
-        buddy_free_pages((uint64_t)(uintptr_t)ref, 0);
-    } else {
-        spinlock_release(&cow_global_lock);
+        cow_release_table((uint64_t *)(uintptr_t)(entry & COW_ADDR_MASK), level - 1, 512);
+        pmm_free_frame(entry & COW_ADDR_MASK);
     }
 }
 
-// Get reference count for a physical page
-uint32_t cow_get_ref_count(uint64_t phys_addr) {
+// Tear down an address space: drop the reference of every COW mapping and
+// free the user-half page tables and the PML4
+void cow_release_address_space(page_table_t *pml4) {
+    if (!pml4) {
+        return;
+    }
+    
+    rmap_release(pml4);
+    cow_release_table((uint64_t *)(uintptr_t)pml4, 4, COW_USER_PML4_ENTRIES);
+    pmm_free_frame((uint64_t)(uintptr_t)pml4);
+}
+
+// Increment reference count for a physical page
+void cow_increment_ref(uint64_t phys_addr) {
+    page_t *page = cow_get_ref(phys_addr);
+    if (!page) {
+        return;  // Not buddy memory
+    }
+    
+    atomic_fetch_and_add(&page->refcount, 1);
+}
+
+// Decrement reference count and free page if count reaches zero
+void cow_decrement_ref(uint64_t phys_addr) {
     phys_addr &= ~0xFFFULL;  // Align to page boundary
-    uint32_t hash = cow_hash(phys_addr);
-    
-    spinlock_acquire(&cow_global_lock);
-    
-    // Find reference entry
-    page_ref_t *ref = cow_hash_table[hash];
-    while (ref) {
-        if (ref->physical_address == phys_addr) {
-            spinlock_acquire(&ref->lock);
-            uint32_t count = ref->ref_count;
-            spinlock_release(&ref->lock);
-            spinlock_release(&cow_global_lock);
-            return count;
-        }
-        ref = ref->next;
+    
+    page_t *page = cow_get_ref(phys_addr);
+    if (!page) {
+        return;
+    }
+    
+    // Only the caller that drops the last reference frees the frame
+    uint32_t old = cow_put_ref(page);
+    if (old == 0) {
+        DEBUG_PRINT(COW, "Reference count underflow for phys 0x%llx\n", phys_addr);
+    } else if (old == 1) {
+        buddy_free_pages(phys_addr, 0);
+    }
+}
+
+// Drop a reference for a caller that frees the frame itself
+int cow_release_ref(uint64_t phys_addr) {
+    page_t *page = cow_get_ref(phys_addr);
+    if (!page) {
+        return 0;  // Zero page or not buddy memory: never freed
     }
     
-    spinlock_release(&cow_global_lock);
-    return 0;  // Not found
+    return cow_put_ref(page) <= 1;
+}
+
+// Get reference count for a physical page
+uint32_t cow_get_ref_count(uint64_t phys_addr) {
+    page_t *page = buddy_phys_to_page(phys_addr & ~0xFFFULL);
+    return page ? atomic_load(&page->refcount) : 0;
 }
@@ -1,19 +1,32 @@
 #include "../../include/mm/demand_paging.h"
 #include "../../include/mm/buddy.h"
 #include "../../include/mm/slab.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/ksm.h"
 #include "../../include/kernel/config.h"
 #include "../../include/kernel/string.h"
 #include "../../include/kernel/stdio.h"
+#include "../../include/kernel/atomic.h"
 
-// Global address space list
-#define MAX_ADDRESS_SPACES 256
+// Global address space table, indexed by a hash of the PML4 address
 static vm_address_space_t address_spaces[MAX_ADDRESS_SPACES];
+static vm_address_space_t *address_space_hash[AS_HASH_SIZE];
 static uint32_t address_space_count = 0;
 static spinlock_t global_lock;
 
 // Slab cache for VM regions
 static slab_cache_t *vm_region_cache = NULL;
 
+// Statistics only; updates from different regions may race
+static demand_paging_stats_t dp_stats;
+
+// Largest fault-around window; each region adapts below it
+static uint32_t fault_around_max = FAULT_AROUND_DEFAULT_PAGES;
+
+// Bytes mapped by one page table, and so covered by one fault lock
+#define PT_SPAN (512ULL * BUDDY_PAGE_SIZE)
+
 void demand_paging_init(void) {
     // Initialize global lock
     spinlock_init(&global_lock);
@@ -22,8 +35,14 @@ void demand_paging_init(void) {
     for (uint32_t i = 0; i < MAX_ADDRESS_SPACES; i++) {
         address_spaces[i].pml4 = NULL;
         address_spaces[i].regions = NULL;
+        address_spaces[i].last_hit = NULL;
+        address_spaces[i].region_count = 0;
+        address_spaces[i].hash_next = NULL;
         spinlock_init(&address_spaces[i].lock);
     }
+    for (uint32_t i = 0; i < AS_HASH_SIZE; i++) {
+        address_space_hash[i] = NULL;
+    }
     
     address_space_count = 0;
     
@@ -31,52 +50,178 @@ void demand_paging_init(void) {
     vm_region_cache = slab_cache_create("vm_region", sizeof(vm_region_t), 8);
 }
 
+static uint32_t address_space_bucket(page_table_t *pml4) {
+    return (uint32_t)(((uint64_t)(uintptr_t)pml4 >> 12) & AS_HASH_MASK);
+}
+
+// Address spaces are never removed and each is set up before it is
+// published, so lookups need no lock
+static vm_address_space_t *address_space_lookup(page_table_t *pml4) {
+    vm_address_space_t *as = address_space_hash[address_space_bucket(pml4)];
+    while (as && as->pml4 != pml4) {
+        as = as->hash_next;
+    }
+    return as;
+}
+
 // Helper function to get or create address space for a page table
 vm_address_space_t *demand_paging_get_address_space(page_table_t *pml4) {
-    spinlock_acquire(&global_lock);
-    
-    // Search for existing address space
-    for (uint32_t i = 0; i < address_space_count; i++) {
-        if (address_spaces[i].pml4 == pml4) {
-            spinlock_release(&global_lock);
-            return &address_spaces[i];
-        }
+    vm_address_space_t *as = address_space_lookup(pml4);
+    if (as) {
+        return as;
     }
     
-    // Create new address space if not found
-    if (address_space_count < MAX_ADDRESS_SPACES) {
-        vm_address_space_t *as = &address_spaces[address_space_count];
+    spinlock_acquire(&global_lock);
+    
+    // Another CPU may have created it while we waited
+    as = address_space_lookup(pml4);
+    if (!as && address_space_count < MAX_ADDRESS_SPACES) {
+        uint32_t bucket = address_space_bucket(pml4);
+        as = &address_spaces[address_space_count++];
         as->pml4 = pml4;
         as->regions = NULL;
-        address_space_count++;
-        spinlock_release(&global_lock);
-        return as;
+        as->last_hit = NULL;
+        as->region_count = 0;
+        as->hash_next = address_space_hash[bucket];
+        memory_barrier();
+        address_space_hash[bucket] = as;
     }
     
     spinlock_release(&global_lock);
+    return as;
+}
+
+// Region tree (AVL, keyed by start)
+
+static int32_t region_height(vm_region_t *region) {
+    return region ? region->height : 0;
+}
+
+static void region_update(vm_region_t *region) {
+    int32_t left = region_height(region->left);
+    int32_t right = region_height(region->right);
+    region->height = 1 + (left > right ? left : right);
+}
+
+static vm_region_t *region_rotate_right(vm_region_t *region) {
+    vm_region_t *left = region->left;
+    region->left = left->right;
+    left->right = region;
+    region_update(region);
+    region_update(left);
+    return left;
+}
+
+static vm_region_t *region_rotate_left(vm_region_t *region) {
+    vm_region_t *right = region->right;
+    region->right = right->left;
+    right->left = region;
+    region_update(region);
+    region_update(right);
+    return right;
+}
+
+static vm_region_t *region_balance(vm_region_t *region) {
+    region_update(region);
+    int32_t balance = region_height(region->left) - region_height(region->right);
+    
+    if (balance > 1) {
+        if (region_height(region->left->left) < region_height(region->left->right)) {
+            region->left = region_rotate_left(region->left);
+        }
+        return region_rotate_right(region);
+    }
+    if (balance < -1) {
+        if (region_height(region->right->right) < region_height(region->right->left)) {
+            region->right = region_rotate_right(region->right);
+        }
+        return region_rotate_left(region);
+    }
+    return region;
+}
+
+static vm_region_t *region_insert(vm_region_t *root, vm_region_t *region) {
+    if (!root) {
+        return region;
+    }
+    if (region->start < root->start) {
+        root->left = region_insert(root->left, region);
+    } else {
+        root->right = region_insert(root->right, region);
+    }
+    return region_balance(root);
+}
+
+static vm_region_t *region_remove_min(vm_region_t *root, vm_region_t **min) {
+    if (!root->left) {
+        *min = root;
+        return root->right;
+    }
+    root->left = region_remove_min(root->left, min);
+    return region_balance(root);
+}
+
+// Unlink the region starting at start; *removed is NULL if there is none
+static vm_region_t *region_remove(vm_region_t *root, uint64_t start, vm_region_t **removed) {
+    if (!root) {
+        return NULL;
+    }
+    if (start < root->start) {
+        root->left = region_remove(root->left, start, removed);
+    } else if (start > root->start) {
+        root->right = region_remove(root->right, start, removed);
+    } else {
+        *removed = root;
+        if (!root->left) {
+            return root->right;
+        }
+        if (!root->right) {
+            return root->left;
+        }
+        vm_region_t *min;
+        vm_region_t *right = region_remove_min(root->right, &min);
+        min->left = root->left;
+        min->right = right;
+        return region_balance(min);
+    }
+    return region_balance(root);
+}
+
+// Any region overlapping [start, end): the regions are disjoint, so one
+// descent decides
+static vm_region_t *region_overlap(vm_region_t *root, uint64_t start, uint64_t end) {
+    while (root) {
+        if (end <= root->start) {
+            root = root->left;
+        } else if (start >= root->end) {
+            root = root->right;
+        } else {
+            return root;
+        }
+    }
     return NULL;
 }
 
 // Helper function to find a region containing the given virtual address
 vm_region_t *demand_paging_find_region(page_table_t *pml4, uint64_t virt_addr) {
-    vm_address_space_t *as = demand_paging_get_address_space(pml4);
+    vm_address_space_t *as = address_space_lookup(pml4);
     if (!as) {
         return NULL;
     }
     
     spinlock_acquire(&as->lock);
     
-    vm_region_t *region = as->regions;
-    while (region) {
-        if (virt_addr >= region->start && virt_addr < region->end) {
-            spinlock_release(&as->lock);
-            return region;
+    // Faults cluster: most hit the same region as the last one
+    vm_region_t *region = as->last_hit;
+    if (!region || virt_addr < region->start || virt_addr >= region->end) {
+        region = region_overlap(as->regions, virt_addr, virt_addr + 1);
+        if (region) {
+            as->last_hit = region;
         }
-        region = region->next;
     }
     
     spinlock_release(&as->lock);
-    return NULL;
+    return region;
 }
 
 // Register a virtual memory region for demand paging
@@ -99,15 +244,9 @@ int demand_paging_register_region(page_table_t *pml4, uint64_t start, uint64_t s
     spinlock_acquire(&as->lock);
     
     // Check for overlapping regions
-    vm_region_t *existing = as->regions;
-    while (existing) {
-        if ((aligned_start >= existing->start && aligned_start < existing->end) ||
-            (aligned_end > existing->start && aligned_end <= existing->end) ||
-            (aligned_start <= existing->start && aligned_end >= existing->end)) {
-            spinlock_release(&as->lock);
-            return -1;  // Overlap detected
-        }
-        existing = existing->next;
+    if (region_overlap(as->regions, aligned_start, aligned_end)) {
+        spinlock_release(&as->lock);
+        return -1;  // Overlap detected
     }
     
     // Allocate new region
@@ -121,19 +260,126 @@ int demand_paging_register_region(page_table_t *pml4, uint64_t start, uint64_t s
     region->start = aligned_start;
     region->end = aligned_end;
     region->flags = flags;
-    spinlock_init(&region->page_fault_lock);  // Initialize per-region lock
-    region->next = as->regions;
-    as->regions = region;
+    region->around_window = 1;
+    region->around_pages = 0;
+    region->around_start = 0;
+    region->around_next = 0;
+    region->height = 1;
+    region->left = NULL;
+    region->right = NULL;
+    as->regions = region_insert(as->regions, region);
+    as->region_count++;
     
     DEBUG_PRINT(DEMAND_PAGING, "Registered region [0x%llx, 0x%llx) with flags 0x%x\n",
                 aligned_start, aligned_end, flags);
     
     spinlock_release(&as->lock);
+    
+    // The region works without merging if the scanner is full
+    if (flags & VM_FLAG_MERGEABLE) {
+        ksm_register(pml4, aligned_start, aligned_end);
+    }
     return 0;
 }
 
-// Handle a page fault for demand paging
+// Handle a page fault for demand paging (legacy entry point: always
+// allocates a private page)
 int demand_paging_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
+    return demand_paging_handle_fault_flags(pml4, virt_addr, VM_FAULT_WRITE);
+}
+
+// Resolve a fault on a page that is already mapped. Only a write to a COW
+// mapping (such as the zero page) needs work. Called with the page table
+// lock held, so two writers cannot both replace the same zero page.
+static int demand_paging_fault_present(page_table_t *pml4, uint64_t aligned_addr,
+                                       uint64_t *pte, uint64_t entry, uint32_t fault_flags) {
+    if (!(fault_flags & VM_FAULT_WRITE) || !(entry & COW_FLAG_MASK)) {
+        return 0;  // Mapped by another thread, nothing to do
+    }
+    
+    int zero = (entry & 0x000FFFFFFFFFF000ULL) == cow_zero_page();
+    int result = cow_handle_fault_locked(pml4, aligned_addr, pte);
+    if (result == 0 && zero) {
+        dp_stats.zero_page_breaks++;
+        DEBUG_PRINT(DEMAND_PAGING, "First write at 0x%llx replaced the zero page\n", aligned_addr);
+    }
+    return result;
+}
+
+void demand_paging_set_fault_around(uint32_t pages) {
+    fault_around_max = pages > FAULT_AROUND_MAX_PAGES ? FAULT_AROUND_MAX_PAGES : pages;
+}
+
+uint32_t demand_paging_get_fault_around(void) {
+    return fault_around_max;
+}
+
+// Judge the region's last window and size this fault's one. Called with
+// the faulting page's table lock held. The window state is a hint shared
+// by faults in every span of the region; a racing update only costs one
+// resize.
+static uint32_t fault_around_window(page_table_t *pml4, vm_region_t *region, uint64_t aligned_addr) {
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < region->around_pages; i++) {
+        uint64_t *pte = vmm_get_pte(pml4, region->around_start + i * BUDDY_PAGE_SIZE);
+        if (pte && (*pte & VMM_FLAG_PRESENT) && (*pte & VMM_FLAG_ACCESSED)) {
+            used++;
+        }
+    }
+    dp_stats.around_hits += used;
+    
+    uint32_t window = region->around_window;
+    if (aligned_addr == region->around_next || (region->around_pages && used * 2 >= region->around_pages)) {
+        window *= 2;
+    } else {
+        window /= 2;
+    }
+    if (window > fault_around_max) {
+        window = fault_around_max;
+    }
+    if (window < 1) {
+        window = 1;
+    }
+    region->around_window = window;
+    
+    // Pre-map the unmapped pages right after the fault, up to the first
+    // mapped one, the region's end or the end of the locked page table
+    uint64_t end = (aligned_addr & ~(PT_SPAN - 1)) + PT_SPAN;
+    if (end > region->end) {
+        end = region->end;
+    }
+    uint32_t extra = 0;
+    uint64_t virt = aligned_addr + BUDDY_PAGE_SIZE;
+    while (extra + 1 < window && virt < end) {
+        uint64_t *pte = vmm_get_pte(pml4, virt);
+        if (pte && (*pte & VMM_FLAG_PRESENT)) {
+            break;
+        }
+        extra++;
+        virt += BUDDY_PAGE_SIZE;
+    }
+    return extra;
+}
+
+// Remember what this fault mapped for the next one to judge
+static void fault_around_record(vm_region_t *region, uint64_t aligned_addr, uint32_t extra) {
+    region->around_start = aligned_addr + BUDDY_PAGE_SIZE;
+    region->around_pages = extra;
+    region->around_next = aligned_addr + (uint64_t)(extra + 1) * BUDDY_PAGE_SIZE;
+    dp_stats.around_mapped += extra;
+    if (extra) {
+        DEBUG_PRINT(DEMAND_PAGING, "Fault-around mapped %u pages after 0x%llx\n", extra, aligned_addr);
+    }
+}
+
+static void demand_paging_zero_frame(uint64_t phys_addr) {
+    // Buddy memory is identity-mapped, as in cow.c and ksm.c
+    memset((void *)(uintptr_t)phys_addr, 0, BUDDY_PAGE_SIZE);
+    DEBUG_PRINT(DEMAND_PAGING, "Zero-filled page at phys 0x%llx\n", phys_addr);
+}
+
+// Handle a page fault for demand paging
+int demand_paging_handle_fault_flags(page_table_t *pml4, uint64_t virt_addr, uint32_t fault_flags) {
     // Align address to page boundary
     uint64_t aligned_addr = virt_addr & ~(BUDDY_PAGE_SIZE - 1);
     
@@ -151,45 +397,70 @@ int demand_paging_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
         return -1;
     }
     
+    dp_stats.faults++;
+    
     // First check (unlocked, fast path) - avoid lock if page already mapped
-    uint64_t existing_phys = vmm_get_physical_address(pml4, aligned_addr);
-    if (existing_phys != 0) {
+    // and there is no zero page to replace
+    uint64_t *pte = vmm_get_pte(pml4, aligned_addr);
+    uint64_t entry = pte ? *pte : 0;
+    if ((entry & VMM_FLAG_PRESENT) &&
+        (!(fault_flags & VM_FAULT_WRITE) || !(entry & COW_FLAG_MASK))) {
         DEBUG_PRINT(DEMAND_PAGING, "Page already mapped at 0x%llx (fast path)\n", aligned_addr);
         return 0;  // Page already mapped by another thread
     }
     
-    // Acquire per-region lock for synchronized page fault handling
-    spinlock_acquire(&region->page_fault_lock);
+    // Serialize on the page table holding the entry: faults in other 2 MiB
+    // spans of the region take other locks and run in parallel. The table
+    // is allocated first so there is a lock to take.
+    pte = vmm_alloc_pte(pml4, aligned_addr);
+    if (!pte) {
+        kprintf("[DEMAND_PAGING] ERROR: Out of memory for page table at 0x%llx\n", aligned_addr);
+        return -1;
+    }
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    spinlock_acquire(ptl);
     
     // Second check (locked) - prevent race condition
-    existing_phys = vmm_get_physical_address(pml4, aligned_addr);
-    if (existing_phys != 0) {
-        // Another thread mapped the page while we were waiting for the lock
-        spinlock_release(&region->page_fault_lock);
-        DEBUG_PRINT(DEMAND_PAGING, "Page already mapped at 0x%llx (race detected)\n", aligned_addr);
-        return 0;
+    entry = *pte;
+    if (entry & VMM_FLAG_PRESENT) {
+        // Another thread mapped the page while we were waiting for the
+        // lock, or this is a write to the zero page
+        int result = demand_paging_fault_present(pml4, aligned_addr, pte, entry, fault_flags);
+        spinlock_release(ptl);
+        DEBUG_PRINT(DEMAND_PAGING, "Page present at 0x%llx once locked\n", aligned_addr);
+        return result;
     }
     
     DEBUG_PRINT(DEMAND_PAGING, "Handling page fault at 0x%llx\n", aligned_addr);
     
+    uint32_t extra = fault_around_window(pml4, region, aligned_addr);
+    
+    // Reads of zero-fill memory share the zero page until the first write
+    uint64_t zero_page = cow_zero_page();
+    if (!(fault_flags & VM_FAULT_WRITE) && (region->flags & VM_FLAG_ZERO_FILL) && zero_page) {
+        for (uint32_t i = 0; i <= extra; i++) {
+            vmm_map_page(pml4, aligned_addr + i * BUDDY_PAGE_SIZE, zero_page,
+                         VMM_FLAG_PRESENT | VMM_FLAG_USER | COW_FLAG_MASK);
+        }
+        dp_stats.zero_page_hits++;
+        fault_around_record(region, aligned_addr, extra);
+        spinlock_release(ptl);
+        DEBUG_PRINT(DEMAND_PAGING, "Mapped zero page at virt 0x%llx\n", aligned_addr);
+        return 0;
+    }
+    
     // Allocate a physical page
     uint64_t phys_addr = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
     if (phys_addr == 0) {
-        spinlock_release(&region->page_fault_lock);
+        spinlock_release(ptl);
         kprintf("[DEMAND_PAGING] ERROR: Out of memory for page fault at 0x%llx\n", aligned_addr);
         return -1;  // Out of memory
     }
+    dp_stats.pages_allocated++;
     
     // Zero-fill the page if requested
     if (region->flags & VM_FLAG_ZERO_FILL) {
-        // Map temporarily to zero it (assuming direct physical mapping at 0xFFFF800000000000)
-        uint64_t direct_map_addr = 0xFFFF800000000000ULL + phys_addr;
-        uint8_t *page_ptr = (uint8_t *)direct_map_addr;
-        
-        for (uint64_t i = 0; i < BUDDY_PAGE_SIZE; i++) {
-            page_ptr[i] = 0;
-        }
-        DEBUG_PRINT(DEMAND_PAGING, "Zero-filled page at phys 0x%llx\n", phys_addr);
+        demand_paging_zero_frame(phys_addr);
     }
     
     // Map the page in the page table
@@ -198,17 +469,35 @@ int demand_paging_handle_fault(page_table_t *pml4, uint64_t virt_addr) {
     
     DEBUG_PRINT(DEMAND_PAGING, "Mapped virt 0x%llx -> phys 0x%llx\n", aligned_addr, phys_addr);
     
-    spinlock_release(&region->page_fault_lock);
+    // The window's frames are optional: map as many as one bulk call gives
+    uint64_t frames[FAULT_AROUND_MAX_PAGES];
+    extra = extra ? buddy_alloc_pages_bulk(extra, BUDDY_ZONE_MOVABLE, frames) : 0;
+    for (uint32_t i = 0; i < extra; i++) {
+        if (region->flags & VM_FLAG_ZERO_FILL) {
+            demand_paging_zero_frame(frames[i]);
+        }
+        vmm_map_page(pml4, aligned_addr + (uint64_t)(i + 1) * BUDDY_PAGE_SIZE, frames[i], flags);
+    }
+    dp_stats.pages_allocated += extra;
+    fault_around_record(region, aligned_addr, extra);
+    
+    spinlock_release(ptl);
     return 0;
 }
 
+void demand_paging_get_stats(demand_paging_stats_t *stats) {
+    if (stats) {
+        *stats = dp_stats;
+    }
+}
+
 // Unregister a virtual memory region
 void demand_paging_unregister_region(page_table_t *pml4, uint64_t start) {
     // Align start to page boundary
     uint64_t aligned_start = start & ~(BUDDY_PAGE_SIZE - 1);
     
     // Get address space
-    vm_address_space_t *as = demand_paging_get_address_space(pml4);
+    vm_address_space_t *as = address_space_lookup(pml4);
     if (!as) {
         return;
     }
@@ -216,37 +505,39 @@ void demand_paging_unregister_region(page_table_t *pml4, uint64_t start) {
     spinlock_acquire(&as->lock);
     
     // Find and remove the region
-    vm_region_t *prev = NULL;
-    vm_region_t *current = as->regions;
-    
-    while (current) {
-        if (current->start == aligned_start) {
-            // Remove from list
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                as->regions = current->next;
-            }
-            
-            // Optionally free allocated pages
-            for (uint64_t addr = current->start; addr < current->end; addr += BUDDY_PAGE_SIZE) {
-                uint64_t phys_addr = vmm_get_physical_address(pml4, addr);
-                if (phys_addr != 0) {
-                    vmm_unmap_page(pml4, addr);
-                    buddy_free_pages(phys_addr, 0);
-                }
-            }
-            
-            // Free the region structure
-            slab_free(vm_region_cache, current);
-            
-            spinlock_release(&as->lock);
-            return;
+    vm_region_t *current = NULL;
+    as->regions = region_remove(as->regions, aligned_start, &current);
+    if (!current) {
+        spinlock_release(&as->lock);
+        return;
+    }
+    as->region_count--;
+    if (as->last_hit == current) {
+        as->last_hit = NULL;
+    }
+    
+    // Stop the scanner before its candidates are unmapped
+    if (current->flags & VM_FLAG_MERGEABLE) {
+        ksm_unregister(pml4, current->start);
+    }
+    
+    // Unmap populated pages; the frames are freed only after the
+    // batched TLB flush. A COW frame (merged or forked) is freed
+    // only with its last mapping.
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb);
+    for (uint64_t addr = current->start; addr < current->end; addr += BUDDY_PAGE_SIZE) {
+        uint64_t *pte = vmm_get_pte(pml4, addr);
+        int shared = pte && (*pte & VMM_FLAG_PRESENT) && (*pte & COW_FLAG_MASK);
+        uint64_t phys_addr = vmm_unmap_page_deferred(pml4, addr, &tlb);
+        if (!shared || cow_release_ref(phys_addr)) {
+            tlb_gather_free_frame(&tlb, phys_addr);
         }
-        
-        prev = current;
-        current = current->next;
     }
+    tlb_gather_finish(&tlb);
+    
+    // Free the region structure
+    slab_free(vm_region_cache, current);
     
     spinlock_release(&as->lock);
 }
@@ -4,195 +4,821 @@
 #include "../../include/kernel/types.h"
 #include "../../include/kernel/stdio.h"
 #include "../../include/mm/slab.h"
+#include "../../include/mm/page.h"
+#include "../../include/mm/tlsf.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/gfp.h"
+#include "../../include/mm/alloc_profile.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/spinlock.h"
+#include "../../include/kernel/atomic.h"
+#include "../../include/kernel/cpu.h"
+#include "../../include/drivers/pit.h"
 
-typedef struct block_header_t {
+// A run of buddy pages mapped into an arena's window and handed to TLSF
+typedef struct heap_pool {
+  uint8_t *start;
   size_t size;
-  int free;
-  struct block_header_t *next;
-  struct block_header_t *prev;
-} block_header_t;
+} heap_pool_t;
 
+// Each CPU allocates from its own arena: a TLSF instance over a private
+// HEAP_ARENA_SIZE slice of the heap window, so the owner of any heap
+// pointer follows from its address. Blocks freed by other CPUs are pushed
+// onto remote_head without taking the lock and drained by the owner.
+typedef struct heap_arena {
+  tlsf_t tlsf;
+  spinlock_t lock;
+  uint32_t id;
+  uint8_t *start;
+  size_t mapped;                       // Backed bytes from start
+  heap_pool_t pools[HEAP_MAX_POOLS];   // Address order; only the last may go
+  uint32_t pool_count;
+  uint64_t tail_free_since;            // Tick the tail pool became free (0 = in use)
+  volatile uint64_t remote_head;       // Lock-free stack of remotely freed blocks
+  uint64_t grows;
+  uint64_t shrinks;
+  uint64_t steals;                     // Blocks handed out to other CPUs' requests
+  uint64_t remote_frees;               // Remote blocks drained back into TLSF
+} heap_arena_t;
+
+static heap_arena_t g_heap_arenas[MAX_CPUS];
 static uint8_t *g_heap_start = 0;
-static size_t g_heap_size = 0;
-static block_header_t *g_heap_head = 0;
+static size_t g_heap_size = 0;       // Reserved window size
 static int g_slab_initialized = 0;
 
-// Slab caches for common allocation sizes
-static slab_cache_t *g_cache_16 = 0;
-static slab_cache_t *g_cache_32 = 0;
-static slab_cache_t *g_cache_64 = 0;
-static slab_cache_t *g_cache_128 = 0;
-static slab_cache_t *g_cache_256 = 0;
-static slab_cache_t *g_cache_512 = 0;
-static slab_cache_t *g_cache_1024 = 0;
-static slab_cache_t *g_cache_2048 = 0;
+static size_t g_grow_min = HEAP_DEFAULT_GROW_MIN;
+static size_t g_shrink_threshold = HEAP_DEFAULT_SHRINK_THRESHOLD;
+static uint64_t g_shrink_delay = HEAP_DEFAULT_SHRINK_DELAY;
+
+// Slab caches backing the kmalloc size classes
+static slab_cache_t *g_kmalloc_caches[KMALLOC_NUM_CACHES];
+
+static const size_t g_kmalloc_sizes[KMALLOC_NUM_CACHES] = {
+  8, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+
+static const char *g_kmalloc_names[KMALLOC_NUM_CACHES] = {
+  "kmalloc-8", "kmalloc-16", "kmalloc-24", "kmalloc-32",
+  "kmalloc-48", "kmalloc-64", "kmalloc-96", "kmalloc-128",
+  "kmalloc-192", "kmalloc-256", "kmalloc-384", "kmalloc-512",
+  "kmalloc-768", "kmalloc-1024", "kmalloc-1536", "kmalloc-2048"
+};
+
+// Per-CPU histogram of slab-sized requests in 8-byte buckets
+#define KMALLOC_HIST_BUCKETS  (KMALLOC_MAX_CACHE_SIZE / 8)
+
+typedef struct kmalloc_hist {
+  uint64_t count[KMALLOC_HIST_BUCKETS];
+  uint64_t bytes[KMALLOC_HIST_BUCKETS];
+  uint64_t since_adapt;                // Requests since the last runtime step
+} kmalloc_hist_t;
+
+static kmalloc_hist_t g_kmalloc_hist[MAX_CPUS];
+
+// Cache serving each bucket: the smallest class holding the bucket's
+// largest size. Adding a class only ever moves buckets to smaller caches.
+static slab_cache_t *volatile g_kmalloc_table[KMALLOC_HIST_BUCKETS];
+
+static slab_cache_t *g_kmalloc_adaptive[KMALLOC_MAX_ADAPTIVE];
+static volatile uint32_t g_kmalloc_adaptive_count = 0;
+static volatile int g_kmalloc_auto_adapt = 0;
+static spinlock_t g_kmalloc_adapt_lock;
 
-static size_t align16(size_t n) { return (n + 15) & ~(size_t)15; }
+// Merged histogram, only touched under g_kmalloc_adapt_lock
+static uint64_t g_merged_count[KMALLOC_HIST_BUCKETS];
+static uint64_t g_merged_bytes[KMALLOC_HIST_BUCKETS];
+
+// Cache index for sizes 1..192, indexed by (size - 1) / 8
+static const uint8_t g_kmalloc_small_index[24] = {
+  0, 1, 2, 3, 4, 4, 5, 5,
+  6, 6, 6, 6, 7, 7, 7, 7,
+  8, 8, 8, 8, 8, 8, 8, 8
+};
+
+// Map a request size (1..KMALLOC_MAX_CACHE_SIZE) to its cache index
+static inline uint32_t kmalloc_index(size_t size) {
+  if (size <= 192)
+    return g_kmalloc_small_index[(size - 1) >> 3];
+  
+  // size lies in (2^shift, 2^(shift+1)]; pick the 1.5x class when it fits
+  uint32_t shift = 63 - (uint32_t)__builtin_clzll((uint64_t)(size - 1));
+  uint32_t index = 2 * shift - 5;
+  if (size <= (3ULL << (shift - 1)))
+    index--;
+  return index;
+}
 
 // Helper to determine if pointer is from heap
-static int is_heap_pointer(void *ptr) {
+static int is_heap_pointer(const void *ptr) {
   uintptr_t addr = (uintptr_t)ptr;
   uintptr_t heap_start = (uintptr_t)g_heap_start;
   uintptr_t heap_end = heap_start + g_heap_size;
   return (addr >= heap_start && addr < heap_end);
 }
 
-// Helper to find which slab cache a pointer belongs to
-static slab_cache_t *find_slab_cache(void *ptr, size_t *out_size) {
-  if (!g_slab_initialized || !ptr) {
+// Helper to find the slab cache that owns a non-heap pointer
+static slab_cache_t *find_slab_cache(const void *ptr) {
+  page_t *page = buddy_phys_to_page((uint64_t)(uintptr_t)ptr);
+  if (!page || !(page->flags & PAGE_FLAG_SLAB)) {
+    return NULL;
+  }
+  return (slab_cache_t *)page->owner;
+}
+
+// Helper to find the head page of a page-granular kmalloc block
+static page_t *find_large_page(const void *ptr) {
+  uint64_t addr = (uint64_t)(uintptr_t)ptr;
+  if (addr & (BUDDY_PAGE_SIZE - 1))
     return NULL;
+  page_t *page = buddy_phys_to_page(addr);
+  if (!page || !(page->flags & PAGE_FLAG_KMALLOC_LARGE))
+    return NULL;
+  return page;
+}
+
+// Smallest buddy order whose block holds size bytes
+static uint32_t size_to_order(size_t size) {
+  uint64_t pages = (size + BUDDY_PAGE_SIZE - 1) / BUDDY_PAGE_SIZE;
+  if (pages <= 1)
+    return 0;
+  return 64 - (uint32_t)__builtin_clzll(pages - 1);
+}
+
+// Unmap [virt, virt + size), flush the TLB once and give the pages back
+// to buddy
+static void heap_unmap_range(uint64_t virt, size_t size) {
+  page_table_t *kernel_pml4 = vmm_get_kernel_address_space();
+  tlb_gather_t tlb;
+  tlb_gather_init(&tlb);
+  for (size_t off = 0; off < size; off += BUDDY_PAGE_SIZE)
+    tlb_gather_free_frame(&tlb, vmm_unmap_page_deferred(kernel_pml4, virt + off, &tlb));
+  tlb_gather_finish(&tlb);
+}
+
+// Arena owning a heap pointer
+static inline heap_arena_t *heap_arena_of(const void *ptr) {
+  uintptr_t offset = (uintptr_t)ptr - (uintptr_t)g_heap_start;
+  return &g_heap_arenas[offset / HEAP_ARENA_SIZE];
+}
+
+// Queue a block freed on another CPU for its owning arena. The link to the
+// next queued block is kept in the first word of the dead payload.
+static void arena_push_remote(heap_arena_t *arena, void *ptr) {
+  uint64_t old = atomic_load64(&arena->remote_head);
+  for (;;) {
+    *(uint64_t *)ptr = old;
+    uint64_t seen = atomic_compare_and_swap64(&arena->remote_head, old,
+                                              (uint64_t)(uintptr_t)ptr);
+    if (seen == old)
+      return;
+    old = seen;
+  }
+}
+
+// Give every remotely freed block back to TLSF. The whole stack is taken
+// with one exchange, so pushes never race with pops (no ABA).
+// Caller must hold arena->lock.
+static void arena_drain_remote(heap_arena_t *arena) {
+  if (!atomic_load64(&arena->remote_head))
+    return;
+  
+  uint64_t head = atomic_exchange64(&arena->remote_head, 0);
+  while (head) {
+    void *ptr = (void *)(uintptr_t)head;
+    head = *(uint64_t *)ptr;
+    if (tlsf_free(&arena->tlsf, ptr) == 0)
+      arena->remote_frees++;
+    else
+      kprintf("[HEAP] ERROR: kfree(%p) - invalid heap block\n", ptr);
   }
+}
+
+// Back the next size bytes of the arena's window with buddy pages and add
+// them to TLSF as a new pool. Caller must hold arena->lock.
+static int heap_grow(heap_arena_t *arena, size_t size) {
+  size = (size + BUDDY_PAGE_SIZE - 1) & ~(size_t)(BUDDY_PAGE_SIZE - 1);
   
-  // Try to determine size by checking cache boundaries
-  // This is a simplified approach - in production, you'd want better tracking
-  slab_cache_t *caches[] = {
-    g_cache_16, g_cache_32, g_cache_64, g_cache_128,
-    g_cache_256, g_cache_512, g_cache_1024, g_cache_2048
-  };
-  size_t sizes[] = {16, 32, 64, 128, 256, 512, 1024, 2048};
-  
-  for (int i = 0; i < 8; i++) {
-    if (caches[i]) {
-      // Simple heuristic: if not in heap range, assume it's from slab
-      if (!is_heap_pointer(ptr)) {
-        if (out_size) *out_size = sizes[i];
-        return caches[i];
+  if (arena->pool_count >= HEAP_MAX_POOLS) {
+    kprintf("[HEAP] ERROR: Cannot grow heap arena %u - pool table full\n", arena->id);
+    return -1;
+  }
+  if (size > HEAP_ARENA_SIZE - arena->mapped) {
+    kprintf("[HEAP] ERROR: Cannot grow heap arena %u by %zu bytes - window exhausted\n",
+            arena->id, size);
+    return -1;
+  }
+  
+  page_table_t *kernel_pml4 = vmm_get_kernel_address_space();
+  uint64_t base = (uint64_t)(uintptr_t)(arena->start + arena->mapped);
+  
+  for (size_t off = 0; off < size; off += BUDDY_PAGE_SIZE) {
+    uint64_t phys = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (phys) {
+      vmm_map_page(kernel_pml4, base + off, phys, VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE);
+      // vmm_map_page() fails silently if a page table cannot be allocated
+      if (vmm_get_physical_address(kernel_pml4, base + off) != phys) {
+        buddy_free_pages(phys, 0);
+        phys = 0;
       }
     }
+    if (!phys) {
+      heap_unmap_range(base, off);
+      kprintf("[HEAP] ERROR: Cannot grow heap arena %u by %zu bytes - out of memory\n",
+              arena->id, size);
+      return -1;
+    }
   }
   
-  return NULL;
+  if (tlsf_add_pool(&arena->tlsf, (void *)(uintptr_t)base, size) != 0) {
+    heap_unmap_range(base, size);
+    return -1;
+  }
+  
+  arena->pools[arena->pool_count].start = (uint8_t *)(uintptr_t)base;
+  arena->pools[arena->pool_count].size = size;
+  arena->pool_count++;
+  arena->mapped += size;
+  arena->grows++;
+  arena->tail_free_since = 0;
+  
+  DEBUG_PRINT(SLAB, "Heap arena %u grew by %zu bytes to %zu bytes (%u pools)\n",
+              arena->id, size, arena->mapped, arena->pool_count);
+  return 0;
+}
+
+// Release the arena's tail pool if it is entirely free. With force clear,
+// the shrink delay and threshold must also be satisfied. Caller must hold
+// arena->lock. Returns the number of bytes released.
+static size_t heap_try_shrink(heap_arena_t *arena, int force) {
+  // The first pool of an arena is never released
+  if (arena->pool_count <= 1)
+    return 0;
+  
+  heap_pool_t *tail = &arena->pools[arena->pool_count - 1];
+  if (!tlsf_pool_is_free(tail->start, tail->size)) {
+    arena->tail_free_since = 0;
+    return 0;
+  }
+  
+  if (!force) {
+    uint64_t now = pit_get_ticks();
+    if (arena->tail_free_since == 0) {
+      arena->tail_free_since = now ? now : 1;
+      if (g_shrink_delay > 0)
+        return 0;
+    }
+    if (now - arena->tail_free_since < g_shrink_delay)
+      return 0;
+    
+    // Keep a cushion so an alloc/free cycle at the boundary cannot thrash
+    size_t tail_payload = tail->size - 2 * TLSF_BLOCK_HEADER;
+    if (arena->tlsf.free_bytes - tail_payload < g_shrink_threshold)
+      return 0;
+  }
+  
+  if (tlsf_remove_pool(&arena->tlsf, tail->start, tail->size) != 0)
+    return 0;
+  
+  size_t released = tail->size;
+  heap_unmap_range((uint64_t)(uintptr_t)tail->start, tail->size);
+  
+  arena->pool_count--;
+  arena->mapped -= released;
+  arena->shrinks++;
+  arena->tail_free_since = 0;
+  
+  DEBUG_PRINT(SLAB, "Heap arena %u shrank by %zu bytes to %zu bytes (%u pools)\n",
+              arena->id, released, arena->mapped, arena->pool_count);
+  return released;
+}
+
+// Release every fully free tail pool, skipping busy arenas when try_lock
+// is set. Returns the number of bytes released.
+static size_t heap_trim_arenas(int try_lock) {
+  size_t released = 0;
+  for (uint32_t i = 0; i < MAX_CPUS; i++) {
+    heap_arena_t *arena = &g_heap_arenas[i];
+    if (!try_lock)
+      spinlock_acquire(&arena->lock);
+    else if (!spinlock_try_acquire(&arena->lock))
+      continue;
+    arena_drain_remote(arena);
+    for (;;) {
+      size_t bytes = heap_try_shrink(arena, 1);
+      if (!bytes)
+        break;
+      released += bytes;
+    }
+    spinlock_release(&arena->lock);
+  }
+  return released;
+}
+
+// Buddy shrinker: may run inside heap_grow() under an arena lock, so it
+// trims like heap_trim() but skips busy arenas
+static uint64_t heap_shrinker(void) {
+  return heap_trim_arenas(1) / BUDDY_PAGE_SIZE;
+}
+
+static void create_kmalloc_caches(void) {
+  for (uint32_t i = 0; i < KMALLOC_NUM_CACHES; i++) {
+    if (g_kmalloc_caches[i])
+      continue;
+    size_t class_size = g_kmalloc_sizes[i];
+    size_t align = (class_size & 15) ? 8 : 16;
+    g_kmalloc_caches[i] = slab_cache_create(g_kmalloc_names[i], class_size, align);
+  }
+  
+  for (uint32_t b = 0; b < KMALLOC_HIST_BUCKETS; b++)
+    g_kmalloc_table[b] = g_kmalloc_caches[kmalloc_index(((size_t)b + 1) << 3)];
+}
+
+// Slot size a bucket is served with now (0 if its cache is missing)
+static inline size_t kmalloc_slot_size(uint32_t bucket) {
+  slab_cache_t *cache = g_kmalloc_table[bucket];
+  return cache ? cache->object_size : 0;
 }
+
+// Sum the per-CPU histograms. Caller must hold g_kmalloc_adapt_lock.
+static void kmalloc_merge_histogram(void) {
+  memset(g_merged_count, 0, sizeof(g_merged_count));
+  memset(g_merged_bytes, 0, sizeof(g_merged_bytes));
+  for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+    kmalloc_hist_t *hist = &g_kmalloc_hist[cpu];
+    for (uint32_t b = 0; b < KMALLOC_HIST_BUCKETS; b++) {
+      g_merged_count[b] += hist->count[b];
+      g_merged_bytes[b] += hist->bytes[b];
+    }
+  }
+}
+
+// Create a cache for size and point every bucket it serves more tightly at
+// it. Caller must hold g_kmalloc_adapt_lock.
+static int kmalloc_add_class(size_t size) {
+  if (size == 0 || size > KMALLOC_MAX_CACHE_SIZE || (size & 7))
+    return -1;
+  if (g_kmalloc_adaptive_count >= KMALLOC_MAX_ADAPTIVE)
+    return -1;
+  
+  size_t current = kmalloc_slot_size((uint32_t)(size >> 3) - 1);
+  if (current == 0 || current == size)
+    return -1;
+  
+  // "kmalloc-a<size>"
+  char name[32] = "kmalloc-a";
+  char digits[8];
+  uint32_t n = 0;
+  for (size_t v = size; v; v /= 10)
+    digits[n++] = (char)('0' + v % 10);
+  uint32_t pos = (uint32_t)strlen(name);
+  while (n)
+    name[pos++] = digits[--n];
+  name[pos] = '\0';
+  
+  slab_cache_t *cache = slab_cache_create(name, size, (size & 15) ? 8 : 16);
+  if (!cache) {
+    kprintf("[HEAP] ERROR: Cannot create adaptive kmalloc class %zu\n", size);
+    return -1;
+  }
+  
+  // The class entry is written before the count that covers it, and the
+  // count (a release store) before any bucket moves: a kfree_sized() that
+  // sees a moved bucket then sees the new count on its recheck
+  uint32_t count = g_kmalloc_adaptive_count;
+  g_kmalloc_adaptive[count] = cache;
+  atomic_store(&g_kmalloc_adaptive_count, count + 1);
+  
+  for (uint32_t b = 0; b < (uint32_t)(size >> 3); b++) {
+    if (kmalloc_slot_size(b) > size)
+      g_kmalloc_table[b] = cache;
+  }
+  
+  DEBUG_PRINT(SLAB, "Added adaptive kmalloc class %s\n", cache->name);
+  return 0;
+}
+
+void heap_set_adaptive_classes(int enable) {
+  g_kmalloc_auto_adapt = enable ? 1 : 0;
+}
+
+uint32_t kmalloc_adapt_classes(uint32_t max_new) {
+  if (!g_slab_initialized)
+    return 0;
+  
+  uint32_t created = 0;
+  spinlock_acquire(&g_kmalloc_adapt_lock);
+  kmalloc_merge_histogram();
+  
+  while (created < max_new && g_kmalloc_adaptive_count < KMALLOC_MAX_ADAPTIVE) {
+    // The best new class always sits at the top of a requested bucket:
+    // moving it down to the next requested size only saves more
+    uint32_t best = 0;
+    uint64_t best_saved = 0;
+    for (uint32_t c = 0; c < KMALLOC_HIST_BUCKETS; c++) {
+      size_t size = ((size_t)c + 1) << 3;
+      if (!g_merged_count[c] || kmalloc_slot_size(c) <= size)
+        continue;
+      
+      // Slot sizes never decrease with the bucket, so stop at the first
+      // bucket the candidate would not shrink
+      uint64_t saved = 0;
+      for (uint32_t b = c + 1; b-- > 0;) {
+        size_t slot = kmalloc_slot_size(b);
+        if (slot <= size)
+          break;
+        saved += g_merged_count[b] * (slot - size);
+      }
+      if (saved > best_saved) {
+        best_saved = saved;
+        best = c;
+      }
+    }
+    
+    // A new cache costs at least a page; not worth it for less
+    if (best_saved < KMALLOC_ADAPT_MIN_SAVED)
+      break;
+    if (kmalloc_add_class(((size_t)best + 1) << 3) != 0)
+      break;
+    created++;
+  }
+  
+  spinlock_release(&g_kmalloc_adapt_lock);
+  return created;
+}
+
+uint32_t kmalloc_load_profile(const uint16_t *sizes, uint32_t count) {
+  if (!sizes || !g_slab_initialized)
+    return 0;
+  
+  uint32_t created = 0;
+  spinlock_acquire(&g_kmalloc_adapt_lock);
+  for (uint32_t i = 0; i < count; i++) {
+    if (sizes[i] && kmalloc_add_class(sizes[i]) == 0)
+      created++;
+  }
+  spinlock_release(&g_kmalloc_adapt_lock);
+  return created;
+}
+
+uint32_t kmalloc_export_profile(uint16_t *sizes, uint32_t max) {
+  uint32_t n = 0;
+  spinlock_acquire(&g_kmalloc_adapt_lock);
+  while (sizes && n < max && n < g_kmalloc_adaptive_count) {
+    sizes[n] = (uint16_t)g_kmalloc_adaptive[n]->object_size;
+    n++;
+  }
+  spinlock_release(&g_kmalloc_adapt_lock);
+  return n;
+}
+
+void kmalloc_get_class_stats(kmalloc_class_stats_t *stats) {
+  if (!stats)
+    return;
+  memset(stats, 0, sizeof(kmalloc_class_stats_t));
+  
+  spinlock_acquire(&g_kmalloc_adapt_lock);
+  kmalloc_merge_histogram();
+  stats->adaptive_classes = g_kmalloc_adaptive_count;
+  for (uint32_t b = 0; b < KMALLOC_HIST_BUCKETS; b++) {
+    uint64_t count = g_merged_count[b];
+    size_t slot = kmalloc_slot_size(b);
+    if (!count || !slot)
+      continue;
+    size_t static_slot = g_kmalloc_sizes[kmalloc_index(((size_t)b + 1) << 3)];
+    stats->requests += count;
+    stats->requested_bytes += g_merged_bytes[b];
+    stats->static_waste += count * static_slot - g_merged_bytes[b];
+    stats->current_waste += count * slot - g_merged_bytes[b];
+  }
+  spinlock_release(&g_kmalloc_adapt_lock);
+  
+  stats->bytes_saved = stats->static_waste - stats->current_waste;
+}
+
+void kmalloc_reset_histogram(void) {
+  spinlock_acquire(&g_kmalloc_adapt_lock);
+  memset(g_kmalloc_hist, 0, sizeof(g_kmalloc_hist));
+  spinlock_release(&g_kmalloc_adapt_lock);
+}
+
+int kmalloc_reset_classes(void) {
+  spinlock_acquire(&g_kmalloc_adapt_lock);
+  uint32_t count = g_kmalloc_adaptive_count;
+  for (uint32_t i = 0; i < count; i++) {
+    slab_cache_t *cache = g_kmalloc_adaptive[i];
+    if (cache->total_allocations != cache->total_frees) {
+      spinlock_release(&g_kmalloc_adapt_lock);
+      return -1;
+    }
+  }
+  
+  // Sizes map to the static classes again before the release store of a
+  // zero count lets kfree_sized() trust them
+  for (uint32_t b = 0; b < KMALLOC_HIST_BUCKETS; b++)
+    g_kmalloc_table[b] = g_kmalloc_caches[kmalloc_index(((size_t)b + 1) << 3)];
+  atomic_store(&g_kmalloc_adaptive_count, 0);
+  
+  for (uint32_t i = 0; i < count; i++) {
+    slab_cache_destroy(g_kmalloc_adaptive[i]);
+    g_kmalloc_adaptive[i] = NULL;
+  }
+  spinlock_release(&g_kmalloc_adapt_lock);
+  return (int)count;
+}
+
+void kmalloc_print_profile(void) {
+  uint16_t sizes[KMALLOC_MAX_ADAPTIVE];
+  uint32_t n = kmalloc_export_profile(sizes, KMALLOC_MAX_ADAPTIVE);
+  
+  kmalloc_class_stats_t stats;
+  kmalloc_get_class_stats(&stats);
+  
+  kprintf("[HEAP] %u adaptive kmalloc classes, %llu requests (%llu bytes)\n",
+          n, stats.requests, stats.requested_bytes);
+  kprintf("[HEAP] Slack: %llu bytes static, %llu bytes now, %llu bytes saved\n",
+          stats.static_waste, stats.current_waste, stats.bytes_saved);
+  kprintf("[HEAP] #define KMALLOC_BOOT_CLASSES {");
+  for (uint32_t i = 0; i < n; i++)
+    kprintf(" %u,", (uint32_t)sizes[i]);
+  kprintf(" 0 }\n");
+}
+
 void heap_init(uint64_t start, uint64_t size) {
   g_heap_start = (uint8_t *)(uintptr_t)start;
-  g_heap_size = (size_t)size;
-  g_heap_head = (block_header_t *)g_heap_start;
-  g_heap_head->size = g_heap_size - sizeof(block_header_t);
-  g_heap_head->free = 1;
-  g_heap_head->next = 0;
-  g_heap_head->prev = 0;
-  
-  // Initialize slab caches for common allocation sizes
-  // Note: slab_init() must be called before heap_init()
-  if (g_slab_initialized) {
-    g_cache_16 = slab_cache_create("kmalloc-16", 16, 16);
-    g_cache_32 = slab_cache_create("kmalloc-32", 32, 16);
-    g_cache_64 = slab_cache_create("kmalloc-64", 64, 16);
-    g_cache_128 = slab_cache_create("kmalloc-128", 128, 16);
-    g_cache_256 = slab_cache_create("kmalloc-256", 256, 16);
-    g_cache_512 = slab_cache_create("kmalloc-512", 512, 16);
-    g_cache_1024 = slab_cache_create("kmalloc-1024", 1024, 16);
-    g_cache_2048 = slab_cache_create("kmalloc-2048", 2048, 16);
+  g_heap_size = HEAP_MAX_SIZE;
+  
+  spinlock_init(&g_kmalloc_adapt_lock);
+  for (uint32_t i = 0; i < MAX_CPUS; i++) {
+    heap_arena_t *arena = &g_heap_arenas[i];
+    memset(arena, 0, sizeof(heap_arena_t));
+    spinlock_init(&arena->lock);
+    tlsf_init(&arena->tlsf);
+    arena->id = i;
+    arena->start = g_heap_start + (size_t)i * HEAP_ARENA_SIZE;
+  }
+  
+  // Back the boot CPU's initial pool; other arenas are backed on first use
+  // and everything else is mapped on demand
+  if (heap_grow(&g_heap_arenas[0], (size_t)size) != 0) {
+    kprintf("[HEAP] ERROR: Failed to initialize heap at %p (%zu bytes)\n",
+            g_heap_start, (size_t)size);
   }
+  g_heap_arenas[0].grows = 0;
+  
+  // Free tail pools waiting out the shrink delay go back under pressure
+  buddy_register_shrinker(heap_shrinker);
+  
+  // Initialize slab caches for the kmalloc size classes
+  // Note: slab_init() must be called before heap_init()
+  if (g_slab_initialized)
+    create_kmalloc_caches();
 }
 
 void heap_enable_slab(void) {
+  static const uint16_t boot_classes[] = KMALLOC_BOOT_CLASSES;
+  
   g_slab_initialized = 1;
+  create_kmalloc_caches();
+  kmalloc_load_profile(boot_classes, sizeof(boot_classes) / sizeof(boot_classes[0]));
+}
+
+void heap_set_growth_params(size_t grow_min, size_t shrink_threshold,
+                            uint64_t shrink_delay) {
+  // Plain word stores; each arena picks them up on its next grow or shrink
+  g_grow_min = grow_min ? grow_min : BUDDY_PAGE_SIZE;
+  g_shrink_threshold = shrink_threshold;
+  g_shrink_delay = shrink_delay;
+}
+
+size_t heap_trim(void) {
+  return heap_trim_arenas(0);
 }
-static void split_block(block_header_t *b, size_t size) {
-  if (b->size >= size + sizeof(block_header_t) + 16) {
-    block_header_t *n =
-        (block_header_t *)((uint8_t *)b + sizeof(block_header_t) + size);
-    n->size = b->size - size - sizeof(block_header_t);
-    n->free = 1;
-    n->next = b->next;
-    n->prev = b;
-    if (n->next)
-      n->next->prev = n;
-    b->next = n;
-    b->size = size;
-  }
-}
-static void coalesce(block_header_t *b) {
-  if (b->next && b->next->free) {
-    b->size += sizeof(block_header_t) + b->next->size;
-    b->next = b->next->next;
-    if (b->next)
-      b->next->prev = b;
-  }
-  if (b->prev && b->prev->free) {
-    b = b->prev;
-    if (b->next && b->next->free) {
-      b->size += sizeof(block_header_t) + b->next->size;
-      b->next = b->next->next;
-      if (b->next)
-        b->next->prev = b;
+
+void heap_get_stats(heap_stats_t *stats) {
+  if (!stats)
+    return;
+  memset(stats, 0, sizeof(heap_stats_t));
+  for (uint32_t i = 0; i < MAX_CPUS; i++) {
+    heap_arena_t *arena = &g_heap_arenas[i];
+    spinlock_acquire(&arena->lock);
+    stats->mapped_bytes += arena->mapped;
+    stats->free_bytes += arena->tlsf.free_bytes;
+    stats->pools += arena->pool_count;
+    stats->grows += arena->grows;
+    stats->shrinks += arena->shrinks;
+    stats->steals += arena->steals;
+    stats->remote_frees += arena->remote_frees;
+    if (arena->pool_count > 0)
+      stats->arenas++;
+    spinlock_release(&arena->lock);
+  }
+}
+
+// Caller must hold arena->lock
+static void *arena_alloc_locked(heap_arena_t *arena, size_t size) {
+  arena_drain_remote(arena);
+  void *ptr = tlsf_malloc(&arena->tlsf, size);
+  
+  // An allocation in the tail pool restarts its shrink delay
+  if (ptr && arena->pool_count > 0 &&
+      (uint8_t *)ptr >= arena->pools[arena->pool_count - 1].start)
+    arena->tail_free_since = 0;
+  return ptr;
+}
+
+// Borrow a block from another CPU's arena holding at least surplus free
+// bytes beyond the request. The block keeps its owner, so freeing it later
+// takes the remote path. Only one arena lock is ever held at a time.
+static void *heap_steal(uint32_t self, size_t size, size_t surplus) {
+  for (uint32_t i = 1; i < MAX_CPUS; i++) {
+    heap_arena_t *victim = &g_heap_arenas[(self + i) % MAX_CPUS];
+    
+    // Unlocked reads are only a hint; the allocation below decides
+    if (victim->pool_count == 0 || victim->tlsf.free_bytes < size + surplus)
+      continue;
+    
+    spinlock_acquire(&victim->lock);
+    void *ptr = arena_alloc_locked(victim, size);
+    if (ptr)
+      victim->steals++;
+    spinlock_release(&victim->lock);
+    
+    if (ptr) {
+      DEBUG_PRINT(SLAB, "kmalloc(%zu) on CPU %u stole %p from arena %u\n",
+                  size, self, ptr, victim->id);
+      return ptr;
     }
   }
+  return NULL;
 }
-void *kmalloc(size_t size) {
+
+static void *heap_alloc(size_t size) {
+  uint32_t cpu = cpu_current_id();
+  heap_arena_t *arena = &g_heap_arenas[cpu];
+  
+  spinlock_acquire(&arena->lock);
+  void *ptr = arena_alloc_locked(arena, size);
+  spinlock_release(&arena->lock);
+  
+  // Prefer memory another arena would otherwise give back to buddy
+  if (!ptr)
+    ptr = heap_steal(cpu, size, g_shrink_threshold);
+  
+  if (!ptr) {
+    spinlock_acquire(&arena->lock);
+    // Grow by at least grow_min; the slack covers TLSF rounding and headers
+    size_t grow = size + size / 16 + 4 * TLSF_BLOCK_HEADER + TLSF_SMALL_BLOCK;
+    if (grow < g_grow_min)
+      grow = g_grow_min;
+    if (grow > size && heap_grow(arena, grow) == 0)
+      ptr = arena_alloc_locked(arena, size);
+    spinlock_release(&arena->lock);
+  }
+  
+  // Out of memory for new pools; take whatever another arena has
+  if (!ptr)
+    ptr = heap_steal(cpu, size, 0);
+  
+  if (!ptr) {
+    kprintf("[HEAP] ERROR: kmalloc(%zu) failed - out of memory\n", size);
+    return NULL;
+  }
+  
+  DEBUG_PRINT(SLAB, "kmalloc(%zu) from heap arena %u -> %p\n", size, cpu, ptr);
+  return ptr;
+}
+
+static void heap_free(void *ptr) {
+  DEBUG_PRINT(SLAB, "kfree(%p) from heap (size %zu)\n", ptr, tlsf_block_size(ptr));
+  
+  // Claiming the block first turns a double free into an error even when
+  // both frees race from different CPUs
+  if (tlsf_block_claim(ptr) != 0) {
+    kprintf("[HEAP] ERROR: kfree(%p) - invalid heap block\n", ptr);
+    return;
+  }
+  
+  heap_arena_t *owner = heap_arena_of(ptr);
+  if (owner->id != cpu_current_id()) {
+    arena_push_remote(owner, ptr);
+    return;
+  }
+  
+  spinlock_acquire(&owner->lock);
+  
+  // TLSF validates the boundary tags before merging
+  arena_drain_remote(owner);
+  int result = tlsf_free(&owner->tlsf, ptr);
+  if (result == 0)
+    heap_try_shrink(owner, 0);
+  
+  spinlock_release(&owner->lock);
+  
+  if (result != 0)
+    kprintf("[HEAP] ERROR: kfree(%p) - invalid heap block\n", ptr);
+}
+
+// Page-granular allocation straight from the buddy allocator. The order
+// lives in the page descriptor, so the block needs no header.
+static void *kmalloc_large(size_t size, uint32_t flags) {
+  uint32_t order = size_to_order(size);
+  uint64_t addr = buddy_alloc_pages_flags(order, flags & (GFP_ZONE_MASK | GFP_ZERO | GFP_DMA));
+  if (!addr)
+    return NULL;
+  
+  page_t *page = buddy_phys_to_page(addr);
+  page->flags |= PAGE_FLAG_KMALLOC_LARGE;
+  
+  DEBUG_PRINT(SLAB, "kmalloc(%zu) from buddy (order %u) -> 0x%llx\n", size, order, addr);
+  return (void *)(uintptr_t)addr;
+}
+
+static void *kmalloc_route(size_t size, uint32_t flags) {
   if (size == 0)
     return NULL;
   
-  // Determine allocation source and cache index
-  slab_cache_t *cache = NULL;
-  uint8_t cache_index = SLAB_CACHE_NONE;
-  uint16_t alloc_flags = ALLOC_FROM_HEAP;
-  
-  // Use slab allocator for allocations < 4KB
-  if (g_slab_initialized && size < 4096) {
-    if (size <= 16) { cache = g_cache_16; cache_index = SLAB_CACHE_16; }
-    else if (size <= 32) { cache = g_cache_32; cache_index = SLAB_CACHE_32; }
-    else if (size <= 64) { cache = g_cache_64; cache_index = SLAB_CACHE_64; }
-    else if (size <= 128) { cache = g_cache_128; cache_index = SLAB_CACHE_128; }
-    else if (size <= 256) { cache = g_cache_256; cache_index = SLAB_CACHE_256; }
-    else if (size <= 512) { cache = g_cache_512; cache_index = SLAB_CACHE_512; }
-    else if (size <= 1024) { cache = g_cache_1024; cache_index = SLAB_CACHE_1024; }
-    else if (size <= 2048) { cache = g_cache_2048; cache_index = SLAB_CACHE_2048; }
+  // Neither slab pages nor heap pools are placed below GFP_DMA_LIMIT, so
+  // DMA requests of any size take whole buddy pages from below it
+  if (flags & GFP_DMA) {
+    if (size > ((size_t)BUDDY_PAGE_SIZE << BUDDY_MAX_ORDER))
+      return NULL;
+    return kmalloc_large(size, flags);
+  }
+  
+  // Use the slab size classes for small allocations (no per-object header)
+  if (g_slab_initialized && size <= KMALLOC_MAX_CACHE_SIZE) {
+    uint32_t bucket = (uint32_t)(size - 1) >> 3;
+    kmalloc_hist_t *hist = &g_kmalloc_hist[cpu_current_id()];
+    hist->count[bucket]++;
+    hist->bytes[bucket] += size;
+    if (g_kmalloc_auto_adapt && ++hist->since_adapt >= KMALLOC_ADAPT_INTERVAL) {
+      hist->since_adapt = 0;
+      kmalloc_adapt_classes(1);
+    }
     
+    slab_cache_t *cache = g_kmalloc_table[bucket];
     if (cache) {
-      // Allocate from slab (includes space for header)
-      void *slab_ptr = slab_alloc(cache);
-      if (slab_ptr) {
-        // Fill allocation header
-        alloc_header_t *header = (alloc_header_t *)slab_ptr;
-        header->magic = ALLOC_MAGIC;
-        header->size = (uint32_t)size;
-        header->flags = ALLOC_FROM_SLAB;
-        header->slab_cache_index = cache_index;
-        header->padding = 0;
-        
-        // Return pointer after header
-        void *user_ptr = (uint8_t *)slab_ptr + sizeof(alloc_header_t);
-        DEBUG_PRINT(SLAB, "kmalloc(%zu) from slab cache %u -> %p\n", 
-                    size, cache_index, user_ptr);
-        return user_ptr;
+      void *obj = slab_alloc(cache);
+      if (obj) {
+        DEBUG_PRINT(SLAB, "kmalloc(%zu) from slab cache %s -> %p\n", 
+                    size, cache->name, obj);
+        if (flags & GFP_ZERO)
+          memset(obj, 0, size);
+        return obj;
       }
       // Fall through to heap allocation if slab fails
       DEBUG_PRINT(SLAB, "Slab allocation failed for size %zu, falling back to heap\n", size);
     }
   }
   
-  // Use heap for large allocations or if slab is not available
-  // Need to allocate: header + requested size
-  size_t total_size = sizeof(alloc_header_t) + size;
-  total_size = align16(total_size);
-  
-  block_header_t *b = g_heap_head;
-  while (b) {
-    if (b->free && b->size >= total_size) {
-      split_block(b, total_size);
-      b->free = 0;
-      
-      // Fill allocation header
-      alloc_header_t *header = (alloc_header_t *)((uint8_t *)b + sizeof(block_header_t));
-      header->magic = ALLOC_MAGIC;
-      header->size = (uint32_t)size;
-      header->flags = ALLOC_FROM_HEAP;
-      header->slab_cache_index = SLAB_CACHE_NONE;
-      header->padding = 0;
-      
-      // Return pointer after header
-      void *user_ptr = (uint8_t *)header + sizeof(alloc_header_t);
-      DEBUG_PRINT(SLAB, "kmalloc(%zu) from heap -> %p\n", size, user_ptr);
-      return user_ptr;
-    }
-    b = b->next;
+  // Whole pages come straight from the buddy allocator; sizes between the
+  // largest slab class and one page stay in the heap to avoid rounding waste
+  if (size >= BUDDY_PAGE_SIZE &&
+      size <= ((size_t)BUDDY_PAGE_SIZE << BUDDY_MAX_ORDER)) {
+    void *ptr = kmalloc_large(size, flags);
+    if (ptr)
+      return ptr;
+    DEBUG_PRINT(SLAB, "Buddy allocation failed for size %zu, falling back to heap\n", size);
   }
   
-  kprintf("[HEAP] ERROR: kmalloc(%zu) failed - out of memory\n", size);
-  return NULL;
+  // Use heap for the remaining sizes or if the other paths failed
+  void *ptr = heap_alloc(size);
+  if (ptr && (flags & GFP_ZERO))
+    memset(ptr, 0, size);
+  return ptr;
+}
+
+// Allocate and report the result to the profiler on behalf of the entry
+// point whose frame is passed in
+static void *kmalloc_internal(size_t size, uint32_t flags, void *frame) {
+  int prof = alloc_profile_enter();
+  void *ptr = kmalloc_route(size, flags);
+  if (prof)
+    alloc_profile_alloc(ALLOC_PROFILE_KMALLOC, (uint64_t)(uintptr_t)ptr, size, frame);
+  alloc_profile_exit(prof);
+  return ptr;
+}
+
+void *kmalloc(size_t size) {
+  return kmalloc_internal(size, GFP_KERNEL, __builtin_frame_address(0));
 }
+
+size_t ksize(const void *ptr) {
+  if (!ptr)
+    return 0;
+  
+  if (is_heap_pointer(ptr))
+    return tlsf_block_size(ptr);
+  
+  page_t *large = find_large_page(ptr);
+  if (large)
+    return (size_t)BUDDY_PAGE_SIZE << large->order;
+  
+  slab_cache_t *cache = find_slab_cache(ptr);
+  return cache ? cache->object_size : 0;
+}
+
 void *kcalloc(size_t num, size_t size) {
   // Check for overflow
   size_t total = 0;
@@ -204,18 +830,26 @@ void *kcalloc(size_t num, size_t size) {
     }
   }
   
-  // kmalloc now handles slab allocation internally and adds headers
-  void *p = kmalloc(total);
-  if (p) {
-    // Zero-fill the user data (not the header)
-    volatile uint8_t *q = p;
-    for (size_t i = 0; i < total; i++)
-      q[i] = 0;
+  void *p = kmalloc_internal(total, GFP_ZERO, __builtin_frame_address(0));
+  if (p)
     DEBUG_PRINT(SLAB, "kcalloc(%zu, %zu) -> %p\n", num, size, p);
-  }
   return p;
 }
-void *krealloc(void *ptr, size_t size) {
+
+// Resize a heap block in place under its owning arena's lock
+static int heap_resize(void *ptr, size_t size) {
+  heap_arena_t *owner = heap_arena_of(ptr);
+  spinlock_acquire(&owner->lock);
+  
+  // Remotely freed neighbours must be merged before they can be absorbed
+  arena_drain_remote(owner);
+  int result = tlsf_resize(&owner->tlsf, ptr, size);
+  
+  spinlock_release(&owner->lock);
+  return result;
+}
+
+static void *krealloc_internal(void *ptr, size_t size) {
   if (!ptr)
     return kmalloc(size);
   if (size == 0) {
@@ -223,124 +857,182 @@ void *krealloc(void *ptr, size_t size) {
     return NULL;
   }
   
-  // Get allocation header to determine current size
-  alloc_header_t *header = (alloc_header_t *)((uint8_t *)ptr - sizeof(alloc_header_t));
-  
-  // Validate magic number
-  if (header->magic != ALLOC_MAGIC) {
-    kprintf("[HEAP] ERROR: krealloc(%p, %zu) - invalid magic number 0x%x\n",
-            ptr, size, header->magic);
+  // The usable size comes from the heap block, buddy order or slab cache
+  size_t old_size = ksize(ptr);
+  if (old_size == 0) {
+    kprintf("[HEAP] ERROR: krealloc(%p, %zu) - not a kmalloc pointer\n", ptr, size);
     return NULL;
   }
   
-  size_t old_size = header->size;
-  
-  // If new size fits in current allocation, just return same pointer
-  if (size <= old_size) {
-    DEBUG_PRINT(SLAB, "krealloc(%p, %zu) - reusing existing allocation (old size %zu)\n",
-                ptr, size, old_size);
-    return ptr;
+  if (is_heap_pointer(ptr)) {
+    // Grow into a free successor, or hand the tail back to TLSF
+    if (heap_resize(ptr, size) == 0) {
+      DEBUG_PRINT(SLAB, "krealloc(%p, %zu) - resized heap block in place (old size %zu)\n",
+                  ptr, size, old_size);
+      return ptr;
+    }
+  } else {
+    // Page-granular block shrinking but still at least a page: free the
+    // upper buddies and keep the head
+    page_t *large = find_large_page(ptr);
+    if (large && size >= BUDDY_PAGE_SIZE && size <= old_size) {
+      uint32_t order = size_to_order(size);
+      if (order < large->order) {
+        DEBUG_PRINT(SLAB, "krealloc(%p, %zu) - shrinking buddy block from order %u to %u\n",
+                    ptr, size, large->order, order);
+        buddy_shrink_pages((uint64_t)(uintptr_t)ptr, large->order, order);
+      }
+      return ptr;
+    }
+    
+    // Stay in the slot (or page) while the data still fills over half of
+    // it; growth within the slack is free
+    if (size <= old_size && size > old_size / 2) {
+      DEBUG_PRINT(SLAB, "krealloc(%p, %zu) - reusing existing allocation (old size %zu)\n",
+                  ptr, size, old_size);
+      return ptr;
+    }
   }
   
-  // Need to allocate new memory
+  // Move to the size class that fits the new size
   void *n = kmalloc(size);
   if (!n) {
     kprintf("[HEAP] ERROR: krealloc(%p, %zu) - allocation failed\n", ptr, size);
     return NULL;
   }
   
-  // Copy old data
-  volatile uint8_t *d = n;
-  volatile uint8_t *s = ptr;
-  for (size_t i = 0; i < old_size; i++)
-    d[i] = s[i];
+  size_t copy = size < old_size ? size : old_size;
+  memcpy(n, ptr, copy);
   
-  DEBUG_PRINT(SLAB, "krealloc(%p, %zu) - allocated new block %p, copied %zu bytes\n",
-              ptr, size, n, old_size);
+  DEBUG_PRINT(SLAB, "krealloc(%p, %zu) - moved to %p, copied %zu bytes\n",
+              ptr, size, n, copy);
   
   kfree(ptr);
   return n;
 }
-void kfree(void *ptr) {
+
+static void kfree_internal(void *ptr) {
   if (!ptr) {
     DEBUG_PRINT(SLAB, "kfree(NULL) called - ignoring\n");
     return;
   }
   
-  // Get allocation header
-  alloc_header_t *header = (alloc_header_t *)((uint8_t *)ptr - sizeof(alloc_header_t));
+  if (is_heap_pointer(ptr)) {
+    heap_free(ptr);
+    return;
+  }
+  
+  // Page-granular block - the head page descriptor records its order
+  page_t *large = find_large_page(ptr);
+  if (large) {
+    DEBUG_PRINT(SLAB, "kfree(%p) to buddy (order %u)\n", ptr, large->order);
+    buddy_free_pages((uint64_t)(uintptr_t)ptr, large->order);
+    return;
+  }
   
-  // Validate magic number
-  if (header->magic != ALLOC_MAGIC) {
-    kprintf("[HEAP] ERROR: kfree(%p) - invalid magic number 0x%x (expected 0x%x)\n",
-            ptr, header->magic, ALLOC_MAGIC);
-    kprintf("[HEAP] ERROR: Possible corruption or double-free detected\n");
+  // Slab allocation - the page descriptor names the owning cache
+  slab_cache_t *cache = find_slab_cache(ptr);
+  if (!cache) {
+    kprintf("[HEAP] ERROR: kfree(%p) - not a kmalloc pointer\n", ptr);
     return;
   }
   
-  // Check allocation source from header
-  if (header->flags & ALLOC_FROM_SLAB) {
-    // Slab allocation - use cache index for O(1) lookup
-    uint8_t cache_index = header->slab_cache_index;
+  DEBUG_PRINT(SLAB, "kfree(%p) to slab cache '%s'\n", ptr, cache->name);
+  slab_free(cache, ptr);
+}
+
+void *krealloc(void *ptr, size_t size) {
+  int prof = alloc_profile_enter();
+  if (prof && ptr)
+    alloc_profile_free((uint64_t)(uintptr_t)ptr);
+  
+  void *n = krealloc_internal(ptr, size);
+  
+  // A resize is profiled as a free plus a new allocation; when it fails
+  // the old block stays live and is charged to this site again
+  if (prof) {
+    if (n)
+      alloc_profile_alloc(ALLOC_PROFILE_KMALLOC, (uint64_t)(uintptr_t)n, size,
+                          __builtin_frame_address(0));
+    else if (ptr && size)
+      alloc_profile_alloc(ALLOC_PROFILE_KMALLOC, (uint64_t)(uintptr_t)ptr, ksize(ptr),
+                          __builtin_frame_address(0));
+  }
+  alloc_profile_exit(prof);
+  return n;
+}
+
+void kfree(void *ptr) {
+  int prof = alloc_profile_enter();
+  if (prof)
+    alloc_profile_free((uint64_t)(uintptr_t)ptr);
+  kfree_internal(ptr);
+  alloc_profile_exit(prof);
+}
+
+static void kfree_sized_internal(void *ptr, size_t size) {
+  if (!ptr)
+    return;
+  
+  // Known size maps straight to its cache; heap fallbacks and small GFP_DMA
+  // blocks (whole pages) take the slow path. Once adaptive classes exist the
+  // object may predate its size's current cache, so only the page
+  // descriptor can be trusted.
+  if (g_slab_initialized && size && size <= KMALLOC_MAX_CACHE_SIZE &&
+      !atomic_load(&g_kmalloc_adaptive_count) && !is_heap_pointer(ptr) &&
+      !find_large_page(ptr)) {
+    slab_cache_t *cache = g_kmalloc_table[(size - 1) >> 3];
     
-    if (cache_index >= 8) {
-      kprintf("[HEAP] ERROR: kfree(%p) - invalid slab cache index %u\n", 
-              ptr, cache_index);
+    // A class added since the first check may already have moved this
+    // bucket; its count was published first, so the recheck catches it
+    if (atomic_load(&g_kmalloc_adaptive_count)) {
+      kfree(ptr);
       return;
     }
     
-    slab_cache_t *caches[] = {
-      g_cache_16, g_cache_32, g_cache_64, g_cache_128,
-      g_cache_256, g_cache_512, g_cache_1024, g_cache_2048
-    };
-    
-    slab_cache_t *cache = caches[cache_index];
-    if (!cache) {
-      kprintf("[HEAP] ERROR: kfree(%p) - slab cache %u not initialized\n",
-              ptr, cache_index);
+#if DEBUG_MODE && DEBUG_SLAB
+    if (cache != find_slab_cache(ptr)) {
+      kprintf("[HEAP] ERROR: kfree_sized(%p, %zu) - size does not match owning cache\n",
+              ptr, size);
+      kfree(ptr);
       return;
     }
+#endif
     
-    // Free to slab cache (pass the header pointer, not user pointer)
-    DEBUG_PRINT(SLAB, "kfree(%p) to slab cache %u (size %u)\n", 
-                ptr, cache_index, header->size);
-    slab_free(cache, header);
-    return;
-  }
-  
-  if (header->flags & ALLOC_FROM_HEAP) {
-    // Heap allocation - get block header
-    // Layout: [block_header_t][alloc_header_t][user data]
-    block_header_t *b = (block_header_t *)((uint8_t *)header - sizeof(block_header_t));
-    
-    DEBUG_PRINT(SLAB, "kfree(%p) from heap (size %u)\n", ptr, header->size);
-    
-    b->free = 1;
-    coalesce(b);
-    return;
+    if (cache) {
+      slab_free(cache, ptr);
+      return;
+    }
   }
   
-  // Unknown allocation source
-  kprintf("[HEAP] ERROR: kfree(%p) - unknown allocation source (flags 0x%x)\n",
-          ptr, header->flags);
+  kfree(ptr);
+}
+
+void kfree_sized(void *ptr, size_t size) {
+  int prof = alloc_profile_enter();
+  if (prof)
+    alloc_profile_free((uint64_t)(uintptr_t)ptr);
+  kfree_sized_internal(ptr, size);
+  alloc_profile_exit(prof);
 }
 
 // Allocation with GFP flags support
 void *kmalloc_flags(size_t size, uint32_t flags) {
-  void *ptr = kmalloc(size);
-  
-  // Handle GFP_ZERO flag
-  if (ptr && (flags & 0x04)) {  // GFP_ZERO
-    volatile uint8_t *p = ptr;
-    for (size_t i = 0; i < size; i++) {
-      p[i] = 0;
-    }
-  }
-  
-  return ptr;
+  // Zone flags select the buddy zone for page-granular requests; slab and
+  // heap memory is always unmovable kernel memory. GFP_DMA requests always
+  // come from buddy pages below GFP_DMA_LIMIT.
+  return kmalloc_internal(size, flags, __builtin_frame_address(0));
 }
 
 void *kcalloc_flags(size_t num, size_t size, uint32_t flags) {
-  // kcalloc already zeros memory, so just call it
-  return kcalloc(num, size);
+  size_t total = 0;
+  if (num && size) {
+    total = num * size;
+    if (total / num != size) {
+      kprintf("[HEAP] ERROR: kcalloc_flags(%zu, %zu) overflow detected\n", num, size);
+      return NULL;
+    }
+  }
+  
+  return kmalloc_internal(total, flags | GFP_ZERO, __builtin_frame_address(0));
 }
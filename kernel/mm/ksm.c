@@ -0,0 +1,477 @@
+#include "../../include/mm/ksm.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/slab.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/drivers/pit.h"
+#include "../../include/kernel/config.h"
+#include "../../include/kernel/spinlock.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+#include "../../include/kernel/atomic.h"
+
+#define KSM_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+typedef struct ksm_range {
+    page_table_t *pml4;
+    uint64_t start;
+    uint64_t end;
+} ksm_range_t;
+
+// A frame seen by the scanner. Stable items are frames KSM shares; unstable
+// items are candidates from the current pass and remember the mapping that
+// held the frame, which may have changed since.
+typedef struct ksm_item {
+    uint64_t checksum;
+    uint64_t frame;
+    page_table_t *pml4;          // Unstable only
+    uint64_t virt;               // Unstable only
+    struct ksm_item *next;
+} ksm_item_t;
+
+static ksm_range_t ksm_ranges[KSM_MAX_RANGES];
+static uint32_t ksm_range_count = 0;
+
+static ksm_item_t *ksm_stable[KSM_HASH_SIZE];
+static ksm_item_t *ksm_unstable[KSM_HASH_SIZE];
+static slab_cache_t *ksm_item_cache = NULL;
+
+// Scan cursor: next page of ksm_ranges[ksm_cursor_range] to look at
+static uint32_t ksm_cursor_range = 0;
+static uint64_t ksm_cursor_addr = 0;
+
+static spinlock_t ksm_lock;
+static uint64_t ksm_zero_checksum = 0;
+
+// Tunables
+static int ksm_enabled = 1;
+static uint32_t ksm_pages_to_scan = KSM_DEFAULT_PAGES_TO_SCAN;
+static uint32_t ksm_sleep_ms = KSM_DEFAULT_SLEEP_MS;
+static uint64_t ksm_last_run = 0;
+
+// Cumulative counters; the current sharing is computed from the stable table
+static uint64_t ksm_pages_scanned = 0;
+static uint64_t ksm_full_scans = 0;
+static uint64_t ksm_zero_merged = 0;
+static uint64_t ksm_merged = 0;
+
+// FNV-1a over the page's 64-bit words
+static uint64_t ksm_checksum(uint64_t frame) {
+    const uint64_t *words = (const uint64_t *)(uintptr_t)frame;
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (uint32_t i = 0; i < BUDDY_PAGE_SIZE / sizeof(uint64_t); i++) {
+        hash ^= words[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static int ksm_same(uint64_t a, uint64_t b) {
+    return memcmp((const void *)(uintptr_t)a, (const void *)(uintptr_t)b, BUDDY_PAGE_SIZE) == 0;
+}
+
+static uint32_t ksm_bucket(uint64_t checksum) {
+    return (uint32_t)(checksum ^ (checksum >> 32)) & KSM_HASH_MASK;
+}
+
+void ksm_init(void) {
+    spinlock_init(&ksm_lock);
+
+    if (!ksm_item_cache) {
+        ksm_item_cache = slab_cache_create("ksm_item", sizeof(ksm_item_t), 8);
+        if (!ksm_item_cache) {
+            kprintf("[KSM] ERROR: Failed to create item cache\n");
+        }
+    }
+
+    uint64_t zero_page = cow_zero_page();
+    if (zero_page) {
+        ksm_zero_checksum = ksm_checksum(zero_page);
+    }
+}
+
+// Entry that still maps a private, writable frame the scanner may merge.
+// Only order-0 anonymous frames (what demand paging maps) qualify.
+static uint64_t *ksm_private_pte(page_table_t *pml4, uint64_t virt, uint64_t frame) {
+    uint64_t *pte = vmm_get_pte(pml4, virt);
+    if (!pte) {
+        return 0;
+    }
+
+    uint64_t entry = *pte;
+    if (!(entry & VMM_FLAG_PRESENT) || !(entry & VMM_FLAG_WRITABLE) || (entry & COW_FLAG_MASK)) {
+        return 0;
+    }
+    if (frame && (entry & KSM_ADDR_MASK) != frame) {
+        return 0;
+    }
+
+    page_t *page = cow_get_ref(entry & KSM_ADDR_MASK);
+    if (!page || (page->flags & ~PAGE_FLAG_ANON) || page->order != 0 || atomic_load(&page->refcount) != 0) {
+        return 0;
+    }
+    return pte;
+}
+
+// Entry still maps frame privately: writable, or (comparing set) as
+// ksm_write_protect() left it
+static int ksm_pte_maps(uint64_t entry, uint64_t frame, int comparing) {
+    uint64_t state = comparing ? KSM_PTE_COMPARING : VMM_FLAG_WRITABLE;
+    return (entry & VMM_FLAG_PRESENT) && !(entry & COW_FLAG_MASK) &&
+           (entry & (VMM_FLAG_WRITABLE | KSM_PTE_COMPARING)) == state &&
+           (entry & KSM_ADDR_MASK) == frame;
+}
+
+// The helpers below re-check the entry under its page-table lock, which
+// the fault path holds while it changes entries; they fail if the entry
+// no longer maps frame as expected.
+
+// Write-protect an entry so the frame cannot change while it is compared
+static int ksm_write_protect(uint64_t *pte, uint64_t virt, uint64_t frame) {
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    spinlock_acquire(ptl);
+    int ok = ksm_pte_maps(*pte, frame, 0);
+    if (ok) {
+        *pte = (*pte & ~(uint64_t)VMM_FLAG_WRITABLE) | KSM_PTE_COMPARING;
+        tlb_flush_page(virt);
+    }
+    spinlock_release(ptl);
+    return ok;
+}
+
+// Undo ksm_write_protect() after a failed comparison
+static void ksm_write_enable(uint64_t *pte, uint64_t frame) {
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    spinlock_acquire(ptl);
+    if (ksm_pte_maps(*pte, frame, 1)) {
+        *pte = (*pte & ~(uint64_t)KSM_PTE_COMPARING) | VMM_FLAG_WRITABLE;
+    }
+    spinlock_release(ptl);
+}
+
+// Point a write-protected entry for frame at a shared frame, read-only
+// with the COW bit
+static int ksm_share_pte(uint64_t *pte, uint64_t virt, uint64_t frame, uint64_t shared) {
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    spinlock_acquire(ptl);
+    int ok = ksm_pte_maps(*pte, frame, 1);
+    if (ok) {
+        *pte = shared | (*pte & ~KSM_ADDR_MASK & ~(uint64_t)KSM_PTE_COMPARING) | COW_FLAG_MASK;
+        tlb_flush_page(virt);
+    }
+    spinlock_release(ptl);
+    return ok;
+}
+
+static void ksm_free_items(ksm_item_t **table, int keep_shared) {
+    for (uint32_t i = 0; i < KSM_HASH_SIZE; i++) {
+        ksm_item_t **link = &table[i];
+        while (*link) {
+            ksm_item_t *item = *link;
+            if (keep_shared && cow_get_ref_count(item->frame) > 0) {
+                link = &item->next;
+                continue;
+            }
+            *link = item->next;
+            slab_free(ksm_item_cache, item);
+        }
+    }
+}
+
+// Look at one page; returns 1 if it was merged
+static int ksm_scan_page(page_table_t *pml4, uint64_t virt) {
+    uint64_t *pte = ksm_private_pte(pml4, virt, 0);
+    if (!pte) {
+        return 0;
+    }
+
+    uint64_t frame = *pte & KSM_ADDR_MASK;
+    uint64_t checksum = ksm_checksum(frame);
+    uint32_t bucket = ksm_bucket(checksum);
+
+    // All-zero pages go to the zero page, which has no reference count
+    uint64_t zero_page = cow_zero_page();
+    if (zero_page && checksum == ksm_zero_checksum) {
+        if (!ksm_write_protect(pte, virt, frame)) {
+            return 0;
+        }
+        if (ksm_same(frame, zero_page)) {
+            if (!ksm_share_pte(pte, virt, frame, zero_page)) {
+                return 0;
+            }
+            buddy_free_pages(frame, 0);
+            ksm_zero_merged++;
+            DEBUG_PRINT(KSM, "Merged zero page at virt 0x%llx\n", virt);
+            return 1;
+        }
+        ksm_write_enable(pte, frame);
+    }
+
+    // A frame KSM already shares; while anyone maps it, it cannot change
+    ksm_item_t **link = &ksm_stable[bucket];
+    while (*link) {
+        ksm_item_t *item = *link;
+        if (cow_get_ref_count(item->frame) == 0) {
+            // Every sharer broke away; the frame may be mapped privately now
+            *link = item->next;
+            slab_free(ksm_item_cache, item);
+            continue;
+        }
+        link = &item->next;
+        if (item->checksum != checksum) {
+            continue;
+        }
+        if (!ksm_write_protect(pte, virt, frame)) {
+            return 0;
+        }
+        if (ksm_same(frame, item->frame)) {
+            // Counted before the entry can fault on it
+            cow_increment_ref(item->frame);
+            if (!ksm_share_pte(pte, virt, frame, item->frame)) {
+                cow_decrement_ref(item->frame);
+                return 0;
+            }
+            buddy_free_pages(frame, 0);
+            ksm_merged++;
+            DEBUG_PRINT(KSM, "Merged virt 0x%llx into shared phys 0x%llx\n", virt, item->frame);
+            return 1;
+        }
+        ksm_write_enable(pte, frame);
+    }
+
+    // A candidate from earlier in this pass
+    link = &ksm_unstable[bucket];
+    while (*link) {
+        ksm_item_t *item = *link;
+        if (item->checksum != checksum || item->frame == frame) {
+            link = &item->next;
+            continue;
+        }
+
+        // The candidate may have been written, remapped or shared since
+        uint64_t *other = ksm_private_pte(item->pml4, item->virt, item->frame);
+        if (!other) {
+            *link = item->next;
+            slab_free(ksm_item_cache, item);
+            continue;
+        }
+
+        if (!ksm_write_protect(other, item->virt, item->frame)) {
+            *link = item->next;
+            slab_free(ksm_item_cache, item);
+            continue;
+        }
+        if (!ksm_write_protect(pte, virt, frame)) {
+            ksm_write_enable(other, item->frame);
+            return 0;
+        }
+        if (!ksm_same(frame, item->frame)) {
+            ksm_write_enable(other, item->frame);
+            ksm_write_enable(pte, frame);
+            link = &item->next;
+            continue;
+        }
+
+        // Both mappings now share the candidate's frame; counted before
+        // either entry can fault on it
+        page_t *shared = buddy_phys_to_page(item->frame);
+        atomic_fetch_and_add(&shared->refcount, 2);
+        if (!ksm_share_pte(other, item->virt, item->frame, item->frame)) {
+            atomic_fetch_and_add(&shared->refcount, (uint32_t)-2);
+            ksm_write_enable(pte, frame);
+            *link = item->next;
+            slab_free(ksm_item_cache, item);
+            continue;
+        }
+        // If this entry changed meanwhile, the candidate alone keeps the
+        // frame, which is a stable one all the same
+        int merged = ksm_share_pte(pte, virt, frame, item->frame);
+        if (merged) {
+            buddy_free_pages(frame, 0);
+            ksm_merged++;
+            DEBUG_PRINT(KSM, "Merged virt 0x%llx with virt 0x%llx into phys 0x%llx\n",
+                        virt, item->virt, item->frame);
+        } else {
+            cow_decrement_ref(item->frame);
+        }
+
+        *link = item->next;
+        item->pml4 = 0;
+        item->virt = 0;
+        item->next = ksm_stable[bucket];
+        ksm_stable[bucket] = item;
+        return merged;
+    }
+
+    ksm_item_t *item = ksm_item_cache ? (ksm_item_t *)slab_alloc(ksm_item_cache) : 0;
+    if (!item) {
+        return 0;  // Not remembered; the next pass tries again
+    }
+    item->checksum = checksum;
+    item->frame = frame;
+    item->pml4 = pml4;
+    item->virt = virt;
+    item->next = ksm_unstable[bucket];
+    ksm_unstable[bucket] = item;
+    return 0;
+}
+
+uint32_t ksm_scan(uint32_t pages) {
+    uint32_t merged = 0;
+
+    spinlock_acquire(&ksm_lock);
+
+    for (uint32_t scanned = 0; scanned < pages && ksm_range_count > 0; scanned++) {
+        ksm_range_t *range = &ksm_ranges[ksm_cursor_range];
+        if (ksm_cursor_addr < range->start) {
+            ksm_cursor_addr = range->start;
+        }
+
+        if (ksm_cursor_addr >= range->end) {
+            ksm_cursor_addr = 0;
+            if (++ksm_cursor_range >= ksm_range_count) {
+                // End of a full pass: candidates are only valid within one
+                ksm_cursor_range = 0;
+                ksm_full_scans++;
+                ksm_free_items(ksm_unstable, 0);
+                ksm_free_items(ksm_stable, 1);
+            }
+            continue;
+        }
+
+        merged += ksm_scan_page(range->pml4, ksm_cursor_addr);
+        ksm_cursor_addr += BUDDY_PAGE_SIZE;
+        ksm_pages_scanned++;
+    }
+
+    spinlock_release(&ksm_lock);
+    return merged;
+}
+
+void ksm_idle(void) {
+    if (!ksm_enabled || ksm_range_count == 0) {
+        return;
+    }
+
+    // The PIT runs at 1000 Hz: one tick per millisecond
+    uint64_t now = pit_get_ticks();
+    if (now - ksm_last_run < ksm_sleep_ms) {
+        return;
+    }
+    ksm_last_run = now;
+
+    ksm_scan(ksm_pages_to_scan);
+}
+
+int ksm_register(page_table_t *pml4, uint64_t start, uint64_t end) {
+    start &= ~(BUDDY_PAGE_SIZE - 1);
+    if (!pml4 || end <= start) {
+        return -1;
+    }
+
+    spinlock_acquire(&ksm_lock);
+    if (ksm_range_count == KSM_MAX_RANGES) {
+        spinlock_release(&ksm_lock);
+        kprintf("[KSM] ERROR: Too many mergeable ranges\n");
+        return -1;
+    }
+    ksm_ranges[ksm_range_count].pml4 = pml4;
+    ksm_ranges[ksm_range_count].start = start;
+    ksm_ranges[ksm_range_count].end = end;
+    ksm_range_count++;
+    spinlock_release(&ksm_lock);
+
+    DEBUG_PRINT(KSM, "Registered mergeable range [0x%llx, 0x%llx)\n", start, end);
+    return 0;
+}
+
+void ksm_unregister(page_table_t *pml4, uint64_t start) {
+    start &= ~(BUDDY_PAGE_SIZE - 1);
+
+    spinlock_acquire(&ksm_lock);
+
+    for (uint32_t i = 0; i < ksm_range_count; i++) {
+        if (ksm_ranges[i].pml4 != pml4 || ksm_ranges[i].start != start) {
+            continue;
+        }
+        uint64_t end = ksm_ranges[i].end;
+
+        // Candidates in the range would point at unmapped memory
+        for (uint32_t b = 0; b < KSM_HASH_SIZE; b++) {
+            ksm_item_t **link = &ksm_unstable[b];
+            while (*link) {
+                ksm_item_t *item = *link;
+                if (item->pml4 == pml4 && item->virt >= start && item->virt < end) {
+                    *link = item->next;
+                    slab_free(ksm_item_cache, item);
+                } else {
+                    link = &item->next;
+                }
+            }
+        }
+
+        // Keep the order so the cursor stays on the range it was scanning
+        for (uint32_t j = i + 1; j < ksm_range_count; j++) {
+            ksm_ranges[j - 1] = ksm_ranges[j];
+        }
+        ksm_range_count--;
+
+        if (ksm_cursor_range > i) {
+            ksm_cursor_range--;
+        } else if (ksm_cursor_range == i) {
+            ksm_cursor_addr = 0;
+        }
+        if (ksm_cursor_range >= ksm_range_count) {
+            ksm_cursor_range = 0;
+        }
+        break;
+    }
+
+    spinlock_release(&ksm_lock);
+}
+
+void ksm_set_enabled(int enabled) {
+    ksm_enabled = enabled ? 1 : 0;
+}
+
+void ksm_set_scan_rate(uint32_t pages_to_scan, uint32_t sleep_ms) {
+    ksm_pages_to_scan = pages_to_scan ? pages_to_scan : 1;
+    ksm_sleep_ms = sleep_ms;
+}
+
+void ksm_get_stats(ksm_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+
+    spinlock_acquire(&ksm_lock);
+
+    stats->pages_scanned = ksm_pages_scanned;
+    stats->full_scans = ksm_full_scans;
+    stats->zero_pages_merged = ksm_zero_merged;
+    stats->pages_merged = ksm_merged;
+    stats->pages_shared = 0;
+    stats->pages_sharing = 0;
+    for (uint32_t i = 0; i < KSM_HASH_SIZE; i++) {
+        for (ksm_item_t *item = ksm_stable[i]; item; item = item->next) {
+            uint32_t refs = cow_get_ref_count(item->frame);
+            if (refs > 0) {
+                stats->pages_shared++;
+                stats->pages_sharing += refs - 1;
+            }
+        }
+    }
+
+    spinlock_release(&ksm_lock);
+}
+
+void ksm_print_stats(void) {
+    ksm_stats_t stats;
+    ksm_get_stats(&stats);
+
+    kprintf("[KSM] Scanned %llu pages in %llu full scans\n",
+            stats.pages_scanned, stats.full_scans);
+    kprintf("[KSM] Shared frames: %llu, extra mappings: %llu, zero pages merged: %llu\n",
+            stats.pages_shared, stats.pages_sharing, stats.zero_pages_merged);
+    kprintf("[KSM] Pages saved: %llu\n", stats.pages_sharing + stats.zero_pages_merged);
+}
@@ -1,5 +1,6 @@
 #include "../../include/mm/page_cache.h"
 #include "../../include/mm/buddy.h"
+#include "../../include/mm/vmalloc.h"
 #include "../../include/kernel/config.h"
 #include "../../include/kernel/string.h"
 #include "../../include/kernel/stdio.h"
@@ -44,16 +45,15 @@ void page_cache_init(uint64_t max_pages) {
     g_page_cache.lru_head = NULL;
     g_page_cache.lru_tail = NULL;
     
-    uint64_t hash_table_pages = (g_page_cache.hash_size * sizeof(page_cache_entry_t *) + BUDDY_PAGE_SIZE - 1) / BUDDY_PAGE_SIZE;
-    uint64_t hash_table_addr = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    // The bucket array spans several pages; vmalloc backs it with order-0
+    // pages so it can grow without a high-order buddy allocation
+    g_page_cache.hash_table = (page_cache_entry_t **)vzalloc(
+        g_page_cache.hash_size * sizeof(page_cache_entry_t *));
     
-    if (hash_table_addr == 0) {
-        g_page_cache.hash_table = NULL;
+    if (g_page_cache.hash_table == NULL) {
+        kprintf("[PAGE_CACHE] ERROR: Failed to allocate hash table\n");
         return;
     }
-    
-    g_page_cache.hash_table = (page_cache_entry_t **)(uintptr_t)hash_table_addr;
-    memset(g_page_cache.hash_table, 0, g_page_cache.hash_size * sizeof(page_cache_entry_t *));
 }
 
 static uint64_t get_timestamp(void) {
@@ -0,0 +1,185 @@
+#include "../../include/mm/page_fault.h"
+#include "../../include/mm/demand_paging.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/ksm.h"
+#include "../../include/kernel/stdio.h"
+
+// Statistics only; updates may race
+static page_fault_stats_t pf_stats;
+
+static const char *pf_type_names[PAGE_FAULT_TYPES] = {
+    "demand", "cow", "spurious", "fatal"
+};
+
+static inline uint64_t read_tsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline uint64_t read_cr2(void) {
+    uint64_t cr2;
+    __asm__ volatile("mov %%cr2, %0" : "=r"(cr2));
+    return cr2;
+}
+
+static uint32_t page_fault_bucket(uint64_t cycles) {
+    uint64_t scaled = cycles >> PAGE_FAULT_HIST_SHIFT;
+    if (scaled == 0) {
+        return 0;
+    }
+    uint32_t bucket = 64 - (uint32_t)__builtin_clzll(scaled);
+    return bucket < PAGE_FAULT_HIST_BUCKETS ? bucket : PAGE_FAULT_HIST_BUCKETS - 1;
+}
+
+// The leaf entry already allows the access, so the fault came from a stale
+// TLB entry. The VMM creates upper-level tables present, writable and user,
+// so only the leaf decides.
+static int page_fault_allowed(uint64_t entry, uint64_t err_code) {
+    if ((err_code & PAGE_FAULT_ERR_WRITE) && !(entry & VMM_FLAG_WRITABLE)) {
+        return 0;
+    }
+    if ((err_code & PAGE_FAULT_ERR_USER) && !(entry & VMM_FLAG_USER)) {
+        return 0;
+    }
+    if ((err_code & PAGE_FAULT_ERR_FETCH) && (entry & VMM_FLAG_NO_EXECUTE)) {
+        return 0;
+    }
+    return 1;
+}
+
+// A write hit a read-only private entry. Re-read it under the page-table
+// lock: KSM write-protects pages while it compares them, and the entry may
+// have been made writable, shared or remapped since the CPU read it.
+static int page_fault_write_retry(uint64_t *pte, uint64_t seen, uint64_t err_code) {
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    spinlock_acquire(ptl);
+    uint64_t entry = *pte;
+    spinlock_release(ptl);
+
+    if (!(entry & VMM_FLAG_PRESENT) || (entry & (KSM_PTE_COMPARING | COW_FLAG_MASK))) {
+        return 1;
+    }
+    return page_fault_allowed(entry, err_code) ||
+           (entry & 0x000FFFFFFFFFF000ULL) != (seen & 0x000FFFFFFFFFF000ULL);
+}
+
+static page_fault_type_t page_fault_resolve(page_table_t *pml4, uint64_t addr, uint64_t err_code) {
+    if (!pml4 || (err_code & PAGE_FAULT_ERR_RESERVED)) {
+        return PAGE_FAULT_FATAL;
+    }
+
+    // P, W and U line up with the VM_FAULT_* flags
+    uint32_t flags = (uint32_t)(err_code & (VM_FAULT_PRESENT | VM_FAULT_WRITE | VM_FAULT_USER));
+    uint64_t page = addr & ~(uint64_t)0xFFF;
+    uint64_t *pte = vmm_get_pte(pml4, page);
+    uint64_t entry = pte ? *pte : 0;
+
+    // Huge pages (the boot identity map) are never demand-paged or COW
+    uint64_t huge = pte ? 0 : vmm_get_huge_entry(pml4, page);
+    if (huge) {
+        if (!page_fault_allowed(huge, err_code)) {
+            return PAGE_FAULT_FATAL;
+        }
+        tlb_flush_page(page);
+        return PAGE_FAULT_SPURIOUS;
+    }
+
+    // Not present, or unmapped again since the CPU raised the fault
+    if (!(entry & VMM_FLAG_PRESENT)) {
+        if (demand_paging_handle_fault_flags(pml4, addr, flags & ~VM_FAULT_PRESENT) != 0) {
+            return PAGE_FAULT_FATAL;
+        }
+        return PAGE_FAULT_DEMAND;
+    }
+
+    if (page_fault_allowed(entry, err_code)) {
+        tlb_flush_page(page);
+        return PAGE_FAULT_SPURIOUS;
+    }
+
+    if ((err_code & PAGE_FAULT_ERR_WRITE) && (entry & COW_FLAG_MASK) &&
+        !(err_code & PAGE_FAULT_ERR_FETCH)) {
+        // Both paths copy under the page-table lock; regions also count
+        // zero page breaks, COW pages of a clone without regions go direct
+        int result;
+        if (demand_paging_find_region(pml4, page)) {
+            result = demand_paging_handle_fault_flags(pml4, addr, flags | VM_FAULT_PRESENT);
+        } else {
+            result = cow_handle_fault(pml4, page);
+        }
+        return result == 0 ? PAGE_FAULT_COW : PAGE_FAULT_FATAL;
+    }
+
+    // Retrying re-faults until KSM has finished with the entry
+    if ((err_code & PAGE_FAULT_ERR_WRITE) && !(err_code & PAGE_FAULT_ERR_FETCH) &&
+        page_fault_write_retry(pte, entry, err_code)) {
+        tlb_flush_page(page);
+        return PAGE_FAULT_SPURIOUS;
+    }
+
+    return PAGE_FAULT_FATAL;
+}
+
+page_fault_type_t page_fault_dispatch(page_table_t *pml4, uint64_t addr, uint64_t err_code) {
+    uint64_t start = read_tsc();
+    page_fault_type_t type = page_fault_resolve(pml4, addr, err_code);
+    uint64_t cycles = read_tsc() - start;
+
+    pf_stats.count[type]++;
+    pf_stats.cycles[type] += cycles;
+    pf_stats.histogram[type][page_fault_bucket(cycles)]++;
+    return type;
+}
+
+void page_fault_handler(interrupt_frame_t *frame) {
+    uint64_t addr = read_cr2();
+    page_table_t *pml4 = vmm_get_current_address_space();
+    if (page_fault_dispatch(pml4, addr, frame->err_code) != PAGE_FAULT_FATAL) {
+        return;
+    }
+
+    kprintf("[PAGE_FAULT] ERROR: Unhandled %s %s fault at 0x%llx (err=0x%llx rip=0x%llx)\n",
+            (frame->err_code & PAGE_FAULT_ERR_USER) ? "user" : "kernel",
+            (frame->err_code & PAGE_FAULT_ERR_FETCH) ? "fetch" :
+            (frame->err_code & PAGE_FAULT_ERR_WRITE) ? "write" : "read",
+            addr, frame->err_code, frame->rip);
+    while (1) {
+        __asm__ volatile("hlt");
+    }
+}
+
+void page_fault_get_stats(page_fault_stats_t *stats) {
+    if (stats) {
+        *stats = pf_stats;
+    }
+}
+
+void page_fault_reset_stats(void) {
+    for (uint32_t t = 0; t < PAGE_FAULT_TYPES; t++) {
+        pf_stats.count[t] = 0;
+        pf_stats.cycles[t] = 0;
+        for (uint32_t b = 0; b < PAGE_FAULT_HIST_BUCKETS; b++) {
+            pf_stats.histogram[t][b] = 0;
+        }
+    }
+}
+
+void page_fault_dump_stats(void) {
+    kprintf("[PAGE_FAULT] Fault statistics:\n");
+    for (uint32_t t = 0; t < PAGE_FAULT_TYPES; t++) {
+        uint64_t count = pf_stats.count[t];
+        if (count == 0) {
+            continue;
+        }
+        kprintf("  %s: %llu faults, avg %llu cycles; histogram:", pf_type_names[t], count,
+                pf_stats.cycles[t] / count);
+        for (uint32_t b = 0; b < PAGE_FAULT_HIST_BUCKETS; b++) {
+            if (pf_stats.histogram[t][b]) {
+                kprintf(" <2^%u:%llu", b + PAGE_FAULT_HIST_SHIFT, pf_stats.histogram[t][b]);
+            }
+        }
+        kprintf("\n");
+    }
+}
@@ -1,6 +1,9 @@
 #include "../../include/mm/pool.h"
 #include "../../include/mm/buddy.h"
+#include "../../include/mm/page.h"
 #include "../../include/kernel/string.h"
+#include "../../include/kernel/atomic.h"
+#include "../../include/kernel/stdio.h"
 
 #define MIN_OBJECT_SIZE sizeof(pool_chunk_t)
 
@@ -9,11 +12,134 @@ static inline size_t align_up(size_t size, size_t alignment) {
 }
 
 static int pool_grow(memory_pool_t *pool, uint32_t count);
+static uint64_t pool_shrinker(void);
+
+// Every live pool, for the memory-pressure shrinker (zero-initialized lock)
+static memory_pool_t *g_pools = NULL;
+static spinlock_t g_pools_lock;
+static int g_pool_shrinker_registered = 0;
+
+// Push a chain of batches (heads linked through next_batch) onto the
+// shared stack. Pushes never need a new tag: a stale top only fails the CAS.
+static void pool_stack_push(memory_pool_t *pool, pool_chunk_t *first, pool_chunk_t *last) {
+    volatile uint64_t *head = (volatile uint64_t *)&pool->free_stack;
+    uint64_t cur[2] = { head[0], head[1] };
+    for (;;) {
+        last->next_batch = (pool_chunk_t *)(uintptr_t)cur[0];
+        if (atomic_compare_and_swap128(head, cur, (uint64_t)(uintptr_t)first, cur[1])) {
+            return;
+        }
+    }
+}
+
+// Pop one batch off the shared stack (NULL if empty)
+static pool_chunk_t *pool_stack_pop(memory_pool_t *pool) {
+    volatile uint64_t *head = (volatile uint64_t *)&pool->free_stack;
+    uint64_t cur[2] = { head[0], head[1] };
+    while (cur[0]) {
+        pool_chunk_t *batch = (pool_chunk_t *)(uintptr_t)cur[0];
+        uint64_t next = (uint64_t)(uintptr_t)batch->next_batch;
+        if (atomic_compare_and_swap128(head, cur, next, cur[1] + 1)) {
+            return batch;
+        }
+    }
+    return NULL;
+}
+
+// Fill an empty front cache with one batch, growing the pool if the shared
+// stack is empty. Only growth takes the pool lock.
+static int pool_refill(memory_pool_t *pool, pool_cpu_cache_t *cache) {
+    pool_chunk_t *batch = pool_stack_pop(pool);
+    if (!batch) {
+        spinlock_acquire(&pool->lock);
+        // Re-check first: another CPU may have grown the pool while we spun
+        while (!(batch = pool_stack_pop(pool))) {
+            if (pool_grow(pool, pool->grow_count) < 0) {
+                break;
+            }
+        }
+        spinlock_release(&pool->lock);
+        if (!batch) {
+            return -1;
+        }
+    }
+    
+    uint32_t count = 0;
+    for (pool_chunk_t *chunk = batch; chunk; chunk = chunk->next) {
+        count++;
+    }
+    atomic_fetch_and_add(&pool->stack_objects, (uint32_t)-count);
+    cache->head = batch;
+    cache->count = count;
+    return 0;
+}
+
+// Region an object was carved from
+static inline pool_region_t *pool_region_of(const void *object) {
+    page_t *page = buddy_phys_to_page((uint64_t)(uintptr_t)object);
+    if (!page || !(page->flags & PAGE_FLAG_POOL)) {
+        return NULL;
+    }
+    return (pool_region_t *)page->owner;
+}
+
+// Point every page of a region at its header, or clear the tags again
+static void pool_region_tag(pool_region_t *region, int tag) {
+    uint64_t base = (uint64_t)(uintptr_t)region;
+    for (uint64_t i = 0; i < (1ULL << region->order); i++) {
+        page_t *page = buddy_phys_to_page(base + i * BUDDY_PAGE_SIZE);
+        if (!page) {
+            continue;
+        }
+        if (tag) {
+            page->flags |= PAGE_FLAG_POOL;
+            page->owner = region;
+        } else {
+            page->flags &= ~PAGE_FLAG_POOL;
+            page->owner = NULL;
+        }
+    }
+}
+
+static void pool_region_free(pool_region_t *region) {
+    pool_region_tag(region, 0);
+    buddy_free_pages((uint64_t)(uintptr_t)region, region->order);
+}
+
+// Move the oldest POOL_BATCH objects of an overfull front cache to the
+// shared stack, keeping the recently freed (cache-hot) ones local
+static void pool_spill(memory_pool_t *pool, pool_cpu_cache_t *cache) {
+    pool_chunk_t *keep_last = cache->head;
+    for (uint32_t i = 1; i < cache->count - POOL_BATCH; i++) {
+        keep_last = keep_last->next;
+    }
+    
+    pool_chunk_t *batch = keep_last->next;
+    keep_last->next = NULL;
+    cache->count -= POOL_BATCH;
+    pool_stack_push(pool, batch, batch);
+    atomic_fetch_and_add(&pool->stack_objects, POOL_BATCH);
+}
 
 memory_pool_t *pool_create(const char *name, size_t object_size, uint32_t initial_count) {
+    return pool_create_aligned(name, object_size, 8, 0, initial_count);
+}
+
+memory_pool_t *pool_create_aligned(const char *name, size_t object_size, size_t align,
+                                   uint32_t flags, uint32_t initial_count) {
     if (!name || object_size == 0 || initial_count == 0) {
         return NULL;
     }
+    if (align == 0 || (align & (align - 1)) || align > POOL_CACHE_LINE) {
+        kprintf("[POOL] ERROR: %s: invalid alignment %zu\n", name, align);
+        return NULL;
+    }
+    if (align < 8) {
+        align = 8;
+    }
+    if (flags & POOL_PAD_CACHELINE) {
+        align = POOL_CACHE_LINE;
+    }
     
     // Allocate memory for the pool structure itself
     uint64_t pool_addr = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
@@ -34,8 +160,9 @@ memory_pool_t *pool_create(const char *name, size_t object_size, uint32_t initia
         pool->object_size = MIN_OBJECT_SIZE;
     }
     
-    // Align object size to 8 bytes for proper alignment
-    pool->object_size = align_up(pool->object_size, 8);
+    // Round the slot to the alignment so every object stays aligned
+    pool->align = align;
+    pool->object_size = align_up(pool->object_size, align);
     
     pool->initial_count = initial_count;
     pool->grow_count = initial_count / 2;
@@ -44,8 +171,7 @@ memory_pool_t *pool_create(const char *name, size_t object_size, uint32_t initia
     }
     
     pool->total_objects = 0;
-    pool->free_objects = 0;
-    pool->free_list = NULL;
+    pool->stack_objects = 0;
     pool->regions = NULL;
     
     spinlock_init(&pool->lock);
@@ -56,6 +182,14 @@ memory_pool_t *pool_create(const char *name, size_t object_size, uint32_t initia
         return NULL;
     }
     
+    spinlock_acquire(&g_pools_lock);
+    pool->next_pool = g_pools;
+    g_pools = pool;
+    if (!g_pool_shrinker_registered) {
+        g_pool_shrinker_registered = (buddy_register_shrinker(pool_shrinker) == 0);
+    }
+    spinlock_release(&g_pools_lock);
+    
     return pool;
 }
 
@@ -64,24 +198,11 @@ void *pool_alloc(memory_pool_t *pool) {
         return NULL;
     }
     
-    spinlock_acquire(&pool->lock);
-    
-    // If free list is empty, try to grow the pool
-    if (pool->free_list == NULL) {
-        if (pool_grow(pool, pool->grow_count) < 0) {
-            spinlock_release(&pool->lock);
-            return NULL;
-        }
+    pool_cpu_cache_t *cache = &pool->cpu_caches[cpu_current_id()];
+    if (!cache->head && pool_refill(pool, cache) < 0) {
+        return NULL;
     }
-    
-    // Pop object from free list (constant time)
-    pool_chunk_t *chunk = pool->free_list;
-    pool->free_list = chunk->next;
-    pool->free_objects--;
-    
-    spinlock_release(&pool->lock);
-    
-    return (void *)chunk;
+    return pool_alloc_inline(pool);
 }
 
 void pool_free(memory_pool_t *pool, void *object) {
@@ -89,17 +210,15 @@ void pool_free(memory_pool_t *pool, void *object) {
         return;
     }
     
-    spinlock_acquire(&pool->lock);
-    
-    // Push object back to free list (constant time)
-    pool_chunk_t *chunk = (pool_chunk_t *)object;
-    chunk->next = pool->free_list;
-    pool->free_list = chunk;
-    pool->free_objects++;
-    
-    spinlock_release(&pool->lock);
+    // Make room in this CPU's front cache by spilling its oldest batch
+    pool_cpu_cache_t *cache = &pool->cpu_caches[cpu_current_id()];
+    if (cache->count >= POOL_CPU_CACHE_MAX) {
+        pool_spill(pool, cache);
+    }
+    pool_free_inline(pool, object);
 }
 
+// Caller must hold pool->lock (or own the pool exclusively during creation)
 static int pool_grow(memory_pool_t *pool, uint32_t count) {
     if (!pool || count == 0) {
         return -1;
@@ -126,66 +245,223 @@ static int pool_grow(memory_pool_t *pool, uint32_t count) {
     // Create region tracking structure
     pool_region_t *region = (pool_region_t *)(uintptr_t)region_addr;
     region->base = (void *)(uintptr_t)region_addr;
-    region->next = pool->regions;
-    pool->regions = region;
     
-    // Calculate usable space (skip the region header)
-    uint8_t *objects_start = (uint8_t *)region + sizeof(pool_region_t);
-    size_t usable_size = (order_pages * BUDDY_PAGE_SIZE) - sizeof(pool_region_t);
+    // Calculate usable space (skip the region header, padded to the alignment)
+    size_t header_size = align_up(sizeof(pool_region_t), pool->align);
+    uint8_t *objects_start = (uint8_t *)region + header_size;
+    size_t usable_size = (order_pages * BUDDY_PAGE_SIZE) - header_size;
     uint32_t objects_in_region = usable_size / pool->object_size;
     
-    // Add all objects to the free list
-    for (uint32_t i = 0; i < objects_in_region; i++) {
-        pool_chunk_t *chunk = (pool_chunk_t *)(objects_start + i * pool->object_size);
-        chunk->next = pool->free_list;
-        pool->free_list = chunk;
+    if (objects_in_region == 0) {
+        buddy_free_pages(region_addr, order);
+        return -1;
+    }
+    region->order = order;
+    region->objects = objects_in_region;
+    region->live = 0;
+    region->free_seen = 0;
+    region->next = pool->regions;
+    pool->regions = region;
+    pool_region_tag(region, 1);
+    
+    // Thread the objects into batches and publish them with a single push
+    pool_chunk_t *first_batch = NULL;
+    pool_chunk_t *last_batch = NULL;
+    for (uint32_t i = 0; i < objects_in_region; i += POOL_BATCH) {
+        uint32_t n = objects_in_region - i;
+        if (n > POOL_BATCH) {
+            n = POOL_BATCH;
+        }
+        
+        pool_chunk_t *batch = (pool_chunk_t *)(objects_start + i * pool->object_size);
+        for (uint32_t j = 0; j < n; j++) {
+            pool_chunk_t *chunk = (pool_chunk_t *)(objects_start + (i + j) * pool->object_size);
+            chunk->next = (j + 1 < n) ? (pool_chunk_t *)((uint8_t *)chunk + pool->object_size) : NULL;
+        }
+        batch->next_batch = NULL;
+        
+        if (last_batch) {
+            last_batch->next_batch = batch;
+        } else {
+            first_batch = batch;
+        }
+        last_batch = batch;
     }
     
     pool->total_objects += objects_in_region;
-    pool->free_objects += objects_in_region;
+    pool_stack_push(pool, first_batch, last_batch);
+    atomic_fetch_and_add(&pool->stack_objects, objects_in_region);
     
     return 0;
 }
 
+// Release every region (except the oldest) whose objects are all free.
+// Caller must hold pool->lock. Returns the number of bytes released.
+static size_t pool_shrink_locked(memory_pool_t *pool) {
+    volatile uint64_t *head = (volatile uint64_t *)&pool->free_stack;
+    
+    // Park this CPU's front cache on the stack so its objects count as free
+    pool_cpu_cache_t *cache = &pool->cpu_caches[cpu_current_id()];
+    if (cache->head) {
+        pool_stack_push(pool, cache->head, cache->head);
+        atomic_fetch_and_add(&pool->stack_objects, cache->count);
+        cache->head = NULL;
+        cache->count = 0;
+    }
+    
+    // Take the whole stack. Refills that find it empty wait on pool->lock,
+    // and objects in flight elsewhere are simply not counted, so a region
+    // is only released if every one of its objects is in our hands.
+    uint64_t cur[2] = { head[0], head[1] };
+    while (!atomic_compare_and_swap128(head, cur, 0, cur[1] + 1)) {
+    }
+    pool_chunk_t *stack = (pool_chunk_t *)(uintptr_t)cur[0];
+    if (!stack) {
+        return 0;
+    }
+    
+    for (pool_region_t *region = pool->regions; region; region = region->next) {
+        region->free_seen = 0;
+    }
+    for (pool_chunk_t *batch = stack; batch; batch = batch->next_batch) {
+        for (pool_chunk_t *chunk = batch; chunk; chunk = chunk->next) {
+            pool_region_t *region = pool_region_of(chunk);
+            if (region) {
+                region->free_seen++;
+            }
+        }
+    }
+    
+    // Regions are newest first; the last one is the initial region and stays
+    uint32_t released_objects = 0;
+    for (pool_region_t *region = pool->regions; region; region = region->next) {
+        region->live = region->objects - region->free_seen;
+        if (region->next && region->live == 0) {
+            released_objects += region->objects;
+        }
+    }
+    
+    // Re-batch the objects of regions that stay and push them back
+    pool_chunk_t *first = NULL;
+    pool_chunk_t *last = NULL;
+    pool_chunk_t *tail = NULL;
+    uint32_t fill = 0;
+    pool_chunk_t *batch = stack;
+    while (batch) {
+        pool_chunk_t *next_batch = batch->next_batch;
+        pool_chunk_t *chunk = batch;
+        while (chunk) {
+            pool_chunk_t *next = chunk->next;
+            pool_region_t *region = pool_region_of(chunk);
+            int keep = !region || !region->next || region->live != 0;
+            if (keep) {
+                chunk->next = NULL;
+                if (!tail || fill == POOL_BATCH) {
+                    chunk->next_batch = NULL;
+                    if (last) {
+                        last->next_batch = chunk;
+                    } else {
+                        first = chunk;
+                    }
+                    last = chunk;
+                    fill = 0;
+                } else {
+                    tail->next = chunk;
+                }
+                tail = chunk;
+                fill++;
+            }
+            chunk = next;
+        }
+        batch = next_batch;
+    }
+    if (first) {
+        pool_stack_push(pool, first, last);
+    }
+    
+    if (released_objects == 0) {
+        return 0;
+    }
+    
+    size_t released = 0;
+    pool_region_t **link = &pool->regions;
+    while (*link) {
+        pool_region_t *region = *link;
+        if (region->next && region->live == 0) {
+            *link = region->next;
+            released += (size_t)BUDDY_PAGE_SIZE << region->order;
+            pool_region_free(region);
+        } else {
+            link = &region->next;
+        }
+    }
+    
+    // The stack was taken and refilled without the objects of freed regions
+    pool->total_objects -= released_objects;
+    atomic_fetch_and_add(&pool->stack_objects, (uint32_t)-released_objects);
+    return released;
+}
+
+size_t pool_shrink(memory_pool_t *pool) {
+    if (!pool) {
+        return 0;
+    }
+    
+    spinlock_acquire(&pool->lock);
+    size_t released = pool_shrink_locked(pool);
+    spinlock_release(&pool->lock);
+    return released;
+}
+
+// Buddy shrinker: may run inside an allocation made under any pool lock,
+// so busy pools are skipped
+static uint64_t pool_shrinker(void) {
+    if (!spinlock_try_acquire(&g_pools_lock)) {
+        return 0;
+    }
+    
+    size_t released = 0;
+    for (memory_pool_t *pool = g_pools; pool; pool = pool->next_pool) {
+        if (spinlock_try_acquire(&pool->lock)) {
+            released += pool_shrink_locked(pool);
+            spinlock_release(&pool->lock);
+        }
+    }
+    
+    spinlock_release(&g_pools_lock);
+    return released / BUDDY_PAGE_SIZE;
+}
+
 void pool_destroy(memory_pool_t *pool) {
     if (!pool) {
         return;
     }
     
+    spinlock_acquire(&g_pools_lock);
+    memory_pool_t **link = &g_pools;
+    while (*link && *link != pool) {
+        link = &(*link)->next_pool;
+    }
+    if (*link) {
+        *link = pool->next_pool;
+    }
+    spinlock_release(&g_pools_lock);
+    
     spinlock_acquire(&pool->lock);
     
-    // Free all memory regions
+    // Free all memory regions with the order each was allocated at
     pool_region_t *region = pool->regions;
     while (region) {
         pool_region_t *next = region->next;
-        
-        // Calculate the order used for this region
-        // We need to determine the size to free it properly
-        // For simplicity, we'll track the order in the allocation
-        // For now, we'll free as order 0 pages and let the buddy allocator handle it
-        // In a production system, we'd track the order in the region structure
-        
-        // Calculate size from total objects
-        size_t region_size = BUDDY_PAGE_SIZE; // Minimum size
-        uint32_t order = 0;
-        
-        // Try to determine the order by checking if address is aligned
-        uint64_t addr = (uint64_t)(uintptr_t)region;
-        for (uint32_t o = 0; o <= BUDDY_MAX_ORDER; o++) {
-            uint64_t alignment = (1ULL << o) * BUDDY_PAGE_SIZE;
-            if ((addr & (alignment - 1)) == 0) {
-                order = o;
-            }
-        }
-        
-        buddy_free_pages((uint64_t)(uintptr_t)region, order);
+        pool_region_free(region);
         region = next;
     }
     
     pool->regions = NULL;
-    pool->free_list = NULL;
+    pool->free_stack.top = NULL;
+    memset(pool->cpu_caches, 0, sizeof(pool->cpu_caches));
     pool->total_objects = 0;
-    pool->free_objects = 0;
+    pool->stack_objects = 0;
     
     spinlock_release(&pool->lock);
     
@@ -200,10 +476,24 @@ uint32_t pool_get_utilization(memory_pool_t *pool) {
     
     spinlock_acquire(&pool->lock);
     
-    uint32_t used_objects = pool->total_objects - pool->free_objects;
+    uint32_t used_objects = pool->total_objects - pool_free_count(pool);
     uint32_t utilization = (used_objects * 100) / pool->total_objects;
     
     spinlock_release(&pool->lock);
     
     return utilization;
 }
+
+uint32_t pool_free_count(memory_pool_t *pool) {
+    if (!pool) {
+        return 0;
+    }
+    
+    // Read without stopping other CPUs: a batch moving between a front
+    // cache and the stack may briefly be missed, so this is a snapshot
+    uint32_t free_objects = pool->stack_objects;
+    for (uint32_t cpu = 0; cpu < MAX_CPUS; cpu++) {
+        free_objects += pool->cpu_caches[cpu].count;
+    }
+    return free_objects;
+}
@@ -0,0 +1,257 @@
+#include "../../include/mm/rmap.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/slab.h"
+#include "../../include/kernel/config.h"
+#include "../../include/kernel/spinlock.h"
+#include "../../include/kernel/stdio.h"
+
+#define RMAP_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+static rmap_mm_t *rmap_mm_hash[RMAP_MM_HASH_SIZE];
+static spinlock_t rmap_lock;
+static int rmap_ready = 0;
+
+static slab_cache_t *rmap_mm_cache = NULL;
+static slab_cache_t *rmap_anon_cache = NULL;
+static slab_cache_t *rmap_link_cache = NULL;
+
+static rmap_stats_t rmap_stats;
+
+void rmap_init(void) {
+    if (rmap_ready) {
+        return;
+    }
+    spinlock_init(&rmap_lock);
+
+    rmap_mm_cache = slab_cache_create("rmap_mm", sizeof(rmap_mm_t), 8);
+    rmap_anon_cache = slab_cache_create("rmap_anon", sizeof(rmap_anon_t), 8);
+    rmap_link_cache = slab_cache_create("rmap_link", sizeof(rmap_link_t), 8);
+    if (!rmap_mm_cache || !rmap_anon_cache || !rmap_link_cache) {
+        kprintf("[RMAP] ERROR: Failed to create caches\n");
+        return;
+    }
+    rmap_ready = 1;
+}
+
+static uint32_t rmap_mm_bucket(page_table_t *pml4) {
+    return (uint32_t)(((uint64_t)(uintptr_t)pml4 >> 12) & RMAP_MM_HASH_MASK);
+}
+
+static rmap_mm_t *rmap_mm_find(page_table_t *pml4) {
+    rmap_mm_t *mm = rmap_mm_hash[rmap_mm_bucket(pml4)];
+    while (mm && mm->pml4 != pml4) {
+        mm = mm->hash_next;
+    }
+    return mm;
+}
+
+// Drop one reference of a group; the last one frees it
+static void rmap_anon_put(rmap_anon_t *anon) {
+    if (--anon->refs == 0) {
+        slab_free(rmap_anon_cache, anon);
+        rmap_stats.groups--;
+    }
+}
+
+static int rmap_link(rmap_mm_t *mm, rmap_anon_t *anon) {
+    rmap_link_t *link = (rmap_link_t *)slab_alloc(rmap_link_cache);
+    if (!link) {
+        return -1;
+    }
+    link->mm = mm;
+    link->anon = anon;
+    link->anon_next = anon->links;
+    anon->links = link;
+    link->mm_next = mm->links;
+    mm->links = link;
+    anon->refs++;
+    rmap_stats.links++;
+    return 0;
+}
+
+// Find or create the state of an address space, linked to its own group
+static rmap_mm_t *rmap_mm_get(page_table_t *pml4) {
+    rmap_mm_t *mm = rmap_mm_find(pml4);
+    if (mm) {
+        return mm;
+    }
+
+    mm = (rmap_mm_t *)slab_alloc(rmap_mm_cache);
+    rmap_anon_t *anon = (rmap_anon_t *)slab_alloc(rmap_anon_cache);
+    if (!mm || !anon) {
+        if (mm) slab_free(rmap_mm_cache, mm);
+        if (anon) slab_free(rmap_anon_cache, anon);
+        return NULL;
+    }
+    anon->links = NULL;
+    anon->refs = 0;
+    mm->pml4 = pml4;
+    mm->anon = anon;
+    mm->links = NULL;
+    if (rmap_link(mm, anon) != 0) {
+        slab_free(rmap_anon_cache, anon);
+        slab_free(rmap_mm_cache, mm);
+        return NULL;
+    }
+    rmap_stats.groups++;
+
+    uint32_t bucket = rmap_mm_bucket(pml4);
+    mm->hash_next = rmap_mm_hash[bucket];
+    rmap_mm_hash[bucket] = mm;
+    return mm;
+}
+
+void rmap_add(page_table_t *pml4, uint64_t virt, uint64_t phys) {
+    if (!rmap_ready || !pml4 || virt >= RMAP_USER_END) {
+        return;
+    }
+
+    page_t *page = buddy_phys_to_page(phys & RMAP_ADDR_MASK);
+    if (!page || (page->flags & ~PAGE_FLAG_ANON)) {
+        return;  // Not buddy memory, or slab/pool/zero page
+    }
+
+    spinlock_acquire(&rmap_lock);
+
+    // A shared frame keeps its group: every sharer maps it at index
+    if ((page->flags & PAGE_FLAG_ANON) && page->refcount != 0) {
+        spinlock_release(&rmap_lock);
+        return;
+    }
+
+    rmap_mm_t *mm = rmap_mm_get(pml4);
+    if (!mm) {
+        spinlock_release(&rmap_lock);
+        DEBUG_PRINT(RMAP, "No memory to track phys 0x%llx at 0x%llx\n", phys, virt);
+        return;
+    }
+
+    if (page->flags & PAGE_FLAG_ANON) {
+        rmap_anon_put((rmap_anon_t *)page->owner);
+    } else {
+        rmap_stats.pages_tracked++;
+    }
+    mm->anon->refs++;
+    page->owner = mm->anon;
+    page->index = virt >> 12;
+    page->flags |= PAGE_FLAG_ANON;
+
+    spinlock_release(&rmap_lock);
+}
+
+int rmap_clone(page_table_t *parent, page_table_t *child) {
+    if (!rmap_ready) {
+        return 0;
+    }
+
+    spinlock_acquire(&rmap_lock);
+
+    rmap_mm_t *pmm = rmap_mm_find(parent);
+    if (!pmm) {
+        spinlock_release(&rmap_lock);
+        return 0;  // Parent never mapped anything tracked
+    }
+    rmap_mm_t *cmm = rmap_mm_get(child);
+    if (!cmm) {
+        spinlock_release(&rmap_lock);
+        return -1;
+    }
+
+    // The child sees the parent's frames at the same addresses
+    for (rmap_link_t *link = pmm->links; link; link = link->mm_next) {
+        if (rmap_link(cmm, link->anon) != 0) {
+            spinlock_release(&rmap_lock);
+            DEBUG_PRINT(RMAP, "Out of memory linking clone %p of %p\n", child, parent);
+            return -1;  // Links made so far go with rmap_release(child)
+        }
+    }
+
+    spinlock_release(&rmap_lock);
+    return 0;
+}
+
+void rmap_release(page_table_t *pml4) {
+    if (!rmap_ready) {
+        return;
+    }
+
+    spinlock_acquire(&rmap_lock);
+
+    rmap_mm_t **slot = &rmap_mm_hash[rmap_mm_bucket(pml4)];
+    while (*slot && (*slot)->pml4 != pml4) {
+        slot = &(*slot)->hash_next;
+    }
+    rmap_mm_t *mm = *slot;
+    if (!mm) {
+        spinlock_release(&rmap_lock);
+        return;
+    }
+    *slot = mm->hash_next;
+
+    rmap_link_t *link = mm->links;
+    while (link) {
+        rmap_link_t *next = link->mm_next;
+        rmap_link_t **prev = &link->anon->links;
+        while (*prev != link) {
+            prev = &(*prev)->anon_next;
+        }
+        *prev = link->anon_next;
+        rmap_anon_put(link->anon);
+        slab_free(rmap_link_cache, link);
+        rmap_stats.links--;
+        link = next;
+    }
+    slab_free(rmap_mm_cache, mm);
+
+    spinlock_release(&rmap_lock);
+}
+
+void rmap_page_freed(page_t *page) {
+    spinlock_acquire(&rmap_lock);
+    if (page->flags & PAGE_FLAG_ANON) {
+        rmap_anon_put((rmap_anon_t *)page->owner);
+        page->flags &= ~PAGE_FLAG_ANON;
+        page->owner = NULL;
+    }
+    spinlock_release(&rmap_lock);
+}
+
+uint32_t rmap_walk(uint64_t phys, rmap_visit_t visit, void *arg) {
+    phys &= RMAP_ADDR_MASK;
+    page_t *page = buddy_phys_to_page(phys);
+    if (!page || !(page->flags & PAGE_FLAG_ANON)) {
+        return 0;
+    }
+
+    uint32_t found = 0;
+    spinlock_acquire(&rmap_lock);
+    rmap_stats.walks++;
+
+    // Recheck under the lock: the frame may have been freed meanwhile
+    if (page->flags & PAGE_FLAG_ANON) {
+        rmap_anon_t *anon = (rmap_anon_t *)page->owner;
+        uint64_t virt = page->index << 12;
+        for (rmap_link_t *link = anon->links; link; link = link->anon_next) {
+            uint64_t *pte = vmm_get_pte(link->mm->pml4, virt);
+            if (!pte || !(*pte & VMM_FLAG_PRESENT) || (*pte & RMAP_ADDR_MASK) != phys) {
+                continue;  // Unmapped, or COW-copied away in this space
+            }
+            found++;
+            if (visit && visit(link->mm->pml4, virt, pte, arg)) {
+                break;
+            }
+        }
+    }
+
+    spinlock_release(&rmap_lock);
+    return found;
+}
+
+void rmap_get_stats(rmap_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+    spinlock_acquire(&rmap_lock);
+    *stats = rmap_stats;
+    spinlock_release(&rmap_lock);
+}
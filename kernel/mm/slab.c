@@ -1,11 +1,12 @@
 #include "../../include/mm/slab.h"
 #include "../../include/mm/buddy.h"
+#include "../../include/mm/page.h"
+#include "../../include/mm/alloc_profile.h"
 #include "../../include/kernel/config.h"
 #include "../../include/kernel/string.h"
 #include "../../include/kernel/stdio.h"
 
 #define CACHE_LINE_SIZE 64
-#define MAX_CPUS 8
 
 static slab_cache_t *g_cache_list = NULL;
 static spinlock_t g_cache_list_lock;
@@ -153,9 +154,19 @@ static slab_t *slab_create(slab_cache_t *cache) {
     slab->in_use = 0;
     slab->total_objects = cache->objects_per_slab;
     
-    size_t color_offset = (cache->color_next * CACHE_LINE_SIZE) % 
-                          (BUDDY_PAGE_SIZE - sizeof(slab_t) - 
-                           (cache->objects_per_slab * cache->object_size));
+    // Tag the page so frees can find the owning cache without a header
+    page_t *page = buddy_phys_to_page(slab_addr);
+    if (page) {
+        page->flags |= PAGE_FLAG_SLAB;
+        page->owner = cache;
+    }
+    
+    size_t color_space = BUDDY_PAGE_SIZE - sizeof(slab_t) - 
+                         (cache->objects_per_slab * cache->object_size);
+    size_t color_offset = 0;
+    if (color_space > 0) {
+        color_offset = (cache->color_next * CACHE_LINE_SIZE) % color_space;
+    }
     cache->color_next = (cache->color_next + 1) % 8;
     
     slab->objects = (uint8_t *)slab + sizeof(slab_t) + color_offset;
@@ -199,14 +210,14 @@ static void slab_move_to_list(slab_t **from_list, slab_t **to_list, slab_t *slab
     *to_list = slab;
 }
 
-void *slab_alloc(slab_cache_t *cache) {
+static void *slab_alloc_object(slab_cache_t *cache) {
     // Validate cache pointer
     if (!cache) {
         kprintf("[SLAB] ERROR: slab_alloc called with NULL cache\n");
         return NULL;
     }
     
-    int cpu_id = 0;
+    int cpu_id = (int)cpu_current_id();
     slab_cpu_cache_t *cpu_cache = &cache->cpu_caches[cpu_id];
     
     if (cpu_cache->available > 0) {
@@ -269,27 +280,16 @@ void *slab_alloc(slab_cache_t *cache) {
 }
 
 static slab_t *slab_find_for_object(slab_cache_t *cache, void *object) {
-    uint64_t obj_addr = (uint64_t)(uintptr_t)object;
-    
-    slab_t *slab = cache->slabs_full;
-    while (slab) {
-        uint64_t slab_addr = (uint64_t)(uintptr_t)slab;
-        if (obj_addr >= slab_addr && obj_addr < slab_addr + BUDDY_PAGE_SIZE) {
-            return slab;
-        }
-        slab = slab->next;
-    }
+    // Slabs are single pages with the slab_t at the page base, so the page
+    // descriptor identifies both the owning cache and the slab in O(1)
+    uint64_t slab_addr = (uint64_t)(uintptr_t)object & ~(uint64_t)(BUDDY_PAGE_SIZE - 1);
+    page_t *page = buddy_phys_to_page(slab_addr);
     
-    slab = cache->slabs_partial;
-    while (slab) {
-        uint64_t slab_addr = (uint64_t)(uintptr_t)slab;
-        if (obj_addr >= slab_addr && obj_addr < slab_addr + BUDDY_PAGE_SIZE) {
-            return slab;
-        }
-        slab = slab->next;
+    if (!page || !(page->flags & PAGE_FLAG_SLAB) || page->owner != cache) {
+        return NULL;
     }
     
-    return NULL;
+    return (slab_t *)(uintptr_t)slab_addr;
 }
 
 static void slab_free_to_slab(slab_cache_t *cache, slab_t *slab, void *object) {
@@ -299,7 +299,7 @@ static void slab_free_to_slab(slab_cache_t *cache, slab_t *slab, void *object) {
     slab->in_use--;
 }
 
-void slab_free(slab_cache_t *cache, void *object) {
+static void slab_free_object(slab_cache_t *cache, void *object) {
     // Validate parameters
     if (!cache) {
         kprintf("[SLAB] ERROR: slab_free called with NULL cache\n");
@@ -311,7 +311,7 @@ void slab_free(slab_cache_t *cache, void *object) {
         return;
     }
     
-    int cpu_id = 0;
+    int cpu_id = (int)cpu_current_id();
     slab_cpu_cache_t *cpu_cache = &cache->cpu_caches[cpu_id];
     
     if (cpu_cache->available < cpu_cache->limit) {
@@ -353,6 +353,26 @@ void slab_free(slab_cache_t *cache, void *object) {
     spinlock_release(&cache->lock);
 }
 
+void *slab_alloc(slab_cache_t *cache) {
+    int prof = alloc_profile_enter();
+    void *obj = slab_alloc_object(cache);
+    if (prof) {
+        alloc_profile_alloc(ALLOC_PROFILE_SLAB, (uint64_t)(uintptr_t)obj,
+                            cache ? cache->object_size : 0, __builtin_frame_address(0));
+    }
+    alloc_profile_exit(prof);
+    return obj;
+}
+
+void slab_free(slab_cache_t *cache, void *object) {
+    int prof = alloc_profile_enter();
+    if (prof) {
+        alloc_profile_free((uint64_t)(uintptr_t)object);
+    }
+    slab_free_object(cache, object);
+    alloc_profile_exit(prof);
+}
+
 static int slab_cpu_cache_refill(slab_cache_t *cache, int cpu_id) {
     slab_cpu_cache_t *cpu_cache = &cache->cpu_caches[cpu_id];
     
@@ -0,0 +1,181 @@
+#include "../../include/mm/slotmap.h"
+#include "../../include/kernel/heap.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+
+#define SLOTMAP_MIN_CAPACITY 16
+#define SLOTMAP_NO_SLOT      SLOTMAP_MAX_OBJECTS
+
+int slotmap_init(slotmap_t *map, const char *name, size_t object_size, uint32_t initial_capacity) {
+    if (!map || object_size == 0) {
+        return -1;
+    }
+
+    memset(map, 0, sizeof(slotmap_t));
+    if (name) {
+        strncpy(map->name, name, SLOTMAP_NAME_MAX - 1);
+        map->name[SLOTMAP_NAME_MAX - 1] = '\0';
+    }
+
+    uint32_t capacity = initial_capacity < SLOTMAP_MIN_CAPACITY ? SLOTMAP_MIN_CAPACITY : initial_capacity;
+    if (capacity > SLOTMAP_MAX_OBJECTS) {
+        capacity = SLOTMAP_MAX_OBJECTS;
+    }
+
+    map->object_size = object_size;
+    map->objects = kmalloc((size_t)capacity * object_size);
+    map->dense_slot = kmalloc((size_t)capacity * sizeof(uint32_t));
+    map->slots = kmalloc((size_t)capacity * sizeof(slotmap_slot_t));
+    if (!map->objects || !map->dense_slot || !map->slots) {
+        kprintf("[SLOTMAP] ERROR: %s: out of memory for %u objects\n", map->name, capacity);
+        slotmap_destroy(map);
+        return -1;
+    }
+
+    map->capacity = capacity;
+    map->free_head = SLOTMAP_NO_SLOT;
+    return 0;
+}
+
+void slotmap_destroy(slotmap_t *map) {
+    if (!map) {
+        return;
+    }
+
+    kfree(map->objects);
+    kfree(map->dense_slot);
+    kfree(map->slots);
+    map->objects = NULL;
+    map->dense_slot = NULL;
+    map->slots = NULL;
+    map->count = 0;
+    map->capacity = 0;
+    map->slot_count = 0;
+    map->free_head = SLOTMAP_NO_SLOT;
+}
+
+// Double the three arrays. A failed krealloc leaves the old array in place,
+// so capacity only changes once all of them have grown.
+static int slotmap_grow(slotmap_t *map) {
+    if (map->capacity >= SLOTMAP_MAX_OBJECTS) {
+        kprintf("[SLOTMAP] ERROR: %s: full (%u objects)\n", map->name, map->capacity);
+        return -1;
+    }
+
+    uint32_t capacity = map->capacity * 2;
+    if (capacity > SLOTMAP_MAX_OBJECTS) {
+        capacity = SLOTMAP_MAX_OBJECTS;
+    }
+
+    uint8_t *objects = krealloc(map->objects, (size_t)capacity * map->object_size);
+    if (objects) {
+        map->objects = objects;
+    }
+    uint32_t *dense_slot = krealloc(map->dense_slot, (size_t)capacity * sizeof(uint32_t));
+    if (dense_slot) {
+        map->dense_slot = dense_slot;
+    }
+    slotmap_slot_t *slots = krealloc(map->slots, (size_t)capacity * sizeof(slotmap_slot_t));
+    if (slots) {
+        map->slots = slots;
+    }
+    if (!objects || !dense_slot || !slots) {
+        kprintf("[SLOTMAP] ERROR: %s: out of memory growing to %u objects\n", map->name, capacity);
+        return -1;
+    }
+
+    map->capacity = capacity;
+    return 0;
+}
+
+static inline slotmap_slot_t *slotmap_lookup(const slotmap_t *map, slot_handle_t handle) {
+    uint32_t index = handle & SLOTMAP_INDEX_MASK;
+    uint32_t gen = handle >> SLOTMAP_INDEX_BITS;
+    if (index >= map->slot_count) {
+        return NULL;
+    }
+
+    slotmap_slot_t *slot = &map->slots[index];
+    if (!slot->used || slot->gen != gen) {
+        return NULL;
+    }
+    return slot;
+}
+
+slot_handle_t slotmap_insert(slotmap_t *map, void **object) {
+    if (!map || !map->objects) {
+        return SLOTMAP_INVALID_HANDLE;
+    }
+    if (map->count == map->capacity && slotmap_grow(map) != 0) {
+        return SLOTMAP_INVALID_HANDLE;
+    }
+
+    // Reuse a freed slot; with none free every slot is in use, so
+    // slot_count == count < capacity and a fresh slot is available
+    uint32_t index;
+    if (map->free_head != SLOTMAP_NO_SLOT) {
+        index = map->free_head;
+        map->free_head = map->slots[index].dense;
+    } else {
+        index = map->slot_count++;
+        map->slots[index].gen = 1;
+    }
+
+    slotmap_slot_t *slot = &map->slots[index];
+    uint32_t dense = map->count++;
+    slot->dense = dense;
+    slot->used = 1;
+    map->dense_slot[dense] = index;
+
+    uint8_t *obj = map->objects + (size_t)dense * map->object_size;
+    memset(obj, 0, map->object_size);
+    if (object) {
+        *object = obj;
+    }
+    return ((slot_handle_t)slot->gen << SLOTMAP_INDEX_BITS) | index;
+}
+
+int slotmap_remove(slotmap_t *map, slot_handle_t handle) {
+    if (!map) {
+        return -1;
+    }
+
+    slotmap_slot_t *slot = slotmap_lookup(map, handle);
+    if (!slot) {
+        return -1;
+    }
+
+    // Move the last object into the hole to keep the array packed
+    uint32_t dense = slot->dense;
+    uint32_t last = map->count - 1;
+    if (dense != last) {
+        memcpy(map->objects + (size_t)dense * map->object_size,
+               map->objects + (size_t)last * map->object_size, map->object_size);
+        uint32_t moved = map->dense_slot[last];
+        map->dense_slot[dense] = moved;
+        map->slots[moved].dense = dense;
+    }
+    map->count--;
+
+    // Retire the handle; generation 0 is skipped so handles are never 0
+    slot->gen = (slot->gen + 1) & SLOTMAP_GEN_MASK;
+    if (slot->gen == 0) {
+        slot->gen = 1;
+    }
+    slot->used = 0;
+    slot->dense = map->free_head;
+    map->free_head = handle & SLOTMAP_INDEX_MASK;
+    return 0;
+}
+
+void *slotmap_get(const slotmap_t *map, slot_handle_t handle) {
+    if (!map) {
+        return NULL;
+    }
+
+    slotmap_slot_t *slot = slotmap_lookup(map, handle);
+    if (!slot) {
+        return NULL;
+    }
+    return map->objects + (size_t)slot->dense * map->object_size;
+}
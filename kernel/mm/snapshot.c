@@ -0,0 +1,190 @@
+#include "../../include/mm/snapshot.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/kernel/heap.h"
+#include "../../include/kernel/stdio.h"
+
+#define SNAPSHOT_ADDR_MASK 0x000FFFFFFFFFF000ULL
+
+typedef struct snapshot_walk {
+    snapshot_t *snap;
+    snapshot_visit_t visit;
+    void *arg;
+    uint32_t count;
+    tlb_gather_t *tlb;
+} snapshot_walk_t;
+
+static int snapshot_clear_dirty(uint64_t virt, uint64_t *pte, void *arg) {
+    (void)virt;
+    (void)arg;
+    *pte &= ~(uint64_t)VMM_FLAG_DIRTY;
+    return 0;
+}
+
+// Take a new view of the live space. Dirty bits are cleared first: the
+// clone then write-protects every shared page and flushes, so the next
+// write faults and sets the bit again.
+static page_table_t *snapshot_freeze(page_table_t *source) {
+    vmm_walk_user_ptes(source, snapshot_clear_dirty, NULL);
+    return cow_clone_address_space(source);
+}
+
+snapshot_t *snapshot_create(page_table_t *pml4) {
+    if (!pml4) {
+        return NULL;
+    }
+
+    snapshot_t *snap = (snapshot_t *)kmalloc(sizeof(snapshot_t));
+    if (!snap) {
+        return NULL;
+    }
+
+    snap->source = pml4;
+    snap->view = snapshot_freeze(pml4);
+    if (!snap->view) {
+        kprintf("[SNAPSHOT] ERROR: Failed to clone address space %p\n", pml4);
+        kfree(snap);
+        return NULL;
+    }
+    snap->generation = 1;
+    return snap;
+}
+
+int snapshot_refresh(snapshot_t *snap) {
+    if (!snap) {
+        return -1;
+    }
+
+    // The old view stays valid if the new one cannot be taken
+    page_table_t *view = snapshot_freeze(snap->source);
+    if (!view) {
+        kprintf("[SNAPSHOT] ERROR: Failed to refresh snapshot of %p\n", snap->source);
+        return -1;
+    }
+    cow_release_address_space(snap->view);
+    snap->view = view;
+    snap->generation++;
+    return 0;
+}
+
+void snapshot_discard(snapshot_t *snap) {
+    if (!snap) {
+        return;
+    }
+    cow_release_address_space(snap->view);
+    kfree(snap);
+}
+
+// Live entry changed since the view was taken; view_entry is 0 if the view
+// has nothing at that address
+static int snapshot_is_dirty(uint64_t entry, uint64_t view_entry) {
+    if (!(view_entry & VMM_FLAG_PRESENT)) {
+        return 1;
+    }
+    return (entry & VMM_FLAG_DIRTY) ||
+           (entry & SNAPSHOT_ADDR_MASK) != (view_entry & SNAPSHOT_ADDR_MASK);
+}
+
+static uint64_t snapshot_view_entry(snapshot_t *snap, uint64_t virt) {
+    uint64_t *pte = vmm_get_pte(snap->view, virt);
+    return pte ? *pte : 0;
+}
+
+static int snapshot_visit_live(uint64_t virt, uint64_t *pte, void *arg) {
+    snapshot_walk_t *walk = (snapshot_walk_t *)arg;
+    if (!snapshot_is_dirty(*pte, snapshot_view_entry(walk->snap, virt))) {
+        return 0;
+    }
+    walk->count++;
+    return walk->visit ? walk->visit(virt, *pte & SNAPSHOT_ADDR_MASK, walk->arg) : 0;
+}
+
+static int snapshot_visit_removed(uint64_t virt, uint64_t *pte, void *arg) {
+    snapshot_walk_t *walk = (snapshot_walk_t *)arg;
+    (void)pte;
+    uint64_t *live = vmm_get_pte(walk->snap->source, virt);
+    if (live && (*live & VMM_FLAG_PRESENT)) {
+        return 0;
+    }
+    walk->count++;
+    return walk->visit ? walk->visit(virt, 0, walk->arg) : 0;
+}
+
+uint32_t snapshot_for_each_dirty(snapshot_t *snap, snapshot_visit_t visit, void *arg) {
+    if (!snap) {
+        return 0;
+    }
+
+    snapshot_walk_t walk = { snap, visit, arg, 0, NULL };
+    if (vmm_walk_user_ptes(snap->source, snapshot_visit_live, &walk) == 0) {
+        vmm_walk_user_ptes(snap->view, snapshot_visit_removed, &walk);
+    }
+    return walk.count;
+}
+
+// Drop the live space's hold on a frame it no longer maps: a COW frame
+// loses a reference, a private one is freed after the flush
+static void snapshot_put_frame(uint64_t entry, tlb_gather_t *tlb) {
+    uint64_t phys = entry & SNAPSHOT_ADDR_MASK;
+    if (entry & COW_FLAG_MASK) {
+        if (cow_release_ref(phys)) {
+            tlb_gather_free_frame(tlb, phys);
+        }
+    } else if (cow_get_ref(phys)) {
+        tlb_gather_free_frame(tlb, phys);
+    }
+}
+
+static int snapshot_restore_live(uint64_t virt, uint64_t *pte, void *arg) {
+    snapshot_walk_t *walk = (snapshot_walk_t *)arg;
+    uint64_t entry = *pte;
+    uint64_t view_entry = snapshot_view_entry(walk->snap, virt);
+    if (!snapshot_is_dirty(entry, view_entry)) {
+        return 0;
+    }
+
+    if (view_entry & VMM_FLAG_PRESENT) {
+        cow_increment_ref(view_entry & SNAPSHOT_ADDR_MASK);
+        *pte = view_entry & ~(uint64_t)VMM_FLAG_DIRTY;
+    } else {
+        *pte = 0;
+    }
+    tlb_gather_page(walk->tlb, virt);
+    snapshot_put_frame(entry, walk->tlb);
+    walk->count++;
+    return 0;
+}
+
+static int snapshot_restore_removed(uint64_t virt, uint64_t *pte, void *arg) {
+    snapshot_walk_t *walk = (snapshot_walk_t *)arg;
+    uint64_t *live = vmm_get_pte(walk->snap->source, virt);
+    if (live && (*live & VMM_FLAG_PRESENT)) {
+        return 0;
+    }
+
+    uint64_t entry = *pte & ~(uint64_t)VMM_FLAG_DIRTY;
+    vmm_map_page(walk->snap->source, virt, entry & SNAPSHOT_ADDR_MASK, (uint32_t)(entry & 0xFFF));
+    live = vmm_get_pte(walk->snap->source, virt);
+    if (!live) {
+        return 0;  // Out of memory for a page table
+    }
+    *live = entry;
+    cow_increment_ref(entry & SNAPSHOT_ADDR_MASK);
+    walk->count++;
+    return 0;
+}
+
+uint32_t snapshot_rollback(snapshot_t *snap) {
+    if (!snap) {
+        return 0;
+    }
+
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb);
+    snapshot_walk_t walk = { snap, NULL, NULL, 0, &tlb };
+    vmm_walk_user_ptes(snap->source, snapshot_restore_live, &walk);
+    vmm_walk_user_ptes(snap->view, snapshot_restore_removed, &walk);
+    tlb_gather_finish(&tlb);
+    return walk.count;
+}
@@ -0,0 +1,103 @@
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/vmm.h"
+
+static uint32_t g_flush_threshold = TLB_DEFAULT_FLUSH_THRESHOLD;
+
+// Statistics only; updates may race
+static tlb_stats_t g_tlb_stats;
+
+static inline void invlpg(uint64_t virt) {
+    __asm__ volatile("invlpg (%0)" : : "r"(virt) : "memory");
+}
+
+void tlb_flush_page(uint64_t virt) {
+    invlpg(virt);
+    g_tlb_stats.page_flushes++;
+}
+
+void tlb_gather_init(tlb_gather_t *tlb) {
+    tlb->page_count = 0;
+    tlb->frame_count = 0;
+    tlb->full = 0;
+}
+
+void tlb_gather_page(tlb_gather_t *tlb, uint64_t virt) {
+    if (tlb->full) {
+        return;
+    }
+    if (tlb->page_count >= g_flush_threshold) {
+        tlb->full = 1;
+        return;
+    }
+    tlb->pages[tlb->page_count++] = virt & ~(BUDDY_PAGE_SIZE - 1);
+}
+
+void tlb_gather_range(tlb_gather_t *tlb, uint64_t start, uint64_t end) {
+    start &= ~(BUDDY_PAGE_SIZE - 1);
+    if (tlb->full || end <= start) {
+        return;
+    }
+
+    // Decide from the size alone so huge ranges are not walked page by page
+    uint64_t pages = (end - start + BUDDY_PAGE_SIZE - 1) / BUDDY_PAGE_SIZE;
+    if (tlb->page_count + pages > g_flush_threshold) {
+        tlb->full = 1;
+        return;
+    }
+    for (uint64_t addr = start; addr < end; addr += BUDDY_PAGE_SIZE) {
+        tlb->pages[tlb->page_count++] = addr;
+    }
+}
+
+void tlb_gather_finish(tlb_gather_t *tlb) {
+    if (tlb->full) {
+        vmm_flush_tlb_all();
+        g_tlb_stats.full_flushes++;
+    } else {
+        for (uint32_t i = 0; i < tlb->page_count; i++) {
+            invlpg(tlb->pages[i]);
+        }
+        g_tlb_stats.page_flushes += tlb->page_count;
+    }
+    if (tlb->full || tlb->page_count) {
+        g_tlb_stats.gathers++;
+    }
+
+    // No CPU can still reach these frames through a stale translation
+    for (uint32_t i = 0; i < tlb->frame_count; i++) {
+        buddy_free_pages(tlb->frames[i], 0);
+    }
+
+    tlb_gather_init(tlb);
+}
+
+void tlb_gather_free_frame(tlb_gather_t *tlb, uint64_t phys) {
+    if (phys == 0) {
+        return;
+    }
+    if (tlb->frame_count == TLB_GATHER_MAX) {
+        tlb_gather_finish(tlb);
+    }
+    tlb->frames[tlb->frame_count++] = phys & ~(BUDDY_PAGE_SIZE - 1);
+}
+
+void tlb_set_flush_threshold(uint32_t pages) {
+    if (pages == 0) {
+        pages = 1;
+    }
+    if (pages > TLB_GATHER_MAX) {
+        pages = TLB_GATHER_MAX;
+    }
+    g_flush_threshold = pages;
+}
+
+uint32_t tlb_get_flush_threshold(void) {
+    return g_flush_threshold;
+}
+
+void tlb_get_stats(tlb_stats_t *stats) {
+    if (stats) {
+        *stats = g_tlb_stats;
+    }
+}
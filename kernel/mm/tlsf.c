@@ -0,0 +1,354 @@
+#include "../../include/mm/tlsf.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+#include "../../include/kernel/atomic.h"
+
+#define TLSF_BLOCK_FREE    0x1ULL
+#define TLSF_BLOCK_CLAIMED 0x2ULL   // Used block already handed to a free path
+#define TLSF_SIZE_MASK  (~(size_t)(TLSF_ALIGN - 1))
+
+static inline size_t block_size(const tlsf_block_t *block) {
+    return block->size & TLSF_SIZE_MASK;
+}
+
+static inline int block_is_free(const tlsf_block_t *block) {
+    return (block->size & TLSF_BLOCK_FREE) != 0;
+}
+
+static inline void *block_to_ptr(tlsf_block_t *block) {
+    return (uint8_t *)block + TLSF_BLOCK_HEADER;
+}
+
+static inline tlsf_block_t *ptr_to_block(const void *ptr) {
+    return (tlsf_block_t *)((uintptr_t)ptr - TLSF_BLOCK_HEADER);
+}
+
+static inline tlsf_block_t *block_next_phys(const tlsf_block_t *block) {
+    return (tlsf_block_t *)((uintptr_t)block + TLSF_BLOCK_HEADER + block_size(block));
+}
+
+static inline size_t align_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+// Index of the most significant set bit
+static inline uint32_t tlsf_fls(size_t value) {
+    return 63 - (uint32_t)__builtin_clzll((uint64_t)value);
+}
+
+// Index of the least significant set bit (value must be non-zero)
+static inline uint32_t tlsf_ffs(uint32_t value) {
+    return (uint32_t)__builtin_ctz(value);
+}
+
+// Map a block size to the list that holds blocks of exactly that class
+static void mapping_insert(size_t size, uint32_t *fl, uint32_t *sl) {
+    if (size < TLSF_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (uint32_t)(size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT));
+    } else {
+        uint32_t top = tlsf_fls(size);
+        *sl = (uint32_t)(size >> (top - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *fl = top - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+// Map a request to the first list whose blocks are all large enough
+static void mapping_search(size_t size, uint32_t *fl, uint32_t *sl) {
+    if (size >= TLSF_SMALL_BLOCK) {
+        size += ((size_t)1 << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static tlsf_block_t *search_suitable_block(tlsf_t *tlsf, uint32_t *fl, uint32_t *sl) {
+    uint32_t sl_map = tlsf->sl_bitmap[*fl] & (~0U << *sl);
+
+    if (!sl_map) {
+        uint32_t fl_map = tlsf->fl_bitmap & (~0U << (*fl + 1));
+        if (!fl_map) {
+            return NULL;
+        }
+        *fl = tlsf_ffs(fl_map);
+        sl_map = tlsf->sl_bitmap[*fl];
+    }
+
+    *sl = tlsf_ffs(sl_map);
+    return tlsf->blocks[*fl][*sl];
+}
+
+static void insert_free_block(tlsf_t *tlsf, tlsf_block_t *block) {
+    uint32_t fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    tlsf_block_t *head = tlsf->blocks[fl][sl];
+    block->next_free = head;
+    block->prev_free = NULL;
+    if (head) {
+        head->prev_free = block;
+    }
+    tlsf->blocks[fl][sl] = block;
+
+    tlsf->fl_bitmap |= (1U << fl);
+    tlsf->sl_bitmap[fl] |= (1U << sl);
+    tlsf->free_bytes += block_size(block);
+}
+
+static void remove_free_block(tlsf_t *tlsf, tlsf_block_t *block) {
+    uint32_t fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        tlsf->blocks[fl][sl] = block->next_free;
+    }
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+
+    if (!tlsf->blocks[fl][sl]) {
+        tlsf->sl_bitmap[fl] &= ~(1U << sl);
+        if (!tlsf->sl_bitmap[fl]) {
+            tlsf->fl_bitmap &= ~(1U << fl);
+        }
+    }
+    tlsf->free_bytes -= block_size(block);
+}
+
+// Split off the tail of a block beyond size bytes and return it as free
+static void block_trim(tlsf_t *tlsf, tlsf_block_t *block, size_t size) {
+    size_t current = block_size(block);
+    if (current < size + TLSF_BLOCK_HEADER + TLSF_MIN_PAYLOAD) {
+        return;
+    }
+
+    tlsf_block_t *rest = (tlsf_block_t *)((uintptr_t)block + TLSF_BLOCK_HEADER + size);
+    rest->size = (current - size - TLSF_BLOCK_HEADER) | TLSF_BLOCK_FREE;
+    rest->prev_phys = block;
+    block_next_phys(rest)->prev_phys = rest;
+
+    block->size = size | (block->size & TLSF_BLOCK_FREE);
+    insert_free_block(tlsf, rest);
+}
+
+// Give the tail of a used block beyond size bytes back to the free lists,
+// merging it with a free successor
+static void block_trim_used(tlsf_t *tlsf, tlsf_block_t *block, size_t size) {
+    size_t current = block_size(block);
+    if (current < size + TLSF_BLOCK_HEADER + TLSF_MIN_PAYLOAD) {
+        return;
+    }
+
+    tlsf_block_t *rest = (tlsf_block_t *)((uintptr_t)block + TLSF_BLOCK_HEADER + size);
+    rest->size = (current - size - TLSF_BLOCK_HEADER) | TLSF_BLOCK_FREE;
+    rest->prev_phys = block;
+    block->size = size | (block->size & ~TLSF_SIZE_MASK);
+
+    tlsf_block_t *next = block_next_phys(rest);
+    if (block_is_free(next)) {
+        remove_free_block(tlsf, next);
+        rest->size += TLSF_BLOCK_HEADER + block_size(next);
+    }
+    block_next_phys(rest)->prev_phys = rest;
+    insert_free_block(tlsf, rest);
+}
+
+void tlsf_init(tlsf_t *tlsf) {
+    memset(tlsf, 0, sizeof(tlsf_t));
+}
+
+// Block header at the start of a pool spanning [mem, mem + bytes)
+static tlsf_block_t *pool_first_block(const void *mem, size_t bytes, size_t *payload) {
+    uintptr_t start = align_up((uintptr_t)mem, TLSF_ALIGN);
+    uintptr_t end = ((uintptr_t)mem + bytes) & ~(uintptr_t)(TLSF_ALIGN - 1);
+    if (end <= start || end - start < 2 * TLSF_BLOCK_HEADER + TLSF_MIN_PAYLOAD) {
+        return NULL;
+    }
+    *payload = (end - start) - 2 * TLSF_BLOCK_HEADER;
+    return (tlsf_block_t *)start;
+}
+
+int tlsf_add_pool(tlsf_t *tlsf, void *mem, size_t bytes) {
+    if (!tlsf || !mem) {
+        return -1;
+    }
+
+    size_t payload;
+    tlsf_block_t *block = pool_first_block(mem, bytes, &payload);
+    if (!block) {
+        kprintf("[TLSF] ERROR: Pool at %p too small (%zu bytes)\n", mem, bytes);
+        return -1;
+    }
+    if (tlsf_fls(payload) - (TLSF_FL_SHIFT - 1) >= TLSF_FL_COUNT) {
+        kprintf("[TLSF] ERROR: Pool at %p too large (%zu bytes)\n", mem, bytes);
+        return -1;
+    }
+
+    // One free block spanning the pool, followed by a zero-size used sentinel
+    // that stops coalescing at the pool end
+    block->size = payload | TLSF_BLOCK_FREE;
+    block->prev_phys = NULL;
+
+    tlsf_block_t *sentinel = block_next_phys(block);
+    sentinel->size = 0;
+    sentinel->prev_phys = block;
+
+    insert_free_block(tlsf, block);
+    tlsf->pool_bytes += payload;
+    return 0;
+}
+
+int tlsf_pool_is_free(const void *mem, size_t bytes) {
+    size_t payload;
+    tlsf_block_t *block = pool_first_block(mem, bytes, &payload);
+    return block && block_is_free(block) && block_size(block) == payload;
+}
+
+int tlsf_remove_pool(tlsf_t *tlsf, void *mem, size_t bytes) {
+    if (!tlsf || !mem) {
+        return -1;
+    }
+
+    // Only a pool that has coalesced back into one free block can go
+    size_t payload;
+    tlsf_block_t *block = pool_first_block(mem, bytes, &payload);
+    if (!block || !block_is_free(block) || block_size(block) != payload) {
+        return -1;
+    }
+
+    remove_free_block(tlsf, block);
+    tlsf->pool_bytes -= payload;
+    return 0;
+}
+
+void *tlsf_malloc(tlsf_t *tlsf, size_t size) {
+    if (!tlsf || size == 0) {
+        return NULL;
+    }
+
+    size_t adjusted = align_up(size < TLSF_MIN_PAYLOAD ? TLSF_MIN_PAYLOAD : size, TLSF_ALIGN);
+    if (adjusted < size) {
+        return NULL;  // Overflow
+    }
+
+    uint32_t fl, sl;
+    mapping_search(adjusted, &fl, &sl);
+    if (fl >= TLSF_FL_COUNT) {
+        return NULL;
+    }
+
+    tlsf_block_t *block = search_suitable_block(tlsf, &fl, &sl);
+    if (!block) {
+        return NULL;
+    }
+
+    remove_free_block(tlsf, block);
+    block_trim(tlsf, block, adjusted);
+    block->size &= ~TLSF_BLOCK_FREE;
+
+    return block_to_ptr(block);
+}
+
+int tlsf_free(tlsf_t *tlsf, void *ptr) {
+    if (!tlsf || !ptr) {
+        return -1;
+    }
+
+    tlsf_block_t *block = ptr_to_block(ptr);
+
+    if (block_is_free(block)) {
+        kprintf("[TLSF] ERROR: Double free of %p detected\n", ptr);
+        return -1;
+    }
+    block->size &= ~TLSF_BLOCK_CLAIMED;
+
+    // Boundary tags must agree in both directions
+    if (block_next_phys(block)->prev_phys != block ||
+        (block->prev_phys && block_next_phys(block->prev_phys) != block)) {
+        kprintf("[TLSF] ERROR: Corrupted block header at %p\n", ptr);
+        return -1;
+    }
+
+    block->size |= TLSF_BLOCK_FREE;
+
+    // Merge with the previous block
+    tlsf_block_t *prev = block->prev_phys;
+    if (prev && block_is_free(prev)) {
+        remove_free_block(tlsf, prev);
+        prev->size += TLSF_BLOCK_HEADER + block_size(block);
+        block = prev;
+        block_next_phys(block)->prev_phys = block;
+    }
+
+    // Merge with the next block (the sentinel is never free)
+    tlsf_block_t *next = block_next_phys(block);
+    if (block_is_free(next)) {
+        remove_free_block(tlsf, next);
+        block->size += TLSF_BLOCK_HEADER + block_size(next);
+        block_next_phys(block)->prev_phys = block;
+    }
+
+    insert_free_block(tlsf, block);
+    return 0;
+}
+
+int tlsf_resize(tlsf_t *tlsf, void *ptr, size_t size) {
+    if (!tlsf || !ptr || size == 0) {
+        return -1;
+    }
+
+    tlsf_block_t *block = ptr_to_block(ptr);
+    if (block_is_free(block)) {
+        return -1;
+    }
+
+    size_t adjusted = align_up(size < TLSF_MIN_PAYLOAD ? TLSF_MIN_PAYLOAD : size, TLSF_ALIGN);
+    if (adjusted < size) {
+        return -1;  // Overflow
+    }
+
+    // Growing needs a free successor that covers the difference
+    size_t current = block_size(block);
+    if (adjusted > current) {
+        tlsf_block_t *next = block_next_phys(block);
+        if (!block_is_free(next) || current + TLSF_BLOCK_HEADER + block_size(next) < adjusted) {
+            return -1;
+        }
+        remove_free_block(tlsf, next);
+        block->size += TLSF_BLOCK_HEADER + block_size(next);
+        block_next_phys(block)->prev_phys = block;
+    }
+
+    block_trim_used(tlsf, block, adjusted);
+    return 0;
+}
+
+int tlsf_block_claim(void *ptr) {
+    if (!ptr) {
+        return -1;
+    }
+
+    // Only the block's own free path writes the size word of a used block,
+    // so a CAS here cannot race with the owner splitting or merging
+    volatile uint64_t *word = (volatile uint64_t *)&ptr_to_block(ptr)->size;
+    uint64_t old = *word;
+    for (;;) {
+        if (old & (TLSF_BLOCK_FREE | TLSF_BLOCK_CLAIMED)) {
+            kprintf("[TLSF] ERROR: Double free of %p detected\n", ptr);
+            return -1;
+        }
+        uint64_t seen = atomic_compare_and_swap64(word, old, old | TLSF_BLOCK_CLAIMED);
+        if (seen == old) {
+            return 0;
+        }
+        old = seen;
+    }
+}
+
+size_t tlsf_block_size(const void *ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    return block_size(ptr_to_block(ptr));
+}
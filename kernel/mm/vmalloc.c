@@ -0,0 +1,312 @@
+#include "../../include/mm/vmalloc.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/slab.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/spinlock.h"
+#include "../../include/kernel/config.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+
+static spinlock_t g_vmalloc_lock;
+static slab_cache_t *g_vmap_cache = NULL;
+
+static vmap_area_t *g_free_list = NULL;   // Sorted by start, neighbours merged
+static vmap_area_t *g_busy_list = NULL;   // Live allocations
+static vmap_area_t *g_lazy_list = NULL;   // Unmapped, awaiting TLB purge
+
+static vmalloc_stats_t g_stats;
+
+void vmalloc_init(void) {
+    spinlock_init(&g_vmalloc_lock);
+    memset(&g_stats, 0, sizeof(g_stats));
+
+    g_vmap_cache = slab_cache_create("vmap_area", sizeof(vmap_area_t), 8);
+    if (!g_vmap_cache) {
+        kprintf("[VMALLOC] ERROR: Failed to create vmap_area cache\n");
+        return;
+    }
+
+    vmap_area_t *all = (vmap_area_t *)slab_alloc(g_vmap_cache);
+    if (!all) {
+        kprintf("[VMALLOC] ERROR: Failed to allocate initial free range\n");
+        return;
+    }
+    all->start = VMALLOC_START;
+    all->size = VMALLOC_SIZE;
+    all->next = NULL;
+    g_free_list = all;
+    g_busy_list = NULL;
+    g_lazy_list = NULL;
+
+    DEBUG_PRINT(VMALLOC, "Initialized range 0x%llx-0x%llx\n", VMALLOC_START, VMALLOC_END);
+}
+
+// Return a range to the free list, merging with its neighbours
+// Caller must hold g_vmalloc_lock
+static void free_list_insert(vmap_area_t *area) {
+    vmap_area_t *prev = NULL;
+    vmap_area_t *curr = g_free_list;
+    while (curr && curr->start < area->start) {
+        prev = curr;
+        curr = curr->next;
+    }
+
+    area->next = curr;
+    if (prev) {
+        prev->next = area;
+    } else {
+        g_free_list = area;
+    }
+
+    if (curr && area->start + area->size == curr->start) {
+        area->size += curr->size;
+        area->next = curr->next;
+        slab_free(g_vmap_cache, curr);
+    }
+    if (prev && prev->start + prev->size == area->start) {
+        prev->size += area->size;
+        prev->next = area->next;
+        slab_free(g_vmap_cache, area);
+    }
+}
+
+// Flush the TLB once and recycle every lazily freed range
+// Caller must hold g_vmalloc_lock
+static void purge_lazy_locked(void) {
+    if (!g_lazy_list) {
+        return;
+    }
+
+    vmm_flush_tlb_all();
+
+    vmap_area_t *area = g_lazy_list;
+    while (area) {
+        vmap_area_t *next = area->next;
+        free_list_insert(area);
+        area = next;
+    }
+
+    g_lazy_list = NULL;
+    g_stats.lazy_pages = 0;
+    g_stats.purges++;
+    DEBUG_PRINT(VMALLOC, "Purged lazy ranges (purge #%llu)\n", g_stats.purges);
+}
+
+// First-fit reservation of size bytes of address space
+// Caller must hold g_vmalloc_lock
+static vmap_area_t *reserve_range(uint64_t size) {
+    vmap_area_t *prev = NULL;
+    vmap_area_t *curr = g_free_list;
+    while (curr && curr->size < size) {
+        prev = curr;
+        curr = curr->next;
+    }
+    if (!curr) {
+        return NULL;
+    }
+
+    // Exact fit: hand over the free node itself
+    if (curr->size == size) {
+        if (prev) {
+            prev->next = curr->next;
+        } else {
+            g_free_list = curr->next;
+        }
+        curr->next = NULL;
+        return curr;
+    }
+
+    vmap_area_t *area = (vmap_area_t *)slab_alloc(g_vmap_cache);
+    if (!area) {
+        return NULL;
+    }
+    area->start = curr->start;
+    area->size = size;
+    area->next = NULL;
+
+    curr->start += size;
+    curr->size -= size;
+    return area;
+}
+
+// Unmap an area's pages, free them, and park the range on the lazy list
+// Caller must hold g_vmalloc_lock
+static void unmap_area_lazy(vmap_area_t *area, uint64_t mapped_pages) {
+    page_table_t *kernel_pml4 = vmm_get_kernel_address_space();
+
+    for (uint64_t i = 0; i < mapped_pages; i++) {
+        uint64_t virt = area->start + i * BUDDY_PAGE_SIZE;
+        // No invlpg here: purge_lazy_locked() flushes the whole range
+        uint64_t phys = vmm_unmap_page_deferred(kernel_pml4, virt, NULL);
+        if (phys) {
+            buddy_free_pages(phys, 0);
+        }
+    }
+    g_stats.mapped_pages -= mapped_pages;
+
+    // Stale TLB entries may still point at the freed pages; nothing may
+    // touch this range again until purge_lazy_locked() has flushed them
+    area->next = g_lazy_list;
+    g_lazy_list = area;
+    g_stats.lazy_pages += area->size / BUDDY_PAGE_SIZE;
+
+    if (g_stats.lazy_pages >= VMALLOC_LAZY_MAX_PAGES) {
+        purge_lazy_locked();
+    }
+}
+
+void *vmalloc(size_t size) {
+    if (size == 0 || !g_vmap_cache) {
+        return NULL;
+    }
+
+    uint64_t pages = (size + BUDDY_PAGE_SIZE - 1) / BUDDY_PAGE_SIZE;
+    if (pages >= VMALLOC_SIZE / BUDDY_PAGE_SIZE) {
+        kprintf("[VMALLOC] ERROR: vmalloc(%zu) exceeds the vmalloc range\n", size);
+        return NULL;
+    }
+
+    page_table_t *kernel_pml4 = vmm_get_kernel_address_space();
+    if (!kernel_pml4) {
+        return NULL;
+    }
+
+    spinlock_acquire(&g_vmalloc_lock);
+
+    // One extra page of address space stays unmapped as a guard
+    uint64_t range_size = (pages + 1) * BUDDY_PAGE_SIZE;
+    vmap_area_t *area = reserve_range(range_size);
+    if (!area) {
+        purge_lazy_locked();
+        area = reserve_range(range_size);
+    }
+    if (!area) {
+        spinlock_release(&g_vmalloc_lock);
+        kprintf("[VMALLOC] ERROR: vmalloc(%zu) - out of address space\n", size);
+        return NULL;
+    }
+
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t virt = area->start + i * BUDDY_PAGE_SIZE;
+        uint64_t phys = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+        if (phys) {
+            vmm_map_page(kernel_pml4, virt, phys, VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE);
+            // vmm_map_page() fails silently if a page table cannot be allocated
+            if (vmm_get_physical_address(kernel_pml4, virt) != phys) {
+                buddy_free_pages(phys, 0);
+                phys = 0;
+            }
+        }
+        if (!phys) {
+            g_stats.mapped_pages += i;
+            unmap_area_lazy(area, i);
+            spinlock_release(&g_vmalloc_lock);
+            kprintf("[VMALLOC] ERROR: vmalloc(%zu) - out of memory\n", size);
+            return NULL;
+        }
+    }
+
+    area->next = g_busy_list;
+    g_busy_list = area;
+    g_stats.mapped_pages += pages;
+    g_stats.total_allocs++;
+
+    spinlock_release(&g_vmalloc_lock);
+
+    DEBUG_PRINT(VMALLOC, "vmalloc(%zu) -> 0x%llx (%llu pages)\n", size, area->start, pages);
+    return (void *)(uintptr_t)area->start;
+}
+
+void *vzalloc(size_t size) {
+    void *ptr = vmalloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// Unlink and return the live area starting at addr
+// Caller must hold g_vmalloc_lock
+static vmap_area_t *busy_list_remove(uint64_t addr) {
+    vmap_area_t *prev = NULL;
+    vmap_area_t *curr = g_busy_list;
+    while (curr && curr->start != addr) {
+        prev = curr;
+        curr = curr->next;
+    }
+    if (!curr) {
+        return NULL;
+    }
+    if (prev) {
+        prev->next = curr->next;
+    } else {
+        g_busy_list = curr->next;
+    }
+    curr->next = NULL;
+    return curr;
+}
+
+void vfree(void *addr) {
+    if (!addr) {
+        return;
+    }
+
+    if (!is_vmalloc_addr(addr)) {
+        kprintf("[VMALLOC] ERROR: vfree(%p) - not a vmalloc address\n", addr);
+        return;
+    }
+
+    spinlock_acquire(&g_vmalloc_lock);
+
+    vmap_area_t *area = busy_list_remove((uint64_t)(uintptr_t)addr);
+    if (!area) {
+        spinlock_release(&g_vmalloc_lock);
+        kprintf("[VMALLOC] ERROR: vfree(%p) - no such allocation (double free?)\n", addr);
+        return;
+    }
+
+    uint64_t pages = area->size / BUDDY_PAGE_SIZE - 1;
+    unmap_area_lazy(area, pages);
+    g_stats.total_frees++;
+
+    spinlock_release(&g_vmalloc_lock);
+
+    DEBUG_PRINT(VMALLOC, "vfree(%p) - %llu pages released\n", addr, pages);
+}
+
+size_t vmalloc_size(const void *addr) {
+    if (!is_vmalloc_addr(addr)) {
+        return 0;
+    }
+
+    size_t size = 0;
+    spinlock_acquire(&g_vmalloc_lock);
+    for (vmap_area_t *area = g_busy_list; area; area = area->next) {
+        if (area->start == (uint64_t)(uintptr_t)addr) {
+            size = area->size - BUDDY_PAGE_SIZE;
+            break;
+        }
+    }
+    spinlock_release(&g_vmalloc_lock);
+    return size;
+}
+
+int is_vmalloc_addr(const void *addr) {
+    uint64_t a = (uint64_t)(uintptr_t)addr;
+    return a >= VMALLOC_START && a < VMALLOC_END;
+}
+
+void vmalloc_purge(void) {
+    spinlock_acquire(&g_vmalloc_lock);
+    purge_lazy_locked();
+    spinlock_release(&g_vmalloc_lock);
+}
+
+void vmalloc_get_stats(vmalloc_stats_t *stats) {
+    if (!stats) {
+        return;
+    }
+    spinlock_acquire(&g_vmalloc_lock);
+    *stats = g_stats;
+    spinlock_release(&g_vmalloc_lock);
+}
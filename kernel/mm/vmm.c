@@ -1,6 +1,10 @@
 #include "../../include/kernel/vmm.h"
 #include "../../include/kernel/pmm.h"
 #include "../../include/kernel/types.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/rmap.h"
+#include "../../include/mm/page.h"
+#include "../../include/kernel/atomic.h"
 #define PAGE_SIZE 4096ULL
 #define PT_ENTRIES 512
 #define ADDR_PML4_INDEX(x) (((x) >> 39) & 0x1FF)
@@ -12,18 +16,46 @@ static inline uint64_t *virt_to_ptr(uint64_t phys) {
 }
 static uint64_t *get_or_alloc(uint64_t *table, uint64_t index) {
   uint64_t e = table[index];
+  // A 1 GiB or 2 MiB page has no table below it
+  if ((e & VMM_FLAG_PRESENT) && (e & VMM_FLAG_HUGE))
+    return 0;
   if (!(e & VMM_FLAG_PRESENT)) {
     uint64_t frame = pmm_alloc_frame();
     if (frame == 0)
       return 0;
     for (size_t i = 0; i < PAGE_SIZE / 8; i++)
       virt_to_ptr(frame)[i] = 0;
-    table[index] = frame | VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE;
-    e = table[index];
+    page_t *page = buddy_phys_to_page(frame);
+    if (page)
+      spinlock_init(&page->ptl);
+    // Access is the AND of every level, so the leaf alone decides
+    uint64_t entry = frame | VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE | VMM_FLAG_USER;
+    // Faults in other spans may fill the same slot; the loser frees its table
+    uint64_t old = atomic_compare_and_swap64((volatile uint64_t *)&table[index], e, entry);
+    if (old == e) {
+      e = entry;
+    } else {
+      pmm_free_frame(frame);
+      e = old;
+    }
   }
   return virt_to_ptr(e & 0x000FFFFFFFFFF000ULL);
 }
-void vmm_init(void) {}
+// Tables outside buddy memory (the boot tables) share one lock
+static spinlock_t g_boot_ptl;
+static page_table_t *g_kernel_pml4 = 0;
+static inline uint64_t read_cr3(void) {
+  uint64_t cr3;
+  __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+  return cr3;
+}
+void vmm_init(void) {
+  g_kernel_pml4 = (page_table_t *)(uintptr_t)(read_cr3() & 0x000FFFFFFFFFF000ULL);
+}
+page_table_t *vmm_get_kernel_address_space(void) { return g_kernel_pml4; }
+void vmm_flush_tlb_all(void) {
+  __asm__ volatile("mov %0, %%cr3" : : "r"(read_cr3()) : "memory");
+}
 page_table_t *vmm_create_address_space(void) {
   uint64_t frame = pmm_alloc_frame();
   if (frame == 0)
@@ -33,36 +65,113 @@ page_table_t *vmm_create_address_space(void) {
   return (page_table_t *)(uintptr_t)frame;
 }
 void vmm_switch_address_space(page_table_t *pml4) { (void)pml4; }
-void vmm_map_page(page_table_t *pml4, uint64_t virt, uint64_t phys,
-                  uint32_t flags) {
+page_table_t *vmm_get_current_address_space(void) {
+  return (page_table_t *)(uintptr_t)(read_cr3() & 0x000FFFFFFFFFF000ULL);
+}
+uint64_t *vmm_alloc_pte(page_table_t *pml4, uint64_t virt) {
   uint64_t *pml4t = virt_to_ptr((uint64_t)(uintptr_t)pml4);
   uint64_t *pdpt = get_or_alloc(pml4t, ADDR_PML4_INDEX(virt));
   if (!pdpt)
-    return;
+    return 0;
   uint64_t *pd = get_or_alloc(pdpt, ADDR_PDPT_INDEX(virt));
   if (!pd)
-    return;
+    return 0;
   uint64_t *pt = get_or_alloc(pd, ADDR_PD_INDEX(virt));
   if (!pt)
+    return 0;
+  return &pt[ADDR_PT_INDEX(virt)];
+}
+spinlock_t *vmm_pte_lock(uint64_t *pte) {
+  page_t *page = buddy_phys_to_page((uint64_t)(uintptr_t)pte & ~(PAGE_SIZE - 1));
+  return page ? &page->ptl : &g_boot_ptl;
+}
+void vmm_map_page(page_table_t *pml4, uint64_t virt, uint64_t phys,
+                  uint32_t flags) {
+  uint64_t *pte = vmm_alloc_pte(pml4, virt);
+  if (!pte)
     return;
-  pt[ADDR_PT_INDEX(virt)] =
-      (phys & 0x000FFFFFFFFFF000ULL) | (flags & 0xFFF) | VMM_FLAG_PRESENT;
+  *pte = (phys & 0x000FFFFFFFFFF000ULL) | (flags & 0xFFF) | VMM_FLAG_PRESENT;
+  rmap_add(pml4, virt, phys);
 }
 void vmm_unmap_page(page_table_t *pml4, uint64_t virt) {
+  uint64_t *pte = vmm_get_pte(pml4, virt);
+  if (!pte || !(*pte & VMM_FLAG_PRESENT))
+    return;
+  *pte = 0;
+  tlb_flush_page(virt);
+}
+uint64_t vmm_unmap_page_deferred(page_table_t *pml4, uint64_t virt,
+                                 struct tlb_gather *tlb) {
+  uint64_t *pte = vmm_get_pte(pml4, virt);
+  if (!pte || !(*pte & VMM_FLAG_PRESENT))
+    return 0;
+  uint64_t phys = *pte & 0x000FFFFFFFFFF000ULL;
+  *pte = 0;
+  if (tlb)
+    tlb_gather_page(tlb, virt);
+  return phys;
+}
+// Entry that maps virt: a PTE, or a PDPT/PD entry with the PS bit set
+// (*huge is then 1); NULL if a table above it is missing
+static uint64_t *lookup_entry(page_table_t *pml4, uint64_t virt, int *huge) {
+  *huge = 0;
   uint64_t *pml4t = virt_to_ptr((uint64_t)(uintptr_t)pml4);
   uint64_t e = pml4t[ADDR_PML4_INDEX(virt)];
   if (!(e & VMM_FLAG_PRESENT))
-    return;
+    return 0;
   uint64_t *pdpt = virt_to_ptr(e & 0x000FFFFFFFFFF000ULL);
   e = pdpt[ADDR_PDPT_INDEX(virt)];
   if (!(e & VMM_FLAG_PRESENT))
-    return;
+    return 0;
+  if (e & VMM_FLAG_HUGE) {
+    *huge = 1;
+    return &pdpt[ADDR_PDPT_INDEX(virt)];
+  }
   uint64_t *pd = virt_to_ptr(e & 0x000FFFFFFFFFF000ULL);
   e = pd[ADDR_PD_INDEX(virt)];
   if (!(e & VMM_FLAG_PRESENT))
-    return;
+    return 0;
+  if (e & VMM_FLAG_HUGE) {
+    *huge = 1;
+    return &pd[ADDR_PD_INDEX(virt)];
+  }
   uint64_t *pt = virt_to_ptr(e & 0x000FFFFFFFFFF000ULL);
-  pt[ADDR_PT_INDEX(virt)] = 0;
+  return &pt[ADDR_PT_INDEX(virt)];
+}
+uint64_t *vmm_get_pte(page_table_t *pml4, uint64_t virt) {
+  int huge;
+  uint64_t *pte = lookup_entry(pml4, virt, &huge);
+  return huge ? 0 : pte;
+}
+uint64_t vmm_get_huge_entry(page_table_t *pml4, uint64_t virt) {
+  int huge;
+  uint64_t *entry = lookup_entry(pml4, virt, &huge);
+  return huge ? *entry : 0;
+}
+#define VMM_USER_PML4_ENTRIES 256
+static int walk_table(uint64_t *table, int level, uint64_t base,
+                      vmm_pte_visit_t visit, void *arg) {
+  size_t entries = level == 4 ? VMM_USER_PML4_ENTRIES : PT_ENTRIES;
+  for (size_t i = 0; i < entries; i++) {
+    uint64_t e = table[i];
+    if (!(e & VMM_FLAG_PRESENT))
+      continue;
+    uint64_t virt = base + ((uint64_t)i << (12 + 9 * (level - 1)));
+    int r;
+    if (level == 1)
+      r = visit(virt, &table[i], arg);
+    else if (e & VMM_FLAG_HUGE)
+      continue;
+    else
+      r = walk_table(virt_to_ptr(e & 0x000FFFFFFFFFF000ULL), level - 1, virt,
+                     visit, arg);
+    if (r)
+      return r;
+  }
+  return 0;
+}
+int vmm_walk_user_ptes(page_table_t *pml4, vmm_pte_visit_t visit, void *arg) {
+  return walk_table(virt_to_ptr((uint64_t)(uintptr_t)pml4), 4, 0, visit, arg);
 }
 uint64_t vmm_get_physical_address(page_table_t *pml4, uint64_t virt) {
   uint64_t *pml4t = virt_to_ptr((uint64_t)(uintptr_t)pml4);
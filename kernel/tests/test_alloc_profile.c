@@ -0,0 +1,153 @@
+#include "../../include/mm/alloc_profile.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/heap.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+#define LEAK_COUNT 10
+#define CHURN_COUNT 5
+
+static void *g_kept[LEAK_COUNT];
+
+void test_alloc_profile_leak_snapshot(void) {
+    alloc_profile_reset();
+    alloc_profile_snapshot_t *before = alloc_profile_snapshot();
+    TEST_ASSERT(before != NULL, "Snapshot should succeed once enabled");
+    if (!before) {
+        return;
+    }
+
+    // One site keeps its objects, another frees them straight away
+    for (int i = 0; i < LEAK_COUNT; i++) {
+        g_kept[i] = kmalloc(100);
+    }
+    for (int i = 0; i < CHURN_COUNT; i++) {
+        void *tmp = kmalloc(200);
+        kfree(tmp);
+    }
+
+    alloc_profile_snapshot_t *after = alloc_profile_snapshot();
+    TEST_ASSERT(after != NULL, "Second snapshot should succeed");
+    if (!after) {
+        alloc_profile_snapshot_free(before);
+        return;
+    }
+
+    alloc_site_t sites[4];
+    uint32_t n = alloc_profile_diff(before, after, ALLOC_PROFILE_BY_LIVE_BYTES, sites, 4);
+    TEST_ASSERT(n == 1, "Only the leaking site should grow (slab/buddy calls are not double counted)");
+    if (n >= 1) {
+        TEST_ASSERT(sites[0].type == ALLOC_PROFILE_KMALLOC, "Leaking site should be a kmalloc site");
+        TEST_ASSERT(sites[0].live_objects == LEAK_COUNT, "All kept objects should be live");
+        TEST_ASSERT(sites[0].live_bytes == LEAK_COUNT * 100, "Live bytes should match the requests");
+        TEST_ASSERT(sites[0].stack[0] != 0, "Site should record its caller");
+    }
+
+    n = alloc_profile_diff(before, after, ALLOC_PROFILE_BY_ALLOCS, sites, 4);
+    TEST_ASSERT(n == 2, "Both sites should show up as allocating");
+    if (n == 2) {
+        TEST_ASSERT(sites[0].allocs == LEAK_COUNT && sites[1].allocs == CHURN_COUNT,
+                    "Hot sites should be ranked by allocation count");
+        TEST_ASSERT(sites[1].frees == CHURN_COUNT && sites[1].live_objects == 0,
+                    "Freed objects should be charged back to their site");
+
+        uint64_t lifetimes = 0;
+        for (uint32_t b = 0; b < ALLOC_PROFILE_HIST_BUCKETS; b++) {
+            lifetimes += sites[1].lifetime[b];
+        }
+        TEST_ASSERT(lifetimes == CHURN_COUNT, "Every free should land in the lifetime histogram");
+    }
+
+    for (int i = 0; i < LEAK_COUNT; i++) {
+        kfree(g_kept[i]);
+    }
+
+    alloc_profile_snapshot_t *cleaned = alloc_profile_snapshot();
+    if (cleaned) {
+        n = alloc_profile_diff(before, cleaned, ALLOC_PROFILE_BY_LIVE_BYTES, sites, 4);
+        TEST_ASSERT(n == 0, "No site should grow once the objects are freed");
+        alloc_profile_snapshot_free(cleaned);
+    }
+
+    alloc_profile_snapshot_free(after);
+    alloc_profile_snapshot_free(before);
+}
+
+void test_alloc_profile_buddy_site(void) {
+    alloc_profile_reset();
+    alloc_profile_snapshot_t *before = alloc_profile_snapshot();
+    if (!before) {
+        TEST_ASSERT(0, "Snapshot should succeed once enabled");
+        return;
+    }
+
+    uint64_t page = buddy_alloc_pages(1, BUDDY_ZONE_UNMOVABLE);
+    TEST_ASSERT(page != 0, "Order-1 allocation should succeed");
+
+    alloc_profile_snapshot_t *after = alloc_profile_snapshot();
+    if (after) {
+        alloc_site_t sites[2];
+        uint32_t n = alloc_profile_diff(before, after, ALLOC_PROFILE_BY_LIVE_BYTES, sites, 2);
+        TEST_ASSERT(n == 1 && sites[0].type == ALLOC_PROFILE_BUDDY, "Page allocation should be a buddy site");
+        TEST_ASSERT(n == 1 && sites[0].live_bytes == 2 * BUDDY_PAGE_SIZE, "Buddy site should count whole pages");
+        alloc_profile_snapshot_free(after);
+    }
+
+    if (page) {
+        buddy_free_pages(page, 1);
+    }
+
+    alloc_profile_stats_t stats;
+    alloc_profile_get_stats(&stats);
+    TEST_ASSERT(stats.live_tracked == 0, "Freed page should leave the live table");
+
+    alloc_profile_snapshot_free(before);
+}
+
+void test_alloc_profile_disabled(void) {
+    alloc_profile_reset();
+    alloc_profile_disable();
+    TEST_ASSERT(!alloc_profile_is_enabled(), "Profiler should report disabled");
+
+    void *ptr = kmalloc(64);
+    kfree(ptr);
+
+    alloc_profile_stats_t stats;
+    alloc_profile_get_stats(&stats);
+    TEST_ASSERT(stats.sites == 0, "Nothing should be recorded while disabled");
+}
+
+void run_alloc_profile_tests(void) {
+    kprintf("\nRunning allocation profiler tests...\n");
+
+    TEST_ASSERT(!alloc_profile_is_enabled(), "Profiler should start disabled");
+#if !ALLOC_PROFILE
+    // Default build: only the compiled-out stubs can be checked
+    TEST_ASSERT(alloc_profile_enable() != 0, "Enabling should fail without ALLOC_PROFILE");
+    TEST_ASSERT(alloc_profile_snapshot() == NULL, "No snapshot without ALLOC_PROFILE");
+    kprintf("Allocation profiler not built (make ALLOC_PROFILE=1): %d/%d passed\n",
+            test_passed, test_count);
+    return;
+#endif
+    if (alloc_profile_enable() != 0) {
+        kprintf("Allocation profiler unavailable - skipping\n");
+        return;
+    }
+
+    test_alloc_profile_leak_snapshot();
+    test_alloc_profile_buddy_site();
+    test_alloc_profile_disabled();
+
+    kprintf("Allocation profiler tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -0,0 +1,150 @@
+#include "../../include/mm/arena.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/stdio.h"
+#include "../../include/kernel/string.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+void test_arena_basic(void) {
+    uint64_t free_before = buddy_get_free_pages();
+
+    mem_arena_t arena;
+    arena_init(&arena, "test-basic", 0);
+    TEST_ASSERT(arena.chunks == 0, "A fresh arena should not hold any chunks");
+
+    uint8_t *objs[64];
+    int aligned = 1;
+    for (int i = 0; i < 64; i++) {
+        objs[i] = (uint8_t *)arena_alloc(&arena, 24);
+        if (!objs[i] || ((uintptr_t)objs[i] & (ARENA_DEFAULT_ALIGN - 1))) {
+            aligned = 0;
+            continue;
+        }
+        memset(objs[i], i, 24);
+    }
+    TEST_ASSERT(aligned, "Allocations should succeed at the default alignment");
+    TEST_ASSERT(arena.chunks == 1, "Small objects should share one chunk");
+
+    int intact = 1;
+    for (int i = 0; i < 64; i++) {
+        if (objs[i] && (objs[i][0] != (uint8_t)i || objs[i][23] != (uint8_t)i)) {
+            intact = 0;
+        }
+    }
+    TEST_ASSERT(intact, "Objects should not overlap");
+
+    arena_destroy(&arena);
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Destroy should return every chunk");
+}
+
+void test_arena_alignment(void) {
+    mem_arena_t arena;
+    arena_init(&arena, "test-align", 0);
+
+    arena_alloc(&arena, 1);
+    void *line = arena_alloc_aligned(&arena, 8, 64);
+    TEST_ASSERT(line && ((uintptr_t)line & 63) == 0, "Cache-line alignment should be honoured");
+
+    void *page = arena_alloc_aligned(&arena, 8, BUDDY_PAGE_SIZE);
+    TEST_ASSERT(page && ((uintptr_t)page & (BUDDY_PAGE_SIZE - 1)) == 0,
+                "Page alignment should be honoured");
+
+    TEST_ASSERT(arena_alloc_aligned(&arena, 8, 24) == NULL, "Non power-of-two alignment should fail");
+    TEST_ASSERT(arena_alloc(&arena, 0) == NULL, "Zero-byte allocation should fail");
+
+    arena_destroy(&arena);
+}
+
+void test_arena_large_request(void) {
+    mem_arena_t arena;
+    arena_init(&arena, "test-large", 0);
+
+    uint8_t *buf = (uint8_t *)arena_alloc(&arena, 3 * BUDDY_PAGE_SIZE);
+    TEST_ASSERT(buf != NULL, "Request larger than a chunk should get its own chunk");
+    if (buf) {
+        buf[0] = 1;
+        buf[3 * BUDDY_PAGE_SIZE - 1] = 2;
+        TEST_ASSERT(arena.current->order == 2, "Oversized chunk should use the smallest fitting order");
+    }
+
+    arena_destroy(&arena);
+}
+
+void test_arena_mark_rewind(void) {
+    uint64_t free_before = buddy_get_free_pages();
+
+    mem_arena_t arena;
+    arena_init(&arena, "test-mark", 0);
+    arena_alloc(&arena, 32);
+
+    arena_mark_t mark = arena_mark(&arena);
+    size_t used = arena.allocated;
+    void *first = arena_alloc(&arena, 100);
+
+    // Spill into several more chunks
+    for (int i = 0; i < 512; i++) {
+        arena_alloc(&arena, 48);
+    }
+    TEST_ASSERT(arena.chunks > 1, "Scratch allocations should span several chunks");
+
+    arena_rewind(&arena, mark);
+    TEST_ASSERT(arena.chunks == 1, "Rewind should release chunks started after the mark");
+    TEST_ASSERT(arena.allocated == used, "Rewind should restore the allocated byte count");
+    TEST_ASSERT(arena_alloc(&arena, 100) == first, "Memory after the mark should be reused");
+
+    // The emptied chunk is kept as a spare, so a reset and refill stays off buddy
+    arena_reset(&arena);
+    uint64_t free_reset = buddy_get_free_pages();
+    arena_alloc(&arena, 64);
+    TEST_ASSERT(buddy_get_free_pages() == free_reset, "Refill after reset should reuse the spare chunk");
+
+    arena_destroy(&arena);
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Destroy should release the spare chunk too");
+}
+
+void test_arena_zalloc(void) {
+    mem_arena_t arena;
+    arena_init(&arena, "test-zero", 0);
+
+    // Dirty the chunk, rewind, and check zalloc clears the reused bytes
+    arena_mark_t mark = arena_mark(&arena);
+    uint8_t *dirty = (uint8_t *)arena_alloc(&arena, 256);
+    if (dirty) {
+        memset(dirty, 0xAA, 256);
+    }
+    arena_rewind(&arena, mark);
+
+    uint8_t *buf = (uint8_t *)arena_zalloc(&arena, 256);
+    int all_zero = buf != NULL;
+    for (int i = 0; buf && i < 256; i++) {
+        if (buf[i] != 0) {
+            all_zero = 0;
+            break;
+        }
+    }
+    TEST_ASSERT(all_zero, "arena_zalloc should zero-fill memory");
+
+    arena_destroy(&arena);
+}
+
+void run_arena_tests(void) {
+    kprintf("\nRunning arena allocator tests...\n");
+
+    test_arena_basic();
+    test_arena_alignment();
+    test_arena_large_request();
+    test_arena_mark_rewind();
+    test_arena_zalloc();
+
+    kprintf("Arena tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -1,4 +1,5 @@
 #include "../../include/mm/buddy.h"
+#include "../../include/mm/page.h"
 #include "../../include/kernel/stdio.h"
 
 static int test_count = 0;
@@ -70,12 +71,58 @@ void test_buddy_zone_separation(void) {
     uint64_t addr_movable = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
     
     TEST_ASSERT(addr_unmovable != 0, "Unmovable zone allocation should succeed");
+    TEST_ASSERT(addr_reclaimable != 0, "Reclaimable request should fall back to a populated zone");
+    TEST_ASSERT(addr_movable != 0, "Movable request should fall back to a populated zone");
     
     if (addr_unmovable) buddy_free_pages(addr_unmovable, 0);
     if (addr_reclaimable) buddy_free_pages(addr_reclaimable, 0);
     if (addr_movable) buddy_free_pages(addr_movable, 0);
 }
 
+void test_buddy_zone_fallback_free(void) {
+    // A fallback allocation must be freed back to the zone it came from
+    uint64_t free_before = buddy_get_free_pages();
+    uint64_t addr = buddy_alloc_pages(1, BUDDY_ZONE_MOVABLE);
+    TEST_ASSERT(addr != 0, "Movable allocation should succeed via fallback");
+    
+    if (addr) {
+        page_t *page = buddy_phys_to_page(addr);
+        TEST_ASSERT(page != NULL && page->order == 1, "Page descriptor should record the order");
+        buddy_free_pages(addr, 1);
+        TEST_ASSERT(buddy_get_free_pages() == free_before, "Free pages should be restored in the owning zone");
+        
+        // The freed block should be reusable right away
+        uint64_t again = buddy_alloc_pages(1, BUDDY_ZONE_UNMOVABLE);
+        TEST_ASSERT(again != 0, "Freed block should be allocatable again");
+        if (again) buddy_free_pages(again, 1);
+    }
+}
+
+void test_buddy_bulk_alloc(void) {
+    uint64_t pages[16];
+    uint64_t free_before = buddy_get_free_pages();
+    
+    uint32_t got = buddy_alloc_pages_bulk(16, BUDDY_ZONE_MOVABLE, pages);
+    TEST_ASSERT(got == 16, "Bulk allocation should fill the request");
+    TEST_ASSERT(buddy_get_free_pages() == free_before - got, "Each bulk page should be accounted");
+    
+    int distinct = 1;
+    for (uint32_t i = 0; i < got; i++) {
+        page_t *page = buddy_phys_to_page(pages[i]);
+        if (!page || page->order != 0 || pages[i] % BUDDY_PAGE_SIZE != 0) distinct = 0;
+        for (uint32_t j = 0; j < i; j++) {
+            if (pages[j] == pages[i]) distinct = 0;
+        }
+    }
+    TEST_ASSERT(distinct, "Bulk pages should be distinct single pages");
+    
+    for (uint32_t i = 0; i < got; i++) {
+        buddy_free_pages(pages[i], 0);
+    }
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Bulk pages should free individually");
+    TEST_ASSERT(buddy_alloc_pages_bulk(0, BUDDY_ZONE_MOVABLE, pages) == 0, "An empty request should allocate nothing");
+}
+
 void test_buddy_statistics(void) {
     uint64_t total_pages = buddy_get_total_pages();
     uint64_t free_pages = buddy_get_free_pages();
@@ -124,6 +171,8 @@ void run_buddy_tests(void) {
     test_buddy_coalescing();
     test_buddy_order_stats();
     test_buddy_zone_separation();
+    test_buddy_zone_fallback_free();
+    test_buddy_bulk_alloc();
     test_buddy_statistics();
     test_buddy_debug_functions();
     
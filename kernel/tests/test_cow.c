@@ -172,6 +172,62 @@ void test_cow_fault_handler_multi_ref(void) {
     cow_decrement_ref(phys);
 }
 
+// Breaking COW replaces the frame but must keep the entry's flags, NX in
+// particular
+void test_cow_fault_keeps_no_execute(void) {
+    page_table_t *pml4_1 = vmm_create_address_space();
+    page_table_t *pml4_2 = vmm_create_address_space();
+    uint64_t phys = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (!pml4_1 || !pml4_2 || !phys) return;
+    
+    uint64_t virt = 0x400000;
+    vmm_map_page(pml4_1, virt, phys, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    vmm_map_page(pml4_2, virt, phys, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    cow_mark_page(pml4_1, virt);
+    cow_mark_page(pml4_2, virt);
+    uint64_t *pte = vmm_get_pte(pml4_1, virt);
+    *pte |= VMM_FLAG_NO_EXECUTE;
+    
+    TEST_ASSERT(cow_handle_fault(pml4_1, virt) == 0, "COW copy should succeed");
+    TEST_ASSERT((*pte & VMM_FLAG_NO_EXECUTE) && (*pte & VMM_FLAG_WRITABLE),
+                "The copy should stay no-execute");
+    uint64_t new_phys = vmm_get_physical_address(pml4_1, virt);
+    
+    // A second writer that waited for the lock finds the copy in place
+    uint64_t resolved = *pte;
+    TEST_ASSERT(cow_handle_fault(pml4_1, virt) == 0 && *pte == resolved,
+                "A fault already resolved should leave the entry alone");
+    TEST_ASSERT(cow_get_ref_count(phys) == 1, "The late writer should not drop a reference");
+    spinlock_t *ptl = vmm_pte_lock(pte);
+    TEST_ASSERT(spinlock_try_acquire(ptl), "The fault should release the page-table lock");
+    spinlock_release(ptl);
+    
+    // First write to a zero-fill page
+    uint64_t zero_page = cow_zero_page();
+    if (zero_page) {
+        uint64_t zero_virt = 0x401000;
+        vmm_map_page(pml4_1, zero_virt, zero_page, VMM_FLAG_USER);
+        uint64_t *zero_pte = vmm_get_pte(pml4_1, zero_virt);
+        *zero_pte |= COW_FLAG_MASK | VMM_FLAG_NO_EXECUTE;
+        
+        TEST_ASSERT(cow_handle_fault(pml4_1, zero_virt) == 0, "Zero page break should succeed");
+        TEST_ASSERT((*zero_pte & VMM_FLAG_NO_EXECUTE) && (*zero_pte & VMM_FLAG_WRITABLE) &&
+                    !(*zero_pte & COW_FLAG_MASK), "The zero page break should stay no-execute");
+        uint64_t zero_copy = vmm_get_physical_address(pml4_1, zero_virt);
+        vmm_unmap_page(pml4_1, zero_virt);
+        if (zero_copy && zero_copy != zero_page) {
+            buddy_free_pages(zero_copy, 0);
+        }
+    }
+    
+    vmm_unmap_page(pml4_1, virt);
+    vmm_unmap_page(pml4_2, virt);
+    if (new_phys && new_phys != phys) {
+        buddy_free_pages(new_phys, 0);
+    }
+    cow_decrement_ref(phys);
+}
+
 void test_cow_multi_process_sharing(void) {
     // Simulate multiple processes sharing pages
     page_table_t *pml4_1 = vmm_create_address_space();
@@ -232,6 +288,88 @@ void test_cow_multi_process_sharing(void) {
     buddy_free_pages(phys, 0);
 }
 
+void test_cow_clone_address_space(void) {
+    uint64_t free_before = buddy_get_free_pages();
+    
+    page_table_t *parent = vmm_create_address_space();
+    uint64_t data = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    uint64_t text = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    TEST_ASSERT(parent && data && text, "Parent setup should succeed");
+    if (!parent || !data || !text) return;
+    
+    uint8_t *bytes = (uint8_t *)(uintptr_t)data;
+    bytes[0] = 0x5A;
+    
+    uint64_t data_virt = 0x400000;
+    uint64_t text_virt = 0x600000;
+    vmm_map_page(parent, data_virt, data, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    vmm_map_page(parent, text_virt, text, VMM_FLAG_USER);
+    
+    page_table_t *child = cow_clone_address_space(parent);
+    TEST_ASSERT(child != NULL && child != parent, "Clone should create a new address space");
+    if (!child) return;
+    
+    TEST_ASSERT(vmm_get_physical_address(child, data_virt) == data, "Child should map the parent's frame");
+    TEST_ASSERT(vmm_get_physical_address(child, text_virt) == text, "Read-only frames should be shared");
+    
+    uint64_t parent_entry = *vmm_get_pte(parent, data_virt);
+    uint64_t child_entry = *vmm_get_pte(child, data_virt);
+    TEST_ASSERT(!(parent_entry & VMM_FLAG_WRITABLE) && (parent_entry & COW_FLAG_MASK),
+                "Parent's writable entry should become read-only COW");
+    TEST_ASSERT(child_entry == parent_entry, "Child's entry should match the parent's");
+    TEST_ASSERT(cow_get_ref_count(data) == 2, "Both mappings should hold a reference");
+    TEST_ASSERT(cow_get_ref_count(text) == 0, "Read-only frames are not reference counted");
+    TEST_ASSERT(vmm_get_pte(child, text_virt) != vmm_get_pte(parent, text_virt),
+                "Child should have its own page tables");
+    
+    // Child writes: it gets a private copy, the parent keeps the original
+    TEST_ASSERT(cow_handle_fault(child, data_virt) == 0, "Child write fault should succeed");
+    uint64_t copy = vmm_get_physical_address(child, data_virt);
+    TEST_ASSERT(copy != data && ((uint8_t *)(uintptr_t)copy)[0] == 0x5A, "Child should get a copy");
+    TEST_ASSERT(cow_get_ref_count(data) == 1, "Parent should hold the last reference");
+    
+    // Parent's write then just reclaims the frame
+    TEST_ASSERT(cow_handle_fault(parent, data_virt) == 0, "Parent write fault should succeed");
+    TEST_ASSERT(vmm_get_physical_address(parent, data_virt) == data, "Parent should keep its frame");
+    
+    // Clean up: the copy and the original are now private writable frames
+    cow_release_address_space(child);
+    cow_release_address_space(parent);
+    buddy_free_pages(copy, 0);
+    buddy_free_pages(data, 0);
+    buddy_free_pages(text, 0);
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Clone and release should not leak pages");
+}
+
+void test_cow_clone_release_frees_shared(void) {
+    page_table_t *parent = vmm_create_address_space();
+    if (!parent) return;
+    
+    // Two pages in different page tables
+    uint64_t a = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    uint64_t b = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (!a || !b) return;
+    vmm_map_page(parent, 0x400000, a, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    vmm_map_page(parent, 0x40000000, b, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    
+    page_table_t *child = cow_clone_address_space(parent);
+    TEST_ASSERT(child != NULL, "Clone should succeed");
+    if (!child) return;
+    
+    page_table_t *grandchild = cow_clone_address_space(child);
+    TEST_ASSERT(grandchild != NULL, "Cloning a clone should succeed");
+    TEST_ASSERT(cow_get_ref_count(a) == 3 && cow_get_ref_count(b) == 3,
+                "Every generation should add one reference");
+    
+    // Once every sharer is gone the frames go back to buddy
+    uint64_t free_before = buddy_get_free_pages();
+    cow_release_address_space(grandchild);
+    cow_release_address_space(child);
+    cow_release_address_space(parent);
+    TEST_ASSERT(cow_get_ref_count(a) == 0 && cow_get_ref_count(b) == 0, "All references should be dropped");
+    TEST_ASSERT(buddy_get_free_pages() > free_before + 2, "Shared frames and tables should be freed");
+}
+
 void run_cow_tests(void) {
     kprintf("Running COW tests...\n");
     
@@ -240,7 +378,10 @@ void run_cow_tests(void) {
     test_cow_reference_counting();
     test_cow_fault_handler_single_ref();
     test_cow_fault_handler_multi_ref();
+    test_cow_fault_keeps_no_execute();
     test_cow_multi_process_sharing();
+    test_cow_clone_address_space();
+    test_cow_clone_release_frees_shared();
     
     kprintf("COW tests: %d/%d passed\n", test_passed, test_count);
 }
@@ -277,11 +418,15 @@ void test_cow_allocation_failure_handling(void) {
     // Test cow_get_ref with a physical address
     uint64_t phys = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
     if (phys) {
-        page_ref_t *ref = cow_get_ref(phys);
+        page_t *ref = cow_get_ref(phys);
         TEST_ASSERT(ref != NULL, "cow_get_ref should succeed with valid physical address");
         
-        // Clean up
+        // Dropping a reference that was never taken must not free the page
         cow_decrement_ref(phys);
+        TEST_ASSERT(cow_get_ref_count(phys) == 0, "Reference count should not underflow");
+        
+        // Clean up
+        buddy_free_pages(phys, 0);
     }
 }
 
@@ -301,23 +446,31 @@ void test_cow_error_logging_verification(void) {
     TEST_ASSERT(1, "Error logging should not crash the system");
 }
 
-void test_cow_hash_function_distribution(void) {
-    // Test that hash function distributes addresses reasonably
-    // We can't test the actual distribution without many allocations,
-    // but we can verify it doesn't crash and returns valid indices
-    
-    uint64_t test_addresses[] = {
-        0x1000, 0x2000, 0x3000, 0x4000, 0x5000,
-        0x100000, 0x200000, 0x300000, 0x400000, 0x500000
-    };
-    
-    for (int i = 0; i < 10; i++) {
-        page_ref_t *ref = cow_get_ref(test_addresses[i]);
-        if (ref) {
-            TEST_ASSERT(1, "Hash function should handle various addresses");
-            cow_decrement_ref(test_addresses[i]);
-        }
+void test_cow_ref_in_page_descriptor(void) {
+    uint64_t phys = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (!phys) return;
+    
+    // Sharing a frame only touches its descriptor: no memory is allocated
+    uint64_t free_before = buddy_get_free_pages();
+    for (int i = 0; i < 16; i++) {
+        cow_increment_ref(phys);
     }
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Reference counting should not allocate");
+    TEST_ASSERT(cow_get_ref(phys)->refcount == 16, "The count should live in the page descriptor");
+    
+    for (int i = 0; i < 15; i++) {
+        cow_decrement_ref(phys);
+    }
+    TEST_ASSERT(cow_get_ref_count(phys) == 1, "Count should track each decrement");
+    
+    // The last reference frees the frame
+    cow_decrement_ref(phys);
+    TEST_ASSERT(buddy_get_free_pages() == free_before + 1, "Last decrement should free the frame");
+    
+    // Addresses outside buddy-managed memory have no descriptor
+    TEST_ASSERT(cow_get_ref(0) == NULL, "Frames outside buddy memory have no descriptor");
+    cow_increment_ref(0);
+    TEST_ASSERT(cow_get_ref_count(0) == 0, "Untracked frames should report no references");
 }
 
 void run_cow_tests_extended(void) {
@@ -330,7 +483,7 @@ void run_cow_tests_extended(void) {
     test_cow_unmapped_page_handling();
     test_cow_allocation_failure_handling();
     test_cow_error_logging_verification();
-    test_cow_hash_function_distribution();
+    test_cow_ref_in_page_descriptor();
     
     kprintf("Extended COW tests: %d/%d passed\n", 
             test_passed - old_passed, test_count - old_count);
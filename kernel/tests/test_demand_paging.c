@@ -1,6 +1,7 @@
 #include "../../include/mm/demand_paging.h"
 #include "../../include/mm/buddy.h"
 #include "../../include/mm/slab.h"
+#include "../../include/mm/cow.h"
 #include "../../include/kernel/vmm.h"
 #include "../../include/kernel/stdio.h"
 
@@ -129,9 +130,8 @@ void test_zero_fill(void) {
     TEST_ASSERT(phys != 0, "Physical page should be allocated");
     
     if (phys != 0) {
-        // Verify page is zero-filled (using direct physical mapping)
-        uint64_t direct_map_addr = 0xFFFF800000000000ULL + phys;
-        uint8_t *page = (uint8_t *)direct_map_addr;
+        // Verify page is zero-filled (buddy memory is identity-mapped)
+        uint8_t *page = (uint8_t *)(uintptr_t)phys;
         
         int all_zeros = 1;
         for (uint32_t i = 0; i < 4096; i++) {
@@ -241,6 +241,275 @@ void test_multiple_regions(void) {
     demand_paging_unregister_region(pml4, start3);
 }
 
+#define REGION_TREE_TEST_COUNT 64
+
+void test_region_tree(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+
+    if (!pml4) return;
+
+    TEST_ASSERT(demand_paging_find_region(pml4, 0x1000000) == NULL, "An unknown address space should have no regions");
+
+    // Register two-page regions with one-page gaps, in scrambled order
+    uint64_t base = 0x1000000;
+    int registered = 0;
+    for (int i = 0; i < REGION_TREE_TEST_COUNT; i++) {
+        int slot = (i * 37) % REGION_TREE_TEST_COUNT;
+        if (demand_paging_register_region(pml4, base + slot * 0x3000, 0x2000, VM_FLAG_DEMAND_PAGED) == 0) {
+            registered++;
+        }
+    }
+    TEST_ASSERT(registered == REGION_TREE_TEST_COUNT, "All scrambled registrations should succeed");
+
+    vm_address_space_t *as = demand_paging_get_address_space(pml4);
+    TEST_ASSERT(as && as->region_count == REGION_TREE_TEST_COUNT, "The region count should match");
+    TEST_ASSERT(as && as->regions && as->regions->height <= 8, "The tree should stay balanced");
+
+    int found = 0;
+    int gaps = 0;
+    for (int i = 0; i < REGION_TREE_TEST_COUNT; i++) {
+        uint64_t start = base + i * 0x3000;
+        vm_region_t *region = demand_paging_find_region(pml4, start + 0x1FFF);
+        if (region && region->start == start) found++;
+        if (demand_paging_find_region(pml4, start + 0x2000) == NULL) gaps++;
+    }
+    TEST_ASSERT(found == REGION_TREE_TEST_COUNT, "Every region should be found by its last byte");
+    TEST_ASSERT(gaps == REGION_TREE_TEST_COUNT, "Gaps between regions should not match");
+
+    vm_region_t *region = demand_paging_find_region(pml4, base + 0x3000);
+    TEST_ASSERT(region && as->last_hit == region, "A lookup should be cached");
+    TEST_ASSERT(demand_paging_find_region(pml4, base + 0x4000) == region, "A repeated lookup should hit the cache");
+
+    // Overlaps at either edge, or around a region, are rejected
+    TEST_ASSERT(demand_paging_register_region(pml4, base + 0x2000, 0x2000, VM_FLAG_DEMAND_PAGED) != 0,
+                "Overlap with the next region should be rejected");
+    TEST_ASSERT(demand_paging_register_region(pml4, base + 0x4000, 0x1000, VM_FLAG_DEMAND_PAGED) != 0,
+                "Overlap with a region's tail should be rejected");
+    TEST_ASSERT(demand_paging_register_region(pml4, base + 0x2000, 0x4000, VM_FLAG_DEMAND_PAGED) != 0,
+                "A range containing a region should be rejected");
+    TEST_ASSERT(demand_paging_register_region(pml4, base + 0x2000, 0x1000, VM_FLAG_DEMAND_PAGED) == 0,
+                "A region filling a gap exactly should be accepted");
+    demand_paging_unregister_region(pml4, base + 0x2000);
+
+    // Remove every other region; the rest must stay reachable
+    for (int i = 0; i < REGION_TREE_TEST_COUNT; i += 2) {
+        demand_paging_unregister_region(pml4, base + i * 0x3000);
+    }
+    TEST_ASSERT(as->region_count == REGION_TREE_TEST_COUNT / 2, "Removal should update the count");
+    TEST_ASSERT(as->regions && as->regions->height <= 7, "The tree should rebalance after removal");
+
+    found = 0;
+    int removed = 0;
+    for (int i = 0; i < REGION_TREE_TEST_COUNT; i++) {
+        vm_region_t *r = demand_paging_find_region(pml4, base + i * 0x3000);
+        if (i % 2 == 0 && r == NULL) removed++;
+        if (i % 2 == 1 && r != NULL) found++;
+    }
+    TEST_ASSERT(removed == REGION_TREE_TEST_COUNT / 2, "Removed regions should not be found");
+    TEST_ASSERT(found == REGION_TREE_TEST_COUNT / 2, "Remaining regions should still be found");
+
+    for (int i = 1; i < REGION_TREE_TEST_COUNT; i += 2) {
+        demand_paging_unregister_region(pml4, base + i * 0x3000);
+    }
+    TEST_ASSERT(as->regions == NULL && as->region_count == 0, "The tree should be empty after removing everything");
+}
+
+void test_page_table_locks(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+    
+    uint32_t saved_around = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(FAULT_AROUND_MAX_PAGES);
+    
+    // One region across two 2 MiB spans
+    uint64_t span = 0x200000;
+    uint64_t start = 0x40000000;
+    demand_paging_register_region(pml4, start, 2 * span, VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL);
+    
+    TEST_ASSERT(demand_paging_handle_fault(pml4, start) == 0, "Fault in the first span should succeed");
+    uint64_t *pte_a = vmm_get_pte(pml4, start);
+    uint64_t *pte_a2 = vmm_get_pte(pml4, start + span - 0x1000);
+    TEST_ASSERT(pte_a && pte_a2 && vmm_pte_lock(pte_a) == vmm_pte_lock(pte_a2),
+                "Pages of one span should share a lock");
+    
+    // Fault-around stays inside the locked page table
+    for (uint64_t virt = start + span - 0x8000; virt < start + span; virt += 0x1000) {
+        demand_paging_handle_fault(pml4, virt);
+    }
+    TEST_ASSERT(vmm_get_physical_address(pml4, start + span) == 0,
+                "Fault-around should not cross into the next page table");
+    
+    // Hold the first span's lock: a fault in the second span must not need it
+    spinlock_t *lock_a = pte_a ? vmm_pte_lock(pte_a) : 0;
+    if (lock_a) spinlock_acquire(lock_a);
+    TEST_ASSERT(demand_paging_handle_fault(pml4, start + span) == 0,
+                "A fault in another span should not wait for the first span's lock");
+    if (lock_a) spinlock_release(lock_a);
+    
+    uint64_t *pte_b = vmm_get_pte(pml4, start + span);
+    spinlock_t *lock_b = pte_b ? vmm_pte_lock(pte_b) : 0;
+    TEST_ASSERT(lock_b && lock_b != lock_a, "Different spans should have different locks");
+    TEST_ASSERT(lock_b && spinlock_try_acquire(lock_b), "The fault should release its lock");
+    if (lock_b) spinlock_release(lock_b);
+    
+    demand_paging_unregister_region(pml4, start);
+    demand_paging_set_fault_around(saved_around);
+}
+
+void test_zero_page_read_faults(void) {
+    uint64_t zero_page = cow_zero_page();
+    if (!zero_page) {
+        kprintf("Zero page unavailable - skipping\n");
+        return;
+    }
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+    
+    // Count one fault per page
+    uint32_t saved_around = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(0);
+    
+    uint64_t start = 0x800000;
+    uint64_t pages = 8;
+    demand_paging_register_region(pml4, start, pages * 0x1000,
+                                  VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL);
+    
+    // Map the page tables first so only data pages are counted below
+    TEST_ASSERT(demand_paging_handle_fault_flags(pml4, start, 0) == 0, "Read fault should succeed");
+    
+    demand_paging_stats_t before, after;
+    demand_paging_get_stats(&before);
+    uint64_t free_before = buddy_get_free_pages();
+    
+    int all_zero_page = 1;
+    for (uint64_t i = 1; i < pages; i++) {
+        if (demand_paging_handle_fault_flags(pml4, start + i * 0x1000, VM_FAULT_USER) != 0 ||
+            vmm_get_physical_address(pml4, start + i * 0x1000) != zero_page) {
+            all_zero_page = 0;
+        }
+    }
+    TEST_ASSERT(all_zero_page, "Read faults should map the shared zero page");
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Read faults should not allocate memory");
+    
+    demand_paging_get_stats(&after);
+    TEST_ASSERT(after.zero_page_hits - before.zero_page_hits == pages - 1, "Every read fault should count a zero-page hit");
+    
+    uint64_t *pte = vmm_get_pte(pml4, start);
+    TEST_ASSERT(pte && !(*pte & VMM_FLAG_WRITABLE) && (*pte & COW_FLAG_MASK),
+                "The zero page should be mapped read-only and COW");
+    
+    // First write gets a private page; the zero page is left alone
+    TEST_ASSERT(demand_paging_handle_fault_flags(pml4, start, VM_FAULT_PRESENT | VM_FAULT_WRITE) == 0,
+                "Write fault on the zero page should succeed");
+    uint64_t phys = vmm_get_physical_address(pml4, start);
+    TEST_ASSERT(phys != 0 && phys != zero_page, "Write should replace the zero page");
+    TEST_ASSERT(pte && (*pte & VMM_FLAG_WRITABLE) && !(*pte & COW_FLAG_MASK), "Private page should be writable");
+    
+    demand_paging_get_stats(&after);
+    TEST_ASSERT(after.zero_page_breaks - before.zero_page_breaks == 1, "The write should count a zero-page break");
+    
+    // Further faults on the private page change nothing
+    demand_paging_handle_fault_flags(pml4, start, VM_FAULT_WRITE);
+    TEST_ASSERT(vmm_get_physical_address(pml4, start) == phys, "Private page should stay mapped");
+    
+    // Unregistering frees the private page but never the zero page
+    free_before = buddy_get_free_pages();
+    demand_paging_unregister_region(pml4, start);
+    TEST_ASSERT(buddy_get_free_pages() == free_before + 1, "Only the private page should be freed");
+    TEST_ASSERT(cow_zero_page() == zero_page, "The zero page should survive unregistering");
+    demand_paging_set_fault_around(saved_around);
+}
+
+void test_fault_around(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+    
+    uint32_t saved_around = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(16);
+    TEST_ASSERT(demand_paging_get_fault_around() == 16, "The window limit should be settable");
+    
+    uint64_t start = 0xA00000;
+    uint64_t pages = 64;
+    uint32_t flags = VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL;
+    demand_paging_register_region(pml4, start, pages * 0x1000, flags);
+    
+    // Touch pages in order, faulting only where nothing is mapped yet
+    demand_paging_stats_t before, after;
+    demand_paging_get_stats(&before);
+    uint32_t faults = 0;
+    int all_mapped = 1;
+    for (uint64_t i = 0; i < pages; i++) {
+        uint64_t virt = start + i * 0x1000;
+        if (vmm_get_physical_address(pml4, virt) == 0) {
+            demand_paging_handle_fault_flags(pml4, virt, VM_FAULT_USER | VM_FAULT_WRITE);
+            faults++;
+        }
+        if (vmm_get_physical_address(pml4, virt) == 0) all_mapped = 0;
+    }
+    demand_paging_get_stats(&after);
+    
+    TEST_ASSERT(all_mapped, "Every page should end up mapped");
+    TEST_ASSERT(faults <= 8, "A sequential sweep should take far fewer faults than pages");
+    TEST_ASSERT(after.around_mapped - before.around_mapped == pages - faults,
+                "Pages not faulted should be counted as pre-mapped");
+    TEST_ASSERT(after.pages_allocated - before.pages_allocated == pages, "Each page should get its own frame");
+    
+    vm_region_t *region = demand_paging_find_region(pml4, start);
+    TEST_ASSERT(region && region->around_window == 16, "The window should grow to the limit");
+    
+    uint8_t *data = (uint8_t *)(uintptr_t)vmm_get_physical_address(pml4, start + 0x3000);
+    TEST_ASSERT(data && data[0] == 0 && data[4095] == 0, "Pre-mapped zero-fill pages should be zeroed");
+    uint64_t *pte = vmm_get_pte(pml4, start + 0x3000);
+    TEST_ASSERT(pte && (*pte & VMM_FLAG_WRITABLE) && (*pte & VMM_FLAG_USER), "Pre-mapped pages should be private");
+    
+    uint64_t free_before = buddy_get_free_pages();
+    demand_paging_unregister_region(pml4, start);
+    TEST_ASSERT(buddy_get_free_pages() == free_before + pages, "Unregistering should free pre-mapped pages");
+    
+    // Scattered faults leave the window unused and shrink it back
+    demand_paging_register_region(pml4, start, pages * 0x1000, flags);
+    region = demand_paging_find_region(pml4, start);
+    demand_paging_handle_fault_flags(pml4, start, 0);
+    demand_paging_handle_fault_flags(pml4, start + 0x1000, 0);
+    TEST_ASSERT(region && region->around_window == 2, "A sequential fault should grow the window");
+    TEST_ASSERT(vmm_get_physical_address(pml4, start + 0x2000) == cow_zero_page(),
+                "Read fault-around should map the zero page");
+    for (uint64_t i = 8; i < pages; i += 8) {
+        demand_paging_handle_fault_flags(pml4, start + i * 0x1000, 0);
+    }
+    TEST_ASSERT(region && region->around_window == 1, "Unused windows should shrink to one page");
+    TEST_ASSERT(vmm_get_physical_address(pml4, start + 0x9000) == 0, "A one-page window should map nothing extra");
+    
+    // Accessed bits on the last window count as hits
+    demand_paging_handle_fault_flags(pml4, start + 0x21000, 0);
+    demand_paging_handle_fault_flags(pml4, start + 0x22000, 0);
+    pte = vmm_get_pte(pml4, start + 0x23000);
+    if (pte) *pte |= VMM_FLAG_ACCESSED;
+    demand_paging_get_stats(&before);
+    demand_paging_handle_fault_flags(pml4, start + 0x31000, 0);
+    demand_paging_get_stats(&after);
+    TEST_ASSERT(after.around_hits - before.around_hits == 1, "An accessed pre-mapped page should count as a hit");
+    TEST_ASSERT(region && region->around_window == 4, "A used window should grow");
+    
+    demand_paging_unregister_region(pml4, start);
+    
+    // Turned off, every fault maps one page
+    demand_paging_set_fault_around(0);
+    demand_paging_register_region(pml4, start, pages * 0x1000, flags);
+    for (uint64_t i = 0; i < 4; i++) {
+        demand_paging_handle_fault_flags(pml4, start + i * 0x1000, VM_FAULT_WRITE);
+    }
+    TEST_ASSERT(vmm_get_physical_address(pml4, start + 0x4000) == 0, "Disabled fault-around should map nothing extra");
+    demand_paging_unregister_region(pml4, start);
+    
+    demand_paging_set_fault_around(saved_around);
+}
+
 void run_demand_paging_tests(void) {
     kprintf("Running demand paging tests...\n");
     
@@ -252,6 +521,10 @@ void run_demand_paging_tests(void) {
     test_invalid_fault_handling();
     test_region_unregistration();
     test_multiple_regions();
+    test_region_tree();
+    test_page_table_locks();
+    test_zero_page_read_faults();
+    test_fault_around();
     
     kprintf("Demand paging tests: %d/%d passed\n", test_passed, test_count);
 }
@@ -298,7 +571,7 @@ void test_demand_paging_concurrent_faults_simulation(void) {
 }
 
 void test_demand_paging_lock_initialization(void) {
-    // Verify that page_fault_lock is properly initialized
+    // Verify that a region is usable right after registration
     page_table_t *pml4 = vmm_create_address_space();
     if (!pml4) return;
     
@@ -394,9 +667,8 @@ void test_demand_paging_zero_fill_verification(void) {
     
     uint64_t phys = vmm_get_physical_address(pml4, fault_addr);
     if (phys) {
-        // Check if page is zeroed (using direct physical mapping)
-        uint64_t direct_map_addr = 0xFFFF800000000000ULL + phys;
-        uint8_t *page_ptr = (uint8_t *)direct_map_addr;
+        // Check if page is zeroed (buddy memory is identity-mapped)
+        uint8_t *page_ptr = (uint8_t *)(uintptr_t)phys;
         
         int all_zero = 1;
         for (int i = 0; i < 4096; i++) {
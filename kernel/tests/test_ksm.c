@@ -0,0 +1,159 @@
+#include "../../include/mm/ksm.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/demand_paging.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+#define KSM_TEST_FLAGS (VM_FLAG_DEMAND_PAGED | VM_FLAG_MERGEABLE)
+
+// Fault a page in and fill it; frames are identity mapped
+static uint64_t ksm_test_fill(page_table_t *pml4, uint64_t virt, uint8_t value) {
+    demand_paging_handle_fault_flags(pml4, virt, VM_FAULT_WRITE);
+    uint64_t phys = vmm_get_physical_address(pml4, virt);
+    if (phys) {
+        memset((void *)(uintptr_t)phys, value, 4096);
+    }
+    return phys;
+}
+
+void test_ksm_merge_duplicates(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+
+    uint64_t start = 0xA00000;
+    TEST_ASSERT(demand_paging_register_region(pml4, start, 6 * 0x1000, KSM_TEST_FLAGS) == 0,
+                "Mergeable region registration should succeed");
+
+    // Two identical pages, two zero pages, and two that differ
+    ksm_test_fill(pml4, start, 0xA5);
+    ksm_test_fill(pml4, start + 0x1000, 0xA5);
+    ksm_test_fill(pml4, start + 0x2000, 0);
+    ksm_test_fill(pml4, start + 0x3000, 0);
+    uint64_t unique = ksm_test_fill(pml4, start + 0x4000, 0x5A);
+    uint64_t near = ksm_test_fill(pml4, start + 0x5000, 0xA5);
+    if (!unique || !near) return;
+    ((uint8_t *)(uintptr_t)near)[4095] = 0;
+
+    ksm_stats_t before, after;
+    ksm_get_stats(&before);
+    uint64_t free_before = buddy_get_free_pages();
+
+    // Enough for a few full passes
+    uint32_t merged = ksm_scan(64);
+    TEST_ASSERT(merged == 3, "One duplicate and two zero pages should be merged");
+    spinlock_t *ptl = vmm_pte_lock(vmm_get_pte(pml4, start));
+    TEST_ASSERT(spinlock_try_acquire(ptl), "The scan should release the page-table lock");
+    spinlock_release(ptl);
+    int marked = 0;
+    for (uint64_t virt = start; virt < start + 6 * 0x1000; virt += 0x1000) {
+        uint64_t *pte = vmm_get_pte(pml4, virt);
+        if (pte && (*pte & KSM_PTE_COMPARING)) marked = 1;
+    }
+    TEST_ASSERT(!marked, "No entry should stay write-protected for comparison");
+    TEST_ASSERT(buddy_get_free_pages() == free_before + 3, "Merged frames should be freed");
+
+    uint64_t shared = vmm_get_physical_address(pml4, start);
+    TEST_ASSERT(shared != 0 && vmm_get_physical_address(pml4, start + 0x1000) == shared,
+                "Identical pages should map one frame");
+    TEST_ASSERT(cow_get_ref_count(shared) == 2, "The shared frame should count both mappings");
+    uint64_t *pte = vmm_get_pte(pml4, start + 0x1000);
+    TEST_ASSERT(pte && !(*pte & VMM_FLAG_WRITABLE) && (*pte & COW_FLAG_MASK),
+                "Merged pages should be read-only and COW");
+
+    uint64_t zero_page = cow_zero_page();
+    TEST_ASSERT(!zero_page || (vmm_get_physical_address(pml4, start + 0x2000) == zero_page &&
+                               vmm_get_physical_address(pml4, start + 0x3000) == zero_page),
+                "Zero pages should map the shared zero page");
+    TEST_ASSERT(vmm_get_physical_address(pml4, start + 0x4000) == unique &&
+                vmm_get_physical_address(pml4, start + 0x5000) == near,
+                "Pages with different contents should stay private");
+
+    ksm_get_stats(&after);
+    TEST_ASSERT(after.pages_shared - before.pages_shared == 1 &&
+                after.pages_sharing - before.pages_sharing == 1,
+                "Stats should report one frame shared by one extra mapping");
+    TEST_ASSERT(after.zero_pages_merged - before.zero_pages_merged == 2, "Stats should count the zero pages");
+    TEST_ASSERT(after.full_scans > before.full_scans, "The scan should complete a full pass");
+
+    // A write breaks the sharing with an ordinary COW fault
+    TEST_ASSERT(demand_paging_handle_fault_flags(pml4, start + 0x1000, VM_FAULT_PRESENT | VM_FAULT_WRITE) == 0,
+                "Write fault on a merged page should succeed");
+    uint64_t copy = vmm_get_physical_address(pml4, start + 0x1000);
+    TEST_ASSERT(copy != shared && ((uint8_t *)(uintptr_t)copy)[100] == 0xA5,
+                "The writer should get a private copy of the contents");
+    TEST_ASSERT(cow_get_ref_count(shared) == 1, "The other mapping should keep the frame");
+
+    // The shared frame goes with its last mapping, the zero page never
+    free_before = buddy_get_free_pages();
+    demand_paging_unregister_region(pml4, start);
+    TEST_ASSERT(buddy_get_free_pages() == free_before + 4, "Unregistering should free each frame once");
+}
+
+void test_ksm_stable_merge(void) {
+    page_table_t *spaces[3];
+    uint64_t start = 0xC00000;
+    for (int i = 0; i < 3; i++) {
+        spaces[i] = vmm_create_address_space();
+        if (!spaces[i]) return;
+        demand_paging_register_region(spaces[i], start, 0x1000, KSM_TEST_FLAGS);
+        ksm_test_fill(spaces[i], start, 0x3C);
+    }
+
+    uint32_t merged = ksm_scan(16);
+    uint64_t shared = vmm_get_physical_address(spaces[0], start);
+    TEST_ASSERT(merged == 2, "Pages in different address spaces should be merged");
+    TEST_ASSERT(vmm_get_physical_address(spaces[1], start) == shared &&
+                vmm_get_physical_address(spaces[2], start) == shared,
+                "The third page should join the stable frame");
+    TEST_ASSERT(cow_get_ref_count(shared) == 3, "The stable frame should count every mapping");
+
+    // Rate limiting and the enable switch
+    ksm_stats_t before, after;
+    ksm_set_scan_rate(1, 0);
+    ksm_get_stats(&before);
+    ksm_idle();
+    ksm_get_stats(&after);
+    TEST_ASSERT(after.pages_scanned - before.pages_scanned == 1, "The idle hook should scan pages_to_scan pages");
+
+    ksm_set_enabled(0);
+    ksm_idle();
+    ksm_get_stats(&before);
+    TEST_ASSERT(before.pages_scanned == after.pages_scanned, "A disabled scanner should not run");
+    ksm_set_enabled(1);
+    ksm_set_scan_rate(KSM_DEFAULT_PAGES_TO_SCAN, KSM_DEFAULT_SLEEP_MS);
+
+    for (int i = 0; i < 3; i++) {
+        demand_paging_unregister_region(spaces[i], start);
+    }
+    TEST_ASSERT(cow_get_ref_count(shared) == 0, "The frame should be released with its last mapping");
+
+    // Nothing left to scan
+    ksm_get_stats(&before);
+    TEST_ASSERT(ksm_scan(16) == 0, "Unregistered ranges should not be scanned");
+    ksm_get_stats(&after);
+    TEST_ASSERT(after.pages_scanned == before.pages_scanned, "No pages should be scanned without ranges");
+}
+
+void run_ksm_tests(void) {
+    kprintf("\nRunning same-page merging tests...\n");
+
+    test_ksm_merge_duplicates();
+    test_ksm_stable_merge();
+
+    kprintf("Same-page merging tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -0,0 +1,237 @@
+#include "../../include/mm/page_fault.h"
+#include "../../include/mm/demand_paging.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/ksm.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+#define PF_TEST_BASE 0xC00000
+// Above the 1 GiB the boot tables identity-map with 2 MiB pages
+#define PF_LIVE_BASE 0x80000000ULL
+
+void test_page_fault_dispatch(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+
+    uint32_t saved_around = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(0);
+    page_fault_reset_stats();
+
+    uint64_t base = PF_TEST_BASE;
+    demand_paging_register_region(pml4, base, 4 * 0x1000, VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL);
+
+    // User read of an unmapped page: demand paging maps the zero page
+    TEST_ASSERT(page_fault_dispatch(pml4, base + 0x10, PAGE_FAULT_ERR_USER) == PAGE_FAULT_DEMAND,
+                "A not-present fault should go to demand paging");
+    uint64_t zero_page = cow_zero_page();
+    TEST_ASSERT(!zero_page || vmm_get_physical_address(pml4, base) == zero_page,
+                "A read fault should map the zero page");
+
+    // The write that follows finds it present, read-only and COW
+    uint64_t err = PAGE_FAULT_ERR_PRESENT | PAGE_FAULT_ERR_WRITE | PAGE_FAULT_ERR_USER;
+    if (zero_page) {
+        TEST_ASSERT(page_fault_dispatch(pml4, base + 0x20, err) == PAGE_FAULT_COW,
+                    "A write to the zero page should be a COW fault");
+        uint64_t phys = vmm_get_physical_address(pml4, base);
+        TEST_ASSERT(phys != 0 && phys != zero_page, "The write should get a private page");
+    }
+
+    // Write to a page that is already writable: only the TLB was stale
+    page_fault_dispatch(pml4, base + 0x1000, PAGE_FAULT_ERR_WRITE | PAGE_FAULT_ERR_USER);
+    TEST_ASSERT(page_fault_dispatch(pml4, base + 0x1000, err) == PAGE_FAULT_SPURIOUS,
+                "A fault the entry already allows should be spurious");
+
+    // Unresolvable faults
+    TEST_ASSERT(page_fault_dispatch(pml4, 0x7000000, PAGE_FAULT_ERR_USER) == PAGE_FAULT_FATAL,
+                "A fault outside every region should be fatal");
+    TEST_ASSERT(page_fault_dispatch(pml4, base + 0x1000, err | PAGE_FAULT_ERR_RESERVED) == PAGE_FAULT_FATAL,
+                "A reserved-bit fault should be fatal");
+    TEST_ASSERT(page_fault_dispatch(NULL, base, PAGE_FAULT_ERR_USER) == PAGE_FAULT_FATAL,
+                "A fault without an address space should be fatal");
+
+    uint64_t frame = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+    if (frame) {
+        vmm_map_page(pml4, 0x6000000, frame, VMM_FLAG_PRESENT);
+        TEST_ASSERT(page_fault_dispatch(pml4, 0x6000000, err) == PAGE_FAULT_FATAL,
+                    "A user write to a read-only kernel page should be fatal");
+        uint64_t *pte = vmm_get_pte(pml4, 0x6000000);
+        if (pte) *pte |= VMM_FLAG_USER | VMM_FLAG_NO_EXECUTE;
+        TEST_ASSERT(page_fault_dispatch(pml4, 0x6000000, PAGE_FAULT_ERR_PRESENT | PAGE_FAULT_ERR_USER |
+                                        PAGE_FAULT_ERR_FETCH) == PAGE_FAULT_FATAL,
+                    "A fetch from a no-execute page should be fatal");
+        TEST_ASSERT(page_fault_dispatch(pml4, 0x6000000, PAGE_FAULT_ERR_PRESENT | PAGE_FAULT_ERR_USER) ==
+                    PAGE_FAULT_SPURIOUS, "A read of a readable page should be spurious");
+        vmm_unmap_page(pml4, 0x6000000);
+        buddy_free_pages(frame, 0);
+    }
+
+    page_fault_stats_t stats;
+    page_fault_get_stats(&stats);
+    TEST_ASSERT(stats.count[PAGE_FAULT_DEMAND] == 2 && stats.count[PAGE_FAULT_SPURIOUS] == (frame ? 2 : 1),
+                "Faults should be counted by outcome");
+    TEST_ASSERT(stats.count[PAGE_FAULT_FATAL] == (frame ? 5u : 3u), "Fatal faults should be counted");
+    int histogram_ok = 1;
+    for (uint32_t t = 0; t < PAGE_FAULT_TYPES; t++) {
+        uint64_t sum = 0;
+        for (uint32_t b = 0; b < PAGE_FAULT_HIST_BUCKETS; b++) {
+            sum += stats.histogram[t][b];
+        }
+        if (sum != stats.count[t]) histogram_ok = 0;
+    }
+    TEST_ASSERT(histogram_ok, "Every fault should land in one histogram bucket");
+
+    page_fault_reset_stats();
+    page_fault_get_stats(&stats);
+    TEST_ASSERT(stats.count[PAGE_FAULT_DEMAND] == 0 && stats.histogram[PAGE_FAULT_DEMAND][0] == 0,
+                "Reset should clear the counters");
+
+    demand_paging_unregister_region(pml4, base);
+    demand_paging_set_fault_around(saved_around);
+}
+
+void test_page_fault_huge_entry(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    uint64_t pdpt = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    TEST_ASSERT(pml4 != 0 && pdpt != 0, "Table allocation should succeed");
+    if (!pml4 || !pdpt) return;
+
+    // A read-only 1 GiB page at 1 GiB, like the boot identity map
+    uint64_t *pdpt_table = (uint64_t *)(uintptr_t)pdpt;
+    for (uint32_t i = 0; i < 512; i++) {
+        pdpt_table[i] = 0;
+    }
+    pdpt_table[1] = 0x40000000ULL | VMM_FLAG_PRESENT | VMM_FLAG_HUGE;
+    pml4[0] = pdpt | VMM_FLAG_PRESENT | VMM_FLAG_WRITABLE | VMM_FLAG_USER;
+
+    uint64_t addr = 0x40201000;
+    TEST_ASSERT(vmm_get_pte(pml4, addr) == 0, "A huge page should have no 4 KB entry");
+    TEST_ASSERT(vmm_alloc_pte(pml4, addr) == 0, "No table should be allocated under a huge page");
+    TEST_ASSERT(vmm_get_huge_entry(pml4, addr) == pdpt_table[1], "The huge entry should be found");
+
+    page_fault_reset_stats();
+    TEST_ASSERT(page_fault_dispatch(pml4, addr, PAGE_FAULT_ERR_PRESENT) == PAGE_FAULT_SPURIOUS,
+                "A read the huge entry allows should be spurious");
+    TEST_ASSERT(page_fault_dispatch(pml4, addr, PAGE_FAULT_ERR_PRESENT | PAGE_FAULT_ERR_WRITE) ==
+                PAGE_FAULT_FATAL, "A write to a read-only huge page should be fatal");
+    TEST_ASSERT(pdpt_table[1] == (0x40000000ULL | VMM_FLAG_PRESENT | VMM_FLAG_HUGE),
+                "The huge entry should be left alone");
+
+    pml4[0] = 0;
+    buddy_free_pages(pdpt, 0);
+    buddy_free_pages((uint64_t)(uintptr_t)pml4, 0);
+}
+
+// A write to a page KSM has write-protected for comparison must wait for
+// KSM rather than halt
+void test_page_fault_ksm_compare(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    uint64_t frame = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+    if (!pml4 || !frame) return;
+
+    uint64_t virt = 0x500000;
+    vmm_map_page(pml4, virt, frame, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    uint64_t *pte = vmm_get_pte(pml4, virt);
+    uint64_t err = PAGE_FAULT_ERR_PRESENT | PAGE_FAULT_ERR_WRITE | PAGE_FAULT_ERR_USER;
+
+    // The entry as ksm_write_protect() leaves it
+    *pte = (*pte & ~(uint64_t)VMM_FLAG_WRITABLE) | KSM_PTE_COMPARING;
+    TEST_ASSERT(page_fault_dispatch(pml4, virt, err) == PAGE_FAULT_SPURIOUS,
+                "A write during a KSM comparison should be retried");
+    TEST_ASSERT((*pte & KSM_PTE_COMPARING) && !(*pte & VMM_FLAG_WRITABLE),
+                "The retry should leave the entry to KSM");
+
+    // A plain read-only private page is still a protection violation
+    *pte &= ~(uint64_t)KSM_PTE_COMPARING;
+    TEST_ASSERT(page_fault_dispatch(pml4, virt, err) == PAGE_FAULT_FATAL,
+                "A write to a read-only page should be fatal");
+
+    vmm_unmap_page(pml4, virt);
+    buddy_free_pages(frame, 0);
+    cow_release_address_space(pml4);
+}
+
+void test_page_fault_cow_clone(void) {
+    page_table_t *parent = vmm_create_address_space();
+    if (!parent) return;
+
+    uint64_t frame = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+    if (!frame) return;
+    vmm_map_page(parent, 0x400000, frame, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+
+    // A clone has no regions: its COW faults go straight to the COW code
+    page_table_t *child = cow_clone_address_space(parent);
+    TEST_ASSERT(child != 0, "Clone should succeed");
+    if (!child) return;
+
+    uint64_t err = PAGE_FAULT_ERR_PRESENT | PAGE_FAULT_ERR_WRITE | PAGE_FAULT_ERR_USER;
+    TEST_ASSERT(page_fault_dispatch(child, 0x400123, err) == PAGE_FAULT_COW, "A write in the clone should be COW");
+    uint64_t copy = vmm_get_physical_address(child, 0x400000);
+    TEST_ASSERT(copy != 0 && copy != frame, "The clone should get its own copy");
+    TEST_ASSERT(vmm_get_physical_address(parent, 0x400000) == frame, "The parent should keep the original");
+    TEST_ASSERT(page_fault_dispatch(child, 0x400000, err) == PAGE_FAULT_SPURIOUS,
+                "A repeated write should find the page writable");
+
+    cow_release_address_space(child);
+    cow_release_address_space(parent);
+}
+
+// Real #PF through the IDT: touch unmapped pages of a region registered in
+// the running address space and let the handler fill them
+void test_page_fault_live(void) {
+    page_table_t *pml4 = vmm_get_current_address_space();
+    uint32_t saved_around = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(0);
+    page_fault_reset_stats();
+
+    int registered = demand_paging_register_region(pml4, PF_LIVE_BASE, 2 * 0x1000,
+                                                   VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL) == 0;
+    TEST_ASSERT(registered, "Registering a region in the current address space should succeed");
+    if (!registered) {
+        demand_paging_set_fault_around(saved_around);
+        return;
+    }
+
+    volatile uint64_t *first = (volatile uint64_t *)(uintptr_t)PF_LIVE_BASE;
+    volatile uint64_t *second = (volatile uint64_t *)(uintptr_t)(PF_LIVE_BASE + 0x1000);
+    TEST_ASSERT(first[0] == 0, "A read fault should return zeroes");
+    first[1] = 0x1234;
+    TEST_ASSERT(first[1] == 0x1234, "A write after the read should stick");
+    second[0] = 0x5678;
+    TEST_ASSERT(second[0] == 0x5678, "A write fault should map a writable page");
+
+    page_fault_stats_t stats;
+    page_fault_get_stats(&stats);
+    TEST_ASSERT(stats.count[PAGE_FAULT_DEMAND] == 2, "Both pages should be filled by demand paging");
+    TEST_ASSERT(stats.count[PAGE_FAULT_COW] == (cow_zero_page() ? 1u : 0u),
+                "The write to the zero page should break COW");
+    TEST_ASSERT(stats.count[PAGE_FAULT_FATAL] == 0, "No fault should be fatal");
+
+    demand_paging_unregister_region(pml4, PF_LIVE_BASE);
+    demand_paging_set_fault_around(saved_around);
+}
+
+void run_page_fault_tests(void) {
+    kprintf("\nRunning page fault dispatch tests...\n");
+
+    test_page_fault_dispatch();
+    test_page_fault_huge_entry();
+    test_page_fault_ksm_compare();
+    test_page_fault_cow_clone();
+    test_page_fault_live();
+
+    kprintf("Page fault tests: %d/%d passed\n", test_passed, test_count);
+}
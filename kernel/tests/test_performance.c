@@ -1,6 +1,21 @@
 #include "../../include/mm/cow.h"
 #include "../../include/mm/page_cache.h"
+#include "../../include/mm/tlsf.h"
+#include "../../include/mm/buddy.h"
 #include "../../include/kernel/stdio.h"
+#include "../../include/kernel/heap.h"
+#include "../../include/mm/alloc_profile.h"
+#include "../../include/mm/arena.h"
+#include "../../include/mm/pool.h"
+#include "../../include/mm/slotmap.h"
+#include "../../include/kernel/cpu.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/demand_paging.h"
+#include "../../include/mm/ksm.h"
+#include "../../include/mm/rmap.h"
+#include "../../include/mm/snapshot.h"
+#include "../../include/mm/page_fault.h"
 
 // Simple cycle counter (x86-64 RDTSC)
 static inline uint64_t read_tsc(void) {
@@ -9,56 +24,587 @@ static inline uint64_t read_tsc(void) {
     return ((uint64_t)hi << 32) | lo;
 }
 
-void benchmark_cow_hash_function(void) {
-    kprintf("\n=== COW Hash Function Benchmark ===\n");
+void benchmark_cow_refcount(void) {
+    kprintf("\n=== COW Reference Count Benchmark ===\n");
     
     const int iterations = 10000;
-    uint64_t test_addresses[100];
+    uint64_t pages[100];
+    int count = 0;
     
-    // Generate test addresses
     for (int i = 0; i < 100; i++) {
-        test_addresses[i] = 0x100000 + (i * 0x1000);
+        pages[i] = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+        if (pages[i]) {
+            count++;
+        }
+    }
+    if (count != 100) {
+        kprintf("Skipped: page allocation failed\n");
+        for (int i = 0; i < 100; i++) {
+            if (pages[i]) {
+                buddy_free_pages(pages[i], 0);
+            }
+        }
+        return;
     }
     
-    // Benchmark new hash function (bitwise AND)
+    // Share each page once more and drop it again: one atomic add and one
+    // compare-and-swap on the page descriptor, no lookup structure
+    for (int i = 0; i < 100; i++) {
+        cow_increment_ref(pages[i]);
+    }
+    uint64_t free_before = buddy_get_free_pages();
     uint64_t start = read_tsc();
     for (int iter = 0; iter < iterations; iter++) {
         for (int i = 0; i < 100; i++) {
-            // Simulate hash calculation
-            uint64_t phys_addr = test_addresses[i];
-            phys_addr &= ~0xFFFULL;
-            volatile uint32_t hash = (uint32_t)((phys_addr >> 12) & COW_HASH_MASK);
-            (void)hash;  // Prevent optimization
+            cow_increment_ref(pages[i]);
+            cow_decrement_ref(pages[i]);
         }
     }
     uint64_t end = read_tsc();
-    uint64_t cycles_new = end - start;
+    uint64_t cycles = end - start;
     
-    kprintf("New hash (bitwise AND): %llu cycles for %d iterations\n", 
-            cycles_new, iterations * 100);
-    kprintf("Average: %llu cycles per hash\n", cycles_new / (iterations * 100));
+    kprintf("Increment + decrement: %llu cycles for %d pairs\n", cycles, iterations * 100);
+    kprintf("Average: %llu cycles per pair\n", cycles / (iterations * 100));
+    kprintf("Pages used for reference tracking: %llu\n", free_before - buddy_get_free_pages());
     
-    // Test distribution
-    int buckets[COW_HASH_SIZE] = {0};
-    for (int i = 0; i < 1000; i++) {
-        uint64_t addr = 0x100000 + (i * 0x1000);
-        addr &= ~0xFFFULL;
-        uint32_t hash = (uint32_t)((addr >> 12) & COW_HASH_MASK);
-        if (hash < COW_HASH_SIZE) {
-            buckets[hash]++;
+    // Dropping the last reference frees each page
+    for (int i = 0; i < 100; i++) {
+        cow_decrement_ref(pages[i]);
+    }
+}
+
+#define FORK_BENCH_MAX_PAGES 1024
+
+void benchmark_fork_latency(void) {
+    kprintf("\n=== Fork (Address Space Clone) Benchmark ===\n");
+    
+    static uint64_t frames[FORK_BENCH_MAX_PAGES];
+    const uint64_t base = 0x400000;
+    
+    for (uint32_t pages = 16; pages <= FORK_BENCH_MAX_PAGES; pages *= 4) {
+        page_table_t *parent = vmm_create_address_space();
+        page_table_t *marked = vmm_create_address_space();
+        if (!parent || !marked) {
+            kprintf("Skipped: address space creation failed\n");
+            return;
         }
+        
+        uint32_t mapped = 0;
+        for (uint32_t i = 0; i < pages; i++) {
+            frames[i] = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+            if (!frames[i]) {
+                break;
+            }
+            vmm_map_page(parent, base + (uint64_t)i * 4096, frames[i], VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+            mapped++;
+        }
+        
+        // Per-page marking: two walks and two invlpg per page, plus the
+        // child's mapping
+        uint64_t start = read_tsc();
+        for (uint32_t i = 0; i < mapped; i++) {
+            uint64_t virt = base + (uint64_t)i * 4096;
+            vmm_map_page(marked, virt, frames[i], VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+            cow_mark_page(parent, virt);
+            cow_mark_page(marked, virt);
+        }
+        uint64_t marking_cycles = read_tsc() - start;
+        
+        // One walk of the parent's tables and one flush
+        start = read_tsc();
+        page_table_t *child = cow_clone_address_space(parent);
+        uint64_t clone_cycles = read_tsc() - start;
+        
+        kprintf("%u pages: per-page marking %llu cycles, clone %llu cycles (%llu per page)\n",
+                mapped, marking_cycles, clone_cycles, clone_cycles / (mapped ? mapped : 1));
+        
+        // Each frame now has three references; the last release frees it
+        if (child) {
+            cow_release_address_space(child);
+        }
+        cow_release_address_space(marked);
+        cow_release_address_space(parent);
     }
+}
+
+#define TLB_BENCH_PAGES 256
+
+void benchmark_tlb_gather(void) {
+    kprintf("\n=== TLB Gather Benchmark ===\n");
     
-    // Calculate distribution statistics
-    int min_count = buckets[0];
-    int max_count = buckets[0];
-    for (int i = 1; i < COW_HASH_SIZE; i++) {
-        if (buckets[i] < min_count) min_count = buckets[i];
-        if (buckets[i] > max_count) max_count = buckets[i];
+    page_table_t *pml4 = vmm_create_address_space();
+    uint64_t frame = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (!pml4 || !frame) {
+        kprintf("Skipped: setup failed\n");
+        return;
+    }
+    
+    const uint64_t base = 0x400000;
+    uint32_t saved = tlb_get_flush_threshold();
+    uint32_t thresholds[] = { 1, 8, TLB_DEFAULT_FLUSH_THRESHOLD, TLB_GATHER_MAX };
+    
+    // Unmap ranges of growing size, flushing with one invlpg per page or a
+    // CR3 reload depending on the threshold
+    for (uint32_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+        tlb_set_flush_threshold(thresholds[t]);
+        kprintf("Threshold %u:", thresholds[t]);
+        for (uint32_t pages = 4; pages <= TLB_BENCH_PAGES; pages *= 4) {
+            for (uint32_t i = 0; i < pages; i++) {
+                vmm_map_page(pml4, base + (uint64_t)i * 4096, frame, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+            }
+            
+            uint64_t start = read_tsc();
+            tlb_gather_t tlb;
+            tlb_gather_init(&tlb);
+            for (uint32_t i = 0; i < pages; i++) {
+                vmm_unmap_page_deferred(pml4, base + (uint64_t)i * 4096, &tlb);
+            }
+            tlb_gather_finish(&tlb);
+            uint64_t cycles = read_tsc() - start;
+            kprintf(" %u pages %llu cycles;", pages, cycles);
+        }
+        kprintf("\n");
+    }
+    
+    tlb_set_flush_threshold(saved);
+    buddy_free_pages(frame, 0);
+}
+
+#define ZERO_PAGE_BENCH_PAGES 256
+
+void benchmark_zero_page_faults(void) {
+    kprintf("\n=== Zero Page Fault Benchmark ===\n");
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    if (!pml4) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+    
+    const uint64_t read_base = 0x10000000;
+    const uint64_t write_base = 0x20000000;
+    const uint64_t size = (uint64_t)ZERO_PAGE_BENCH_PAGES * 4096;
+    uint32_t flags = VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL;
+    demand_paging_register_region(pml4, read_base, size, flags);
+    demand_paging_register_region(pml4, write_base, size, flags);
+    
+    // Touch one page of each so page-table allocation is not measured
+    demand_paging_handle_fault_flags(pml4, read_base, 0);
+    demand_paging_handle_fault_flags(pml4, write_base, VM_FAULT_WRITE);
+    
+    // Read-mostly sparse data: every fault maps the shared zero page
+    uint64_t free_before = buddy_get_free_pages();
+    uint64_t start = read_tsc();
+    for (uint64_t i = 1; i < ZERO_PAGE_BENCH_PAGES; i++) {
+        demand_paging_handle_fault_flags(pml4, read_base + i * 4096, VM_FAULT_USER);
+    }
+    uint64_t read_cycles = read_tsc() - start;
+    uint64_t read_pages = free_before - buddy_get_free_pages();
+    
+    // Write faults: a private zeroed frame each
+    free_before = buddy_get_free_pages();
+    start = read_tsc();
+    for (uint64_t i = 1; i < ZERO_PAGE_BENCH_PAGES; i++) {
+        demand_paging_handle_fault_flags(pml4, write_base + i * 4096, VM_FAULT_USER | VM_FAULT_WRITE);
+    }
+    uint64_t write_cycles = read_tsc() - start;
+    uint64_t write_pages = free_before - buddy_get_free_pages();
+    
+    uint64_t faults = ZERO_PAGE_BENCH_PAGES - 1;
+    kprintf("Read faults:  avg %llu cycles, %llu pages allocated\n", read_cycles / faults, read_pages);
+    kprintf("Write faults: avg %llu cycles, %llu pages allocated\n", write_cycles / faults, write_pages);
+    
+    demand_paging_unregister_region(pml4, read_base);
+    demand_paging_unregister_region(pml4, write_base);
+}
+
+#define FAULT_AROUND_BENCH_PAGES 512
+
+void benchmark_fault_around(void) {
+    kprintf("\n=== Fault-Around Benchmark ===\n");
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    if (!pml4) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+    
+    const uint64_t base = 0x30000000;
+    const uint64_t size = (uint64_t)FAULT_AROUND_BENCH_PAGES * 4096;
+    uint32_t saved = demand_paging_get_fault_around();
+    uint32_t windows[] = { 0, 8, FAULT_AROUND_DEFAULT_PAGES, FAULT_AROUND_MAX_PAGES };
+    
+    // Sequential write sweep, faulting only on pages not yet mapped
+    for (uint32_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        demand_paging_set_fault_around(windows[w]);
+        demand_paging_register_region(pml4, base, size, VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL);
+        
+        uint32_t faults = 0;
+        uint64_t start = read_tsc();
+        for (uint64_t i = 0; i < FAULT_AROUND_BENCH_PAGES; i++) {
+            uint64_t virt = base + i * 4096;
+            if (!vmm_get_physical_address(pml4, virt)) {
+                demand_paging_handle_fault_flags(pml4, virt, VM_FAULT_USER | VM_FAULT_WRITE);
+                faults++;
+            }
+        }
+        uint64_t cycles = read_tsc() - start;
+        
+        kprintf("Window %u: %u faults for %u pages, %llu cycles per page\n",
+                windows[w], faults, FAULT_AROUND_BENCH_PAGES, cycles / FAULT_AROUND_BENCH_PAGES);
+        demand_paging_unregister_region(pml4, base);
+    }
+    
+    demand_paging_set_fault_around(saved);
+}
+
+#define SCALING_BENCH_PAGES 64
+
+void benchmark_fault_scaling(void) {
+    kprintf("\n=== Fault Scaling Benchmark ===\n");
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    if (!pml4) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+    
+    // Only the boot CPU runs, so each CPU's fault stream is interleaved on
+    // it; what scales is how many locks the streams are spread over
+    kprintf("CPUs online: %u (streams interleaved on CPU 0)\n", cpu_online_count());
+    
+    const uint64_t base = 0x80000000;
+    const uint64_t span = 512ULL * 4096;
+    uint32_t saved = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(0);
+    
+    for (uint32_t cpus = 1; cpus <= MAX_CPUS; cpus *= 2) {
+        // One shared region; each CPU faults in its own 2 MiB span
+        demand_paging_register_region(pml4, base, cpus * span, VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL);
+        
+        spinlock_t *locks[MAX_CPUS];
+        uint32_t distinct = 0;
+        uint64_t start = read_tsc();
+        for (uint64_t i = 0; i < SCALING_BENCH_PAGES; i++) {
+            for (uint32_t c = 0; c < cpus; c++) {
+                demand_paging_handle_fault_flags(pml4, base + c * span + i * 4096, VM_FAULT_USER | VM_FAULT_WRITE);
+            }
+        }
+        uint64_t cycles = read_tsc() - start;
+        
+        for (uint32_t c = 0; c < cpus; c++) {
+            uint64_t *pte = vmm_get_pte(pml4, base + c * span);
+            spinlock_t *lock = pte ? vmm_pte_lock(pte) : NULL;
+            int seen = 0;
+            for (uint32_t j = 0; j < distinct; j++) {
+                if (locks[j] == lock) seen = 1;
+            }
+            if (lock && !seen) locks[distinct++] = lock;
+        }
+        
+        kprintf("%u CPUs: %u fault locks (1 with a region lock), avg %llu cycles per fault\n",
+                cpus, distinct, cycles / (SCALING_BENCH_PAGES * cpus));
+        demand_paging_unregister_region(pml4, base);
     }
     
-    kprintf("Distribution: min=%d, max=%d (1000 addresses across %d buckets)\n",
-            min_count, max_count, COW_HASH_SIZE);
+    // The regions gave their frames back; free the page tables and PML4
+    cow_release_address_space(pml4);
+    demand_paging_set_fault_around(saved);
+}
+
+#define PF_BENCH_PAGES 256
+
+void benchmark_page_fault_dispatch(void) {
+    kprintf("\n=== Page Fault Dispatch Benchmark ===\n");
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    if (!pml4) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+    
+    const uint64_t direct_base = 0x50000000;
+    const uint64_t dispatch_base = 0x60000000;
+    const uint64_t size = (uint64_t)PF_BENCH_PAGES * 4096;
+    uint32_t flags = VM_FLAG_DEMAND_PAGED | VM_FLAG_ZERO_FILL;
+    uint32_t saved = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(0);
+    demand_paging_register_region(pml4, direct_base, size, flags);
+    demand_paging_register_region(pml4, dispatch_base, size, flags);
+    
+    // Handler called directly, as the tests did before faults were wired up
+    uint64_t start = read_tsc();
+    for (uint64_t i = 0; i < PF_BENCH_PAGES; i++) {
+        demand_paging_handle_fault_flags(pml4, direct_base + i * 4096, VM_FAULT_USER | VM_FAULT_WRITE);
+    }
+    uint64_t direct = read_tsc() - start;
+    
+    // The same faults through error-code decoding and accounting
+    page_fault_reset_stats();
+    start = read_tsc();
+    for (uint64_t i = 0; i < PF_BENCH_PAGES; i++) {
+        page_fault_dispatch(pml4, dispatch_base + i * 4096, PAGE_FAULT_ERR_USER | PAGE_FAULT_ERR_WRITE);
+    }
+    uint64_t dispatched = read_tsc() - start;
+    
+    kprintf("Direct handler: avg %llu cycles\n", direct / PF_BENCH_PAGES);
+    kprintf("Dispatched:     avg %llu cycles\n", dispatched / PF_BENCH_PAGES);
+    page_fault_dump_stats();
+    
+    demand_paging_unregister_region(pml4, direct_base);
+    demand_paging_unregister_region(pml4, dispatch_base);
+    demand_paging_set_fault_around(saved);
+}
+
+#define REGION_BENCH_REGIONS 512
+#define REGION_BENCH_SPACES 16
+#define REGION_BENCH_LOOKUPS 10000
+
+void benchmark_region_lookup(void) {
+    kprintf("\n=== VM Region Lookup Benchmark ===\n");
+
+    page_table_t *spaces[REGION_BENCH_SPACES];
+    int created = 0;
+    for (int i = 0; i < REGION_BENCH_SPACES; i++) {
+        spaces[i] = vmm_create_address_space();
+        if (!spaces[i]) break;
+        created++;
+    }
+    if (created == 0) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+
+    // Many small mappings, as a process with many mmap()s would have
+    const uint64_t base = 0x40000000;
+    page_table_t *pml4 = spaces[0];
+    for (uint64_t i = 0; i < REGION_BENCH_REGIONS; i++) {
+        demand_paging_register_region(pml4, base + i * 0x4000, 0x2000, VM_FLAG_DEMAND_PAGED);
+    }
+
+    // Scattered lookups miss the last-hit cache and walk the tree
+    uint64_t start = read_tsc();
+    uint32_t found = 0;
+    for (uint64_t i = 0; i < REGION_BENCH_LOOKUPS; i++) {
+        uint64_t slot = (i * 157) % REGION_BENCH_REGIONS;
+        found += demand_paging_find_region(pml4, base + slot * 0x4000 + 0x1000) != NULL;
+    }
+    uint64_t scattered = read_tsc() - start;
+
+    // Clustered lookups stay in one region
+    start = read_tsc();
+    for (uint64_t i = 0; i < REGION_BENCH_LOOKUPS; i++) {
+        found += demand_paging_find_region(pml4, base + (i & 1) * 0x1000) != NULL;
+    }
+    uint64_t clustered = read_tsc() - start;
+
+    // Round-robin over address spaces exercises the hashed lookup
+    for (int i = 1; i < created; i++) {
+        demand_paging_register_region(spaces[i], base, 0x2000, VM_FLAG_DEMAND_PAGED);
+    }
+    start = read_tsc();
+    for (uint64_t i = 0; i < REGION_BENCH_LOOKUPS; i++) {
+        found += demand_paging_find_region(spaces[i % created], base) != NULL;
+    }
+    uint64_t spread = read_tsc() - start;
+
+    kprintf("Regions: %d, address spaces: %d, found: %u\n", REGION_BENCH_REGIONS, created, found);
+    kprintf("Scattered lookup:  avg %llu cycles\n", scattered / REGION_BENCH_LOOKUPS);
+    kprintf("Clustered lookup:  avg %llu cycles\n", clustered / REGION_BENCH_LOOKUPS);
+    kprintf("Across spaces:     avg %llu cycles\n", spread / REGION_BENCH_LOOKUPS);
+
+    for (uint64_t i = 0; i < REGION_BENCH_REGIONS; i++) {
+        demand_paging_unregister_region(pml4, base + i * 0x4000);
+    }
+    for (int i = 1; i < created; i++) {
+        demand_paging_unregister_region(spaces[i], base);
+    }
+}
+
+#define RMAP_BENCH_PAGES 64
+#define RMAP_BENCH_FORKS 8
+
+void benchmark_rmap_walk(void) {
+    kprintf("\n=== Reverse Mapping Walk Benchmark ===\n");
+    
+    page_table_t *parent = vmm_create_address_space();
+    if (!parent) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+    
+    static uint64_t frames[RMAP_BENCH_PAGES];
+    for (int i = 0; i < RMAP_BENCH_PAGES; i++) {
+        frames[i] = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+        if (!frames[i]) {
+            kprintf("Skipped: out of memory\n");
+            return;
+        }
+        vmm_map_page(parent, 0x400000 + (uint64_t)i * 4096, frames[i],
+                     VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    }
+    
+    rmap_stats_t before, after;
+    rmap_get_stats(&before);
+    
+    // Walk cost grows with the address spaces sharing a group, not with
+    // the number of pages mapped
+    page_table_t *children[RMAP_BENCH_FORKS];
+    int forks = 0;
+    for (int round = 0; round <= RMAP_BENCH_FORKS; round++) {
+        uint32_t mappings = 0;
+        uint64_t start = read_tsc();
+        for (int i = 0; i < RMAP_BENCH_PAGES; i++) {
+            mappings += rmap_walk(frames[i], NULL, NULL);
+        }
+        uint64_t cycles = read_tsc() - start;
+        
+        if (round == 0 || round == 1 || round == RMAP_BENCH_FORKS) {
+            kprintf("%d forks: %llu cycles/walk, %u mappings/page\n",
+                    forks, cycles / RMAP_BENCH_PAGES, mappings / RMAP_BENCH_PAGES);
+        }
+        if (round == RMAP_BENCH_FORKS) {
+            break;
+        }
+        children[forks] = cow_clone_address_space(parent);
+        if (!children[forks]) {
+            break;
+        }
+        forks++;
+    }
+    
+    rmap_get_stats(&after);
+    uint64_t links = after.links - before.links;
+    kprintf("Tracking memory: %llu links (%llu bytes) vs %llu bytes for per-PTE records\n",
+            links, links * sizeof(rmap_link_t),
+            (uint64_t)RMAP_BENCH_PAGES * (forks + 1) * 2 * sizeof(uint64_t));
+    
+    for (int i = 0; i < forks; i++) {
+        cow_release_address_space(children[i]);
+    }
+    cow_release_address_space(parent);
+}
+
+#define SNAPSHOT_BENCH_PAGES 256
+
+static int snapshot_bench_count(uint64_t virt, uint64_t phys, void *arg) {
+    (void)virt;
+    (void)phys;
+    (*(uint32_t *)arg)++;
+    return 0;
+}
+
+void benchmark_snapshot(void) {
+    kprintf("\n=== Address-Space Snapshot Benchmark ===\n");
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    uint64_t scratch = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+    if (!pml4 || !scratch) {
+        kprintf("Skipped: out of memory\n");
+        return;
+    }
+    
+    const uint64_t base = 0x40000000;
+    demand_paging_register_region(pml4, base, (uint64_t)SNAPSHOT_BENCH_PAGES * 4096, VM_FLAG_DEMAND_PAGED);
+    for (uint64_t i = 0; i < SNAPSHOT_BENCH_PAGES; i++) {
+        demand_paging_handle_fault_flags(pml4, base + i * 4096, VM_FAULT_WRITE);
+    }
+    
+    // Baseline: copying every page up front
+    uint64_t start = read_tsc();
+    for (uint64_t i = 0; i < SNAPSHOT_BENCH_PAGES; i++) {
+        uint64_t *src = (uint64_t *)(uintptr_t)vmm_get_physical_address(pml4, base + i * 4096);
+        uint64_t *dst = (uint64_t *)(uintptr_t)scratch;
+        for (uint32_t w = 0; w < 512; w++) {
+            dst[w] = src[w];
+        }
+    }
+    uint64_t copy_cycles = read_tsc() - start;
+    
+    start = read_tsc();
+    snapshot_t *snap = snapshot_create(pml4);
+    uint64_t create_cycles = read_tsc() - start;
+    if (!snap) {
+        kprintf("Skipped: snapshot failed\n");
+        return;
+    }
+    
+    // One pre-copy round with a tenth of the pages written
+    for (uint64_t i = 0; i < SNAPSHOT_BENCH_PAGES; i += 10) {
+        demand_paging_handle_fault_flags(pml4, base + i * 4096, VM_FAULT_PRESENT | VM_FAULT_WRITE);
+    }
+    uint32_t dirty = 0;
+    start = read_tsc();
+    snapshot_for_each_dirty(snap, snapshot_bench_count, &dirty);
+    uint64_t scan_cycles = read_tsc() - start;
+    
+    start = read_tsc();
+    snapshot_refresh(snap);
+    uint64_t refresh_cycles = read_tsc() - start;
+    
+    start = read_tsc();
+    snapshot_discard(snap);
+    uint64_t discard_cycles = read_tsc() - start;
+    
+    kprintf("Full copy of %u pages: %llu cycles\n", SNAPSHOT_BENCH_PAGES, copy_cycles);
+    kprintf("Snapshot: %llu cycles, refresh: %llu, discard: %llu\n",
+            create_cycles, refresh_cycles, discard_cycles);
+    kprintf("Dirty scan: %llu cycles for %u dirty pages\n", scan_cycles, dirty);
+    
+    demand_paging_unregister_region(pml4, base);
+    buddy_free_pages(scratch, 0);
+}
+
+#define KSM_BENCH_PAGES 256
+
+void benchmark_ksm_scan(void) {
+    kprintf("\n=== Same-Page Merging Scan Benchmark ===\n");
+    
+    page_table_t *pml4 = vmm_create_address_space();
+    if (!pml4) {
+        kprintf("Skipped: address space creation failed\n");
+        return;
+    }
+    
+    const uint64_t base = 0x30000000;
+    demand_paging_register_region(pml4, base, (uint64_t)KSM_BENCH_PAGES * 4096,
+                                  VM_FLAG_DEMAND_PAGED | VM_FLAG_MERGEABLE);
+    
+    // A quarter zero pages, a quarter copies of 8 patterns, the rest unique
+    for (uint64_t i = 0; i < KSM_BENCH_PAGES; i++) {
+        demand_paging_handle_fault_flags(pml4, base + i * 4096, VM_FAULT_WRITE);
+        uint64_t *page = (uint64_t *)(uintptr_t)vmm_get_physical_address(pml4, base + i * 4096);
+        if (!page) {
+            continue;
+        }
+        uint64_t value = (i % 4 == 0) ? 0 : (i % 4 == 1) ? 0x1000 + (i / 4) % 8 : 0x2000 + i;
+        for (uint32_t w = 0; w < 512; w++) {
+            page[w] = value;
+        }
+    }
+    
+    ksm_stats_t before, after;
+    ksm_get_stats(&before);
+    uint64_t free_before = buddy_get_free_pages();
+    
+    // One full pass finds every duplicate
+    uint64_t start = read_tsc();
+    uint32_t merged = ksm_scan(KSM_BENCH_PAGES + 1);
+    uint64_t cycles = read_tsc() - start;
+    
+    ksm_get_stats(&after);
+    kprintf("Scan: %llu cycles/page, %u pages merged\n", cycles / KSM_BENCH_PAGES, merged);
+    kprintf("Frames freed: %llu (shared frames %llu, zero pages %llu)\n",
+            buddy_get_free_pages() - free_before,
+            after.pages_shared - before.pages_shared,
+            after.zero_pages_merged - before.zero_pages_merged);
+    
+    // Second pass over merged memory: only unique pages are hashed again
+    start = read_tsc();
+    ksm_scan(KSM_BENCH_PAGES + 1);
+    kprintf("Rescan: %llu cycles/page\n", (read_tsc() - start) / KSM_BENCH_PAGES);
+    
+    demand_paging_unregister_region(pml4, base);
 }
 
 void benchmark_page_cache_hash_function(void) {
@@ -138,14 +684,389 @@ void benchmark_comparison(void) {
     kprintf("Speedup: %.2fx faster\n", (double)cycles_mod / (double)cycles_and);
 }
 
+#define TLSF_BENCH_ORDER  10     // 4 MiB pool
+#define TLSF_BENCH_SLOTS  512
+
+void benchmark_tlsf_fragmentation(void) {
+    kprintf("\n=== TLSF Fragmentation Benchmark ===\n");
+    
+    static tlsf_t tlsf;
+    static void *slots[TLSF_BENCH_SLOTS];
+    
+    uint64_t pool = buddy_alloc_pages(TLSF_BENCH_ORDER, BUDDY_ZONE_UNMOVABLE);
+    if (!pool) {
+        kprintf("Skipped: could not allocate %d KiB pool\n",
+                (BUDDY_PAGE_SIZE << TLSF_BENCH_ORDER) / 1024);
+        return;
+    }
+    tlsf_init(&tlsf);
+    tlsf_add_pool(&tlsf, (void *)pool, BUDDY_PAGE_SIZE << TLSF_BENCH_ORDER);
+    
+    // Fill the pool with mixed sizes, then free every other block so the
+    // free lists hold hundreds of small, non-adjacent holes
+    uint32_t seed = 12345;
+    for (int i = 0; i < TLSF_BENCH_SLOTS; i++) {
+        seed = seed * 1103515245 + 12345;
+        slots[i] = tlsf_malloc(&tlsf, 64 + (seed >> 16) % 4096);
+    }
+    for (int i = 0; i < TLSF_BENCH_SLOTS; i += 2) {
+        tlsf_free(&tlsf, slots[i]);
+        slots[i] = NULL;
+    }
+    
+    // Random replace workload: free a random slot, allocate a new random size
+    const int iterations = 20000;
+    uint64_t alloc_total = 0, alloc_worst = 0;
+    uint64_t free_total = 0, free_worst = 0;
+    int alloc_ops = 0, free_ops = 0, failures = 0;
+    
+    for (int iter = 0; iter < iterations; iter++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t slot = (seed >> 16) % TLSF_BENCH_SLOTS;
+        
+        if (slots[slot]) {
+            uint64_t start = read_tsc();
+            tlsf_free(&tlsf, slots[slot]);
+            uint64_t cycles = read_tsc() - start;
+            free_total += cycles;
+            if (cycles > free_worst) free_worst = cycles;
+            free_ops++;
+        }
+        
+        seed = seed * 1103515245 + 12345;
+        size_t size = 16 + (seed >> 16) % 16384;
+        
+        uint64_t start = read_tsc();
+        slots[slot] = tlsf_malloc(&tlsf, size);
+        uint64_t cycles = read_tsc() - start;
+        alloc_total += cycles;
+        if (cycles > alloc_worst) alloc_worst = cycles;
+        alloc_ops++;
+        if (!slots[slot]) failures++;
+    }
+    
+    kprintf("malloc: avg %llu cycles, worst %llu cycles (%d ops, %d failed)\n",
+            alloc_total / alloc_ops, alloc_worst, alloc_ops, failures);
+    kprintf("free:   avg %llu cycles, worst %llu cycles (%d ops)\n",
+            free_ops ? free_total / free_ops : 0, free_worst, free_ops);
+    kprintf("Pool: %zu bytes, %zu free at end\n", tlsf.pool_bytes, tlsf.free_bytes);
+    
+    buddy_free_pages(pool, TLSF_BENCH_ORDER);
+}
+
+#define HEAP_BENCH_SLOTS  256
+
+void benchmark_heap_arenas(void) {
+    kprintf("\n=== Heap Arena Throughput Benchmark ===\n");
+    
+    static void *slots[HEAP_BENCH_SLOTS];
+    const int rounds = 64;
+    
+    // Heap-path sizes only: above the largest slab class, below one page
+    uint64_t local_cycles = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = read_tsc();
+        for (int i = 0; i < HEAP_BENCH_SLOTS; i++) {
+            slots[i] = kmalloc(2100 + (i * 7) % 1900);
+        }
+        for (int i = 0; i < HEAP_BENCH_SLOTS; i++) {
+            kfree(slots[i]);
+        }
+        local_cycles += read_tsc() - start;
+    }
+    
+    // Same workload, but every block is freed from another CPU and has to
+    // travel through the owner's remote queue
+    uint64_t remote_cycles = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t start = read_tsc();
+        for (int i = 0; i < HEAP_BENCH_SLOTS; i++) {
+            slots[i] = kmalloc(2100 + (i * 7) % 1900);
+        }
+        cpu_local_init(1);
+        for (int i = 0; i < HEAP_BENCH_SLOTS; i++) {
+            kfree(slots[i]);
+        }
+        cpu_local_init(0);
+        remote_cycles += read_tsc() - start;
+    }
+    cpu_local(1)->online = 0;
+    
+    uint64_t ops = (uint64_t)rounds * HEAP_BENCH_SLOTS;
+    kprintf("Local free:  avg %llu cycles per kmalloc+kfree\n", local_cycles / ops);
+    kprintf("Remote free: avg %llu cycles per kmalloc+kfree\n", remote_cycles / ops);
+    
+    heap_stats_t stats;
+    heap_get_stats(&stats);
+    kprintf("Arenas: %u, remote frees drained: %llu, steals: %llu\n",
+            stats.arenas, stats.remote_frees, stats.steals);
+    kprintf("CPUs online: %u (multi-core scaling needs APs running)\n", cpu_online_count());
+}
+
+void benchmark_krealloc_growth(void) {
+    kprintf("\n=== krealloc Append Benchmark ===\n");
+    
+    // Grow a log-style buffer 64 bytes at a time up to 256 KiB
+    const size_t step = 64;
+    const size_t limit = 256 * 1024;
+    
+    uint8_t *buf = (uint8_t *)kmalloc(step);
+    if (!buf) {
+        kprintf("Skipped: initial allocation failed\n");
+        return;
+    }
+    
+    int moves = 0, grows = 0;
+    uint64_t start = read_tsc();
+    for (size_t len = step; len < limit; len += step) {
+        uint8_t *n = (uint8_t *)krealloc(buf, len + step);
+        if (!n) {
+            break;
+        }
+        if (n != buf) {
+            moves++;
+        }
+        buf = n;
+        buf[len] = (uint8_t)len;
+        grows++;
+    }
+    uint64_t cycles = read_tsc() - start;
+    
+    kprintf("%d grows, %d moves, avg %llu cycles per grow\n",
+            grows, moves, grows ? cycles / grows : 0);
+    kfree(buf);
+}
+
+void benchmark_alloc_profile_overhead(void) {
+    kprintf("\n=== Allocation Profiler Overhead Benchmark ===\n");
+    
+    const int iterations = 10000;
+    int was_enabled = alloc_profile_is_enabled();
+    
+    alloc_profile_disable();
+    uint64_t start = read_tsc();
+    for (int i = 0; i < iterations; i++) {
+        kfree(kmalloc(64));
+    }
+    uint64_t disabled = read_tsc() - start;
+    
+    if (alloc_profile_enable() != 0) {
+        kprintf("Disabled: avg %llu cycles per kmalloc+kfree (profiler unavailable)\n",
+                disabled / iterations);
+        return;
+    }
+    start = read_tsc();
+    for (int i = 0; i < iterations; i++) {
+        kfree(kmalloc(64));
+    }
+    uint64_t enabled = read_tsc() - start;
+    alloc_profile_reset();
+    if (!was_enabled) {
+        alloc_profile_disable();
+    }
+    
+    kprintf("Disabled: avg %llu cycles per kmalloc+kfree\n", disabled / iterations);
+    kprintf("Enabled:  avg %llu cycles per kmalloc+kfree\n", enabled / iterations);
+}
+
+void benchmark_arena_scratch(void) {
+    kprintf("\n=== Arena Scratch Benchmark ===\n");
+    
+    // Per-request scratch: many small objects that all die together
+    const int requests = 100;
+    const int objects = 256;
+    static void *ptrs[256];
+    
+    uint64_t start = read_tsc();
+    for (int r = 0; r < requests; r++) {
+        for (int i = 0; i < objects; i++) {
+            ptrs[i] = kmalloc(48);
+        }
+        for (int i = 0; i < objects; i++) {
+            kfree(ptrs[i]);
+        }
+    }
+    uint64_t cycles_kmalloc = read_tsc() - start;
+    
+    mem_arena_t arena;
+    arena_init(&arena, "bench-scratch", 2);
+    start = read_tsc();
+    for (int r = 0; r < requests; r++) {
+        for (int i = 0; i < objects; i++) {
+            ptrs[i] = arena_alloc(&arena, 48);
+        }
+        arena_reset(&arena);
+    }
+    uint64_t cycles_arena = read_tsc() - start;
+    arena_destroy(&arena);
+    
+    uint64_t total = (uint64_t)requests * objects;
+    kprintf("kmalloc/kfree: avg %llu cycles per object\n", cycles_kmalloc / total);
+    kprintf("Arena + reset: avg %llu cycles per object\n", cycles_arena / total);
+}
+
+#define POOL_BENCH_SLOTS 256
+
+void benchmark_pool_contention(void) {
+    kprintf("\n=== Memory Pool Contention Benchmark ===\n");
+    
+    memory_pool_t *pool = pool_create("bench-pool", 64, POOL_BENCH_SLOTS);
+    if (!pool) {
+        kprintf("Skipped: pool creation failed\n");
+        return;
+    }
+    
+    static void *slots[POOL_BENCH_SLOTS];
+    const int rounds = 64;
+    
+    // Alloc and free on one CPU: served from its front cache
+    uint64_t start = read_tsc();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < POOL_BENCH_SLOTS; i++) {
+            slots[i] = pool_alloc(pool);
+        }
+        for (int i = 0; i < POOL_BENCH_SLOTS; i++) {
+            pool_free(pool, slots[i]);
+        }
+    }
+    uint64_t local_cycles = read_tsc() - start;
+    
+    // Producer/consumer: CPU 0 allocates, CPU 1 frees, so every object
+    // travels through the shared lock-free stack in batches
+    start = read_tsc();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < POOL_BENCH_SLOTS; i++) {
+            slots[i] = pool_alloc(pool);
+        }
+        cpu_local_init(1);
+        for (int i = 0; i < POOL_BENCH_SLOTS; i++) {
+            pool_free(pool, slots[i]);
+        }
+        cpu_local_init(0);
+    }
+    uint64_t remote_cycles = read_tsc() - start;
+    cpu_local(1)->online = 0;
+    
+    uint64_t ops = (uint64_t)rounds * POOL_BENCH_SLOTS;
+    kprintf("Same CPU:          avg %llu cycles per alloc+free\n", local_cycles / ops);
+    kprintf("Producer/consumer: avg %llu cycles per alloc+free\n", remote_cycles / ops);
+    kprintf("Objects: %u total, %u free\n", pool->total_objects, pool_free_count(pool));
+    kprintf("CPUs online: %u (multi-core scaling needs APs running)\n", cpu_online_count());
+    
+    pool_destroy(pool);
+}
+
+#define SLOTMAP_BENCH_OBJECTS 4096
+
+typedef struct sweep_obj {
+    struct sweep_obj *next;
+    uint64_t value;
+    uint64_t pad[6];
+} sweep_obj_t;
+
+void benchmark_slotmap_sweep(void) {
+    kprintf("\n=== Slot Map Sweep Benchmark ===\n");
+    
+    memory_pool_t *pool = pool_create("bench-sweep", sizeof(sweep_obj_t), SLOTMAP_BENCH_OBJECTS);
+    slotmap_t map;
+    if (!pool || slotmap_init(&map, "bench-sweep", sizeof(sweep_obj_t), SLOTMAP_BENCH_OBJECTS) != 0) {
+        kprintf("Skipped: setup failed\n");
+        if (pool) {
+            pool_destroy(pool);
+        }
+        return;
+    }
+    
+    // Same objects both ways: a list threaded through pool objects with
+    // churn in between, and a slot map's dense array
+    static slot_handle_t handles[SLOTMAP_BENCH_OBJECTS];
+    static sweep_obj_t *objs[SLOTMAP_BENCH_OBJECTS];
+    sweep_obj_t *head = NULL;
+    for (int i = 0; i < SLOTMAP_BENCH_OBJECTS; i++) {
+        objs[i] = pool_alloc(pool);
+        handles[i] = slotmap_insert(&map, NULL);
+    }
+    for (int i = 0; i < SLOTMAP_BENCH_OBJECTS; i += 2) {
+        pool_free(pool, objs[i]);
+        slotmap_remove(&map, handles[i]);
+    }
+    for (int i = 0; i < SLOTMAP_BENCH_OBJECTS; i += 2) {
+        objs[i] = pool_alloc(pool);
+        slotmap_insert(&map, NULL);
+    }
+    for (int i = 0; i < SLOTMAP_BENCH_OBJECTS; i++) {
+        if (objs[i]) {
+            objs[i]->value = i;
+            objs[i]->next = head;
+            head = objs[i];
+        }
+    }
+    sweep_obj_t *dense = slotmap_data(&map);
+    for (uint32_t i = 0; i < slotmap_count(&map); i++) {
+        dense[i].value = i;
+    }
+    
+    const int passes = 32;
+    volatile uint64_t sink = 0;
+    
+    uint64_t start = read_tsc();
+    for (int p = 0; p < passes; p++) {
+        uint64_t sum = 0;
+        for (sweep_obj_t *obj = head; obj; obj = obj->next) {
+            sum += obj->value;
+        }
+        sink += sum;
+    }
+    uint64_t list_cycles = read_tsc() - start;
+    
+    start = read_tsc();
+    for (int p = 0; p < passes; p++) {
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < slotmap_count(&map); i++) {
+            sum += dense[i].value;
+        }
+        sink += sum;
+    }
+    uint64_t dense_cycles = read_tsc() - start;
+    
+    uint64_t visits = (uint64_t)passes * SLOTMAP_BENCH_OBJECTS;
+    kprintf("Linked pool objects: avg %llu cycles per object\n", list_cycles / visits);
+    kprintf("Slot map sweep:      avg %llu cycles per object\n", dense_cycles / visits);
+    
+    for (int i = 0; i < SLOTMAP_BENCH_OBJECTS; i++) {
+        if (objs[i]) {
+            pool_free(pool, objs[i]);
+        }
+    }
+    slotmap_destroy(&map);
+    pool_destroy(pool);
+}
+
 void run_performance_benchmarks(void) {
     kprintf("\n========================================\n");
     kprintf("  Memory Management Performance Tests  \n");
     kprintf("========================================\n");
     
-    benchmark_cow_hash_function();
+    benchmark_cow_refcount();
+    benchmark_fork_latency();
+    benchmark_tlb_gather();
+    benchmark_rmap_walk();
+    benchmark_snapshot();
+    benchmark_zero_page_faults();
+    benchmark_region_lookup();
+    benchmark_fault_around();
+    benchmark_page_fault_dispatch();
+    benchmark_fault_scaling();
+    benchmark_ksm_scan();
     benchmark_page_cache_hash_function();
     benchmark_comparison();
+    benchmark_tlsf_fragmentation();
+    benchmark_heap_arenas();
+    benchmark_krealloc_growth();
+    benchmark_alloc_profile_overhead();
+    benchmark_arena_scratch();
+    benchmark_pool_contention();
+    benchmark_slotmap_sweep();
     
     kprintf("\n========================================\n");
 }
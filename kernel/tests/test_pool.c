@@ -1,5 +1,9 @@
 #include "../../include/mm/pool.h"
+#include "../../include/mm/typed_pool.h"
 #include "../../include/kernel/stdio.h"
+#include "../../include/kernel/cpu.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/page.h"
 
 static int test_count = 0;
 static int test_passed = 0;
@@ -20,7 +24,7 @@ void test_pool_creation_and_destruction(void) {
     if (pool) {
         TEST_ASSERT(pool->object_size >= 64, "Object size should be at least 64 bytes");
         TEST_ASSERT(pool->total_objects >= 10, "Pool should have at least 10 objects");
-        TEST_ASSERT(pool->free_objects >= 10, "Pool should have at least 10 free objects");
+        TEST_ASSERT(pool_free_count(pool) >= 10, "Pool should have at least 10 free objects");
         
         pool_destroy(pool);
         TEST_ASSERT(1, "Pool destruction should complete without crashing");
@@ -32,22 +36,22 @@ void test_pool_allocation_and_freeing(void) {
     TEST_ASSERT(pool != NULL, "Pool creation should succeed");
     
     if (pool) {
-        uint32_t initial_free = pool->free_objects;
+        uint32_t initial_free = pool_free_count(pool);
         
         void *obj1 = pool_alloc(pool);
         TEST_ASSERT(obj1 != NULL, "First allocation should succeed");
-        TEST_ASSERT(pool->free_objects == initial_free - 1, "Free count should decrease by 1");
+        TEST_ASSERT(pool_free_count(pool) == initial_free - 1, "Free count should decrease by 1");
         
         void *obj2 = pool_alloc(pool);
         TEST_ASSERT(obj2 != NULL, "Second allocation should succeed");
         TEST_ASSERT(obj1 != obj2, "Allocations should return different addresses");
-        TEST_ASSERT(pool->free_objects == initial_free - 2, "Free count should decrease by 2");
+        TEST_ASSERT(pool_free_count(pool) == initial_free - 2, "Free count should decrease by 2");
         
         pool_free(pool, obj1);
-        TEST_ASSERT(pool->free_objects == initial_free - 1, "Free count should increase after freeing");
+        TEST_ASSERT(pool_free_count(pool) == initial_free - 1, "Free count should increase after freeing");
         
         pool_free(pool, obj2);
-        TEST_ASSERT(pool->free_objects == initial_free, "Free count should return to initial");
+        TEST_ASSERT(pool_free_count(pool) == initial_free, "Free count should return to initial");
         
         pool_destroy(pool);
     }
@@ -70,7 +74,7 @@ void test_pool_constant_time_operations(void) {
             pool_free(pool, objects[i]);
         }
         
-        TEST_ASSERT(pool->free_objects == pool->total_objects, 
+        TEST_ASSERT(pool_free_count(pool) == pool->total_objects, 
                    "All objects should be free after freeing");
         
         pool_destroy(pool);
@@ -212,13 +216,195 @@ void test_pool_stress(void) {
             }
         }
         
-        TEST_ASSERT(pool->free_objects == pool->total_objects, 
+        TEST_ASSERT(pool_free_count(pool) == pool->total_objects, 
                    "All objects should be free after stress test");
         
         pool_destroy(pool);
     }
 }
 
+#define CROSS_CPU_OBJECTS 40
+
+void test_pool_cross_cpu_free(void) {
+    memory_pool_t *pool = pool_create("cross_cpu", 64, 64);
+    TEST_ASSERT(pool != NULL, "Pool creation should succeed");
+    if (!pool) {
+        return;
+    }
+    
+    void *objects[CROSS_CPU_OBJECTS];
+    for (int i = 0; i < CROSS_CPU_OBJECTS; i++) {
+        objects[i] = pool_alloc(pool);
+    }
+    uint32_t total = pool->total_objects;
+    
+    // Free everything from CPU 1; its front cache keeps a few, the rest
+    // goes back to the shared stack in batches
+    cpu_local_init(1);
+    for (int i = 0; i < CROSS_CPU_OBJECTS; i++) {
+        pool_free(pool, objects[i]);
+    }
+    TEST_ASSERT(pool->cpu_caches[1].count <= POOL_CPU_CACHE_MAX,
+                "Front cache should spill once it overflows");
+    cpu_local_init(0);
+    cpu_local(1)->online = 0;
+    
+    TEST_ASSERT(pool_free_count(pool) == pool->total_objects,
+                "Objects parked in front caches should count as free");
+    
+    // CPU 0 gets the spilled objects back without growing the pool
+    int reused = 1;
+    for (int i = 0; i < CROSS_CPU_OBJECTS - POOL_CPU_CACHE_MAX; i++) {
+        objects[i] = pool_alloc(pool);
+        if (!objects[i]) {
+            reused = 0;
+        }
+    }
+    TEST_ASSERT(reused && pool->total_objects == total,
+                "Spilled objects should be reused by other CPUs");
+    
+    for (int i = 0; i < CROSS_CPU_OBJECTS - POOL_CPU_CACHE_MAX; i++) {
+        pool_free(pool, objects[i]);
+    }
+    pool_destroy(pool);
+}
+
+#define SPIKE_OBJECTS 400
+
+static void *g_spike[SPIKE_OBJECTS];
+
+void test_pool_shrink_after_spike(void) {
+    uint64_t free_before = buddy_get_free_pages();
+    memory_pool_t *pool = pool_create("spike", 64, 64);
+    TEST_ASSERT(pool != NULL, "Pool creation should succeed");
+    if (!pool) {
+        return;
+    }
+    uint32_t initial_total = pool->total_objects;
+    
+    for (int i = 0; i < SPIKE_OBJECTS; i++) {
+        g_spike[i] = pool_alloc(pool);
+    }
+    TEST_ASSERT(pool->total_objects >= SPIKE_OBJECTS, "Spike should grow the pool");
+    
+    // Nothing to release while objects are live
+    void *held = g_spike[SPIKE_OBJECTS - 1];
+    for (int i = 0; i < SPIKE_OBJECTS - 1; i++) {
+        pool_free(pool, g_spike[i]);
+    }
+    uint32_t before_shrink = pool->total_objects;
+    pool_shrink(pool);
+    TEST_ASSERT(pool->total_objects < before_shrink, "Free regions should be released");
+    page_t *page = buddy_phys_to_page((uint64_t)(uintptr_t)held);
+    TEST_ASSERT(page && (page->flags & PAGE_FLAG_POOL), "Region with a live object should stay");
+    
+    pool_free(pool, held);
+    size_t released = pool_shrink(pool);
+    TEST_ASSERT(released > 0, "Last grown region should go once its object is freed");
+    TEST_ASSERT(pool->total_objects == initial_total, "Pool should shrink back to its initial region");
+    TEST_ASSERT(pool_free_count(pool) == pool->total_objects, "Free count should match after shrinking");
+    
+    void *obj = pool_alloc(pool);
+    TEST_ASSERT(obj != NULL, "Pool should still allocate after shrinking");
+    pool_free(pool, obj);
+    
+    pool_destroy(pool);
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Destroy should return every page");
+}
+
+void test_pool_destroy_multi_page_region(void) {
+    // 64 x 1 KiB needs an order-4 region; destroy must free exactly that
+    uint64_t free_before = buddy_get_free_pages();
+    memory_pool_t *pool = pool_create("multi_page", 1024, 64);
+    TEST_ASSERT(pool != NULL, "Pool creation should succeed");
+    if (pool) {
+        TEST_ASSERT(pool->regions && pool->regions->order == 4, "Region should record its buddy order");
+        pool_destroy(pool);
+    }
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Destroy should free each region at its own order");
+}
+
+void test_pool_memory_pressure(void) {
+    memory_pool_t *pool = pool_create("pressure", 64, 64);
+    TEST_ASSERT(pool != NULL, "Pool creation should succeed");
+    if (!pool) {
+        return;
+    }
+    uint32_t initial_total = pool->total_objects;
+    
+    for (int i = 0; i < SPIKE_OBJECTS; i++) {
+        g_spike[i] = pool_alloc(pool);
+    }
+    for (int i = 0; i < SPIKE_OBJECTS; i++) {
+        pool_free(pool, g_spike[i]);
+    }
+    
+    // The pool shrinker runs with every other registered shrinker
+    TEST_ASSERT(buddy_reclaim() > 0, "Reclaim should release the spare pool regions");
+    TEST_ASSERT(pool->total_objects == initial_total, "Pool shrinker should leave the initial region");
+    
+    pool_destroy(pool);
+}
+
+void test_pool_aligned(void) {
+    memory_pool_t *pool = pool_create_aligned("aligned", 24, 32, 0, 16);
+    TEST_ASSERT(pool != NULL, "Aligned pool creation should succeed");
+    if (pool) {
+        TEST_ASSERT(pool->object_size == 32, "Slot size should round up to the alignment");
+        int aligned = 1;
+        void *objects[8];
+        for (int i = 0; i < 8; i++) {
+            objects[i] = pool_alloc(pool);
+            if (!objects[i] || ((uintptr_t)objects[i] & 31)) {
+                aligned = 0;
+            }
+        }
+        TEST_ASSERT(aligned, "Every object should be 32-byte aligned");
+        for (int i = 0; i < 8; i++) {
+            pool_free(pool, objects[i]);
+        }
+        pool_destroy(pool);
+    }
+    
+    TEST_ASSERT(pool_create_aligned("bad", 24, 48, 0, 16) == NULL, "Non power-of-two alignment should fail");
+    TEST_ASSERT(pool_create_aligned("bad", 24, 128, 0, 16) == NULL, "Alignment above a cache line should fail");
+}
+
+typedef struct test_counter {
+    uint64_t hits;
+    uint32_t cpu;
+} test_counter_t;
+
+DEFINE_TYPED_POOL(test_counter, test_counter_t, 8, POOL_PAD_CACHELINE)
+
+void test_pool_typed_padded(void) {
+    TEST_ASSERT(test_counter_pool_init(8) == 0, "Typed pool init should succeed");
+    if (!test_counter_pool) {
+        return;
+    }
+    TEST_ASSERT(test_counter_pool->object_size == POOL_CACHE_LINE,
+                "Padded objects should fill a whole cache line");
+    
+    test_counter_t *a = test_counter_alloc();
+    test_counter_t *b = test_counter_alloc();
+    TEST_ASSERT(a && b, "Typed allocations should succeed");
+    if (a && b) {
+        uintptr_t line_a = (uintptr_t)a / POOL_CACHE_LINE;
+        uintptr_t line_b = (uintptr_t)b / POOL_CACHE_LINE;
+        TEST_ASSERT(((uintptr_t)a & (POOL_CACHE_LINE - 1)) == 0, "Padded objects should start a cache line");
+        TEST_ASSERT(line_a != line_b, "Two objects should never share a cache line");
+        
+        uint32_t free_before = pool_free_count(test_counter_pool);
+        test_counter_free(a);
+        TEST_ASSERT(pool_free_count(test_counter_pool) == free_before + 1, "Inline free should count the object");
+        TEST_ASSERT(test_counter_alloc() == a, "Inline alloc should reuse the hot object");
+        test_counter_free(a);
+        test_counter_free(b);
+    }
+    
+    test_counter_pool_destroy();
+}
+
 void run_pool_tests(void) {
     kprintf("Running memory pool tests...\n");
     
@@ -229,6 +415,12 @@ void run_pool_tests(void) {
     test_pool_utilization();
     test_pool_multiple_sizes();
     test_pool_stress();
+    test_pool_cross_cpu_free();
+    test_pool_shrink_after_spike();
+    test_pool_destroy_multi_page_region();
+    test_pool_memory_pressure();
+    test_pool_aligned();
+    test_pool_typed_padded();
     
     kprintf("Pool tests: %d/%d passed\n", test_passed, test_count);
 }
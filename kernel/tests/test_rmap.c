@@ -0,0 +1,140 @@
+#include "../../include/mm/rmap.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+typedef struct rmap_test_visit {
+    page_table_t *spaces[4];
+    uint64_t virt;
+    uint32_t count;
+    int stop;
+} rmap_test_visit_t;
+
+static int rmap_test_visitor(page_table_t *pml4, uint64_t virt, uint64_t *pte, void *arg) {
+    rmap_test_visit_t *v = (rmap_test_visit_t *)arg;
+    (void)pte;
+    if (v->count < 4) {
+        v->spaces[v->count] = pml4;
+    }
+    v->virt = virt;
+    v->count++;
+    return v->stop;
+}
+
+static int rmap_test_seen(rmap_test_visit_t *v, page_table_t *pml4) {
+    for (uint32_t i = 0; i < v->count && i < 4; i++) {
+        if (v->spaces[i] == pml4) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void test_rmap_map_and_walk(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+
+    uint64_t frame = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+    if (!frame) return;
+    vmm_map_page(pml4, 0x400000, frame, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+
+    page_t *page = buddy_phys_to_page(frame);
+    TEST_ASSERT(page && (page->flags & PAGE_FLAG_ANON) && page->index == 0x400,
+                "Mapping a user page should tag it with its group and page number");
+
+    rmap_test_visit_t v = { { 0 }, 0, 0, 0 };
+    TEST_ASSERT(rmap_walk(frame, rmap_test_visitor, &v) == 1, "The walk should find the one mapping");
+    TEST_ASSERT(v.spaces[0] == pml4 && v.virt == 0x400000, "The visitor should get the address space and address");
+
+    // A private frame moves with its mapping
+    vmm_unmap_page(pml4, 0x400000);
+    TEST_ASSERT(rmap_walk(frame, NULL, NULL) == 0, "An unmapped frame should have no mappings");
+    vmm_map_page(pml4, 0x800000, frame, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    TEST_ASSERT(page->index == 0x800 && rmap_walk(frame, NULL, NULL) == 1,
+                "Remapping a private frame should move its record");
+    vmm_unmap_page(pml4, 0x800000);
+
+    buddy_free_pages(frame, 0);
+    TEST_ASSERT(!(page->flags & PAGE_FLAG_ANON) && page->owner == NULL, "Freeing should leave the group");
+
+    // Kernel-half mappings and the zero page are not tracked
+    uint64_t kframe = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+    if (kframe) {
+        vmm_map_page(pml4, 0xFFFF900000000000ULL, kframe, VMM_FLAG_WRITABLE);
+        TEST_ASSERT(!(buddy_phys_to_page(kframe)->flags & PAGE_FLAG_ANON), "Kernel mappings should not be tracked");
+        vmm_unmap_page(pml4, 0xFFFF900000000000ULL);
+        buddy_free_pages(kframe, 0);
+    }
+    if (cow_zero_page()) {
+        vmm_map_page(pml4, 0x400000, cow_zero_page(), VMM_FLAG_USER);
+        TEST_ASSERT(rmap_walk(cow_zero_page(), NULL, NULL) == 0, "The zero page should never be walked");
+        vmm_unmap_page(pml4, 0x400000);
+    }
+}
+
+void test_rmap_fork(void) {
+    page_table_t *parent = vmm_create_address_space();
+    if (!parent) return;
+
+    uint64_t frame = buddy_alloc_pages(0, BUDDY_ZONE_MOVABLE);
+    if (!frame) return;
+    vmm_map_page(parent, 0x400000, frame, VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+
+    rmap_stats_t before, after;
+    rmap_get_stats(&before);
+
+    page_table_t *child = cow_clone_address_space(parent);
+    page_table_t *grandchild = child ? cow_clone_address_space(child) : 0;
+    TEST_ASSERT(child && grandchild, "Clones should succeed");
+    if (!child || !grandchild) return;
+
+    rmap_test_visit_t v = { { 0 }, 0, 0, 0 };
+    TEST_ASSERT(rmap_walk(frame, rmap_test_visitor, &v) == 3, "Forked mappings should be found without per-PTE records");
+    TEST_ASSERT(rmap_test_seen(&v, parent) && rmap_test_seen(&v, child) && rmap_test_seen(&v, grandchild),
+                "Every address space should be visited");
+
+    v.count = 0;
+    v.stop = 1;
+    TEST_ASSERT(rmap_walk(frame, rmap_test_visitor, &v) == 1 && v.count == 1, "A visitor should be able to stop the walk");
+
+    // A COW copy belongs to the writer's own group
+    TEST_ASSERT(cow_handle_fault(child, 0x400000) == 0, "COW fault in the child should succeed");
+    uint64_t copy = vmm_get_physical_address(child, 0x400000);
+    TEST_ASSERT(rmap_walk(copy, NULL, NULL) == 1, "The copy should be found in the child only");
+    TEST_ASSERT(rmap_walk(frame, NULL, NULL) == 2, "The original should lose the child's mapping");
+
+    cow_release_address_space(grandchild);
+    TEST_ASSERT(rmap_walk(frame, NULL, NULL) == 1, "A released address space should not be walked");
+    cow_release_address_space(child);
+
+    rmap_get_stats(&after);
+    TEST_ASSERT(after.links == before.links, "Releasing the clones should drop their links");
+    TEST_ASSERT(rmap_walk(copy, NULL, NULL) == 0, "The child's frames should have no mappings left");
+    buddy_free_pages(copy, 0);
+
+    vmm_unmap_page(parent, 0x400000);
+    cow_decrement_ref(frame);
+}
+
+void run_rmap_tests(void) {
+    kprintf("\nRunning reverse mapping tests...\n");
+
+    test_rmap_map_and_walk();
+    test_rmap_fork();
+
+    kprintf("Reverse mapping tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -9,9 +9,20 @@
 // Forward declarations of test functions
 extern void run_buddy_tests(void);
 extern void run_slab_tests(void);
+extern void run_heap_tests(void);
+extern void run_tlsf_tests(void);
 extern void run_pool_tests(void);
+extern void run_arena_tests(void);
+extern void run_slotmap_tests(void);
+extern void run_vmalloc_tests(void);
+extern void run_alloc_profile_tests(void);
 extern void run_cow_tests(void);
+extern void run_tlb_tests(void);
+extern void run_rmap_tests(void);
+extern void run_snapshot_tests(void);
 extern void run_demand_paging_tests(void);
+extern void run_page_fault_tests(void);
+extern void run_ksm_tests(void);
 extern void run_page_cache_tests(void);
 extern void run_integration_tests(void);
 
@@ -27,15 +38,48 @@ void run_all_memory_tests(void) {
     kprintf("\n[TEST SUITE] Running Slab Allocator Tests...\n");
     run_slab_tests();
     
+    kprintf("\n[TEST SUITE] Running TLSF Allocator Tests...\n");
+    run_tlsf_tests();
+    
+    kprintf("\n[TEST SUITE] Running Heap Tests...\n");
+    run_heap_tests();
+    
     kprintf("\n[TEST SUITE] Running Memory Pool Tests...\n");
     run_pool_tests();
     
+    kprintf("\n[TEST SUITE] Running Arena Allocator Tests...\n");
+    run_arena_tests();
+    
+    kprintf("\n[TEST SUITE] Running Slot Map Tests...\n");
+    run_slotmap_tests();
+    
+    kprintf("\n[TEST SUITE] Running vmalloc Tests...\n");
+    run_vmalloc_tests();
+    
+    kprintf("\n[TEST SUITE] Running Allocation Profiler Tests...\n");
+    run_alloc_profile_tests();
+    
     kprintf("\n[TEST SUITE] Running COW Tests...\n");
     run_cow_tests();
     
+    kprintf("\n[TEST SUITE] Running TLB Gather Tests...\n");
+    run_tlb_tests();
+    
+    kprintf("\n[TEST SUITE] Running Reverse Mapping Tests...\n");
+    run_rmap_tests();
+    
+    kprintf("\n[TEST SUITE] Running Snapshot Tests...\n");
+    run_snapshot_tests();
+    
     kprintf("\n[TEST SUITE] Running Demand Paging Tests...\n");
     run_demand_paging_tests();
     
+    kprintf("\n[TEST SUITE] Running Page Fault Dispatch Tests...\n");
+    run_page_fault_tests();
+    
+    kprintf("\n[TEST SUITE] Running Same-Page Merging Tests...\n");
+    run_ksm_tests();
+    
     kprintf("\n[TEST SUITE] Running Page Cache Tests...\n");
     run_page_cache_tests();
     
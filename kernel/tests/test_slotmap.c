@@ -0,0 +1,138 @@
+#include "../../include/mm/slotmap.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+typedef struct test_item {
+    uint64_t key;
+    uint64_t value;
+} test_item_t;
+
+#define SLOTMAP_TEST_ITEMS 100
+
+void test_slotmap_basic(void) {
+    slotmap_t map;
+    TEST_ASSERT(slotmap_init(&map, "test-basic", sizeof(test_item_t), 8) == 0, "Slot map init should succeed");
+
+    static slot_handle_t handles[SLOTMAP_TEST_ITEMS];
+    int inserted = 1;
+    for (int i = 0; i < SLOTMAP_TEST_ITEMS; i++) {
+        test_item_t *item;
+        handles[i] = slotmap_insert(&map, (void **)&item);
+        if (handles[i] == SLOTMAP_INVALID_HANDLE || item->key != 0) {
+            inserted = 0;
+            continue;
+        }
+        item->key = i;
+        item->value = i * 10;
+    }
+    TEST_ASSERT(inserted, "Inserts should grow past the initial capacity and return zeroed objects");
+    TEST_ASSERT(slotmap_count(&map) == SLOTMAP_TEST_ITEMS, "Count should match the inserts");
+
+    int found = 1;
+    for (int i = 0; i < SLOTMAP_TEST_ITEMS; i++) {
+        test_item_t *item = slotmap_get(&map, handles[i]);
+        if (!item || item->key != (uint64_t)i || item->value != (uint64_t)i * 10) {
+            found = 0;
+        }
+    }
+    TEST_ASSERT(found, "Every handle should find its object after growth");
+    TEST_ASSERT(slotmap_get(&map, SLOTMAP_INVALID_HANDLE) == NULL, "The invalid handle should never resolve");
+
+    slotmap_destroy(&map);
+}
+
+void test_slotmap_stale_handles(void) {
+    slotmap_t map;
+    if (slotmap_init(&map, "test-stale", sizeof(test_item_t), 0) != 0) {
+        TEST_ASSERT(0, "Slot map init should succeed");
+        return;
+    }
+
+    test_item_t *item;
+    slot_handle_t old = slotmap_insert(&map, (void **)&item);
+    item->key = 1;
+    TEST_ASSERT(slotmap_remove(&map, old) == 0, "Removing a live handle should succeed");
+    TEST_ASSERT(slotmap_get(&map, old) == NULL, "A removed handle should be stale");
+    TEST_ASSERT(slotmap_remove(&map, old) == -1, "Removing twice should fail");
+
+    slot_handle_t reused = slotmap_insert(&map, (void **)&item);
+    TEST_ASSERT((reused & SLOTMAP_INDEX_MASK) == (old & SLOTMAP_INDEX_MASK), "The freed slot should be reused");
+    TEST_ASSERT(reused != old, "A reused slot should get a new generation");
+    TEST_ASSERT(slotmap_get(&map, old) == NULL, "The old handle should stay stale after reuse");
+    TEST_ASSERT(slotmap_get(&map, reused) == item, "The new handle should find the new object");
+
+    slotmap_destroy(&map);
+}
+
+void test_slotmap_dense_sweep(void) {
+    slotmap_t map;
+    if (slotmap_init(&map, "test-sweep", sizeof(test_item_t), 0) != 0) {
+        TEST_ASSERT(0, "Slot map init should succeed");
+        return;
+    }
+
+    static slot_handle_t handles[SLOTMAP_TEST_ITEMS];
+    for (int i = 0; i < SLOTMAP_TEST_ITEMS; i++) {
+        test_item_t *item;
+        handles[i] = slotmap_insert(&map, (void **)&item);
+        if (item) {
+            item->key = i;
+        }
+    }
+
+    // Remove every odd key; the survivors must stay packed at the front
+    for (int i = 1; i < SLOTMAP_TEST_ITEMS; i += 2) {
+        slotmap_remove(&map, handles[i]);
+    }
+    TEST_ASSERT(slotmap_count(&map) == SLOTMAP_TEST_ITEMS / 2, "Half the objects should remain");
+
+    test_item_t *items = slotmap_data(&map);
+    uint64_t sum = 0;
+    int even = 1;
+    for (uint32_t i = 0; i < slotmap_count(&map); i++) {
+        sum += items[i].key;
+        if (items[i].key & 1) {
+            even = 0;
+        }
+    }
+    TEST_ASSERT(even, "Only live objects should be in the dense array");
+    TEST_ASSERT(sum == 2450, "A linear sweep should visit every live object once");
+
+    int consistent = 1;
+    for (uint32_t i = 0; i < slotmap_count(&map); i++) {
+        if (slotmap_get(&map, slotmap_handle_at(&map, i)) != &items[i]) {
+            consistent = 0;
+        }
+    }
+    TEST_ASSERT(consistent, "Dense handles should resolve to their own objects after moves");
+
+    // Backward sweep removing as it goes
+    for (uint32_t i = slotmap_count(&map); i > 0; i--) {
+        slotmap_remove(&map, slotmap_handle_at(&map, i - 1));
+    }
+    TEST_ASSERT(slotmap_count(&map) == 0, "A backward sweep should be able to remove everything");
+    TEST_ASSERT(slotmap_get(&map, handles[0]) == NULL, "Handles should be stale once removed");
+
+    slotmap_destroy(&map);
+}
+
+void run_slotmap_tests(void) {
+    kprintf("\nRunning slot map tests...\n");
+
+    test_slotmap_basic();
+    test_slotmap_stale_handles();
+    test_slotmap_dense_sweep();
+
+    kprintf("Slot map tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -0,0 +1,152 @@
+#include "../../include/mm/snapshot.h"
+#include "../../include/mm/cow.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/mm/demand_paging.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/string.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+#define SNAPSHOT_TEST_BASE  0xE00000
+#define SNAPSHOT_TEST_PAGES 6
+
+typedef struct snapshot_test_dirty {
+    uint64_t virts[SNAPSHOT_TEST_PAGES];
+    uint64_t phys[SNAPSHOT_TEST_PAGES];
+    uint32_t count;
+} snapshot_test_dirty_t;
+
+static int snapshot_test_collect(uint64_t virt, uint64_t phys, void *arg) {
+    snapshot_test_dirty_t *d = (snapshot_test_dirty_t *)arg;
+    if (d->count < SNAPSHOT_TEST_PAGES) {
+        d->virts[d->count] = virt;
+        d->phys[d->count] = phys;
+    }
+    d->count++;
+    return 0;
+}
+
+// Write through a fault, as a user write to a COW page would; frames are
+// identity mapped
+static uint8_t *snapshot_test_write(page_table_t *pml4, uint64_t virt, uint8_t value) {
+    demand_paging_handle_fault_flags(pml4, virt, VM_FAULT_PRESENT | VM_FAULT_WRITE);
+    uint8_t *data = (uint8_t *)(uintptr_t)vmm_get_physical_address(pml4, virt);
+    if (data) {
+        memset(data, value, 4096);
+    }
+    return data;
+}
+
+void test_snapshot_dirty_tracking(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+
+    uint64_t base = SNAPSHOT_TEST_BASE;
+    demand_paging_register_region(pml4, base, SNAPSHOT_TEST_PAGES * 0x1000, VM_FLAG_DEMAND_PAGED);
+    for (int i = 0; i < 4; i++) {
+        snapshot_test_write(pml4, base + i * 0x1000, (uint8_t)(0x10 + i));
+    }
+
+    snapshot_t *snap = snapshot_create(pml4);
+    TEST_ASSERT(snap != 0 && snap->generation == 1, "Snapshot creation should succeed");
+    if (!snap) return;
+
+    uint64_t frame1 = vmm_get_physical_address(pml4, base + 0x1000);
+    uint64_t *pte = vmm_get_pte(pml4, base + 0x1000);
+    TEST_ASSERT(pte && !(*pte & VMM_FLAG_WRITABLE) && (*pte & COW_FLAG_MASK),
+                "Live pages should be COW against the view");
+    TEST_ASSERT(vmm_get_physical_address(snap->view, base + 0x1000) == frame1,
+                "The view should share the live frames");
+    TEST_ASSERT(snapshot_for_each_dirty(snap, NULL, NULL) == 0, "Nothing should be dirty right after the snapshot");
+
+    // Modify page 1, fault in page 4, unmap page 3, dirty page 0's entry
+    uint8_t *data = snapshot_test_write(pml4, base + 0x1000, 0xEE);
+    snapshot_test_write(pml4, base + 0x4000, 0x44);
+    uint64_t frame3 = vmm_get_physical_address(pml4, base + 0x3000);
+    vmm_unmap_page(pml4, base + 0x3000);
+    cow_decrement_ref(frame3);
+    uint64_t *pte0 = vmm_get_pte(pml4, base);
+    if (pte0) *pte0 |= VMM_FLAG_DIRTY;
+
+    snapshot_test_dirty_t dirty = { { 0 }, { 0 }, 0 };
+    TEST_ASSERT(snapshot_for_each_dirty(snap, snapshot_test_collect, &dirty) == 4,
+                "Dirty, copied, new and unmapped pages should be reported");
+    TEST_ASSERT(dirty.virts[0] == base && dirty.virts[1] == base + 0x1000 && dirty.virts[2] == base + 0x4000,
+                "Live pages should be reported in address order");
+    TEST_ASSERT(dirty.phys[1] == (uint64_t)(uintptr_t)data && dirty.phys[1] != frame1,
+                "A written page should report its new frame");
+    TEST_ASSERT(dirty.virts[3] == base + 0x3000 && dirty.phys[3] == 0, "An unmapped page should report phys 0");
+
+    uint8_t *frozen = (uint8_t *)(uintptr_t)vmm_get_physical_address(snap->view, base + 0x1000);
+    TEST_ASSERT(frozen && frozen[0] == 0x11 && frozen[4095] == 0x11, "The view should keep the old contents");
+
+    // Incremental round: only new writes count
+    TEST_ASSERT(snapshot_refresh(snap) == 0 && snap->generation == 2, "Refresh should succeed");
+    TEST_ASSERT(snapshot_for_each_dirty(snap, NULL, NULL) == 0, "Refresh should start a clean round");
+    snapshot_test_write(pml4, base + 0x2000, 0x22);
+    TEST_ASSERT(snapshot_for_each_dirty(snap, NULL, NULL) == 1, "The next round should see one page");
+
+    snapshot_discard(snap);
+    demand_paging_unregister_region(pml4, base);
+}
+
+void test_snapshot_rollback(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    if (!pml4) return;
+
+    uint64_t base = SNAPSHOT_TEST_BASE;
+    demand_paging_register_region(pml4, base, SNAPSHOT_TEST_PAGES * 0x1000, VM_FLAG_DEMAND_PAGED);
+    snapshot_test_write(pml4, base, 0x01);
+    snapshot_test_write(pml4, base + 0x1000, 0x02);
+
+    snapshot_t *snap = snapshot_create(pml4);
+    if (!snap) return;
+    uint64_t frame0 = vmm_get_physical_address(pml4, base);
+
+    snapshot_test_write(pml4, base, 0xAA);
+    snapshot_test_write(pml4, base + 0x2000, 0xBB);
+    uint64_t free_before = buddy_get_free_pages();
+
+    TEST_ASSERT(snapshot_rollback(snap) == 2, "Rollback should restore the changed pages");
+    TEST_ASSERT(vmm_get_physical_address(pml4, base) == frame0, "The view's frame should be mapped again");
+    TEST_ASSERT(((uint8_t *)(uintptr_t)frame0)[0] == 0x01, "Rolled-back contents should be the snapshot's");
+    TEST_ASSERT(vmm_get_physical_address(pml4, base + 0x2000) == 0, "Pages added since should be unmapped");
+    TEST_ASSERT(buddy_get_free_pages() == free_before + 2, "Replaced private frames should be freed");
+    TEST_ASSERT(snapshot_for_each_dirty(snap, NULL, NULL) == 0, "Nothing should be dirty after rollback");
+    TEST_ASSERT(cow_get_ref_count(frame0) == 2, "The restored frame should count both mappings");
+
+    // Without the view the live space owns its frames again
+    snapshot_discard(snap);
+    TEST_ASSERT(cow_get_ref_count(frame0) == 1, "Discard should drop the view's references");
+    snapshot_test_write(pml4, base, 0x03);
+    TEST_ASSERT(vmm_get_physical_address(pml4, base) == frame0, "Writes after discard should not copy");
+
+    demand_paging_unregister_region(pml4, base);
+}
+
+void run_snapshot_tests(void) {
+    kprintf("\nRunning snapshot tests...\n");
+
+    // The tests fault in exactly the pages they write
+    uint32_t saved_around = demand_paging_get_fault_around();
+    demand_paging_set_fault_around(0);
+
+    test_snapshot_dirty_tracking();
+    test_snapshot_rollback();
+
+    demand_paging_set_fault_around(saved_around);
+
+    kprintf("Snapshot tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -0,0 +1,103 @@
+#include "../../include/mm/tlb.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/stdio.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+void test_tlb_gather_pages(void) {
+    tlb_stats_t before, after;
+    tlb_get_stats(&before);
+
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb);
+    tlb_gather_page(&tlb, 0x400000);
+    tlb_gather_page(&tlb, 0x401234);
+    TEST_ASSERT(tlb.page_count == 2 && !tlb.full, "Pages below the threshold should be kept");
+    TEST_ASSERT(tlb.pages[1] == 0x401000, "Gathered addresses should be page aligned");
+    tlb_gather_finish(&tlb);
+
+    tlb_get_stats(&after);
+    TEST_ASSERT(after.page_flushes - before.page_flushes == 2, "Each gathered page should get one invlpg");
+    TEST_ASSERT(after.full_flushes == before.full_flushes, "A small batch should not reload CR3");
+    TEST_ASSERT(tlb.page_count == 0, "Finish should reset the gather");
+}
+
+void test_tlb_gather_threshold(void) {
+    uint32_t saved = tlb_get_flush_threshold();
+    tlb_set_flush_threshold(4);
+    TEST_ASSERT(tlb_get_flush_threshold() == 4, "Threshold should be tunable");
+
+    tlb_stats_t before, after;
+    tlb_get_stats(&before);
+
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb);
+    tlb_gather_range(&tlb, 0x400000, 0x404000);
+    TEST_ASSERT(!tlb.full, "A range at the threshold should use invlpg");
+    tlb_gather_page(&tlb, 0x500000);
+    TEST_ASSERT(tlb.full, "Going past the threshold should switch to a full flush");
+    tlb_gather_finish(&tlb);
+
+    tlb_gather_range(&tlb, 0, 1ULL << 40);
+    TEST_ASSERT(tlb.full, "A huge range should be decided without walking it");
+    tlb_gather_finish(&tlb);
+
+    tlb_get_stats(&after);
+    TEST_ASSERT(after.full_flushes - before.full_flushes == 2, "Each oversized batch should reload CR3 once");
+    TEST_ASSERT(after.page_flushes == before.page_flushes, "Oversized batches should issue no invlpg");
+
+    tlb_set_flush_threshold(0);
+    TEST_ASSERT(tlb_get_flush_threshold() == 1, "Threshold should be at least one page");
+    tlb_set_flush_threshold(TLB_GATHER_MAX + 1);
+    TEST_ASSERT(tlb_get_flush_threshold() == TLB_GATHER_MAX, "Threshold should be capped at the gather size");
+    tlb_set_flush_threshold(saved);
+}
+
+void test_tlb_deferred_frame_free(void) {
+    page_table_t *pml4 = vmm_create_address_space();
+    TEST_ASSERT(pml4 != 0, "Address space creation should succeed");
+    if (!pml4) return;
+
+    uint64_t frames[3];
+    for (int i = 0; i < 3; i++) {
+        frames[i] = buddy_alloc_pages(0, BUDDY_ZONE_UNMOVABLE);
+        if (!frames[i]) return;
+        vmm_map_page(pml4, 0x400000 + i * 0x1000, frames[i], VMM_FLAG_WRITABLE | VMM_FLAG_USER);
+    }
+
+    uint64_t free_before = buddy_get_free_pages();
+    tlb_gather_t tlb;
+    tlb_gather_init(&tlb);
+    for (int i = 0; i < 4; i++) {
+        uint64_t phys = vmm_unmap_page_deferred(pml4, 0x400000 + i * 0x1000, &tlb);
+        TEST_ASSERT(i == 3 ? phys == 0 : phys == frames[i], "Deferred unmap should return the mapped frame");
+        tlb_gather_free_frame(&tlb, phys);
+    }
+    TEST_ASSERT(vmm_get_physical_address(pml4, 0x400000) == 0, "Entries should be cleared right away");
+    TEST_ASSERT(buddy_get_free_pages() == free_before, "Frames should stay allocated until the flush");
+    TEST_ASSERT(tlb.frame_count == 3, "Only mapped frames should be queued");
+
+    tlb_gather_finish(&tlb);
+    TEST_ASSERT(buddy_get_free_pages() == free_before + 3, "Frames should be freed after the flush");
+}
+
+void run_tlb_tests(void) {
+    kprintf("\nRunning TLB gather tests...\n");
+
+    test_tlb_gather_pages();
+    test_tlb_gather_threshold();
+    test_tlb_deferred_frame_free();
+
+    kprintf("TLB tests: %d/%d passed\n", test_passed, test_count);
+}
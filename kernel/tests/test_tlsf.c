@@ -0,0 +1,194 @@
+#include "../../include/mm/tlsf.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/stdio.h"
+#include "../../include/kernel/string.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+#define TLSF_TEST_ORDER 4   // 64 KiB pool
+
+static tlsf_t g_test_tlsf;
+
+static uint64_t tlsf_test_setup(void) {
+    uint64_t pool = buddy_alloc_pages(TLSF_TEST_ORDER, BUDDY_ZONE_UNMOVABLE);
+    if (!pool) {
+        return 0;
+    }
+    tlsf_init(&g_test_tlsf);
+    if (tlsf_add_pool(&g_test_tlsf, (void *)pool, BUDDY_PAGE_SIZE << TLSF_TEST_ORDER) != 0) {
+        buddy_free_pages(pool, TLSF_TEST_ORDER);
+        return 0;
+    }
+    return pool;
+}
+
+void test_tlsf_basic_alloc(void) {
+    uint64_t pool = tlsf_test_setup();
+    TEST_ASSERT(pool != 0, "TLSF pool setup should succeed");
+    if (!pool) {
+        return;
+    }
+
+    size_t initial_free = g_test_tlsf.free_bytes;
+
+    void *a = tlsf_malloc(&g_test_tlsf, 100);
+    TEST_ASSERT(a != NULL, "tlsf_malloc(100) should succeed");
+    TEST_ASSERT(((uintptr_t)a & (TLSF_ALIGN - 1)) == 0, "TLSF blocks should be 16-byte aligned");
+    TEST_ASSERT(tlsf_block_size(a) >= 100, "Block should cover the request");
+
+    memset(a, 0xAB, 100);
+    TEST_ASSERT(tlsf_free(&g_test_tlsf, a) == 0, "tlsf_free should succeed");
+    TEST_ASSERT(g_test_tlsf.free_bytes == initial_free, "Free bytes should be restored after free");
+
+    buddy_free_pages(pool, TLSF_TEST_ORDER);
+}
+
+void test_tlsf_coalescing(void) {
+    uint64_t pool = tlsf_test_setup();
+    TEST_ASSERT(pool != 0, "TLSF pool setup should succeed");
+    if (!pool) {
+        return;
+    }
+
+    size_t initial_free = g_test_tlsf.free_bytes;
+
+    void *a = tlsf_malloc(&g_test_tlsf, 1024);
+    void *b = tlsf_malloc(&g_test_tlsf, 1024);
+    void *c = tlsf_malloc(&g_test_tlsf, 1024);
+    TEST_ASSERT(a && b && c, "Three 1 KiB allocations should succeed");
+
+    // Free out of order; neighbours must merge back into a single block
+    tlsf_free(&g_test_tlsf, a);
+    tlsf_free(&g_test_tlsf, c);
+    tlsf_free(&g_test_tlsf, b);
+    TEST_ASSERT(g_test_tlsf.free_bytes == initial_free, "Coalescing should restore the whole pool");
+
+    // The merged block starts where the first allocation did
+    void *big = tlsf_malloc(&g_test_tlsf, 3 * 1024 + 2 * TLSF_BLOCK_HEADER);
+    TEST_ASSERT(big == a, "Merged range should be reusable as one block");
+    if (big) {
+        tlsf_free(&g_test_tlsf, big);
+    }
+
+    buddy_free_pages(pool, TLSF_TEST_ORDER);
+}
+
+void test_tlsf_good_fit(void) {
+    uint64_t pool = tlsf_test_setup();
+    TEST_ASSERT(pool != 0, "TLSF pool setup should succeed");
+    if (!pool) {
+        return;
+    }
+
+    // Leave a small and a large hole separated by live blocks
+    void *small = tlsf_malloc(&g_test_tlsf, 512);
+    void *sep1 = tlsf_malloc(&g_test_tlsf, 64);
+    void *large = tlsf_malloc(&g_test_tlsf, 8192);
+    void *sep2 = tlsf_malloc(&g_test_tlsf, 64);
+    TEST_ASSERT(small && sep1 && large && sep2, "Setup allocations should succeed");
+
+    tlsf_free(&g_test_tlsf, small);
+    tlsf_free(&g_test_tlsf, large);
+
+    // A 512-byte request should reuse the small hole, not split the large one
+    void *reuse = tlsf_malloc(&g_test_tlsf, 512);
+    TEST_ASSERT(reuse == small, "Request should be served from the matching size class");
+
+    tlsf_free(&g_test_tlsf, reuse);
+    tlsf_free(&g_test_tlsf, sep1);
+    tlsf_free(&g_test_tlsf, sep2);
+
+    buddy_free_pages(pool, TLSF_TEST_ORDER);
+}
+
+void test_tlsf_double_free_detection(void) {
+    uint64_t pool = tlsf_test_setup();
+    TEST_ASSERT(pool != 0, "TLSF pool setup should succeed");
+    if (!pool) {
+        return;
+    }
+
+    void *a = tlsf_malloc(&g_test_tlsf, 256);
+    void *b = tlsf_malloc(&g_test_tlsf, 256);
+    TEST_ASSERT(a && b, "Allocations should succeed");
+
+    TEST_ASSERT(tlsf_free(&g_test_tlsf, a) == 0, "First free should succeed");
+    TEST_ASSERT(tlsf_free(&g_test_tlsf, a) == -1, "Second free should be rejected");
+
+    tlsf_free(&g_test_tlsf, b);
+    buddy_free_pages(pool, TLSF_TEST_ORDER);
+}
+
+void test_tlsf_resize_in_place(void) {
+    uint64_t pool = tlsf_test_setup();
+    TEST_ASSERT(pool != 0, "TLSF pool setup should succeed");
+    if (!pool) {
+        return;
+    }
+
+    size_t initial_free = g_test_tlsf.free_bytes;
+
+    void *a = tlsf_malloc(&g_test_tlsf, 256);
+    void *b = tlsf_malloc(&g_test_tlsf, 256);
+    TEST_ASSERT(a && b, "Allocations should succeed");
+
+    // a is followed by the used block b, so it cannot grow
+    TEST_ASSERT(tlsf_resize(&g_test_tlsf, a, 512) == -1, "Growth into a used block should fail");
+    TEST_ASSERT(tlsf_block_size(a) == 256, "Failed resize should leave the block untouched");
+
+    // b is followed by the rest of the pool
+    memset(b, 0x5C, 256);
+    TEST_ASSERT(tlsf_resize(&g_test_tlsf, b, 4096) == 0, "Growth into a free block should succeed");
+    TEST_ASSERT(tlsf_block_size(b) >= 4096, "Grown block should cover the new size");
+    TEST_ASSERT(((uint8_t *)b)[255] == 0x5C, "Growing in place should keep the data");
+
+    size_t before_shrink = g_test_tlsf.free_bytes;
+    TEST_ASSERT(tlsf_resize(&g_test_tlsf, b, 64) == 0, "Shrinking should always succeed");
+    TEST_ASSERT(tlsf_block_size(b) < 4096, "Shrunk block should release its tail");
+    TEST_ASSERT(g_test_tlsf.free_bytes > before_shrink, "Released tail should be free again");
+
+    tlsf_free(&g_test_tlsf, a);
+    tlsf_free(&g_test_tlsf, b);
+    TEST_ASSERT(g_test_tlsf.free_bytes == initial_free, "Released tails should coalesce");
+
+    buddy_free_pages(pool, TLSF_TEST_ORDER);
+}
+
+void test_tlsf_exhaustion(void) {
+    uint64_t pool = tlsf_test_setup();
+    TEST_ASSERT(pool != 0, "TLSF pool setup should succeed");
+    if (!pool) {
+        return;
+    }
+
+    void *too_big = tlsf_malloc(&g_test_tlsf, (BUDDY_PAGE_SIZE << TLSF_TEST_ORDER) + 1);
+    TEST_ASSERT(too_big == NULL, "Request larger than the pool should fail");
+
+    void *zero = tlsf_malloc(&g_test_tlsf, 0);
+    TEST_ASSERT(zero == NULL, "Zero-size request should return NULL");
+
+    buddy_free_pages(pool, TLSF_TEST_ORDER);
+}
+
+void run_tlsf_tests(void) {
+    kprintf("\nRunning TLSF allocator tests...\n");
+
+    test_tlsf_basic_alloc();
+    test_tlsf_coalescing();
+    test_tlsf_good_fit();
+    test_tlsf_double_free_detection();
+    test_tlsf_resize_in_place();
+    test_tlsf_exhaustion();
+
+    kprintf("TLSF tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -0,0 +1,164 @@
+#include "../../include/mm/vmalloc.h"
+#include "../../include/mm/buddy.h"
+#include "../../include/kernel/vmm.h"
+#include "../../include/kernel/stdio.h"
+#include "../../include/kernel/string.h"
+
+static int test_count = 0;
+static int test_passed = 0;
+
+#define TEST_ASSERT(condition, message) do { \
+    test_count++; \
+    if (condition) { \
+        test_passed++; \
+    } else { \
+        kprintf("[FAIL] %s\n", message); \
+    } \
+} while(0)
+
+void test_vmalloc_basic(void) {
+    uint8_t *buf = (uint8_t *)vmalloc(3 * BUDDY_PAGE_SIZE + 100);
+    TEST_ASSERT(buf != NULL, "vmalloc of 3+ pages should succeed");
+    if (!buf) {
+        return;
+    }
+
+    TEST_ASSERT(is_vmalloc_addr(buf), "Result should lie in the vmalloc range");
+    TEST_ASSERT(((uint64_t)(uintptr_t)buf & (BUDDY_PAGE_SIZE - 1)) == 0, "Result should be page aligned");
+    TEST_ASSERT(vmalloc_size(buf) == 4 * BUDDY_PAGE_SIZE, "Usable size should round up to whole pages");
+
+    // Every byte of every page must be backed and writable
+    for (uint64_t i = 0; i < 4 * BUDDY_PAGE_SIZE; i++) {
+        buf[i] = (uint8_t)(i * 7);
+    }
+    int intact = 1;
+    for (uint64_t i = 0; i < 4 * BUDDY_PAGE_SIZE; i++) {
+        if (buf[i] != (uint8_t)(i * 7)) {
+            intact = 0;
+            break;
+        }
+    }
+    TEST_ASSERT(intact, "Data written through vmalloc mapping should read back");
+
+    vfree(buf);
+}
+
+void test_vmalloc_guard_page(void) {
+    void *buf = vmalloc(BUDDY_PAGE_SIZE);
+    TEST_ASSERT(buf != NULL, "Single-page vmalloc should succeed");
+    if (!buf) {
+        return;
+    }
+
+    page_table_t *kernel_pml4 = vmm_get_kernel_address_space();
+    uint64_t guard = (uint64_t)(uintptr_t)buf + BUDDY_PAGE_SIZE;
+    TEST_ASSERT(vmm_get_physical_address(kernel_pml4, (uint64_t)(uintptr_t)buf) != 0,
+                "Allocated page should be mapped");
+    TEST_ASSERT(vmm_get_physical_address(kernel_pml4, guard) == 0,
+                "Page after the allocation should be an unmapped guard");
+
+    vfree(buf);
+}
+
+void test_vmalloc_larger_than_buddy_max(void) {
+    // Larger than the biggest buddy block, so it cannot be physically contiguous
+    size_t size = (BUDDY_PAGE_SIZE << BUDDY_MAX_ORDER) * 2;
+    uint8_t *buf = (uint8_t *)vmalloc(size);
+    TEST_ASSERT(buf != NULL, "vmalloc beyond the buddy max order should succeed");
+    if (buf) {
+        buf[0] = 0x11;
+        buf[size - 1] = 0x22;
+        TEST_ASSERT(buf[0] == 0x11 && buf[size - 1] == 0x22, "First and last byte should be usable");
+        vfree(buf);
+    }
+}
+
+void test_vmalloc_frees_pages(void) {
+    // Warm up so any page tables for the range already exist
+    void *warm = vmalloc(16 * BUDDY_PAGE_SIZE);
+    vfree(warm);
+    vmalloc_purge();
+
+    uint64_t free_before = buddy_get_free_pages();
+    void *buf = vmalloc(16 * BUDDY_PAGE_SIZE);
+    TEST_ASSERT(buf != NULL, "16-page vmalloc should succeed");
+    if (!buf) {
+        return;
+    }
+    TEST_ASSERT(buddy_get_free_pages() <= free_before - 16, "vmalloc should consume backing pages");
+
+    vfree(buf);
+    TEST_ASSERT(buddy_get_free_pages() >= free_before, "vfree should return backing pages immediately");
+}
+
+void test_vmalloc_lazy_purge(void) {
+    vmalloc_purge();
+
+    vmalloc_stats_t before;
+    vmalloc_get_stats(&before);
+
+    void *buf = vmalloc(2 * BUDDY_PAGE_SIZE);
+    TEST_ASSERT(buf != NULL, "vmalloc should succeed");
+    if (!buf) {
+        return;
+    }
+    vfree(buf);
+
+    vmalloc_stats_t after_free;
+    vmalloc_get_stats(&after_free);
+    TEST_ASSERT(after_free.lazy_pages == 3, "Freed range (with guard) should await a purge");
+    TEST_ASSERT(after_free.purges == before.purges, "vfree should not flush the TLB by itself");
+
+    vmalloc_purge();
+
+    vmalloc_stats_t after_purge;
+    vmalloc_get_stats(&after_purge);
+    TEST_ASSERT(after_purge.lazy_pages == 0, "Purge should recycle all lazy ranges");
+    TEST_ASSERT(after_purge.purges == before.purges + 1, "Purge should flush exactly once");
+}
+
+void test_vmalloc_vzalloc(void) {
+    uint8_t *buf = (uint8_t *)vzalloc(2 * BUDDY_PAGE_SIZE);
+    TEST_ASSERT(buf != NULL, "vzalloc should succeed");
+    if (!buf) {
+        return;
+    }
+
+    int all_zero = 1;
+    for (uint64_t i = 0; i < 2 * BUDDY_PAGE_SIZE; i++) {
+        if (buf[i] != 0) {
+            all_zero = 0;
+            break;
+        }
+    }
+    TEST_ASSERT(all_zero, "vzalloc should zero-fill memory");
+    vfree(buf);
+}
+
+void test_vmalloc_invalid_free(void) {
+    vfree(NULL);
+    TEST_ASSERT(1, "vfree(NULL) should not crash");
+
+    TEST_ASSERT(vmalloc(0) == NULL, "vmalloc(0) should return NULL");
+
+    void *buf = vmalloc(BUDDY_PAGE_SIZE);
+    if (buf) {
+        vfree(buf);
+        vfree(buf);
+        TEST_ASSERT(1, "Double vfree should be detected without crashing");
+    }
+}
+
+void run_vmalloc_tests(void) {
+    kprintf("\nRunning vmalloc tests...\n");
+
+    test_vmalloc_basic();
+    test_vmalloc_guard_page();
+    test_vmalloc_larger_than_buddy_max();
+    test_vmalloc_frees_pages();
+    test_vmalloc_lazy_purge();
+    test_vmalloc_vzalloc();
+    test_vmalloc_invalid_free();
+
+    kprintf("vmalloc tests: %d/%d passed\n", test_passed, test_count);
+}
@@ -78,6 +78,50 @@ void test_atomic_store_load(void) {
     printf("  atomic_store/load: PASSED\n");
 }
 
+void test_atomic_64bit(void) {
+    printf("Testing 64-bit atomic operations...\n");
+    
+    volatile uint64_t value = 0x100000000ULL;
+    uint64_t prev;
+    
+    // CAS must compare and swap the full 64 bits
+    prev = atomic_compare_and_swap64(&value, 0x100000000ULL, 0xFFFFFFFF00000001ULL);
+    assert(prev == 0x100000000ULL);
+    assert(value == 0xFFFFFFFF00000001ULL);
+    
+    // Same low half, different high half must fail
+    prev = atomic_compare_and_swap64(&value, 0x1ULL, 0x2ULL);
+    assert(prev == 0xFFFFFFFF00000001ULL);
+    assert(value == 0xFFFFFFFF00000001ULL);
+    
+    // Exchange returns the old value
+    prev = atomic_exchange64(&value, 0);
+    assert(prev == 0xFFFFFFFF00000001ULL);
+    assert(atomic_load64(&value) == 0);
+    
+    printf("  64-bit atomics: PASSED\n");
+}
+
+void test_atomic_128bit(void) {
+    printf("Testing 128-bit compare-and-swap...\n");
+    
+    volatile uint64_t pair[2] __attribute__((aligned(16))) = { 1, 7 };
+    uint64_t expected[2] = { 1, 7 };
+    
+    // Both halves match: swap
+    assert(atomic_compare_and_swap128(pair, expected, 2, 8) == 1);
+    assert(pair[0] == 2 && pair[1] == 8);
+    
+    // Same low half, stale high half (ABA tag): fail and report current pair
+    expected[0] = 2;
+    expected[1] = 7;
+    assert(atomic_compare_and_swap128(pair, expected, 3, 9) == 0);
+    assert(expected[0] == 2 && expected[1] == 8);
+    assert(pair[0] == 2 && pair[1] == 8);
+    
+    printf("  128-bit CAS: PASSED\n");
+}
+
 void test_memory_barrier(void) {
     printf("Testing memory_barrier...\n");
     
@@ -103,6 +147,8 @@ int main(void) {
     test_atomic_compare_and_swap();
     test_atomic_fetch_and_add();
     test_atomic_store_load();
+    test_atomic_64bit();
+    test_atomic_128bit();
     test_memory_barrier();
     
     printf("\n=== All Atomic Tests Passed ===\n\n");